@@ -64,10 +64,15 @@ FERITE_API FeriteScript *ferite_new_script();
 FERITE_API int           ferite_script_load( FeriteScript *script, char *filename );
 FERITE_API int           ferite_script_load_from_stream( FeriteScript *script, FILE *file );
 FERITE_API int           ferite_cache_toggle( int state );
+FERITE_API void          ferite_cache_set_limit( FeriteScript *script, size_t bytes );
+FERITE_API int           ferite_cache_invalidate( FeriteScript *script, char *filename );
+FERITE_API void          ferite_cache_stats( FeriteCacheStats *stats );
 FERITE_API FeriteScript *ferite_script_compile( char *filename );
 FERITE_API FeriteScript *ferite_script_compile_with_path( char *filename, char **paths );
 FERITE_API int           ferite_script_execute( FeriteScript *script );
 FERITE_API FeriteScript *ferite_duplicate_script( FeriteScript *script );
+FERITE_API int           ferite_script_snapshot( FeriteScript *script );
+FERITE_API int           ferite_script_reset( FeriteScript *script );
 FERITE_API int           ferite_script_delete( FeriteScript *script );
 FERITE_API void          ferite_show_help();
    
@@ -98,16 +103,20 @@ FERITE_API int ferite_get_required_parameter_list_size( FeriteScript *script, Fe
 #define fe_new_void_static( name )    ferite_create_void_variable( script, name, FE_STATIC )
 
 #define FE_STRLEN( var )      VAS(var)->length
-#define FE_STR2PTR( var )      VAS(var)->data
+#define FE_STR2PTR( var )      ferite_str_cstr( NULL, VAS(var) )
    
 #define fe_create_ns_fnc( script, namespace, name, function, signature ) ferite_register_ns_function( script, namespace, ferite_create_external_function( script, name, function, signature ) )
 #define fe_create_cls_fnc( script, class, name, function, signature, static ) ferite_register_class_function( script, class, ferite_create_external_function( script, name, function, signature ), static )
    
    /* macros to make writing functions easier */
-#define FDECREF( obj ) do { (obj)->refcount--; if( (obj)->refcount < 0 ) ferite_debug_catch((obj),(obj)->refcount); } while(0)
-#define FINCREF( obj ) (obj)->refcount++
-#define FDECREFI( obj, amount ) do { (obj)->refcount -= (amount); if( (obj)->refcount < 0 ) ferite_debug_catch((obj),(obj)->refcount); } while(0)
-#define FINCREFI( obj, amount ) (obj)->refcount += (amount)
+   /* Plain arithmetic until a second thread turns up, see ferite_enable_atomic_refcounts(). This is
+    * decided by libferite at run time and not by THREAD_SAFE, so that modules built without the thread
+    * defines count the same way as everything else; the flag is never set when threads are not built in. */
+#define FE_REFCOUNT_ADD( obj, amount ) (ferite_atomic_refcounts ? __atomic_add_fetch( &(obj)->refcount, (amount), __ATOMIC_ACQ_REL ) : ((obj)->refcount += (amount)))
+#define FDECREF( obj ) do { if( FE_REFCOUNT_ADD( (obj), -1 ) < 0 ) ferite_debug_catch((obj),(obj)->refcount); } while(0)
+#define FINCREF( obj ) FE_REFCOUNT_ADD( (obj), 1 )
+#define FDECREFI( obj, amount ) do { if( FE_REFCOUNT_ADD( (obj), -(amount) ) < 0 ) ferite_debug_catch((obj),(obj)->refcount); } while(0)
+#define FINCREFI( obj, amount ) FE_REFCOUNT_ADD( (obj), (amount) )
 
    /* these are for return values */
 #define FE_FALSE 0
@@ -198,6 +207,9 @@ FERITE_API int ferite_get_required_parameter_list_size( FeriteScript *script, Fe
 #include <ferite/ferror.h>
 #include <ferite/farray.h>
 #include <ferite/fbuffer.h>
+#include <ferite/fworker.h>
+#include <ferite/fkernels.h>
+#include <ferite/fmatcher.h>
 
 #include <ferite/fobj.h> /* As this is the native class 'Obj' we need the macros here for compilation!*/    
 
@@ -38,6 +38,7 @@ FERITE_API FeriteUnifiedArray *ferite_uarray_create( FeriteScript *script );
 FERITE_API void                ferite_uarray_destroy( FeriteScript *script,FeriteUnifiedArray *array);
 FERITE_API void                ferite_uarray_add( FeriteScript *script,FeriteUnifiedArray *array, FeriteVariable *var, char *id, int index);
 FERITE_API FeriteVariable     *ferite_uarray_get_index( FeriteScript *script, FeriteUnifiedArray *array, int index );
+FERITE_API void                ferite_uarray_resolve( FeriteScript *script, FeriteUnifiedArray *array );
 FERITE_API FeriteVariable     *ferite_uarray_get( FeriteScript *script,FeriteUnifiedArray *array, FeriteVariable *var);
 FERITE_API FeriteVariable     *ferite_uarray_get( FeriteScript *script,FeriteUnifiedArray *array, FeriteVariable *index );
 FERITE_API FeriteVariable     *ferite_uarray_set( FeriteScript *script,FeriteUnifiedArray *array, FeriteVariable *index, FeriteVariable *rhs );
@@ -31,6 +31,31 @@
 #define __FERITE_BUFFER_H__
 
 #define FE_DEFAULT_BUFFER_SIZE  1024
+#define FE_FORMAT_CACHE_SIZE    256
+#define FE_FORMAT_FROM_ARGUMENT -2
+
+typedef struct __ferite_format_directive
+{
+    char   conversion;    /* The conversion character, 0 for literal text */
+    char   flags[6];      /* Any of "-+ #0" */
+    char   left;          /* The '-' flag was given */
+    int    width;         /* -1 if not given, FE_FORMAT_FROM_ARGUMENT for '*' */
+    int    precision;     /* -1 if not given, FE_FORMAT_FROM_ARGUMENT for '*' */
+    size_t offset;        /* The literal text, or the whole directive for when the arguments run out */
+    size_t length;
+}
+FeriteFormatDirective;
+
+typedef struct __ferite_format
+{
+    char                  *text;        /* A copy of the format string */
+    size_t                 length;
+    int                    count;
+    int                    cached;      /* True if it is kept in the script's format cache */
+    int                    users;       /* Gets not yet matched by a release */
+    FeriteFormatDirective *directives;
+}
+FeriteFormat;
 
 FERITE_API FeriteBuffer    *ferite_buffer_new( FeriteScript *script, size_t size );
 FERITE_API void            ferite_buffer_add( FeriteScript *script, FeriteBuffer *buf, void *ptr, size_t size );
@@ -53,8 +78,13 @@ FERITE_API int             ferite_buffer_to_fd( FeriteScript *script, FeriteBuff
 FERITE_API int             ferite_buffer_to_file( FeriteScript *script, FeriteBuffer *buf, FILE *f );
 FERITE_API FeriteVariable *ferite_buffer_to_var( FeriteScript *script, FeriteBuffer *buf );
 FERITE_API FeriteString   *ferite_buffer_to_str( FeriteScript *script, FeriteBuffer *buf );
-FERITE_API FeriteVariable *ferite_sprintf(FeriteScript *script, char *format, FeriteVariable **params );
+FERITE_API FeriteFormat   *ferite_format_compile( FeriteScript *script, char *format, size_t length );
+FERITE_API void            ferite_format_destroy( FeriteScript *script, FeriteFormat *format );
+FERITE_API FeriteFormat   *ferite_format_get( FeriteScript *script, char *format, size_t length );
+FERITE_API void            ferite_format_release( FeriteScript *script, FeriteFormat *format );
+FERITE_API int             ferite_format_run( FeriteScript *script, FeriteBuffer *buf, FeriteFormat *format, FeriteVariable **params, int count );
 FERITE_API int             ferite_format( FeriteScript *script, FeriteBuffer *buf, char *format, FeriteVariable **params );
+FERITE_API FeriteVariable *ferite_sprintf( FeriteScript *script, char *format, FeriteVariable **params );
 
 #endif /* __FERITE_BUFFER_H__ */
 
@@ -1,38 +1,86 @@
+#ifndef __FERITE_CACHE_H__
+#define __FERITE_CACHE_H__
 
-#define CHECK_AND_INIT( CACHE, RETURN ) if( !CACHE ) { if( ferite_cache_enabled ) { CACHE = ferite_AMTHash_Create(script); } else { return (RETURN); } } 
+/*
+ * The compile cache holds one line per source file, keyed by the file's path. A line records
+ * the mtime and size the file had when it was read, the normalised source, and the functions
+ * and closure classes compiled out of it. Every script that uses a line holds a reference on
+ * it; lines that are invalidated or evicted are unlinked straight away but only freed once the
+ * last of those scripts has been deleted. All access goes through ferite_cache_lock; lookups
+ * in a line the script already holds only need it for reading, anything else writes.
+ */
+
+#define READ_LOCK_CACHE() aphex_rwlock_read_lock( ferite_cache_lock )
+#define LOCK_CACHE()      aphex_rwlock_write_lock( ferite_cache_lock )
+#define UNLOCK_CACHE()    aphex_rwlock_unlock( ferite_cache_lock )
 
 #define CACHE_OUT(VALUE) FUD(VALUE)
 
-#define IMPLEMENT_CACHE_LINE( TYPE, DEFAULT, NAME, COPY )                                    \
-	FeriteAMT *ferite_cache_##NAME = NULL;                                                   \
+/* Functions and closures are scoped to the file currently being scanned */
+#define IMPLEMENT_CACHE_LINE( TYPE, DEFAULT, NAME, SIZE )                                    \
 	TYPE ferite_cache_has_##NAME( FeriteScript *script, char *line ) {                       \
 		TYPE existing = DEFAULT;                                                             \
-		CHECK_AND_INIT(ferite_cache_##NAME,DEFAULT);                                         \
-		existing = ferite_hamt_get( script, ferite_cache_##NAME, line );                     \
-		CACHE_OUT(("Looking for "  #NAME " '%s' [%p]\n", line, existing));                   \
-		if( !existing ) {                                                                    \
-			CACHE_OUT((#NAME " cache miss: %s\n", line));                                    \
+		FeriteCacheEntry *entry = NULL;                                                      \
+		if( !ferite_cache_enabled ) return DEFAULT;                                          \
+		READ_LOCK_CACHE();                                                                   \
+		entry = ferite_cache_entry_held( script, ferite_scanner_file );                     \
+		if( entry == NULL ) {                                                                \
+			UNLOCK_CACHE();                                                                  \
+			LOCK_CACHE();                                                                    \
+			entry = ferite_cache_entry_acquire( script, ferite_scanner_file, FE_FALSE );    \
 		}                                                                                    \
+		if( entry != NULL && entry->NAME != NULL )                                           \
+			existing = ferite_hamt_get( NULL, entry->NAME, line );                           \
+		ferite_cache_count_lookup( existing != DEFAULT );                                    \
+		UNLOCK_CACHE();                                                                      \
+		CACHE_OUT(("Looking for "  #NAME " '%s' [%p]\n", line, existing));                   \
 		return existing;                                                                     \
 	}                                                                                        \
 	int ferite_cache_register_##NAME( FeriteScript *script, char *line, TYPE line_value ) {  \
-		TYPE existing = NULL;                                                                \
-		CHECK_AND_INIT(ferite_cache_##NAME,FE_FALSE);                                        \
-		existing = ferite_cache_has_##NAME( script, line );                                  \
-		if( !existing ) {                                                                    \
-			CACHE_OUT(("Registering " #NAME " '%s' [%p]\n", line, line_value ));             \
-			existing = COPY(line_value);                                                     \
-			ferite_hamt_set( script, ferite_cache_##NAME, line, existing );                  \
-			return FE_TRUE;                                                                  \
+		FeriteCacheEntry *entry = NULL;                                                      \
+		int result = FE_FALSE;                                                               \
+		if( !ferite_cache_enabled || line_value->cached ) return FE_FALSE;                   \
+		LOCK_CACHE();                                                                        \
+		entry = ferite_cache_entry_acquire( script, ferite_scanner_file, FE_TRUE );         \
+		if( entry != NULL ) {                                                                \
+			if( entry->NAME == NULL )                                                        \
+				entry->NAME = ferite_AMTHash_Create( NULL );                                 \
+			if( ferite_hamt_get( NULL, entry->NAME, line ) == NULL ) {                       \
+				CACHE_OUT(("Registering " #NAME " '%s' [%p]\n", line, line_value ));         \
+				line_value->cached = FE_TRUE;                                                \
+				ferite_hamt_set( NULL, entry->NAME, line, line_value );                      \
+				entry->NAME##_count++;                                                       \
+				if( !entry->retired )                                                        \
+					ferite_cache_counters.NAME##s++;                                         \
+				ferite_cache_account( script, entry, SIZE( line_value ) );                   \
+				result = FE_TRUE;                                                            \
+			}                                                                                \
 		}                                                                                    \
-		return FE_FALSE;                                                                     \
+		UNLOCK_CACHE();                                                                      \
+		return result;                                                                       \
 	}
 #define DECLARE_CACHE_LINE( TYPE, DEFAULT, NAME )                                            \
 	TYPE ferite_cache_has_##NAME( FeriteScript *script, char *line );                        \
 	int ferite_cache_register_##NAME( FeriteScript *script, char *line, TYPE line_value );
-	
+
 DECLARE_CACHE_LINE( char*, NULL, code );
 DECLARE_CACHE_LINE( FeriteClass*, NULL, closure );
 DECLARE_CACHE_LINE( FeriteFunction*, NULL, function );
 
 FeriteFunction *ferite_cache_reference_function( FeriteScript *script, char *fqfunction );
+
+FeriteCacheEntry *ferite_cache_entry_held( FeriteScript *script, char *filename );
+FeriteCacheEntry *ferite_cache_entry_acquire( FeriteScript *script, char *filename, int create );
+void ferite_cache_account( FeriteScript *script, FeriteCacheEntry *entry, long bytes );
+void ferite_cache_count_lookup( int hit );
+void ferite_cache_init();
+void ferite_cache_deinit();
+void ferite_cache_release_script( FeriteScript *script );
+void ferite_cache_share_script( FeriteScript *from, FeriteScript *to );
+
+extern int         ferite_cache_enabled;
+extern AphexRWLock *ferite_cache_lock;
+extern FeriteCacheStats ferite_cache_counters;
+extern FE_THREAD_LOCAL char *ferite_scanner_file;
+
+#endif /* __FERITE_CACHE_H__ */
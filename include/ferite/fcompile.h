@@ -61,6 +61,7 @@ void ferite_destroy_request( FeriteBkRequest *ptr );
   
 FERITE_API void ferite_compiler_keep_native_code();
 FERITE_API int  ferite_compiler_include_in_list( FeriteScript *script, char *name );
+FERITE_API char **ferite_compiler_search_paths();
 
 int ferite_parse(void);
 void ferite_prepare_parser( char *s );
@@ -220,6 +221,7 @@ FERITE_API FeriteVariable *ferite_call_function( FeriteScript *script, void *con
 /* ferite_script.c */
 FERITE_API int ferite_script_being_deleted( FeriteScript *script );
 FERITE_API int ferite_script_clean( FeriteScript *script );
+FERITE_API void ferite_script_snapshot_delete( FeriteScript *script );
 FERITE_API void ferite_init_cache( FeriteScript *script );
 FERITE_API void ferite_free_cache( FeriteScript *script );
 FERITE_API int ferite_script_attach_data( FeriteScript *script, char *key, void *data, FeriteAttachedDataCleanup cleanup );
@@ -39,7 +39,7 @@
 #define NO_ERROR(SCRIPT) (SCRIPT->error_state == FE_NO_ERROR)
 
 FERITE_API void ferite_init_error_system( FeriteScript *script, FeriteNamespace *ns );
-FERITE_API void ferite_raise_script_error( FeriteScript *script, int err, char *fmt, ... );
+FERITE_API void ferite_verror( FeriteScript *script, int err, char *errormsg, va_list *ap );
 FERITE_API void ferite_vwarning(FeriteScript *script, char *errormsg, va_list *ap );
 FERITE_API FeriteVariable *ferite_generate_backtrace( FeriteScript *script, int skip_first );
 FERITE_API void ferite_error( FeriteScript *script, int err, char *errormsg, ... );
@@ -56,8 +56,8 @@ FERITE_API int ferite_has_runtime_error( FeriteScript *script );
 FERITE_API int ferite_has_warnings( FeriteScript *script );
 FERITE_API void ferite_assert( char *fmt, ... );
 
-extern jmp_buf ferite_exception_jmpback;
-extern int ferite_exception_status;
+extern FE_THREAD_LOCAL jmp_buf ferite_exception_jmpback;
+extern FE_THREAD_LOCAL int ferite_exception_status;
 
 #define MONITOR \
 	do { \
@@ -35,19 +35,24 @@ FERITE_API void ferite_init_std_gc( FeriteScript *script );
 FERITE_API void ferite_deinit_std_gc( FeriteScript *script );
 FERITE_API void ferite_add_to_std_gc( FeriteScript *script, FeriteObject *obj );
 FERITE_API void ferite_check_std_gc( FeriteScript *script );
+FERITE_API void ferite_collect_std_gc( FeriteScript *script );
 FERITE_API void ferite_merge_std_gc( FeriteScript *script, void *g );
 
 FERITE_API void ferite_init_generation_gc( FeriteScript *script );
 FERITE_API void ferite_deinit_generation_gc( FeriteScript *script );
 FERITE_API void ferite_add_to_generation_gc( FeriteScript *script, FeriteObject *obj );
 FERITE_API void ferite_check_generation_gc( FeriteScript *script );
+FERITE_API void ferite_collect_generation_gc( FeriteScript *script );
 FERITE_API void ferite_check_gc_generation( FeriteScript *script, FeriteGCGeneration *g );
+FERITE_API int  ferite_sweep_gc_generation( FeriteScript *script, FeriteGCGeneration *g );
 FERITE_API void ferite_merge_generation_gc( FeriteScript *script, void *g );
+FERITE_API void ferite_adopt_generation_gc( FeriteScript *script );
 
 FERITE_API void ferite_init_libgc_gc( FeriteScript *script );
 FERITE_API void ferite_deinit_libgc_gc( FeriteScript *script );
 FERITE_API void ferite_add_to_libgc_gc( FeriteScript *script, FeriteObject *obj );
 FERITE_API void ferite_check_libgc_gc( FeriteScript *script );
+FERITE_API void ferite_collect_libgc_gc( FeriteScript *script );
 FERITE_API void ferite_merge_libgc_gc( FeriteScript *script, void *g );
 
 #endif /* __FERITE_GC_H__ */
@@ -35,12 +35,13 @@
 #pragma data_seg( ".GLOBALS" )
 #endif
 
-FERITE_API int ferite_call_level;
+FERITE_API FE_THREAD_LOCAL int ferite_call_level;
 FERITE_API int ferite_show_debug;
 FERITE_API int ferite_hide_mem_use;
 FERITE_API int ferite_use_mm_with_pcre;
 FERITE_API int ferite_is_strict;
 FERITE_API int ferite_show_partial_implementation;
+FERITE_API int ferite_atomic_refcounts;
 FERITE_API FeriteVariable *ferite_ARGV;
 
 FERITE_API void  (*ferite_memory_init)(void);
@@ -54,6 +55,7 @@ FERITE_API void  (*ferite_init_gc)( FeriteScript *script );
 FERITE_API void  (*ferite_deinit_gc)( FeriteScript *script );
 FERITE_API void  (*ferite_add_to_gc)( FeriteScript *script, FeriteObject *obj );
 FERITE_API void  (*ferite_check_gc)( FeriteScript *script );
+FERITE_API void  (*ferite_collect_gc)( FeriteScript *script );
 FERITE_API void  (*ferite_merge_gc)( FeriteScript *script, void *gc );
 
 #ifdef WIN32
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2000-2007 Chris Ross and various contributors
+ * Copyright (C) 1999-2000 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_KERNELS_H__
+#define __FERITE_KERNELS_H__
+
+#define FE_KERNEL_AUTO   -1
+#define FE_KERNEL_SCALAR  0
+#define FE_KERNEL_SSE2    1
+#define FE_KERNEL_AVX2    2
+
+FERITE_API int    ferite_kernel_select( int kind );
+FERITE_API int    ferite_kernel_kind();
+FERITE_API char  *ferite_kernel_name( int kind );
+
+FERITE_API void   ferite_kernel_lower( char *dst, const char *src, size_t length );
+FERITE_API void   ferite_kernel_upper( char *dst, const char *src, size_t length );
+FERITE_API void   ferite_kernel_reverse( char *dst, const char *src, size_t length );
+FERITE_API long   ferite_kernel_find( const char *haystack, size_t length, const char *needle, size_t count );
+FERITE_API size_t ferite_kernel_scan( const char *data, size_t length, const char *set, size_t count );
+FERITE_API size_t ferite_kernel_span( const char *data, size_t length, const char *set, size_t count );
+FERITE_API size_t ferite_kernel_span_back( const char *data, size_t length, const char *set, size_t count );
+FERITE_API size_t ferite_kernel_span_printable( const char *data, size_t length, const char *set, size_t count );
+FERITE_API size_t ferite_kernel_base64_encode( char *dst, const char *src, size_t length );
+FERITE_API size_t ferite_kernel_base64_decode( char *dst, const char *src, size_t length );
+FERITE_API int    ferite_kernel_utf8_valid( const char *data, size_t length );
+FERITE_API size_t ferite_kernel_utf8_length( const char *data, size_t length );
+FERITE_API long   ferite_kernel_utf8_detect( const char *data, size_t length );
+FERITE_API size_t ferite_kernel_url_encode( char *dst, const char *src, size_t length );
+
+#endif /* __FERITE_KERNELS_H__ */
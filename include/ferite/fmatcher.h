@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2000-2007 Chris Ross and various contributors
+ * Copyright (C) 1999-2000 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_MATCHER_H__
+#define __FERITE_MATCHER_H__
+
+#define FE_MATCHER_IGNORE_CASE 1
+
+typedef struct __ferite_matcher
+{
+    int            patterns;      /* How many patterns were given, including any empty ones */
+    size_t        *lengths;       /* The length of each pattern */
+    int           *same;          /* The next pattern with the same text, or -1 */
+    int            states;
+    int            classes;       /* Bytes that appear in the patterns, plus one for the rest */
+    unsigned short class_of[256];
+    int           *next;          /* states * classes transitions, failures already followed: the row of
+                                     the next state times two, plus one if that state has anything to report */
+    int           *output;        /* The first pattern ending at each state, or -1 */
+    int           *output_link;   /* The nearest state along the failure links with an output, or 0 */
+    int            skip_count;    /* How many bytes can start a match, or 0 if too many to skip with */
+    char           skip[16];
+}
+FeriteMatcher;
+
+typedef int (*FeriteMatcherCallback)( FeriteMatcher *matcher, int pattern, size_t offset, void *data );
+
+FERITE_API FeriteMatcher *ferite_matcher_create( FeriteScript *script, char **patterns, size_t *lengths, int count, int flags );
+FERITE_API void           ferite_matcher_destroy( FeriteScript *script, FeriteMatcher *matcher );
+FERITE_API size_t         ferite_matcher_scan( FeriteMatcher *matcher, const char *data, size_t length, FeriteMatcherCallback callback, void *user );
+
+#endif /* __FERITE_MATCHER_H__ */
@@ -53,5 +53,15 @@
 
 #include <limits.h>
 
+/* Engine state that every interpreter thread keeps to itself, so independent scripts can
+ * be compiled and run on as many threads as the embedder likes */
+#if defined(THREAD_SAFE) && defined(__GNUC__)
+# define FE_THREAD_LOCAL __thread
+#elif defined(THREAD_SAFE) && defined(VCWIN32)
+# define FE_THREAD_LOCAL __declspec(thread)
+#else
+# define FE_THREAD_LOCAL
+#endif
+
 #endif /* __FERITE_REQ_H__ */
 
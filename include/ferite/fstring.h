@@ -52,6 +52,15 @@ FERITE_API int           ferite_str_data_cat( FeriteScript *script, FeriteString
 FERITE_API FeriteString *ferite_str_escape( FeriteScript *script, FeriteString *str );
 FeriteString *ferite_bin_str_new( FeriteScript *script, char *str, size_t length, int encoding );
 
+FERITE_API FeriteStringStorage *ferite_str_storage_new( FeriteScript *script, char *data, size_t length, FeriteStringStorageRelease release, void *odata );
+FERITE_API void          ferite_str_storage_release( FeriteScript *script, FeriteStringStorage *storage );
+FERITE_API FeriteString *ferite_str_new_from_storage( FeriteScript *script, FeriteStringStorage *storage, size_t offset, size_t length, int encoding );
+FERITE_API void          ferite_str_materialise( FeriteScript *script, FeriteString *str );
+FERITE_API FeriteString *ferite_str_map_file( FeriteScript *script, char *filename );
+FERITE_API char         *ferite_str_cstr( FeriteScript *script, FeriteString *str );
+FERITE_API FeriteString *ferite_str_view( FeriteScript *script, FeriteString *str, size_t offset, size_t length );
+FERITE_API int           ferite_str_split( FeriteScript *script, FeriteUnifiedArray *array, FeriteString *str, FeriteString *delimiter, int limit );
+
 #define FE_CHARSET_DEFAULT 0
 #define FE_CHARSET_UTF8    1
 
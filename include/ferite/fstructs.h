@@ -39,6 +39,7 @@ typedef struct _ferite_hash_bucket                 FeriteHashBucket;
 typedef struct _ferite_hash                        FeriteHash;
 typedef struct _ferite_stack                       FeriteStack;
 typedef struct _ferite_string                      FeriteString;
+typedef struct _ferite_string_storage              FeriteStringStorage;
 typedef struct _ferite_unified_array               FeriteUnifiedArray;
 typedef struct _ferite_function                    FeriteFunction;
 typedef struct _ferite_class                       FeriteClass;
@@ -70,11 +71,17 @@ typedef struct _ferite_compile_record              FeriteCompileRecord;
 typedef struct _ferite_bk_req                      FeriteBkRequest;
 typedef struct _ferite_variable_accessors          FeriteVariableAccessors;
 typedef struct _ferite_variable_subtype            FeriteVariableSubType;
+typedef struct _ferite_worker_pool                 FeriteWorkerPool;
+typedef struct _ferite_cache_entry                 FeriteCacheEntry;
+typedef struct _ferite_cache_stats                 FeriteCacheStats;
 
 typedef void (*FeriteVariableGetAccessor)(FeriteScript*,FeriteVariable*);
 typedef void (*FeriteVariableSetAccessor)(FeriteScript*,FeriteVariable*,FeriteVariable*);
 typedef void (*FeriteVariableCleanupAccessor)(FeriteScript*,void*);
 typedef void (*FeriteAttachedDataCleanup)(FeriteScript*,int,char*,void*);
+typedef void (*FeriteStringStorageRelease)(FeriteScript*,FeriteStringStorage*);
+typedef int  (*FeriteWorkerAccept)(FeriteWorkerPool*,void*);
+typedef void (*FeriteWorkerRequest)(FeriteWorkerPool*,FeriteScript*,void*);
 
 typedef struct _ferite_amt_node                    FeriteAMTNode;
 typedef struct _ferite_amt_tree                    FeriteAMTTree;
@@ -119,12 +126,22 @@ struct _ferite_stack
     void **stack;     /* The stack itself */
 };
 
+struct _ferite_string_storage /* Read-only data shared between a number of strings */
+{
+    int                         refcount; /* The number of strings pointing into the storage */
+    char                       *data;     /* The start of the shared data */
+    size_t                      length;   /* How much data there is */
+    FeriteStringStorageRelease  release;  /* Called once the last string lets go of the storage */
+    void                       *odata;    /* Owner data for the release function */
+};
+
 struct _ferite_string
 {
     size_t  length;     /* How long the string is */
     int     encoding;   /* What encoding the string has, eg. Latin-1 or UTF-8 etc */
     size_t  pos;        /* Current position within the string */
 	char   *data;       /* The strings actual data */
+	FeriteStringStorage *storage; /* If set, data points into shared read-only storage and is not ours to free */
 };
 
 struct _ferite_variable_accessors
@@ -351,6 +368,7 @@ struct _ferite_gc_generation /* Used in the generational GC */
 	FeriteObject **contents;      /* The contents holds pointers to the objects */
 	FeriteGCGeneration *younger;  /* The generation younger than this one */
 	FeriteGCGeneration *older;    /* The generation older than this one */
+	FeriteGCGeneration *handoff;  /* The next chain on a script's gc_incoming stack */
 };
 
 struct _ferite_std_gc /* Standard 'old skool' GC */
@@ -399,6 +417,7 @@ struct _ferite_script
     FeriteStack        *vars;               /* Variable cache */
     FeriteStack        *objects;            /* Object cache */
     FeriteStack        *stacks;             /* Stack cache */
+    FeriteHash         *formats;            /* Compiled format strings, see ferite_format_get() */
     
     /* error stuff */
     char               *current_op_file;    /* File being executed in */
@@ -420,6 +439,7 @@ struct _ferite_script
     int                 gc_running;         /* Is the GC running ? */
     int                 gc_count;           /* Count ops since last GC invocation */
     void               *gc_lock;            /* GC lock */
+    void               *gc_incoming;        /* GC generations handed over by threads that have finished */
 	FeriteExecuteRec   *gc_stack;           /* We need this to do a GC run */
     
     /* user information */
@@ -429,6 +449,8 @@ struct _ferite_script
 
 	FeriteAMT          *globals;
 	FeriteAMT          *types;
+	FeriteStack        *snapshot;           /* (variable, saved value) pairs for ferite_script_reset() */
+	FeriteStack        *cache_entries;      /* Compile cache lines this script holds a reference on */
 };
 
 struct _ferite_script_attached_data 
@@ -518,4 +540,49 @@ struct _ferite_compile_record /* Used in the compiler */
 	int want_container_finish;
 };
 
+struct _ferite_worker_pool /* A master process and the workers it has forked to run a script */
+{
+    char                *filename;     /* The script every request runs */
+    FeriteScript        *script;       /* The master's compile, which every request executes */
+    int                  workers;      /* How many workers to keep running */
+    int                  max_requests; /* Requests a worker serves before it is replaced, 0 for no limit */
+    int                 *pids;         /* The process id of each worker slot, 0 when empty */
+    volatile int         running;      /* Cleared by ferite_worker_pool_stop() */
+    FeriteWorkerAccept   accept;       /* Called in the worker to wait for a request, FE_FALSE to retire */
+    FeriteWorkerRequest  setup;        /* Called with the script before it is executed */
+    FeriteWorkerRequest  finish;       /* Called with the script after it has been executed, before it is reset */
+    void                *data;         /* Passed to the callbacks */
+};
+
+struct _ferite_cache_entry /* One source file's worth of the compile cache */
+{
+    char             *filename;       /* The path the line is keyed on */
+    time_t            mtime;          /* The file's mtime when it was read */
+    off_t             size;           /* ... and its size */
+    char             *code;           /* The normalised source */
+    FeriteAMT        *function;       /* Functions compiled from the file, keyed on their path */
+    FeriteAMT        *closure;        /* Closure classes compiled from the file */
+    long              function_count;
+    long              closure_count;
+    size_t            bytes;          /* Approximate memory held by the line */
+    int               users;          /* Scripts holding a reference */
+    int               retired;        /* Unlinked from the cache, freed when users drops to 0 */
+    FeriteCacheEntry *newer;          /* LRU list */
+    FeriteCacheEntry *older;
+};
+
+struct _ferite_cache_stats /* A snapshot of the compile cache counters */
+{
+    long   entries;        /* Live cache lines, one per source file */
+    long   retired;        /* Lines dropped from the cache that scripts still reference */
+    long   functions;      /* Functions held by the live lines */
+    long   closures;       /* Closure classes held by the live lines */
+    size_t bytes;          /* Approximate memory held by the live lines */
+    size_t limit;          /* The size bound set with ferite_cache_set_limit(), 0 for none */
+    long   hits;           /* Lookups that found what they wanted */
+    long   misses;         /* ... and those that did not */
+    long   evictions;      /* Lines dropped to honour the size bound */
+    long   invalidations;  /* Lines dropped because the file changed or was invalidated */
+};
+
 #endif /* __FERITE_STRUCTS_H__ */
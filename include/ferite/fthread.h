@@ -48,5 +48,14 @@ FERITE_API void ferite_thread_group_destroy( FeriteScript *script, FeriteThreadG
 FERITE_API void ferite_thread_group_attach( FeriteScript *script, FeriteThreadGroup *group, FeriteThread *data );
 FERITE_API void ferite_thread_group_dettach( FeriteScript *script, FeriteThreadGroup *group, FeriteThread *data );
 FERITE_API void ferite_thread_group_wait( FeriteScript *script, FeriteThreadGroup *group );
+FERITE_API void ferite_enable_atomic_refcounts();
+
+#define FE_IO_READ  1
+#define FE_IO_WRITE 2
+
+typedef int (*FeriteIOWaitHook)( FeriteScript *script, int fd, int events );
+
+FERITE_API void ferite_set_io_wait_hook( FeriteIOWaitHook hook );
+FERITE_API int  ferite_io_wait( FeriteScript *script, int fd, int events );
 
 #endif
@@ -73,6 +73,13 @@ typedef struct __aphex_file
     long  size;
 } AphexFile;
 
+typedef struct __aphex_mapped_file
+{
+    char  *data;        /* The contents of the file, always followed by a '\0' */
+    size_t size;        /* The size of the file */
+    size_t mapped_size; /* The size of the mapping, including the trailing zero page */
+} AphexMappedFile;
+
 typedef struct __aphex_directoy
 {
     char **contents;
@@ -118,8 +125,32 @@ typedef struct __aphex_mutex
 #  endif
 # endif
     int recursive;
+    int spins;          /* Running average of how long lock() spun before it got in */
 } AphexMutex;
 
+typedef struct __aphex_rwlock
+{
+# ifdef USE_PTHREAD
+    pthread_rwlock_t     lock;
+# endif
+} AphexRWLock;
+
+typedef struct __aphex_condition
+{
+# ifdef USE_PTHREAD
+    pthread_cond_t      cond;
+# endif
+} AphexCondition;
+
+typedef struct __aphex_thread_key
+{
+# ifdef USE_PTHREAD
+    pthread_key_t       key;
+# else
+    void               *value;
+# endif
+} AphexThreadKey;
+
 typedef struct __aphex_event
 {
 # ifdef USE_PTHREAD
@@ -152,6 +183,9 @@ APHEX_API AphexFile       *aphex_open_file( char *filename, char *mode, AphexSea
 APHEX_API void             aphex_close_file( AphexFile *file );
 APHEX_API size_t           aphex_read_file( AphexFile *file, char *buffer, size_t length );
 
+APHEX_API AphexMappedFile *aphex_map_file( char *filename );
+APHEX_API void             aphex_unmap_file( AphexMappedFile *map );
+
 APHEX_API AphexSearchList *aphex_create_search_list();
 APHEX_API void             aphex_add_to_list( AphexSearchList *list, char *path );
 APHEX_API void             aphex_delete_search_list( AphexSearchList *list );
@@ -194,6 +228,26 @@ APHEX_API void             aphex_mutex_destroy( AphexMutex *mutex );
 APHEX_API int              aphex_mutex_lock( AphexMutex *mutex );
 APHEX_API int              aphex_mutex_unlock( AphexMutex *mutex );
 
+APHEX_API AphexRWLock     *aphex_rwlock_create();
+APHEX_API void             aphex_rwlock_destroy( AphexRWLock *lock );
+APHEX_API int              aphex_rwlock_read_lock( AphexRWLock *lock );
+APHEX_API int              aphex_rwlock_write_lock( AphexRWLock *lock );
+APHEX_API int              aphex_rwlock_try_read_lock( AphexRWLock *lock );
+APHEX_API int              aphex_rwlock_try_write_lock( AphexRWLock *lock );
+APHEX_API int              aphex_rwlock_unlock( AphexRWLock *lock );
+
+APHEX_API AphexCondition  *aphex_condition_create();
+APHEX_API void             aphex_condition_destroy( AphexCondition *condition );
+APHEX_API int              aphex_condition_wait( AphexCondition *condition, AphexMutex *mutex );
+APHEX_API int              aphex_condition_timedwait( AphexCondition *condition, AphexMutex *mutex, int msecs );
+APHEX_API int              aphex_condition_signal( AphexCondition *condition );
+APHEX_API int              aphex_condition_broadcast( AphexCondition *condition );
+
+APHEX_API AphexThreadKey  *aphex_thread_key_create( void (*destructor)(void *) );
+APHEX_API void             aphex_thread_key_destroy( AphexThreadKey *key );
+APHEX_API int              aphex_thread_key_set( AphexThreadKey *key, void *value );
+APHEX_API void            *aphex_thread_key_get( AphexThreadKey *key );
+
 APHEX_API AphexEvent      *aphex_event_create();
 APHEX_API void             aphex_event_destroy( AphexEvent *event );
 APHEX_API int              aphex_event_signal( AphexEvent *event );
@@ -41,6 +41,11 @@
 #include <sys/stat.h>
 #ifndef WIN32
 # include <unistd.h>
+# include <errno.h>
+# include <sys/mman.h>
+# if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
 #else
 # include <io.h>
 #endif
@@ -181,6 +186,78 @@ size_t           aphex_read_file( AphexFile *file, char *buffer, size_t length )
     return 0;
 }
 
+/*
+ * Map a file read-only into memory. We reserve an anonymous region one page larger than
+ * the file and map the file over the start of it, this means that the contents are always
+ * followed by at least one '\0' and can be handed to code expecting a C string without
+ * being copied. On failure NULL is returned and errno is left describing the problem.
+ */
+AphexMappedFile *aphex_map_file( char *filename )
+{
+#ifndef WIN32
+    AphexMappedFile *map = NULL;
+    struct stat filestat;
+    size_t page_size = (size_t)sysconf( _SC_PAGESIZE );
+    char *region = NULL;
+    int fd = -1, saved_errno = 0;
+
+    if( (fd = open( filename, O_RDONLY )) == -1 )
+      return NULL;
+
+    if( fstat( fd, &filestat ) == -1 )
+      goto fail;
+    if( !S_ISREG(filestat.st_mode) )
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    map = aphex_malloc( sizeof( AphexMappedFile ) );
+    map->size = (size_t)filestat.st_size;
+    map->mapped_size = ((map->size / page_size) + 1) * page_size;
+
+    region = mmap( NULL, map->mapped_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( region == MAP_FAILED )
+      goto fail;
+    if( map->size > 0 && mmap( region, map->size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED )
+    {
+        saved_errno = errno;
+        munmap( region, map->mapped_size );
+        errno = saved_errno;
+        goto fail;
+    }
+# ifdef MADV_SEQUENTIAL
+    if( map->size > 0 )
+      madvise( region, map->size, MADV_SEQUENTIAL );
+# endif
+    close( fd );
+    map->data = region;
+    D(( "aphex debug: mapped %s [%ld bytes] at %p\n", filename, (long)map->size, region ));
+    return map;
+
+  fail:
+    saved_errno = errno;
+    if( map != NULL )
+      aphex_free( map );
+    close( fd );
+    errno = saved_errno;
+    return NULL;
+#else
+    return NULL;
+#endif
+}
+
+void             aphex_unmap_file( AphexMappedFile *map )
+{
+    if( map != NULL )
+    {
+#ifndef WIN32
+        munmap( map->data, map->mapped_size );
+#endif
+        aphex_free( map );
+    }
+}
+
 AphexSearchList *aphex_create_search_list()
 {
     AphexSearchList *list = aphex_malloc( sizeof( AphexSearchList ) );
@@ -31,6 +31,10 @@
 #include "../../../config.h"
 #endif
 
+#if defined(USING_LINUX) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE /* pthread_rwlockattr_setkind_np */
+#endif
+
 #ifdef HAVE_LIBGC
 # define GC_THREADS
 # define GC_REDIRECT_TO_LOCAL
@@ -246,6 +250,7 @@ AphexMutex *aphex_mutex_create()
 # endif
 #endif
     mutex->recursive = 0;
+    mutex->spins = 0;
     return mutex;
 }
 
@@ -268,6 +273,7 @@ AphexMutex *aphex_mutex_recursive_create()
 #endif
     mutex->recursive = 1;
 #endif
+    mutex->spins = 0;
 
     return mutex;
 }
@@ -287,6 +293,69 @@ void aphex_mutex_destroy( AphexMutex *mutex )
     }
 }
 
+#ifdef USE_PTHREAD
+/*
+ * Most critical sections in ferite are a handful of instructions long, so when a lock
+ * is taken it is usually cheaper to spin for a moment than to go to sleep in the
+ * kernel and be woken again. How long we are willing to spin adapts to how long it
+ * has taken to get the lock recently, and we never spin with only one processor as
+ * the holder can not run while we do.
+ */
+# define APHEX_SPIN_MIN 10
+# define APHEX_SPIN_MAX 100
+
+static int aphex_processors = 0;
+
+static int aphex_processor_count()
+{
+    if( aphex_processors == 0 )
+    {
+        long count = 1;
+# ifdef _SC_NPROCESSORS_ONLN
+        count = sysconf( _SC_NPROCESSORS_ONLN );
+# endif
+        aphex_processors = (count > 0 ? (int)count : 1);
+    }
+    return aphex_processors;
+}
+
+static void aphex_cpu_relax()
+{
+# if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ __volatile__( "pause" );
+# endif
+}
+
+static int aphex_mutex_acquire( AphexMutex *mutex )
+{
+    int limit = 0, spun = 0;
+
+    if( pthread_mutex_trylock( &mutex->mutex ) == 0 )
+      return 0;
+
+    if( aphex_processor_count() > 1 )
+    {
+        limit = mutex->spins * 2 + APHEX_SPIN_MIN;
+        if( limit > APHEX_SPIN_MAX )
+          limit = APHEX_SPIN_MAX;
+        for( spun = 1; spun <= limit; spun++ )
+        {
+            aphex_cpu_relax();
+            if( pthread_mutex_trylock( &mutex->mutex ) == 0 )
+              break;
+        }
+    }
+    if( spun == 0 || spun > limit )
+    {
+        if( pthread_mutex_lock( &mutex->mutex ) != 0 )
+          return -1;
+    }
+    /* We hold the lock, so nobody else is updating the average */
+    mutex->spins += (spun - mutex->spins) / 8;
+    return 0;
+}
+#endif
+
 int aphex_mutex_lock( AphexMutex *mutex )
 {
 #ifdef USE_PTHREAD
@@ -294,7 +363,7 @@ int aphex_mutex_lock( AphexMutex *mutex )
 
     if( mutex != NULL )
     {
-        if( pthread_mutex_lock( &mutex->mutex ) == -1 )
+        if( aphex_mutex_acquire( mutex ) != 0 )
           return -1;
 
 #if defined(USING_FAKE_RECURSIVE_MUTEX)
@@ -353,6 +422,260 @@ int aphex_mutex_unlock( AphexMutex *mutex )
     return 0;
 }
 
+/***************************************************
+ * RWLOCK
+ ***************************************************/
+AphexRWLock *aphex_rwlock_create()
+{
+    AphexRWLock *lock = aphex_malloc(sizeof(AphexRWLock));
+#ifdef USE_PTHREAD
+    pthread_rwlockattr_t attr;
+
+    pthread_rwlockattr_init( &attr );
+# if defined(USING_LINUX) && defined(__USE_GNU)
+    /* glibc lets a steady stream of readers starve a writer unless asked not to */
+    pthread_rwlockattr_setkind_np( &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP );
+# endif
+    if( pthread_rwlock_init( &lock->lock, &attr ) != 0 )
+    {
+        pthread_rwlockattr_destroy( &attr );
+        aphex_free( lock );
+        return NULL;
+    }
+    pthread_rwlockattr_destroy( &attr );
+#endif
+    return lock;
+}
+
+void aphex_rwlock_destroy( AphexRWLock *lock )
+{
+    if( lock != NULL )
+    {
+#ifdef USE_PTHREAD
+        pthread_rwlock_destroy( &lock->lock );
+#endif
+        aphex_free( lock );
+    }
+}
+
+int aphex_rwlock_read_lock( AphexRWLock *lock )
+{
+#ifdef USE_PTHREAD
+    if( lock != NULL && pthread_rwlock_rdlock( &lock->lock ) != 0 )
+      return -1;
+#endif
+    return 0;
+}
+
+int aphex_rwlock_write_lock( AphexRWLock *lock )
+{
+#ifdef USE_PTHREAD
+    if( lock != NULL && pthread_rwlock_wrlock( &lock->lock ) != 0 )
+      return -1;
+#endif
+    return 0;
+}
+
+int aphex_rwlock_try_read_lock( AphexRWLock *lock )
+{
+#ifdef USE_PTHREAD
+    if( lock != NULL && pthread_rwlock_tryrdlock( &lock->lock ) != 0 )
+      return -1;
+#endif
+    return 0;
+}
+
+int aphex_rwlock_try_write_lock( AphexRWLock *lock )
+{
+#ifdef USE_PTHREAD
+    if( lock != NULL && pthread_rwlock_trywrlock( &lock->lock ) != 0 )
+      return -1;
+#endif
+    return 0;
+}
+
+int aphex_rwlock_unlock( AphexRWLock *lock )
+{
+#ifdef USE_PTHREAD
+    if( lock != NULL && pthread_rwlock_unlock( &lock->lock ) != 0 )
+      return -1;
+#endif
+    return 0;
+}
+
+/***************************************************
+ * CONDITION
+ ***************************************************/
+AphexCondition *aphex_condition_create()
+{
+    AphexCondition *condition = aphex_malloc(sizeof(AphexCondition));
+#ifdef USE_PTHREAD
+    if( pthread_cond_init( &condition->cond, NULL ) != 0 )
+    {
+        aphex_free( condition );
+        return NULL;
+    }
+#endif
+    return condition;
+}
+
+void aphex_condition_destroy( AphexCondition *condition )
+{
+    if( condition != NULL )
+    {
+#ifdef USE_PTHREAD
+        pthread_cond_destroy( &condition->cond );
+#endif
+        aphex_free( condition );
+    }
+}
+
+#ifdef USE_PTHREAD
+static int aphex_condition_block( AphexCondition *condition, AphexMutex *mutex, struct timespec *until )
+{
+    int retval = 0;
+# if defined(USING_FAKE_RECURSIVE_MUTEX)
+    pthread_t self = pthread_self();
+    int count = 0;
+
+    if( mutex->recursive == 1 )
+    {
+        /* Give up the whole of our ownership while we wait and take it all back after */
+        pthread_mutex_lock( &mutex->mutex );
+        count = mutex->count;
+        mutex->count = 0;
+        mutex->is_owned = 0;
+        pthread_cond_signal( &mutex->cond );
+        if( until != NULL )
+          retval = pthread_cond_timedwait( &condition->cond, &mutex->mutex, until );
+        else
+          retval = pthread_cond_wait( &condition->cond, &mutex->mutex );
+        while( mutex->is_owned )
+          pthread_cond_wait( &mutex->cond, &mutex->mutex );
+        mutex->owner = self;
+        mutex->count = count;
+        mutex->is_owned = 1;
+        pthread_mutex_unlock( &mutex->mutex );
+        return retval;
+    }
+# endif
+    if( until != NULL )
+      retval = pthread_cond_timedwait( &condition->cond, &mutex->mutex, until );
+    else
+      retval = pthread_cond_wait( &condition->cond, &mutex->mutex );
+    return retval;
+}
+#endif
+
+/*
+ * The mutex must be locked by the caller, and a recursive mutex must be held exactly
+ * once. As with any condition variable the wait can end without a signal, so callers
+ * should re-check whatever they are waiting for.
+ */
+int aphex_condition_wait( AphexCondition *condition, AphexMutex *mutex )
+{
+#ifdef USE_PTHREAD
+    if( condition == NULL || mutex == NULL )
+      return -1;
+    if( aphex_condition_block( condition, mutex, NULL ) != 0 )
+      return -1;
+#endif
+    return 0;
+}
+
+/* Returns 0 when woken, 1 when the wait timed out */
+int aphex_condition_timedwait( AphexCondition *condition, AphexMutex *mutex, int msecs )
+{
+#ifdef USE_PTHREAD
+    struct timespec ts;
+    struct timeval  tp;
+
+    if( condition == NULL || mutex == NULL )
+      return -1;
+    gettimeofday( &tp, NULL );
+    ts.tv_sec  = tp.tv_sec + msecs / 1000;
+    ts.tv_nsec = (tp.tv_usec + (long)(msecs % 1000) * 1000) * 1000;
+    if( ts.tv_nsec >= 1000000000 )
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    if( aphex_condition_block( condition, mutex, &ts ) != 0 )
+      return 1;
+#endif
+    return 0;
+}
+
+int aphex_condition_signal( AphexCondition *condition )
+{
+#ifdef USE_PTHREAD
+    if( condition != NULL )
+      pthread_cond_signal( &condition->cond );
+#endif
+    return 0;
+}
+
+int aphex_condition_broadcast( AphexCondition *condition )
+{
+#ifdef USE_PTHREAD
+    if( condition != NULL )
+      pthread_cond_broadcast( &condition->cond );
+#endif
+    return 0;
+}
+
+/***************************************************
+ * THREAD KEY
+ ***************************************************/
+/* The destructor is called with the thread's value when a thread that set one exits */
+AphexThreadKey *aphex_thread_key_create( void (*destructor)(void *) )
+{
+    AphexThreadKey *key = aphex_malloc(sizeof(AphexThreadKey));
+#ifdef USE_PTHREAD
+    if( pthread_key_create( &key->key, destructor ) != 0 )
+    {
+        aphex_free( key );
+        return NULL;
+    }
+#else
+    key->value = NULL;
+#endif
+    return key;
+}
+
+void aphex_thread_key_destroy( AphexThreadKey *key )
+{
+    if( key != NULL )
+    {
+#ifdef USE_PTHREAD
+        pthread_key_delete( key->key );
+#endif
+        aphex_free( key );
+    }
+}
+
+int aphex_thread_key_set( AphexThreadKey *key, void *value )
+{
+#ifdef USE_PTHREAD
+    if( key == NULL || pthread_setspecific( key->key, value ) != 0 )
+      return -1;
+#else
+    key->value = value;
+#endif
+    return 0;
+}
+
+void *aphex_thread_key_get( AphexThreadKey *key )
+{
+    if( key == NULL )
+      return NULL;
+#ifdef USE_PTHREAD
+    return pthread_getspecific( key->key );
+#else
+    return key->value;
+#endif
+}
+
 /***************************************************
  * EVENT
  ***************************************************/
@@ -387,7 +710,9 @@ void aphex_event_destroy( AphexEvent *event )
 int aphex_event_signal( AphexEvent *event )
 {
 #ifdef USE_PTHREAD
+    pthread_mutex_lock(&(event->mutex));
     pthread_cond_signal(&(event->cond));
+    pthread_mutex_unlock(&(event->mutex));
 #endif
     return 0;
 }
@@ -395,7 +720,10 @@ int aphex_event_signal( AphexEvent *event )
 int aphex_event_wait( AphexEvent *event )
 {
 #ifdef USE_PTHREAD
+    /* The condition has to be waited on with its mutex held */
+    pthread_mutex_lock(&(event->mutex));
     pthread_cond_wait(&(event->cond), &(event->mutex));
+    pthread_mutex_unlock(&(event->mutex));
 #endif
     return 0;
 }
@@ -464,7 +792,9 @@ int aphex_event_timedwait( AphexEvent *event , int seconds)
     ts.tv_nsec = tp.tv_usec * 1000;
     ts.tv_sec += seconds;
 
+    pthread_mutex_lock(&(event->mutex));
     t_ret = pthread_cond_timedwait(&(event->cond), &(event->mutex), &ts);
+    pthread_mutex_unlock(&(event->mutex));
 #endif
     
     if (t_ret != 0)
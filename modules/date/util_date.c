@@ -62,7 +62,7 @@ int system_sync_to_tm( struct FeTm *Tm, struct tm *tm )
     tm->tm_yday  = VAI(Tm->tm_yday);
     tm->tm_isdst = VAI(Tm->tm_isdst);
 #if !defined(USING_SOLARIS) && !defined(USING_CYGWIN) && !defined(USING_MINGW)
-    tm->tm_zone  = VAS(Tm->tm_zone)->data;
+    tm->tm_zone  = FE_STR2PTR(Tm->tm_zone);
     tm->tm_gmtoff = VAI(Tm->tm_gmtoff);
 #endif
     return 0;
@@ -1,5 +1,8 @@
 ipc_LIBS=""
 ipc_CFLAGS="-I../../"
+
+dnl shm_open lives in librt on older glibc
+AC_CHECK_LIB(rt, shm_open, ipc_LIBS="-lrt")
 AC_SUBST(ipc_LIBS)
 AC_SUBST(ipc_CFLAGS)
 
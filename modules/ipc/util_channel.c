@@ -0,0 +1,452 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross, Stephan Engstrom, Alex Holden et al
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../../config.h"
+#include "util_channel.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+# include <linux/futex.h>
+# include <sys/syscall.h>
+#endif
+
+#define ipc_relaxed( p )       __atomic_load_n( (p), __ATOMIC_RELAXED )
+#define ipc_load( p )          __atomic_load_n( (p), __ATOMIC_ACQUIRE )
+#define ipc_store( p, v )      __atomic_store_n( (p), (v), __ATOMIC_RELEASE )
+#define ipc_cas( p, e, v )     __atomic_compare_exchange_n( (p), (e), (v), 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED )
+#define ipc_inc( p )           __atomic_add_fetch( (p), 1, __ATOMIC_SEQ_CST )
+#define ipc_dec( p )           __atomic_sub_fetch( (p), 1, __ATOMIC_SEQ_CST )
+#define ipc_slot( c, pos )     ((IpcChannelSlot*)((c)->slots + ((pos) & ((c)->header->capacity - 1)) * (c)->header->stride))
+
+/* POSIX wants shared memory object names to start with a single slash */
+static char *ipc_channel_name( char *name )
+{
+    char *n = fmalloc_ngc( strlen(name) + 2 );
+    sprintf( n, "%s%s", (name[0] == '/' ? "" : "/"), name );
+    return n;
+}
+
+static IpcChannel *ipc_channel_map( char *name, int fd, size_t size )
+{
+    IpcChannel *c = NULL;
+    void *mem = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+
+    if( mem == MAP_FAILED )
+      return NULL;
+
+    c = fmalloc_ngc( sizeof(IpcChannel) );
+    c->name = name;
+    c->mapped_size = size;
+    c->header = mem;
+    c->slots = (char*)mem + sizeof(IpcChannelHeader);
+    return c;
+}
+
+/* deadline is absolute on CLOCK_MONOTONIC, NULL means wait for ever */
+static void ipc_channel_deadline( struct timespec *deadline, long timeout )
+{
+    clock_gettime( CLOCK_MONOTONIC, deadline );
+    deadline->tv_sec += timeout / 1000;
+    deadline->tv_nsec += (timeout % 1000) * 1000000;
+    if( deadline->tv_nsec >= 1000000000 )
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/* returns 0 when the word changed (or we were woken) and -1 on timeout */
+static int ipc_channel_wait( unsigned int *word, unsigned int value, struct timespec *deadline )
+{
+    struct timespec now, left, *wait = NULL;
+
+    if( deadline != NULL )
+    {
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        left.tv_sec = deadline->tv_sec - now.tv_sec;
+        left.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if( left.tv_nsec < 0 )
+        {
+            left.tv_sec--;
+            left.tv_nsec += 1000000000;
+        }
+        if( left.tv_sec < 0 )
+          return -1;
+        wait = &left;
+    }
+#ifdef __linux__
+    /* not FUTEX_PRIVATE: the word lives in memory shared between processes */
+    if( syscall( SYS_futex, word, FUTEX_WAIT, value, wait, NULL, 0 ) == -1 && errno == ETIMEDOUT )
+      return -1;
+#else
+    /* no futex: poll the word at a modest rate */
+    if( ipc_load( word ) == value )
+    {
+        struct timespec nap = { 0, 100000 };
+        nanosleep( &nap, NULL );
+    }
+#endif
+    return 0;
+}
+
+static void ipc_channel_wake( unsigned int *word )
+{
+#ifdef __linux__
+    syscall( SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0 );
+#endif
+}
+
+/**
+ * @function ipc_channel_create
+ * @declaration IpcChannel *ipc_channel_create( char *name, size_t capacity, size_t slot_size, int mode )
+ * @brief Create a channel, or attach to it if it already exists
+ * @param char *name The name of the shared memory object
+ * @param size_t capacity The number of messages the ring can hold, rounded up to a power of two
+ * @param size_t slot_size The largest message that can be sent
+ * @param int mode IPC_CHANNEL_SPSC or IPC_CHANNEL_MPMC
+ * @return The channel or NULL with errno set
+ * @description The capacity and slot size must both be between 1 and IPC_CHANNEL_MAX_SIZE,
+ *              and the mode one of the two above, otherwise errno is set to EINVAL.
+ */
+IpcChannel *ipc_channel_create( char *name, size_t capacity, size_t slot_size, int mode )
+{
+    IpcChannelHeader *h = NULL;
+    IpcChannelSlot *slot = NULL;
+    IpcChannel *c = NULL;
+    char *n = ipc_channel_name( name );
+    size_t slots = 2, stride = 0, i = 0;
+    int fd = -1, saved = 0;
+
+    if( capacity < 1 || capacity > IPC_CHANNEL_MAX_SIZE || slot_size < 1 || slot_size > IPC_CHANNEL_MAX_SIZE ||
+        (mode != IPC_CHANNEL_SPSC && mode != IPC_CHANNEL_MPMC) )
+    {
+        ffree_ngc( n );
+        errno = EINVAL;
+        return NULL;
+    }
+    while( slots < capacity )
+      slots <<= 1;
+    stride = (offsetof(IpcChannelSlot, data) + slot_size + 7) & ~((size_t)7);
+
+    fd = shm_open( n, O_RDWR | O_CREAT | O_EXCL, 0666 );
+    if( fd == -1 )
+    {
+        ffree_ngc( n );
+        return (errno == EEXIST ? ipc_channel_open( name ) : NULL);
+    }
+
+    if( ftruncate( fd, sizeof(IpcChannelHeader) + slots * stride ) == -1 ||
+        (c = ipc_channel_map( n, fd, sizeof(IpcChannelHeader) + slots * stride )) == NULL )
+    {
+        saved = errno;
+        close( fd );
+        shm_unlink( n );
+        ffree_ngc( n );
+        errno = saved;
+        return NULL;
+    }
+    close( fd );
+
+    h = c->header;
+    h->mode = mode;
+    h->capacity = slots;
+    h->slot_size = slot_size;
+    h->stride = stride;
+    for( i = 0; i < slots; i++ )
+    {
+        slot = ipc_slot( c, i );
+        slot->sequence = i;
+    }
+    /* publishing the magic number is what lets openers use the ring */
+    ipc_store( &h->magic, IPC_CHANNEL_MAGIC );
+    return c;
+}
+
+/**
+ * @function ipc_channel_open
+ * @declaration IpcChannel *ipc_channel_open( char *name )
+ * @brief Attach to an existing channel
+ * @param char *name The name of the shared memory object
+ * @return The channel or NULL with errno set
+ */
+IpcChannel *ipc_channel_open( char *name )
+{
+    IpcChannel *c = NULL;
+    struct stat st;
+    char *n = ipc_channel_name( name );
+    int fd = shm_open( n, O_RDWR, 0666 ), tries = 0, saved = 0;
+
+    if( fd == -1 )
+    {
+        ffree_ngc( n );
+        return NULL;
+    }
+
+    /* the creator may still be sizing and initialising the object */
+    for( tries = 0; tries < 1000; tries++ )
+    {
+        if( fstat( fd, &st ) == -1 )
+          break;
+        if( (size_t)st.st_size >= sizeof(IpcChannelHeader) )
+        {
+            if( c == NULL && (c = ipc_channel_map( n, fd, st.st_size )) == NULL )
+              break;
+            if( ipc_load( &c->header->magic ) == IPC_CHANNEL_MAGIC )
+            {
+                close( fd );
+                return c;
+            }
+        }
+        sched_yield();
+    }
+
+    saved = (tries == 1000 ? EAGAIN : errno);
+    close( fd );
+    if( c != NULL )
+    {
+        ipc_channel_close( c );
+    }
+    else
+      ffree_ngc( n );
+    errno = saved;
+    return NULL;
+}
+
+/**
+ * @function ipc_channel_close
+ * @declaration void ipc_channel_close( IpcChannel *c )
+ * @brief Detach from a channel, the shared memory object itself is left alone
+ * @param IpcChannel *c The channel
+ */
+void ipc_channel_close( IpcChannel *c )
+{
+    if( c != NULL )
+    {
+        munmap( (void*)c->header, c->mapped_size );
+        ffree_ngc( c->name );
+        ffree_ngc( c );
+    }
+}
+
+/**
+ * @function ipc_channel_unlink
+ * @declaration int ipc_channel_unlink( char *name )
+ * @brief Remove the name of a channel, attached processes keep their mapping
+ * @param char *name The name of the shared memory object
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int ipc_channel_unlink( char *name )
+{
+    char *n = ipc_channel_name( name );
+    int retval = shm_unlink( n );
+    ffree_ngc( n );
+    return retval;
+}
+
+static int ipc_channel_try_send( IpcChannel *c, char *data, size_t length )
+{
+    IpcChannelHeader *h = c->header;
+    IpcChannelSlot *slot = NULL;
+    unsigned long pos = ipc_relaxed( &h->head ), sequence = 0;
+    long diff = 0;
+
+    for( ;; )
+    {
+        slot = ipc_slot( c, pos );
+        sequence = ipc_load( &slot->sequence );
+        diff = (long)(sequence - pos);
+        if( diff == 0 )
+        {
+            /* with a single producer nobody can race us for the slot */
+            if( h->mode == IPC_CHANNEL_SPSC )
+            {
+                __atomic_store_n( &h->head, pos + 1, __ATOMIC_RELAXED );
+                break;
+            }
+            if( ipc_cas( &h->head, &pos, pos + 1 ) )
+              break;
+        }
+        else if( diff < 0 )
+          return 0; /* full */
+        else
+          pos = ipc_relaxed( &h->head );
+    }
+
+    memcpy( slot->data, data, length );
+    slot->length = length;
+    ipc_store( &slot->sequence, pos + 1 );
+
+    ipc_inc( &h->not_empty );
+    if( ipc_load( &h->readers_waiting ) )
+      ipc_channel_wake( &h->not_empty );
+    return 1;
+}
+
+static int ipc_channel_try_receive( FeriteScript *script, IpcChannel *c, FeriteVariable **result )
+{
+    IpcChannelHeader *h = c->header;
+    IpcChannelSlot *slot = NULL;
+    unsigned long pos = ipc_relaxed( &h->tail ), sequence = 0;
+    long diff = 0;
+
+    for( ;; )
+    {
+        slot = ipc_slot( c, pos );
+        sequence = ipc_load( &slot->sequence );
+        diff = (long)(sequence - (pos + 1));
+        if( diff == 0 )
+        {
+            if( h->mode == IPC_CHANNEL_SPSC )
+            {
+                __atomic_store_n( &h->tail, pos + 1, __ATOMIC_RELAXED );
+                break;
+            }
+            if( ipc_cas( &h->tail, &pos, pos + 1 ) )
+              break;
+        }
+        else if( diff < 0 )
+          return 0; /* empty */
+        else
+          pos = ipc_relaxed( &h->tail );
+    }
+
+    *result = fe_new_bin_str( "IPCChannel::receive", slot->data, slot->length, FE_CHARSET_DEFAULT );
+    ipc_store( &slot->sequence, pos + h->capacity );
+
+    ipc_inc( &h->not_full );
+    if( ipc_load( &h->writers_waiting ) )
+      ipc_channel_wake( &h->not_full );
+    return 1;
+}
+
+/**
+ * @function ipc_channel_send
+ * @declaration int ipc_channel_send( IpcChannel *c, char *data, size_t length, long timeout )
+ * @brief Copy a message into the ring
+ * @param IpcChannel *c The channel
+ * @param char *data The message
+ * @param size_t length The length of the message
+ * @param long timeout Milliseconds to wait for space; 0 does not wait, a negative value waits for ever
+ * @return 1 when sent, 0 when the ring stayed full (errno is EAGAIN or ETIMEDOUT), -1 when the message is too big
+ */
+int ipc_channel_send( IpcChannel *c, char *data, size_t length, long timeout )
+{
+    IpcChannelHeader *h = c->header;
+    struct timespec deadline;
+    unsigned int seen = 0;
+
+    if( length > h->slot_size )
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if( timeout > 0 )
+      ipc_channel_deadline( &deadline, timeout );
+
+    for( ;; )
+    {
+        /* sample the futex word before looking so a receive in between is not lost */
+        seen = ipc_load( &h->not_full );
+        if( ipc_channel_try_send( c, data, length ) )
+          return 1;
+        if( timeout == 0 )
+        {
+            errno = EAGAIN;
+            return 0;
+        }
+        ipc_inc( &h->writers_waiting );
+        if( ipc_channel_wait( &h->not_full, seen, (timeout > 0 ? &deadline : NULL) ) == -1 )
+        {
+            ipc_dec( &h->writers_waiting );
+            errno = ETIMEDOUT;
+            return 0;
+        }
+        ipc_dec( &h->writers_waiting );
+    }
+}
+
+/**
+ * @function ipc_channel_receive
+ * @declaration int ipc_channel_receive( FeriteScript *script, IpcChannel *c, FeriteVariable **result, long timeout )
+ * @brief Take the oldest message out of the ring
+ * @param FeriteScript *script The script
+ * @param IpcChannel *c The channel
+ * @param FeriteVariable **result Where to put the string variable holding the message
+ * @param long timeout Milliseconds to wait for a message; 0 does not wait, a negative value waits for ever
+ * @return 1 when a message was received, 0 otherwise (errno is EAGAIN or ETIMEDOUT)
+ */
+int ipc_channel_receive( FeriteScript *script, IpcChannel *c, FeriteVariable **result, long timeout )
+{
+    IpcChannelHeader *h = c->header;
+    struct timespec deadline;
+    unsigned int seen = 0;
+
+    if( timeout > 0 )
+      ipc_channel_deadline( &deadline, timeout );
+
+    for( ;; )
+    {
+        seen = ipc_load( &h->not_empty );
+        if( ipc_channel_try_receive( script, c, result ) )
+          return 1;
+        if( timeout == 0 )
+        {
+            errno = EAGAIN;
+            return 0;
+        }
+        ipc_inc( &h->readers_waiting );
+        if( ipc_channel_wait( &h->not_empty, seen, (timeout > 0 ? &deadline : NULL) ) == -1 )
+        {
+            ipc_dec( &h->readers_waiting );
+            errno = ETIMEDOUT;
+            return 0;
+        }
+        ipc_dec( &h->readers_waiting );
+    }
+}
+
+/**
+ * @function ipc_channel_pending
+ * @declaration long ipc_channel_pending( IpcChannel *c )
+ * @brief An estimate of the number of messages in the ring
+ * @param IpcChannel *c The channel
+ * @return The number of messages sent but not yet received
+ */
+long ipc_channel_pending( IpcChannel *c )
+{
+    unsigned long tail = ipc_load( &c->header->tail );
+    unsigned long head = ipc_load( &c->header->head );
+    long diff = (long)(head - tail);
+    return (diff < 0 ? 0 : diff);
+}
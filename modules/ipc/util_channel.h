@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross, Stephan Engstrom, Alex Holden et al
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_UTIL_CHANNEL__
+#define __FERITE_UTIL_CHANNEL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "ferite.h"
+
+/*
+ * An IPCChannel is a bounded ring of fixed size slots living in a POSIX
+ * shared memory object. Every slot carries a sequence number (Vyukov's
+ * bounded queue) so that producers and consumers only ever touch the
+ * head/tail counters and the slot they own -- there is no lock on the fast
+ * path. Blocking is done on two futex words which are bumped on every
+ * send/receive and only woken when somebody is actually asleep on them.
+ */
+#define IPC_CHANNEL_MAGIC      0x46524e47 /* 'FRNG' */
+#define IPC_CHANNEL_SPSC       0
+#define IPC_CHANNEL_MPMC       1
+#define IPC_CHANNEL_CACHELINE  64
+#define IPC_CHANNEL_MAX_SIZE   (1 << 30)  /* largest capacity and slot size accepted */
+
+#define ChannelObj ((IpcChannel*)(self->odata))
+
+typedef struct ipc_channel_header
+{
+    unsigned int magic;
+    unsigned int mode;
+    unsigned int capacity;      /* number of slots, always a power of two */
+    unsigned int slot_size;     /* bytes of payload a slot can hold */
+    unsigned int stride;        /* bytes between two slots */
+    char pad0[IPC_CHANNEL_CACHELINE - 5 * sizeof(unsigned int)];
+
+    unsigned long head;         /* next position to enqueue */
+    char pad1[IPC_CHANNEL_CACHELINE - sizeof(unsigned long)];
+    unsigned long tail;         /* next position to dequeue */
+    char pad2[IPC_CHANNEL_CACHELINE - sizeof(unsigned long)];
+
+    unsigned int not_empty;     /* futex word, bumped on every send */
+    unsigned int readers_waiting;
+    unsigned int not_full;      /* futex word, bumped on every receive */
+    unsigned int writers_waiting;
+    char pad3[IPC_CHANNEL_CACHELINE - 4 * sizeof(unsigned int)];
+}
+IpcChannelHeader;
+
+typedef struct ipc_channel_slot
+{
+    unsigned long sequence;
+    unsigned int length;
+    unsigned int reserved;
+    char data[1];
+}
+IpcChannelSlot;
+
+typedef struct ipc_channel
+{
+    char *name;
+    size_t mapped_size;
+    IpcChannelHeader *header;
+    char *slots;
+}
+IpcChannel;
+
+IpcChannel *ipc_channel_create( char *name, size_t capacity, size_t slot_size, int mode );
+IpcChannel *ipc_channel_open( char *name );
+void ipc_channel_close( IpcChannel *c );
+int ipc_channel_unlink( char *name );
+
+int ipc_channel_send( IpcChannel *c, char *data, size_t length, long timeout );
+int ipc_channel_receive( FeriteScript *script, IpcChannel *c, FeriteVariable **result, long timeout );
+long ipc_channel_pending( IpcChannel *c );
+
+#endif /* __FERITE_UTIL_CHANNEL__ */
@@ -0,0 +1,6 @@
+json_LIBS=""
+json_CFLAGS=""
+AC_SUBST(json_LIBS)
+AC_SUBST(json_CFLAGS)
+
+modules="$modules json"
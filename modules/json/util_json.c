@@ -0,0 +1,982 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross, Stephan Engstrom, Alex Holden et al
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../../config.h"
+#include "util_json.h"
+#include <math.h>
+
+#define JSON_LONG_DIGITS  (sizeof(long) >= 8 ? 18 : 9)   /* digits that always fit in a long */
+#define JSON_MAX_TEXT     0xFFFFFFFFUL                   /* positions in the index are 32 bit */
+
+typedef struct json_decoder
+{
+    FeriteScript *script;
+    const char *data;
+    size_t length;
+    uint32_t *positions;
+    size_t next;
+    size_t count;
+    size_t offset;             /* where data is in the whole document, for messages */
+    size_t last;               /* just past the last value decoded */
+
+    char *scratch;             /* unescaped strings and the keys of the objects being built */
+    size_t scratch_used;
+    size_t scratch_size;
+    int failed;
+}
+JsonDecoder;
+
+/*
+ * Decoding
+ */
+static void json_decoder_init( JsonDecoder *d, FeriteScript *script, const char *data, size_t length, JsonIndex *index, size_t next, size_t offset )
+{
+    d->script = script;
+    d->data = data;
+    d->length = length;
+    d->positions = index->positions;
+    d->next = next;
+    d->count = index->count;
+    d->offset = offset;
+    d->last = 0;
+    d->scratch = NULL;
+    d->scratch_used = d->scratch_size = 0;
+    d->failed = 0;
+}
+
+static void json_decoder_deinit( JsonDecoder *d )
+{
+    FeriteScript *script = d->script;
+
+    if( d->scratch != NULL )
+      ffree( d->scratch );
+}
+
+static FeriteVariable *json_fail( JsonDecoder *d, size_t position, char *message )
+{
+    FeriteScript *script = d->script;
+
+    if( !d->failed )
+      ferite_error( script, 0, "Unable to decode JSON: %s at offset %lu\n", message, (unsigned long)(d->offset + position) );
+    d->failed = 1;
+    return NULL;
+}
+
+static char *json_scratch( JsonDecoder *d, size_t more )
+{
+    FeriteScript *script = d->script;
+
+    if( d->scratch_used + more > d->scratch_size )
+    {
+        while( d->scratch_used + more > d->scratch_size )
+          d->scratch_size = (d->scratch_size == 0 ? 256 : d->scratch_size * 2);
+        if( d->scratch == NULL )
+          d->scratch = fmalloc( d->scratch_size );
+        else
+          d->scratch = frealloc( d->scratch, d->scratch_size );
+    }
+    return d->scratch + d->scratch_used;
+}
+
+/* Whether a number or literal may stop here */
+static int json_delimiter_char( char c )
+{
+    switch( c )
+    {
+        case ' ': case '\t': case '\r': case '\n':
+        case ',': case ':': case '[': case ']': case '{': case '}': case '"':
+            return 1;
+    }
+    return 0;
+}
+
+static int json_delimiter( JsonDecoder *d, size_t p )
+{
+    return (p >= d->length || json_delimiter_char( d->data[p] ));
+}
+
+static long json_hex( const char *p )
+{
+    long value = 0;
+    int i;
+
+    for( i = 0; i < 4; i++ )
+    {
+        value <<= 4;
+        if( p[i] >= '0' && p[i] <= '9' )
+          value |= p[i] - '0';
+        else if( (p[i] | 0x20) >= 'a' && (p[i] | 0x20) <= 'f' )
+          value |= (p[i] | 0x20) - 'a' + 10;
+        else
+          return -1;
+    }
+    return value;
+}
+
+/*
+ * Find the end of the string whose opening quote is at pos. If it has no
+ * escapes in it the text is used where it is, otherwise it is unescaped into
+ * the scratch space, which is left with scratch_used pointing at the result.
+ */
+static int json_scan_string( JsonDecoder *d, size_t pos, const char **text, size_t *length )
+{
+    const char *data = d->data;
+    size_t p = pos + 1, end;
+    unsigned char c;
+    int escaped = 0;
+    char *out, *start;
+    long code, low;
+
+    for( ; p < d->length; p++ )
+    {
+        c = (unsigned char)data[p];
+        if( c == '"' )
+          break;
+        if( c == '\\' )
+        {
+            escaped = 1;
+            p++;
+        }
+        else if( c < 0x20 )
+        {
+            json_fail( d, p, "control character in string" );
+            return 0;
+        }
+    }
+    if( p >= d->length )
+    {
+        json_fail( d, pos, "unterminated string" );
+        return 0;
+    }
+    end = p;
+    d->last = end + 1;
+    if( !escaped )
+    {
+        *text = data + pos + 1;
+        *length = end - pos - 1;
+        return 1;
+    }
+
+    /* What comes out is never longer than what went in */
+    start = out = json_scratch( d, end - pos );
+    for( p = pos + 1; p < end; p++ )
+    {
+        if( data[p] != '\\' )
+        {
+            *out++ = data[p];
+            continue;
+        }
+        switch( data[++p] )
+        {
+            case '"':  *out++ = '"';  break;
+            case '\\': *out++ = '\\'; break;
+            case '/':  *out++ = '/';  break;
+            case 'b':  *out++ = '\b'; break;
+            case 'f':  *out++ = '\f'; break;
+            case 'n':  *out++ = '\n'; break;
+            case 'r':  *out++ = '\r'; break;
+            case 't':  *out++ = '\t'; break;
+            case 'u':
+                if( p + 4 >= end || (code = json_hex( data + p + 1 )) < 0 )
+                {
+                    json_fail( d, p - 1, "bad \\u escape" );
+                    return 0;
+                }
+                p += 4;
+                if( code >= 0xD800 && code <= 0xDBFF )
+                {
+                    if( p + 6 >= end || data[p + 1] != '\\' || data[p + 2] != 'u' ||
+                        (low = json_hex( data + p + 3 )) < 0xDC00 || low > 0xDFFF )
+                    {
+                        json_fail( d, p - 5, "unpaired surrogate" );
+                        return 0;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                else if( code >= 0xDC00 && code <= 0xDFFF )
+                {
+                    json_fail( d, p - 5, "unpaired surrogate" );
+                    return 0;
+                }
+                /* UTF-8: at most four bytes for the six or twelve they came from */
+                if( code < 0x80 )
+                  *out++ = (char)code;
+                else if( code < 0x800 )
+                {
+                    *out++ = (char)(0xC0 | (code >> 6));
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                }
+                else if( code < 0x10000 )
+                {
+                    *out++ = (char)(0xE0 | (code >> 12));
+                    *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    *out++ = (char)(0xF0 | (code >> 18));
+                    *out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+                    *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            default:
+                json_fail( d, p - 1, "bad escape in string" );
+                return 0;
+        }
+    }
+    *text = start;
+    *length = out - start;
+    return 1;
+}
+
+static FeriteVariable *json_number( JsonDecoder *d, size_t pos )
+{
+    FeriteScript *script = d->script;
+    const char *data = d->data;
+    size_t p = pos, digits;
+    int integral = 1;
+    long value = 0;
+
+    if( data[p] == '-' )
+      p++;
+    if( p < d->length && data[p] == '0' )
+      p++;
+    else if( p < d->length && data[p] >= '1' && data[p] <= '9' )
+    {
+        while( p < d->length && data[p] >= '0' && data[p] <= '9' )
+          p++;
+    }
+    else
+      return json_fail( d, pos, "bad number" );
+    digits = p - pos - (data[pos] == '-');
+
+    if( p < d->length && data[p] == '.' )
+    {
+        integral = 0;
+        if( ++p >= d->length || data[p] < '0' || data[p] > '9' )
+          return json_fail( d, pos, "bad number" );
+        while( p < d->length && data[p] >= '0' && data[p] <= '9' )
+          p++;
+    }
+    if( p < d->length && (data[p] | 0x20) == 'e' )
+    {
+        integral = 0;
+        if( ++p < d->length && (data[p] == '+' || data[p] == '-') )
+          p++;
+        if( p >= d->length || data[p] < '0' || data[p] > '9' )
+          return json_fail( d, pos, "bad number" );
+        while( p < d->length && data[p] >= '0' && data[p] <= '9' )
+          p++;
+    }
+    if( !json_delimiter( d, p ) )
+      return json_fail( d, pos, "bad number" );
+    d->last = p;
+
+    if( integral && digits <= JSON_LONG_DIGITS )
+    {
+        size_t i;
+
+        for( i = pos + (data[pos] == '-'); i < p; i++ )
+          value = value * 10 + (data[i] - '0');
+        return ferite_create_number_long_variable( script, "", (data[pos] == '-' ? -value : value), FE_STATIC );
+    }
+    return ferite_create_number_double_variable( script, "", strtod( data + pos, NULL ), FE_STATIC );
+}
+
+static int json_literal( JsonDecoder *d, size_t pos, char *word, size_t length )
+{
+    if( pos + length > d->length || memcmp( d->data + pos, word, length ) != 0 || !json_delimiter( d, pos + length ) )
+    {
+        json_fail( d, pos, "unexpected character" );
+        return 0;
+    }
+    d->last = pos + length;
+    return 1;
+}
+
+static FeriteVariable *json_value( JsonDecoder *d, int depth );
+
+static FeriteVariable *json_array( JsonDecoder *d, size_t pos, int depth )
+{
+    FeriteScript *script = d->script;
+    FeriteVariable *v = NULL, *item = NULL;
+    char c;
+
+    if( depth >= JSON_MAX_DEPTH )
+      return json_fail( d, pos, "too deeply nested" );
+    v = ferite_create_uarray_variable( script, "", 0, FE_STATIC );
+    if( d->next < d->count && d->data[d->positions[d->next]] == ']' )
+    {
+        d->last = d->positions[d->next++] + 1;
+        return v;
+    }
+    for( ;; )
+    {
+        if( (item = json_value( d, depth + 1 )) == NULL )
+          break;
+        ferite_uarray_add( script, VAUA(v), item, NULL, FE_ARRAY_ADD_AT_END );
+        if( d->next >= d->count )
+        {
+            json_fail( d, d->length, "unexpected end of text" );
+            break;
+        }
+        pos = d->positions[d->next++];
+        c = d->data[pos];
+        if( c == ']' )
+        {
+            d->last = pos + 1;
+            return v;
+        }
+        if( c != ',' )
+        {
+            json_fail( d, pos, "expected ',' or ']'" );
+            break;
+        }
+    }
+    ferite_variable_destroy( script, v );
+    return NULL;
+}
+
+static FeriteVariable *json_object( JsonDecoder *d, size_t pos, int depth )
+{
+    FeriteScript *script = d->script;
+    FeriteVariable *v = NULL, *item = NULL;
+    const char *text;
+    size_t length, key;
+    char *scratch, c;
+
+    if( depth >= JSON_MAX_DEPTH )
+      return json_fail( d, pos, "too deeply nested" );
+    v = ferite_create_uarray_variable( script, "", 0, FE_STATIC );
+    if( d->next < d->count && d->data[d->positions[d->next]] == '}' )
+    {
+        d->last = d->positions[d->next++] + 1;
+        return v;
+    }
+    for( ;; )
+    {
+        if( d->next >= d->count )
+        {
+            json_fail( d, d->length, "unexpected end of text" );
+            break;
+        }
+        pos = d->positions[d->next++];
+        if( d->data[pos] != '"' )
+        {
+            json_fail( d, pos, "expected a string key" );
+            break;
+        }
+        /* The key is kept in the scratch space, by offset as it may move, until the value is in.
+         * A key with escapes in it has been unescaped there already, with room left for the nul */
+        key = d->scratch_used;
+        if( !json_scan_string( d, pos, &text, &length ) )
+          break;
+        scratch = json_scratch( d, length + 1 );
+        memmove( scratch, text, length );
+        scratch[length] = '\0';
+        d->scratch_used += length + 1;
+
+        if( d->next >= d->count || d->data[d->positions[d->next]] != ':' )
+        {
+            json_fail( d, (d->next < d->count ? d->positions[d->next] : d->length), "expected ':'" );
+            break;
+        }
+        d->next++;
+        if( (item = json_value( d, depth + 1 )) == NULL )
+          break;
+
+        /* The last of a repeated key wins */
+        if( ferite_hash_get( script, VAUA(v)->hash, d->scratch + key ) != NULL )
+          ferite_uarray_delete_from_string( script, VAUA(v), d->scratch + key );
+        ferite_uarray_add( script, VAUA(v), item, d->scratch + key, FE_ARRAY_ADD_AT_END );
+        d->scratch_used = key;
+
+        if( d->next >= d->count )
+        {
+            json_fail( d, d->length, "unexpected end of text" );
+            break;
+        }
+        pos = d->positions[d->next++];
+        c = d->data[pos];
+        if( c == '}' )
+        {
+            d->last = pos + 1;
+            return v;
+        }
+        if( c != ',' )
+        {
+            json_fail( d, pos, "expected ',' or '}'" );
+            break;
+        }
+    }
+    ferite_variable_destroy( script, v );
+    return NULL;
+}
+
+static FeriteVariable *json_value( JsonDecoder *d, int depth )
+{
+    FeriteScript *script = d->script;
+    const char *text;
+    size_t pos, length;
+
+    if( d->next >= d->count )
+      return json_fail( d, d->length, "unexpected end of text" );
+    pos = d->positions[d->next++];
+    switch( d->data[pos] )
+    {
+        case '{':
+            return json_object( d, pos, depth );
+        case '[':
+            return json_array( d, pos, depth );
+        case '"':
+            if( !json_scan_string( d, pos, &text, &length ) )
+              return NULL;
+            return ferite_create_binary_string_variable_from_ptr( script, "", (char*)text, length, FE_CHARSET_DEFAULT, FE_STATIC );
+        case 't':
+            if( !json_literal( d, pos, "true", 4 ) )
+              return NULL;
+            return ferite_create_boolean_variable( script, "", FE_TRUE, FE_STATIC );
+        case 'f':
+            if( !json_literal( d, pos, "false", 5 ) )
+              return NULL;
+            return ferite_create_boolean_variable( script, "", FE_FALSE, FE_STATIC );
+        case 'n':
+            if( !json_literal( d, pos, "null", 4 ) )
+              return NULL;
+            return ferite_create_object_variable( script, "", FE_STATIC );
+        case '-': case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return json_number( d, pos );
+    }
+    return json_fail( d, pos, "unexpected character" );
+}
+
+/**
+ * Decode a whole document. Objects come back as keyed arrays, null as a null
+ * object and numbers as longs unless they have a fraction, an exponent or too
+ * many digits. Returns NULL with an error raised if the text is not JSON.
+ */
+FeriteVariable *json_decode( FeriteScript *script, char *data, size_t length )
+{
+    JsonIndexState state = { 0, 0, 0 };
+    JsonIndex index;
+    JsonDecoder d;
+    FeriteVariable *v = NULL;
+
+    if( length > JSON_MAX_TEXT )
+    {
+        ferite_error( script, 0, "Unable to decode JSON: the text is too long\n" );
+        return NULL;
+    }
+    json_index_init( &index );
+    json_index_text( &state, (const unsigned char *)data, length, 0, &index );
+    json_decoder_init( &d, script, data, length, &index, 0, 0 );
+    if( (v = json_value( &d, 0 )) != NULL && d.next < d.count )
+    {
+        ferite_variable_destroy( script, v );
+        v = json_fail( &d, d.positions[d.next], "unexpected text after the value" );
+    }
+    json_decoder_deinit( &d );
+    json_index_deinit( &index );
+    return v;
+}
+
+/*
+ * Encoding
+ */
+typedef struct json_output
+{
+    FeriteScript *script;
+    char *data;
+    size_t length;
+    size_t size;
+    int pretty;
+    int failed;
+}
+JsonOutput;
+
+/* For each byte, 0 if it goes out as it is, otherwise the letter after the backslash */
+static const char json_escape[256] = {
+    'u','u','u','u','u','u','u','u','b','t','n','u','f','r','u','u',
+    'u','u','u','u','u','u','u','u','u','u','u','u','u','u','u','u',
+    0,0,'"',0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,'\\',0,0,0
+};
+
+static char *json_reserve( JsonOutput *o, size_t more )
+{
+    FeriteScript *script = o->script;
+
+    if( o->length + more + 1 > o->size )
+    {
+        while( o->length + more + 1 > o->size )
+          o->size = (o->size == 0 ? 256 : o->size * 2);
+        if( o->data == NULL )
+          o->data = fmalloc( o->size );
+        else
+          o->data = frealloc( o->data, o->size );
+    }
+    return o->data + o->length;
+}
+
+static void json_put( JsonOutput *o, const char *text, size_t length )
+{
+    memcpy( json_reserve( o, length ), text, length );
+    o->length += length;
+}
+
+static void json_put_line( JsonOutput *o, int depth )
+{
+    char *p;
+
+    if( !o->pretty )
+      return;
+    p = json_reserve( o, 1 + depth * 4 );
+    *p = '\n';
+    memset( p + 1, ' ', depth * 4 );
+    o->length += 1 + depth * 4;
+}
+
+static void json_put_string( JsonOutput *o, const char *text, size_t length )
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *s = (const unsigned char *)text;
+    size_t i, run;
+    char *p;
+
+    json_put( o, "\"", 1 );
+    for( i = 0; i < length; )
+    {
+        /* Copy as much as can go out untouched in one go */
+        for( run = i; run < length && json_escape[s[run]] == 0; run++ )
+          ;
+        if( run > i )
+        {
+            json_put( o, text + i, run - i );
+            i = run;
+            continue;
+        }
+        p = json_reserve( o, 6 );
+        p[0] = '\\';
+        p[1] = json_escape[s[i]];
+        if( p[1] == 'u' )
+        {
+            p[2] = '0';
+            p[3] = '0';
+            p[4] = hex[s[i] >> 4];
+            p[5] = hex[s[i] & 0xF];
+            o->length += 6;
+        }
+        else
+          o->length += 2;
+        i++;
+    }
+    json_put( o, "\"", 1 );
+}
+
+static void json_put_double( JsonOutput *o, double value )
+{
+    char buf[40];
+    size_t length;
+
+    if( !isfinite( value ) )
+    {
+        json_put( o, "null", 4 );
+        return;
+    }
+    /* The shortest of the usual precisions that reads back as the same number */
+    snprintf( buf, sizeof(buf), "%.15g", value );
+    if( strtod( buf, NULL ) != value )
+      snprintf( buf, sizeof(buf), "%.17g", value );
+    length = strlen( buf );
+    /* Keep it a number with a fraction, so it decodes to a double again */
+    if( strpbrk( buf, ".eE" ) == NULL )
+    {
+        strcpy( buf + length, ".0" );
+        length += 2;
+    }
+    json_put( o, buf, length );
+}
+
+static int json_put_value( JsonOutput *o, FeriteVariable *v, int depth );
+
+static int json_put_member( JsonOutput *o, char *name, FeriteVariable *v, int depth, int first )
+{
+    if( !first )
+      json_put( o, ",", 1 );
+    json_put_line( o, depth );
+    json_put_string( o, name, strlen( name ) );
+    json_put( o, (o->pretty ? ": " : ":"), (o->pretty ? 2 : 1) );
+    return json_put_value( o, v, depth );
+}
+
+static int json_put_array( JsonOutput *o, FeriteUnifiedArray *array, int depth )
+{
+    char index[32];
+    long i;
+    int keyed = 0;
+
+    ferite_uarray_resolve( o->script, array );
+    for( i = 0; i < array->size && !keyed; i++ )
+      keyed = (array->array[i]->vname != NULL && array->array[i]->vname[0] != '\0');
+
+    json_put( o, (keyed ? "{" : "["), 1 );
+    for( i = 0; i < array->size; i++ )
+    {
+        FeriteVariable *item = array->array[i];
+
+        if( keyed )
+        {
+            /* Anything without a key in an array that has some is keyed by where it is */
+            char *name = item->vname;
+
+            if( name == NULL || name[0] == '\0' )
+            {
+                snprintf( index, sizeof(index), "%ld", i );
+                name = index;
+            }
+            if( !json_put_member( o, name, item, depth + 1, (i == 0) ) )
+              return 0;
+            continue;
+        }
+        if( i > 0 )
+          json_put( o, ",", 1 );
+        json_put_line( o, depth + 1 );
+        if( !json_put_value( o, item, depth + 1 ) )
+          return 0;
+    }
+    if( array->size > 0 )
+      json_put_line( o, depth );
+    json_put( o, (keyed ? "}" : "]"), 1 );
+    return 1;
+}
+
+static int json_put_object( JsonOutput *o, FeriteObject *obj, int depth )
+{
+    FeriteScript *script = o->script;
+    FeriteObjectVariable *obv = NULL;
+    FeriteIterator iter;
+    FeriteHashBucket *buk;
+    int first = 1;
+
+    json_put( o, "{", 1 );
+    for( obv = obj->variables; obv != NULL; obv = obv->parent )
+    {
+        memset( &iter, 0, sizeof(FeriteIterator) );
+        while( (buk = ferite_hash_walk( script, obv->variables, &iter )) != NULL )
+        {
+            if( !json_put_member( o, buk->id, (FeriteVariable*)buk->data, depth + 1, first ) )
+              return 0;
+            first = 0;
+        }
+    }
+    if( !first )
+      json_put_line( o, depth );
+    json_put( o, "}", 1 );
+    return 1;
+}
+
+static int json_put_value( JsonOutput *o, FeriteVariable *v, int depth )
+{
+    FeriteScript *script = o->script;
+    char buf[32];
+
+    if( depth >= JSON_MAX_DEPTH )
+    {
+        ferite_error( script, 0, "Unable to encode JSON: the value is too deeply nested, or refers to itself\n" );
+        return 0;
+    }
+    switch( F_VAR_TYPE(v) )
+    {
+        case F_VAR_VOID:
+            json_put( o, "null", 4 );
+            return 1;
+        case F_VAR_BOOL:
+            if( VAB(v) )
+              json_put( o, "true", 4 );
+            else
+              json_put( o, "false", 5 );
+            return 1;
+        case F_VAR_LONG:
+            snprintf( buf, sizeof(buf), "%ld", VAI(v) );
+            json_put( o, buf, strlen( buf ) );
+            return 1;
+        case F_VAR_DOUBLE:
+            json_put_double( o, VAF(v) );
+            return 1;
+        case F_VAR_STR:
+            json_put_string( o, VAS(v)->data, VAS(v)->length );
+            return 1;
+        case F_VAR_UARRAY:
+            return json_put_array( o, VAUA(v), depth );
+        case F_VAR_OBJ:
+            if( VAO(v) == NULL )
+            {
+                json_put( o, "null", 4 );
+                return 1;
+            }
+            return json_put_object( o, VAO(v), depth );
+    }
+    ferite_error( script, 0, "Unable to encode a variable of type '%s' as JSON\n", ferite_variable_id_to_str( script, F_VAR_TYPE(v) ) );
+    return 0;
+}
+
+/**
+ * Encode a value as JSON text, laid out over several lines if pretty is set.
+ * Returns NULL with an error raised if it holds something JSON has no way of
+ * saying, such as a class, or if it refers to itself.
+ */
+FeriteVariable *json_encode( FeriteScript *script, FeriteVariable *value, int pretty )
+{
+    JsonOutput o;
+    FeriteVariable *v = NULL;
+
+    o.script = script;
+    o.data = NULL;
+    o.length = o.size = 0;
+    o.pretty = pretty;
+    o.failed = 0;
+    if( !json_put_value( &o, value, 0 ) )
+    {
+        if( o.data != NULL )
+          ffree( o.data );
+        return NULL;
+    }
+    /* Handed over to the string without copying it */
+    json_reserve( &o, 0 );
+    o.data[o.length] = '\0';
+    v = ferite_create_string_variable_from_ptr( script, "json", NULL, 0, FE_CHARSET_DEFAULT, FE_STATIC );
+    ffree( VAS(v)->data );
+    VAS(v)->data = o.data;
+    VAS(v)->length = o.length;
+    return v;
+}
+
+/*
+ * Incremental decoding
+ */
+JsonParser *json_parser_create()
+{
+    JsonParser *parser = fmalloc_ngc( sizeof(JsonParser) );
+
+    parser->size = 4096;
+    parser->data = fmalloc_ngc( parser->size + 1 );
+    json_index_init( &parser->index );
+    json_parser_reset( parser );
+    return parser;
+}
+
+void json_parser_destroy( JsonParser *parser )
+{
+    json_index_deinit( &parser->index );
+    ffree_ngc( parser->data );
+    ffree_ngc( parser );
+}
+
+/* Forget everything fed so far, keeping the memory */
+void json_parser_reset( JsonParser *parser )
+{
+    parser->data[0] = '\0';
+    parser->length = 0;
+    parser->consumed = 0;
+    parser->start = 0;
+    memset( &parser->state, 0, sizeof(JsonIndexState) );
+    parser->indexed = 0;
+    parser->index.count = 0;
+    parser->next = 0;
+    parser->scan = 0;
+    parser->depth = 0;
+}
+
+/*
+ * Look for the entry that closes the container opened by the entry at next.
+ * Entries from whole blocks do not change, so how far the hunt got through
+ * those is kept and it carries on from there next time.
+ */
+static int json_parser_container_end( JsonParser *p, size_t stable, size_t *end )
+{
+    long depth, saved = -1;
+    size_t i;
+    char c;
+
+    if( p->scan <= p->next )
+    {
+        p->scan = p->next;
+        p->depth = 0;
+    }
+    depth = p->depth;
+    for( i = p->scan; i < p->index.count; i++ )
+    {
+        if( i == stable )
+          saved = depth;
+        c = p->data[p->index.positions[i]];
+        if( c == '{' || c == '[' )
+          depth++;
+        else if( (c == '}' || c == ']') && --depth == 0 )
+        {
+            *end = i;
+            return 1;
+        }
+    }
+    if( i == stable )
+      saved = depth;
+    if( saved >= 0 )
+    {
+        p->scan = stable;
+        p->depth = saved;
+    }
+    return 0;
+}
+
+/* Drop the text that has been handed back, once it is at least half of what is held */
+static void json_parser_compact( JsonParser *p )
+{
+    size_t drop = (p->start < p->indexed ? p->start : p->indexed), gone = 0, i;
+
+    if( drop == 0 || drop < p->length / 2 )
+      return;
+    while( gone < p->index.count && p->index.positions[gone] < drop )
+      gone++;
+    for( i = gone; i < p->index.count; i++ )
+      p->index.positions[i - gone] = p->index.positions[i] - (uint32_t)drop;
+    p->index.count -= gone;
+    p->next -= gone;
+    p->scan = (p->scan >= gone ? p->scan - gone : 0);
+
+    memmove( p->data, p->data + drop, p->length - drop + 1 );
+    p->length -= drop;
+    p->start -= drop;
+    p->indexed -= drop;
+    p->consumed += drop;
+}
+
+/**
+ * Add some more text and return an array of the top level values that are
+ * now complete. Values may follow one another with or without whitespace
+ * between them. If final is set the text is at an end and anything left over
+ * is an error. On an error NULL is returned and the parser starts afresh.
+ */
+FeriteVariable *json_parser_feed( FeriteScript *script, JsonParser *p, char *data, size_t length, int final )
+{
+    FeriteVariable *values = NULL, *v = NULL;
+    JsonIndexState tail;
+    JsonDecoder d;
+    size_t whole, stable, pos, end, q;
+    char c;
+
+    if( p->length + length > JSON_MAX_TEXT )
+    {
+        ferite_error( script, 0, "Unable to decode JSON: the text is too long\n" );
+        json_parser_reset( p );
+        return NULL;
+    }
+    if( p->length + length > p->size )
+    {
+        while( p->length + length > p->size )
+          p->size *= 2;
+        p->data = frealloc_ngc( p->data, p->size + 1 );
+    }
+    memcpy( p->data + p->length, data, length );
+    p->length += length;
+    p->data[p->length] = '\0';
+
+    /* What the last call found in the part block is found again, now that there is more of it */
+    while( p->index.count > 0 && p->index.positions[p->index.count - 1] >= p->indexed )
+      p->index.count--;
+    if( p->next > p->index.count )
+      p->next = p->index.count;
+    whole = p->indexed + (p->length - p->indexed) / JSON_BLOCK * JSON_BLOCK;
+    json_index_text( &p->state, (const unsigned char *)p->data + p->indexed, whole - p->indexed, p->indexed, &p->index );
+    p->indexed = whole;
+    stable = p->index.count;
+    tail = p->state;
+    json_index_text( &tail, (const unsigned char *)p->data + whole, p->length - whole, whole, &p->index );
+    while( p->next < p->index.count && p->index.positions[p->next] < p->start )
+      p->next++;
+
+    values = ferite_create_uarray_variable( script, "values", 0, FE_STATIC );
+    while( p->next < p->index.count )
+    {
+        pos = p->index.positions[p->next];
+        c = p->data[pos];
+        end = p->next;
+        if( c == '{' || c == '[' )
+        {
+            if( !json_parser_container_end( p, stable, &end ) )
+              break;
+        }
+        else if( c == '"' )
+        {
+            /* Still open if nothing follows it and the text ends inside a string */
+            if( !final && p->next + 1 == p->index.count && tail.in_string )
+              break;
+        }
+        else
+        {
+            /* A number might have more digits to come */
+            for( q = pos; q < p->length && !json_delimiter_char( p->data[q] ); q++ )
+              ;
+            if( !final && q == p->length )
+              break;
+        }
+
+        json_decoder_init( &d, script, p->data, p->length, &p->index, p->next, p->consumed );
+        d.count = end + 1;
+        v = json_value( &d, 0 );
+        json_decoder_deinit( &d );
+        if( v == NULL )
+        {
+            ferite_variable_destroy( script, values );
+            json_parser_reset( p );
+            return NULL;
+        }
+        ferite_uarray_add( script, VAUA(values), v, NULL, FE_ARRAY_ADD_AT_END );
+        p->next = end + 1;
+        p->start = d.last;
+        p->scan = 0;
+        p->depth = 0;
+    }
+
+    if( final )
+    {
+        if( p->next < p->index.count )
+        {
+            json_decoder_init( &d, script, p->data, p->length, &p->index, p->next, p->consumed );
+            json_fail( &d, p->length, "unexpected end of text" );
+            ferite_variable_destroy( script, values );
+            values = NULL;
+        }
+        json_parser_reset( p );
+        return values;
+    }
+    json_parser_compact( p );
+    return values;
+}
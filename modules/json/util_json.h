@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross, Stephan Engstrom, Alex Holden et al
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_UTIL_JSON__
+#define __FERITE_UTIL_JSON__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ferite.h"
+
+/*
+ * Decoding is done in two passes, after simdjson. The first pass looks at the
+ * text 64 bytes at a time and builds an index of where every structural
+ * character is: the brackets, braces, colons and commas outside of strings,
+ * the opening quote of each string and the first character of each number or
+ * literal. The classification of a block is done with SSE2 or AVX2 on x86-64
+ * and byte by byte elsewhere; what is inside a string is then worked out with
+ * a handful of 64 bit operations whichever way the block was classified. The
+ * second pass walks the index, building the ferite variables as it goes.
+ *
+ * The first pass carries three bits of state from one block to the next, so
+ * a document can be indexed as it arrives. A JsonParser holds the text that
+ * has not been decoded yet together with its index, and hands back each top
+ * level value as soon as the whole of it has been seen.
+ */
+#define JSON_BLOCK        64
+#define JSON_MAX_DEPTH    512
+
+#define JSON_INDEX_AUTO   -1
+#define JSON_INDEX_SCALAR 0
+#define JSON_INDEX_SSE2   1
+#define JSON_INDEX_AVX2   2
+
+#define SelfJSONParser ((JsonParser*)self->odata)
+
+typedef struct json_index_state
+{
+    uint64_t escaped;          /* 1 if the first byte of the next block is escaped */
+    uint64_t in_string;        /* all ones if the next block starts inside a string */
+    uint64_t scalar;           /* 1 if the last byte was part of a number or literal */
+}
+JsonIndexState;
+
+typedef struct json_index
+{
+    uint32_t *positions;
+    size_t count;
+    size_t size;
+}
+JsonIndex;
+
+typedef struct json_parser
+{
+    char *data;                /* text not yet handed back as a value, nul terminated */
+    size_t length;
+    size_t size;
+    size_t consumed;           /* bytes dropped from the front so far, for messages */
+
+    size_t start;              /* where the text not yet handed back begins */
+
+    JsonIndexState state;      /* as of the end of the last whole block */
+    size_t indexed;            /* bytes covered by whole blocks */
+    JsonIndex index;
+    size_t next;               /* first entry in the index at or after start */
+
+    size_t scan;               /* how far the hunt for the end of an open container has got ... */
+    long depth;                /* ... and how deep it was there */
+}
+JsonParser;
+
+int   json_index_select( int kind );
+int   json_index_kind();
+char *json_index_name( int kind );
+void  json_index_init( JsonIndex *index );
+void  json_index_deinit( JsonIndex *index );
+void  json_index_text( JsonIndexState *state, const unsigned char *data, size_t length, size_t base, JsonIndex *index );
+
+FeriteVariable *json_decode( FeriteScript *script, char *data, size_t length );
+FeriteVariable *json_encode( FeriteScript *script, FeriteVariable *value, int pretty );
+
+JsonParser     *json_parser_create();
+void            json_parser_destroy( JsonParser *parser );
+void            json_parser_reset( JsonParser *parser );
+FeriteVariable *json_parser_feed( FeriteScript *script, JsonParser *parser, char *data, size_t length, int final );
+
+#endif /* __FERITE_UTIL_JSON__ */
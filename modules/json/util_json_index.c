@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross, Stephan Engstrom, Alex Holden et al
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../../config.h"
+#include "util_json.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+# define JSON_HAVE_SSE2
+# include <emmintrin.h>
+# if __GNUC__ >= 5 || defined(__clang__)
+#  define JSON_HAVE_AVX2
+#  include <immintrin.h>
+# endif
+#endif
+
+#define JSON_EVEN_BITS 0x5555555555555555ULL
+
+/* Where the interesting characters of a block are, one bit per byte */
+typedef struct json_masks
+{
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;               /* { } [ ] : , */
+    uint64_t space;            /* space, tab, carriage return, new line */
+}
+JsonMasks;
+
+typedef void (*JsonClassify)( const unsigned char *block, JsonMasks *masks );
+
+/* 1 quote, 2 backslash, 3 op, 4 space */
+static const unsigned char json_class[256] = {
+    0,0,0,0,0,0,0,0,0,4,4,0,0,4,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    4,0,1,0,0,0,0,0,0,0,0,0,3,0,0,0, 0,0,0,0,0,0,0,0,0,0,3,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,3,2,3,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,3,0,3,0,0
+};
+
+static void json_classify_scalar( const unsigned char *block, JsonMasks *m )
+{
+    uint64_t bit;
+    int i;
+
+    m->quote = m->backslash = m->op = m->space = 0;
+    for( i = 0; i < JSON_BLOCK; i++ )
+    {
+        bit = 1ULL << i;
+        switch( json_class[block[i]] )
+        {
+            case 1: m->quote |= bit; break;
+            case 2: m->backslash |= bit; break;
+            case 3: m->op |= bit; break;
+            case 4: m->space |= bit; break;
+        }
+    }
+}
+
+#ifdef JSON_HAVE_SSE2
+/* Brackets and braces are found together: '[' | 0x20 is '{' and ']' | 0x20 is '}' */
+static void json_classify_sse2( const unsigned char *block, JsonMasks *m )
+{
+    const __m128i quote = _mm_set1_epi8( '"' ), backslash = _mm_set1_epi8( '\\' );
+    const __m128i open = _mm_set1_epi8( '{' ), close = _mm_set1_epi8( '}' ), fold = _mm_set1_epi8( 0x20 );
+    const __m128i colon = _mm_set1_epi8( ':' ), comma = _mm_set1_epi8( ',' );
+    const __m128i space = _mm_set1_epi8( ' ' ), tab = _mm_set1_epi8( '\t' ), nl = _mm_set1_epi8( '\n' ), cr = _mm_set1_epi8( '\r' );
+    __m128i c, f, op, ws;
+    int i;
+
+    m->quote = m->backslash = m->op = m->space = 0;
+    for( i = 0; i < JSON_BLOCK; i += 16 )
+    {
+        c = _mm_loadu_si128( (const __m128i *)(block + i) );
+        f = _mm_or_si128( c, fold );
+        op = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( f, open ), _mm_cmpeq_epi8( f, close ) ),
+                           _mm_or_si128( _mm_cmpeq_epi8( c, colon ), _mm_cmpeq_epi8( c, comma ) ) );
+        ws = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( c, space ), _mm_cmpeq_epi8( c, tab ) ),
+                           _mm_or_si128( _mm_cmpeq_epi8( c, nl ), _mm_cmpeq_epi8( c, cr ) ) );
+        m->quote |= (uint64_t)(unsigned int)_mm_movemask_epi8( _mm_cmpeq_epi8( c, quote ) ) << i;
+        m->backslash |= (uint64_t)(unsigned int)_mm_movemask_epi8( _mm_cmpeq_epi8( c, backslash ) ) << i;
+        m->op |= (uint64_t)(unsigned int)_mm_movemask_epi8( op ) << i;
+        m->space |= (uint64_t)(unsigned int)_mm_movemask_epi8( ws ) << i;
+    }
+}
+#endif
+
+#ifdef JSON_HAVE_AVX2
+__attribute__((target("avx2")))
+static void json_classify_avx2( const unsigned char *block, JsonMasks *m )
+{
+    const __m256i quote = _mm256_set1_epi8( '"' ), backslash = _mm256_set1_epi8( '\\' );
+    const __m256i open = _mm256_set1_epi8( '{' ), close = _mm256_set1_epi8( '}' ), fold = _mm256_set1_epi8( 0x20 );
+    const __m256i colon = _mm256_set1_epi8( ':' ), comma = _mm256_set1_epi8( ',' );
+    const __m256i space = _mm256_set1_epi8( ' ' ), tab = _mm256_set1_epi8( '\t' ), nl = _mm256_set1_epi8( '\n' ), cr = _mm256_set1_epi8( '\r' );
+    __m256i c, f, op, ws;
+    int i;
+
+    m->quote = m->backslash = m->op = m->space = 0;
+    for( i = 0; i < JSON_BLOCK; i += 32 )
+    {
+        c = _mm256_loadu_si256( (const __m256i *)(block + i) );
+        f = _mm256_or_si256( c, fold );
+        op = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( f, open ), _mm256_cmpeq_epi8( f, close ) ),
+                              _mm256_or_si256( _mm256_cmpeq_epi8( c, colon ), _mm256_cmpeq_epi8( c, comma ) ) );
+        ws = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( c, space ), _mm256_cmpeq_epi8( c, tab ) ),
+                              _mm256_or_si256( _mm256_cmpeq_epi8( c, nl ), _mm256_cmpeq_epi8( c, cr ) ) );
+        m->quote |= (uint64_t)(unsigned int)_mm256_movemask_epi8( _mm256_cmpeq_epi8( c, quote ) ) << i;
+        m->backslash |= (uint64_t)(unsigned int)_mm256_movemask_epi8( _mm256_cmpeq_epi8( c, backslash ) ) << i;
+        m->op |= (uint64_t)(unsigned int)_mm256_movemask_epi8( op ) << i;
+        m->space |= (uint64_t)(unsigned int)_mm256_movemask_epi8( ws ) << i;
+    }
+}
+#endif
+
+static JsonClassify json_classify = json_classify_scalar;
+static int json_classify_kind = JSON_INDEX_SCALAR;
+
+/**
+ * Choose how blocks are classified: JSON_INDEX_AUTO picks the best the
+ * processor can do. Returns the kind now in use, or -1 if the one asked for is
+ * not available here.
+ */
+int json_index_select( int kind )
+{
+    if( kind == JSON_INDEX_AUTO )
+    {
+        kind = JSON_INDEX_SCALAR;
+#ifdef JSON_HAVE_SSE2
+        kind = JSON_INDEX_SSE2;
+#endif
+#ifdef JSON_HAVE_AVX2
+        __builtin_cpu_init();
+        if( __builtin_cpu_supports( "avx2" ) )
+          kind = JSON_INDEX_AVX2;
+#endif
+    }
+    switch( kind )
+    {
+        case JSON_INDEX_SCALAR:
+            json_classify = json_classify_scalar;
+            break;
+#ifdef JSON_HAVE_SSE2
+        case JSON_INDEX_SSE2:
+            json_classify = json_classify_sse2;
+            break;
+#endif
+#ifdef JSON_HAVE_AVX2
+        case JSON_INDEX_AVX2:
+            __builtin_cpu_init();
+            if( !__builtin_cpu_supports( "avx2" ) )
+              return -1;
+            json_classify = json_classify_avx2;
+            break;
+#endif
+        default:
+            return -1;
+    }
+    json_classify_kind = kind;
+    return kind;
+}
+
+int json_index_kind()
+{
+    return json_classify_kind;
+}
+
+char *json_index_name( int kind )
+{
+    switch( kind )
+    {
+        case JSON_INDEX_SSE2: return "sse2";
+        case JSON_INDEX_AVX2: return "avx2";
+    }
+    return "scalar";
+}
+
+void json_index_init( JsonIndex *index )
+{
+    index->positions = NULL;
+    index->count = 0;
+    index->size = 0;
+}
+
+void json_index_deinit( JsonIndex *index )
+{
+    if( index->positions != NULL )
+      ffree_ngc( index->positions );
+    json_index_init( index );
+}
+
+static void json_index_reserve( JsonIndex *index, size_t more )
+{
+    if( index->count + more <= index->size )
+      return;
+    if( index->positions == NULL )
+    {
+        index->size = (more > 1024 ? more : 1024);
+        index->positions = fmalloc_ngc( index->size * sizeof(uint32_t) );
+        return;
+    }
+    while( index->count + more > index->size )
+      index->size *= 2;
+    index->positions = frealloc_ngc( index->positions, index->size * sizeof(uint32_t) );
+}
+
+/* Every bit from a set bit up to (not including) the next one, as a running xor */
+static uint64_t json_prefix_xor( uint64_t x )
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/* The bytes that follow an odd number of backslashes -- simdjson's version */
+static uint64_t json_escaped( uint64_t backslash, uint64_t *carry )
+{
+    uint64_t start_edges = backslash & ~(backslash << 1);
+    uint64_t even_start_mask = JSON_EVEN_BITS ^ *carry;
+    uint64_t even_starts = start_edges & even_start_mask;
+    uint64_t odd_starts = start_edges & ~even_start_mask;
+    uint64_t even_carries = backslash + even_starts;
+    uint64_t odd_carries = backslash + odd_starts;
+    uint64_t ends_odd = (odd_carries < backslash);
+
+    odd_carries |= *carry;
+    *carry = ends_odd;
+    return ((even_carries & ~backslash) & ~JSON_EVEN_BITS) | ((odd_carries & ~backslash) & JSON_EVEN_BITS);
+}
+
+static void json_index_block( JsonIndexState *state, const unsigned char *block, size_t base, JsonIndex *index )
+{
+    JsonMasks m;
+    uint64_t quote, in_string, outside, scalar, structurals;
+
+    json_classify( block, &m );
+
+    quote = m.quote & ~json_escaped( m.backslash, &state->escaped );
+    /* The opening quote and what follows it, up to but not including the closing quote */
+    in_string = json_prefix_xor( quote ) ^ state->in_string;
+    state->in_string = (uint64_t)((int64_t)in_string >> 63);
+
+    outside = ~(in_string | quote);
+    scalar = ~(m.op | m.space | quote) & outside;
+    structurals = (m.op & outside) | (quote & in_string) | (scalar & ~((scalar << 1) | state->scalar));
+    state->scalar = scalar >> 63;
+
+    json_index_reserve( index, JSON_BLOCK );
+    while( structurals != 0 )
+    {
+        index->positions[index->count++] = (uint32_t)(base + __builtin_ctzll( structurals ));
+        structurals &= structurals - 1;
+    }
+}
+
+/**
+ * Index length bytes of text that starts base bytes into the document. A
+ * last part block is padded out with spaces, so the state it leaves behind
+ * is only good for carrying on if length was a whole number of blocks.
+ */
+void json_index_text( JsonIndexState *state, const unsigned char *data, size_t length, size_t base, JsonIndex *index )
+{
+    unsigned char tail[JSON_BLOCK];
+    size_t i;
+
+    for( i = 0; i + JSON_BLOCK <= length; i += JSON_BLOCK )
+      json_index_block( state, data + i, base + i, index );
+    if( i < length )
+    {
+        memset( tail, ' ', JSON_BLOCK );
+        memcpy( tail, data + i, length - i );
+        json_index_block( state, tail, base + i, index );
+    }
+}
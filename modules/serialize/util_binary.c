@@ -0,0 +1,966 @@
+/*
+ * Copyright (c) 2002-2007 Stephan Engstrom
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_binary.h"
+
+/* Pointer maps -- open addressing, a value of zero means 'not there' */
+static size_t serialize_map_slot( SerializePointerMap *m, void *key )
+{
+    unsigned long k = (unsigned long)key;
+    size_t slot = (size_t)(((k >> 4) ^ (k >> 16)) * 2654435761UL) & (m->size - 1);
+
+    while( m->keys[slot] != NULL && m->keys[slot] != key )
+      slot = (slot + 1) & (m->size - 1);
+    return slot;
+}
+
+static void serialize_map_init( SerializePointerMap *m )
+{
+    m->keys = NULL;
+    m->values = NULL;
+    m->size = 0;
+    m->count = 0;
+}
+
+static void serialize_map_deinit( FeriteScript *script, SerializePointerMap *m )
+{
+    if( m->keys != NULL )
+    {
+        ffree( m->keys );
+        ffree( m->values );
+    }
+    serialize_map_init( m );
+}
+
+static long serialize_map_get( SerializePointerMap *m, void *key )
+{
+    size_t slot;
+
+    if( m->count == 0 )
+      return 0;
+    slot = serialize_map_slot( m, key );
+    return (m->keys[slot] == key ? m->values[slot] : 0);
+}
+
+static void serialize_map_put( FeriteScript *script, SerializePointerMap *m, void *key, long value )
+{
+    size_t slot, i;
+
+    if( (m->count + 1) * 2 > m->size )
+    {
+        SerializePointerMap old = *m;
+
+        m->size = (old.size == 0 ? 64 : old.size * 2);
+        m->keys = fcalloc( m->size, sizeof(void*) );
+        m->values = fmalloc( m->size * sizeof(long) );
+        for( i = 0; i < old.size; i++ )
+        {
+            if( old.keys[i] != NULL )
+            {
+                slot = serialize_map_slot( m, old.keys[i] );
+                m->keys[slot] = old.keys[i];
+                m->values[slot] = old.values[i];
+            }
+        }
+        if( old.keys != NULL )
+        {
+            ffree( old.keys );
+            ffree( old.values );
+        }
+    }
+    slot = serialize_map_slot( m, key );
+    if( m->keys[slot] == NULL )
+      m->count++;
+    m->keys[slot] = key;
+    m->values[slot] = value;
+}
+
+static int serialize_little_endian()
+{
+    union { unsigned short s; unsigned char c[2]; } u;
+    u.s = 1;
+    return u.c[0] == 1;
+}
+
+/*
+ * Writing
+ */
+void Serialize_writer_init( FeriteScript *script, SerializeWriter *w, size_t size )
+{
+    if( size < 64 )
+      size = 64;
+    w->script = script;
+    w->data = fmalloc( size + 1 );
+    w->length = 0;
+    w->size = size;
+    w->flush = NULL;
+    w->odata = NULL;
+    w->names = ferite_create_hash( script, 32 );
+    w->name_count = 0;
+    serialize_map_init( &w->objects );
+    serialize_map_init( &w->classes );
+    w->object_count = 0;
+    w->failed = 0;
+}
+
+void Serialize_writer_deinit( SerializeWriter *w )
+{
+    FeriteScript *script = w->script;
+
+    if( w->data != NULL )
+      ffree( w->data );
+    if( w->odata != NULL )
+      ffree( w->odata );
+    ferite_delete_hash( script, w->names, NULL );
+    serialize_map_deinit( script, &w->objects );
+    serialize_map_deinit( script, &w->classes );
+}
+
+/* Make room for n more bytes, either by handing on what we have or by growing */
+static int serialize_reserve( SerializeWriter *w, size_t n )
+{
+    FeriteScript *script = w->script;
+
+    if( w->size - w->length >= n )
+      return 1;
+    if( w->failed )
+      return 0;
+    if( w->flush != NULL && w->length > 0 )
+    {
+        if( !w->flush( w ) )
+        {
+            w->failed = 1;
+            return 0;
+        }
+        if( w->size - w->length >= n )
+          return 1;
+    }
+    while( w->size - w->length < n )
+      w->size *= 2;
+    w->data = frealloc( w->data, w->size + 1 );
+    return 1;
+}
+
+static int serialize_put_byte( SerializeWriter *w, int c )
+{
+    if( !serialize_reserve( w, 1 ) )
+      return 0;
+    w->data[w->length++] = (unsigned char)c;
+    return 1;
+}
+
+static int serialize_put_bytes( SerializeWriter *w, void *ptr, size_t n )
+{
+    unsigned char *src = ptr;
+    size_t room;
+
+    while( n > 0 )
+    {
+        /* With somewhere to flush to, big strings go out a window at a time */
+        if( w->flush == NULL ? !serialize_reserve( w, n ) : (w->length == w->size && !serialize_reserve( w, 1 )) )
+          return 0;
+        room = w->size - w->length;
+        if( room > n )
+          room = n;
+        memcpy( w->data + w->length, src, room );
+        w->length += room;
+        src += room;
+        n -= room;
+    }
+    return 1;
+}
+
+static int serialize_put_varint( SerializeWriter *w, unsigned long value )
+{
+    unsigned char *p;
+
+    if( !serialize_reserve( w, 10 ) )
+      return 0;
+    p = w->data + w->length;
+    while( value >= 0x80 )
+    {
+        *p++ = (unsigned char)((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    w->length = p - w->data;
+    return 1;
+}
+
+static int serialize_put_double( SerializeWriter *w, double value )
+{
+    unsigned char bytes[sizeof(double)];
+    int i;
+
+    if( !serialize_reserve( w, 8 ) )
+      return 0;
+    memcpy( bytes, &value, sizeof(double) );
+    for( i = 0; i < 8; i++ )
+      w->data[w->length++] = bytes[serialize_little_endian() ? i : 7 - i];
+    return 1;
+}
+
+/* Returns the name's table entry + 1, or 0 on failure */
+static long serialize_put_name( SerializeWriter *w, char *name )
+{
+    FeriteScript *script = w->script;
+    long entry;
+    size_t length;
+
+    if( name == NULL )
+      name = "";
+    entry = (long)ferite_hash_get( script, w->names, name );
+    if( entry > 0 )
+      return (serialize_put_varint( w, ((unsigned long)(entry - 1) << 1) | 1 ) ? entry : 0);
+
+    if( w->name_count > w->names->size * 4 )
+      w->names = ferite_hash_grow( script, w->names );
+    entry = ++w->name_count;
+    ferite_hash_add( script, w->names, name, (void*)entry );
+
+    length = strlen( name );
+    if( !serialize_put_varint( w, (unsigned long)length << 1 ) || !serialize_put_bytes( w, name, length ) )
+      return 0;
+    return entry;
+}
+
+static int serialize_put_class( SerializeWriter *w, FeriteClass *klass )
+{
+    FeriteScript *script = w->script;
+    long entry = serialize_map_get( &w->classes, klass );
+    char *name;
+
+    if( entry > 0 )
+      return serialize_put_varint( w, ((unsigned long)(entry - 1) << 1) | 1 );
+
+    name = ferite_generate_class_fqn( script, klass );
+    entry = serialize_put_name( w, name );
+    ffree( name );
+    if( entry == 0 )
+      return 0;
+    serialize_map_put( script, &w->classes, klass, entry );
+    return 1;
+}
+
+static int serialize_put_object( SerializeWriter *w, FeriteVariable *v, int level )
+{
+    FeriteScript *script = w->script;
+    FeriteObject *obj = VAO(v);
+    FeriteObjectVariable *obv = NULL;
+    FeriteFunction *func = NULL;
+    FeriteIterator iter;
+    FeriteHashBucket *buk;
+    unsigned long count = 0;
+    long number;
+
+    if( obj == NULL )
+      return serialize_put_byte( w, SERIALIZE_BINARY_NULL );
+
+    if( (number = serialize_map_get( &w->objects, obj )) > 0 )
+      return serialize_put_byte( w, SERIALIZE_BINARY_REFERENCE ) && serialize_put_varint( w, (unsigned long)(number - 1) );
+
+    func = ferite_object_get_function_for_params( script, obj, "serializeSleep", NULL );
+    if( func != NULL )
+      ferite_variable_destroy( script, ferite_call_function( script, obj, NULL, func, NULL ) );
+
+    /* Numbered before the members are walked so that cycles come back as references */
+    serialize_map_put( script, &w->objects, obj, ++w->object_count );
+
+    for( obv = obj->variables; obv != NULL; obv = obv->parent )
+    {
+        memset( &iter, 0, sizeof(FeriteIterator) );
+        while( ferite_hash_walk( script, obv->variables, &iter ) != NULL )
+          count++;
+    }
+    if( !serialize_put_byte( w, SERIALIZE_BINARY_OBJECT ) || !serialize_put_class( w, obj->klass ) || !serialize_put_varint( w, count ) )
+      return 0;
+
+    for( obv = obj->variables; obv != NULL; obv = obv->parent )
+    {
+        memset( &iter, 0, sizeof(FeriteIterator) );
+        while( (buk = ferite_hash_walk( script, obv->variables, &iter )) != NULL )
+        {
+            if( !serialize_put_name( w, buk->id ) || !Serialize_write_binary( w, (FeriteVariable*)buk->data, level + 1 ) )
+              return 0;
+        }
+    }
+    return 1;
+}
+
+int Serialize_write_header( SerializeWriter *w )
+{
+    return serialize_put_bytes( w, SERIALIZE_BINARY_MAGIC, 3 ) && serialize_put_byte( w, SERIALIZE_BINARY_VERSION );
+}
+
+int Serialize_write_binary( SerializeWriter *w, FeriteVariable *v, int level )
+{
+    FeriteScript *script = w->script;
+    long i;
+
+    if( w->failed )
+      return 0;
+    if( level >= SERIALIZE_BINARY_DEPTH )
+    {
+        ferite_error( script, 0, "Serializing too deeply nested\n" );
+        w->failed = 1;
+        return 0;
+    }
+
+    switch( F_VAR_TYPE(v) )
+    {
+        case F_VAR_BOOL:
+            return serialize_put_byte( w, (VAB(v) ? SERIALIZE_BINARY_TRUE : SERIALIZE_BINARY_FALSE) );
+        case F_VAR_LONG:
+            /* zig-zag, so that small negative numbers stay short */
+            return serialize_put_byte( w, SERIALIZE_BINARY_LONG ) &&
+                   serialize_put_varint( w, ((unsigned long)VAI(v) << 1) ^ (VAI(v) < 0 ? ~0UL : 0UL) );
+        case F_VAR_DOUBLE:
+            return serialize_put_byte( w, SERIALIZE_BINARY_DOUBLE ) && serialize_put_double( w, VAF(v) );
+        case F_VAR_STR:
+            return serialize_put_byte( w, SERIALIZE_BINARY_STRING ) &&
+                   serialize_put_varint( w, FE_STRLEN(v) ) &&
+                   serialize_put_bytes( w, FE_STR2PTR(v), FE_STRLEN(v) );
+        case F_VAR_OBJ:
+            return serialize_put_object( w, v, level );
+        case F_VAR_UARRAY:
+            if( !serialize_put_byte( w, SERIALIZE_BINARY_ARRAY ) || !serialize_put_varint( w, VAUA(v)->size ) )
+              return 0;
+            ferite_uarray_resolve( w->script, VAUA(v) );
+            for( i = 0; i < VAUA(v)->size; i++ )
+            {
+                if( !serialize_put_name( w, VAUA(v)->array[i]->vname ) || !Serialize_write_binary( w, VAUA(v)->array[i], level + 1 ) )
+                  return 0;
+            }
+            return 1;
+        case F_VAR_VOID:
+            return serialize_put_byte( w, SERIALIZE_BINARY_VOID );
+        case F_VAR_NS:
+        {
+            char *name = ferite_generate_namespace_fqn( script, VAN(v) );
+            int ok = serialize_put_byte( w, SERIALIZE_BINARY_NAMESPACE ) && serialize_put_name( w, name );
+            ffree( name );
+            return ok;
+        }
+        case F_VAR_CLASS:
+            return serialize_put_byte( w, SERIALIZE_BINARY_CLASS ) && serialize_put_class( w, VAC(v) );
+    }
+    ferite_error( script, 0, "Unable to serialize a variable of type '%s'\n", ferite_variable_id_to_str( script, F_VAR_TYPE(v) ) );
+    w->failed = 1;
+    return 0;
+}
+
+/* Hands the written data over to a string variable without copying it */
+FeriteVariable *Serialize_writer_to_var( SerializeWriter *w )
+{
+    FeriteScript *script = w->script;
+    FeriteVariable *v = ferite_create_string_variable_from_ptr( script, "buffer", NULL, 0, FE_CHARSET_DEFAULT, FE_STATIC );
+
+    ffree( VAS(v)->data );
+    VAS(v)->data = frealloc( w->data, w->length + 1 );
+    VAS(v)->data[w->length] = '\0';
+    VAS(v)->length = w->length;
+    w->data = NULL;
+    w->length = w->size = 0;
+    return v;
+}
+
+/*
+ * Reading
+ */
+void Serialize_reader_init( FeriteScript *script, SerializeReader *r, unsigned char *data, size_t length )
+{
+    r->script = script;
+    r->data = data;
+    r->length = length;
+    r->position = 0;
+    r->size = 0;
+    r->fill = NULL;
+    r->odata = NULL;
+    r->names = NULL;
+    r->name_count = r->name_size = 0;
+    r->objects = NULL;
+    r->object_count = r->object_size = 0;
+    r->failed = 0;
+}
+
+void Serialize_reader_deinit( SerializeReader *r )
+{
+    FeriteScript *script = r->script;
+    long i;
+
+    for( i = 0; i < r->name_count; i++ )
+      ffree( r->names[i].name );
+    if( r->names != NULL )
+      ffree( r->names );
+    if( r->objects != NULL )
+      ffree( r->objects );
+    if( r->size > 0 )
+      ffree( r->data );
+    if( r->odata != NULL )
+      ffree( r->odata );
+}
+
+static int serialize_corrupt( SerializeReader *r, char *why )
+{
+    if( !r->failed )
+    {
+        ferite_error( r->script, 0, "%s\n", why );
+        r->failed = 1;
+    }
+    return 0;
+}
+
+static int serialize_need( SerializeReader *r, size_t n )
+{
+    if( r->length - r->position >= n )
+      return 1;
+    if( !r->failed && r->fill != NULL && r->fill( r, n ) )
+      return 1;
+    return serialize_corrupt( r, "Serialized variable is not complete." );
+}
+
+static int serialize_get_varint( SerializeReader *r, unsigned long *value )
+{
+    unsigned int shift = 0;
+    int c;
+
+    *value = 0;
+    do
+    {
+        if( shift >= sizeof(unsigned long) * 8 )
+          return serialize_corrupt( r, "Corrupted serialized data: number too big" );
+        if( !serialize_need( r, 1 ) )
+          return 0;
+        c = r->data[r->position++];
+        *value |= (unsigned long)(c & 0x7F) << shift;
+        shift += 7;
+    }
+    while( c & 0x80 );
+    return 1;
+}
+
+/* Returns the name's table entry, or -1 on failure */
+static long serialize_get_name( SerializeReader *r )
+{
+    FeriteScript *script = r->script;
+    SerializeName *entry;
+    unsigned long value;
+    size_t length;
+
+    if( !serialize_get_varint( r, &value ) )
+      return -1;
+    if( value & 1 )
+    {
+        if( (value >> 1) >= (unsigned long)r->name_count )
+        {
+            serialize_corrupt( r, "Corrupted serialized data: unknown name" );
+            return -1;
+        }
+        return (long)(value >> 1);
+    }
+
+    length = value >> 1;
+    /* A stream's names have to fit in its window, so a bad length can't ask for more */
+    if( r->fill != NULL && length > SERIALIZE_STREAM_WINDOW )
+    {
+        serialize_corrupt( r, "Corrupted serialized data: name too long" );
+        return -1;
+    }
+    if( !serialize_need( r, length ) )
+      return -1;
+    if( r->names == NULL )
+    {
+        r->name_size = 32;
+        r->names = fmalloc( r->name_size * sizeof(SerializeName) );
+    }
+    else if( r->name_count == r->name_size )
+    {
+        r->name_size *= 2;
+        r->names = frealloc( r->names, r->name_size * sizeof(SerializeName) );
+    }
+    entry = &r->names[r->name_count];
+    entry->name = fmalloc( length + 1 );
+    memcpy( entry->name, r->data + r->position, length );
+    entry->name[length] = '\0';
+    entry->length = length;
+    entry->klass = NULL;
+    r->position += length;
+    return r->name_count++;
+}
+
+static FeriteClass *serialize_get_class( SerializeReader *r, long entry )
+{
+    if( r->names[entry].klass == NULL )
+      r->names[entry].klass = ferite_find_namespace_element_contents( r->script, r->script->mainns, r->names[entry].name, FENS_CLS );
+    return r->names[entry].klass;
+}
+
+static FeriteVariable *serialize_get_string( SerializeReader *r, char *name )
+{
+    FeriteScript *script = r->script;
+    FeriteVariable *v = NULL;
+    unsigned long length;
+    unsigned char *data;
+    size_t chunk, got = 0, size;
+
+    if( !serialize_get_varint( r, &length ) || (r->fill == NULL && !serialize_need( r, length )) )
+      return NULL;
+    /*
+     * A stream's length can't be checked up front, so the string only grows
+     * as its bytes turn up: a corrupt length runs out of data rather than
+     * asking for all of the memory at once.
+     */
+    size = (r->fill != NULL && length > SERIALIZE_STREAM_WINDOW ? SERIALIZE_STREAM_WINDOW : length);
+    data = fmalloc( size + 1 );
+    /* Copied a window at a time, so a long string is only ever held the once */
+    while( got < length )
+    {
+        if( !serialize_need( r, 1 ) )
+        {
+            ffree( data );
+            return NULL;
+        }
+        chunk = r->length - r->position;
+        if( chunk > length - got )
+          chunk = length - got;
+        if( got + chunk > size )
+        {
+            size = (size * 2 < length ? size * 2 : length);
+            if( size < got + chunk )
+              size = got + chunk;
+            data = frealloc( data, size + 1 );
+        }
+        memcpy( data + got, r->data + r->position, chunk );
+        r->position += chunk;
+        got += chunk;
+    }
+    data[length] = '\0';
+    /* Not straight from the pointer: that gives up on data that starts with a nul */
+    v = ferite_create_string_variable_from_ptr( script, name, NULL, 0, FE_CHARSET_DEFAULT, FE_ALLOC );
+    ffree( VAS(v)->data );
+    VAS(v)->data = (char *)data;
+    VAS(v)->length = length;
+    return v;
+}
+
+static FeriteVariable *serialize_get_object( SerializeReader *r, char *name, int level )
+{
+    FeriteScript *script = r->script;
+    FeriteVariable *v = NULL, *member = NULL;
+    FeriteClass *klass = NULL;
+    unsigned long count, i;
+    long entry;
+
+    if( (entry = serialize_get_name( r )) < 0 || !serialize_get_varint( r, &count ) )
+      return NULL;
+    if( (klass = serialize_get_class( r, entry )) == NULL )
+    {
+        ferite_error( script, 0, "Unable to locate class '%s' making it impossible rebuild serialized data.\n", r->names[entry].name );
+        r->failed = 1;
+        return NULL;
+    }
+
+    v = ferite_build_object( script, klass );
+    ferite_set_variable_name( script, v, name );
+    if( r->objects == NULL )
+    {
+        r->object_size = 32;
+        r->objects = fmalloc( r->object_size * sizeof(FeriteObject*) );
+    }
+    else if( r->object_count == r->object_size )
+    {
+        r->object_size *= 2;
+        r->objects = frealloc( r->objects, r->object_size * sizeof(FeriteObject*) );
+    }
+    r->objects[r->object_count++] = VAO(v);
+
+    for( i = 0; i < count; i++ )
+    {
+        if( (entry = serialize_get_name( r )) < 0 || (member = Serialize_read_binary( r, r->names[entry].name, level + 1 )) == NULL )
+        {
+            ferite_variable_destroy( script, v );
+            return NULL;
+        }
+        ferite_object_set_var( script, VAO(v), r->names[entry].name, member );
+    }
+    return v;
+}
+
+static FeriteVariable *serialize_get_array( SerializeReader *r, char *name, int level )
+{
+    FeriteScript *script = r->script;
+    FeriteVariable *v = NULL, *item = NULL;
+    FeriteUnifiedArray *array = NULL;
+    unsigned long count, i;
+    long entry;
+
+    if( !serialize_get_varint( r, &count ) )
+      return NULL;
+    v = ferite_create_uarray_variable( script, name, 0, FE_ALLOC );
+    array = VAUA(v);
+    /* Every item takes at least two bytes, which keeps a bad count from asking for the earth */
+    if( count > (unsigned long)array->actual_size && count <= (r->length - r->position) / 2 )
+    {
+        array->actual_size = (long)count;
+        array->array = frealloc( array->array, sizeof(FeriteVariable*) * array->actual_size );
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        if( (entry = serialize_get_name( r )) < 0 || (item = Serialize_read_binary( r, r->names[entry].name, level + 1 )) == NULL )
+        {
+            ferite_variable_destroy( script, v );
+            return NULL;
+        }
+        ferite_uarray_add( script, array, item, (r->names[entry].length > 0 ? r->names[entry].name : NULL), FE_ARRAY_ADD_AT_END );
+    }
+    return v;
+}
+
+int Serialize_read_header( SerializeReader *r )
+{
+    int version;
+
+    if( !serialize_need( r, 4 ) )
+      return 0;
+    if( memcmp( r->data + r->position, SERIALIZE_BINARY_MAGIC, 3 ) != 0 )
+      return serialize_corrupt( r, "Data is not in the binary serialization format." );
+    version = r->data[r->position + 3];
+    if( version != SERIALIZE_BINARY_VERSION )
+      return serialize_corrupt( r, (version < SERIALIZE_BINARY_VERSION ? "Serialized variable uses old scheme." : "Serialized variable uses newer scheme.") );
+    r->position += 4;
+    return 1;
+}
+
+FeriteVariable *Serialize_read_binary( SerializeReader *r, char *name, int level )
+{
+    FeriteScript *script = r->script;
+    FeriteVariable *v = NULL;
+    unsigned long value;
+    int tag;
+
+    if( level >= SERIALIZE_BINARY_DEPTH )
+    {
+        serialize_corrupt( r, "Structure is too deeply nested" );
+        return NULL;
+    }
+    if( !serialize_need( r, 1 ) )
+      return NULL;
+
+    tag = r->data[r->position++];
+    switch( tag )
+    {
+        case SERIALIZE_BINARY_VOID:
+            return ferite_create_void_variable( script, name, FE_ALLOC );
+        case SERIALIZE_BINARY_FALSE:
+        case SERIALIZE_BINARY_TRUE:
+            return ferite_create_boolean_variable( script, name, (tag == SERIALIZE_BINARY_TRUE ? FE_TRUE : FE_FALSE), FE_ALLOC );
+        case SERIALIZE_BINARY_LONG:
+            if( !serialize_get_varint( r, &value ) )
+              return NULL;
+            return ferite_create_number_long_variable( script, name, (long)(value >> 1) ^ -(long)(value & 1), FE_ALLOC );
+        case SERIALIZE_BINARY_DOUBLE:
+        {
+            unsigned char bytes[sizeof(double)];
+            double number;
+            int i;
+
+            if( !serialize_need( r, 8 ) )
+              return NULL;
+            for( i = 0; i < 8; i++ )
+              bytes[serialize_little_endian() ? i : 7 - i] = r->data[r->position++];
+            memcpy( &number, bytes, sizeof(double) );
+            return ferite_create_number_double_variable( script, name, number, FE_ALLOC );
+        }
+        case SERIALIZE_BINARY_STRING:
+            return serialize_get_string( r, name );
+        case SERIALIZE_BINARY_NULL:
+            return ferite_create_object_variable( script, name, FE_ALLOC );
+        case SERIALIZE_BINARY_OBJECT:
+            return serialize_get_object( r, name, level );
+        case SERIALIZE_BINARY_REFERENCE:
+            if( !serialize_get_varint( r, &value ) )
+              return NULL;
+            if( value >= (unsigned long)r->object_count )
+            {
+                serialize_corrupt( r, "Corrupted serialized data: reference to an unknown object" );
+                return NULL;
+            }
+            v = ferite_create_object_variable( script, name, FE_ALLOC );
+            VAO(v) = r->objects[value];
+            FINCREF(VAO(v));
+            return v;
+        case SERIALIZE_BINARY_ARRAY:
+            return serialize_get_array( r, name, level );
+        case SERIALIZE_BINARY_CLASS:
+        {
+            long entry = serialize_get_name( r );
+            if( entry < 0 )
+              return NULL;
+            return ferite_create_class_variable( script, name, serialize_get_class( r, entry ), FE_ALLOC );
+        }
+        case SERIALIZE_BINARY_NAMESPACE:
+        {
+            long entry = serialize_get_name( r );
+            if( entry < 0 )
+              return NULL;
+            return ferite_create_namespace_variable( script, name, ferite_find_namespace_element_contents( script, script->mainns, r->names[entry].name, FENS_NS ), FE_ALLOC );
+        }
+    }
+    serialize_corrupt( r, "Can not create variable from unknown type" );
+    return NULL;
+}
+
+/* Objects are woken in the reverse order to the one they were read in, as fromNative() does */
+void Serialize_reader_wakeup( SerializeReader *r )
+{
+    FeriteScript *script = r->script;
+    FeriteFunction *func = NULL;
+    long i;
+
+    for( i = r->object_count - 1; i >= 0; i-- )
+    {
+        func = ferite_object_get_function_for_params( script, r->objects[i], "serializeWakeup", NULL );
+        if( func != NULL )
+          ferite_variable_destroy( script, ferite_call_function( script, r->objects[i], NULL, func, NULL ) );
+    }
+}
+
+/*
+ * Streams
+ */
+static SerializeStream *serialize_stream_create( FeriteScript *script, FeriteObject *stream )
+{
+    SerializeStream *s = NULL;
+
+    if( stream == NULL )
+      return NULL;
+    s = fmalloc( sizeof(SerializeStream) );
+    s->stream = stream;
+    s->read = ferite_object_get_function( script, stream, "read" );
+    s->write = ferite_object_get_function( script, stream, "write" );
+    s->flush = ferite_object_get_function( script, stream, "flush" );
+    s->frame = 0;
+    return s;
+}
+
+/* Calls one of the stream's methods, giving back what it returned or NULL if it threw */
+static FeriteVariable *serialize_stream_call( FeriteScript *script, SerializeStream *s, FeriteFunction *func, FeriteVariable **params )
+{
+    FeriteVariable *retval = ferite_call_function( script, s->stream, NULL, func, params );
+
+    if( params != NULL )
+      ferite_delete_parameter_list( script, params );
+    if( script->error_state == FE_ERROR_THROWN )
+    {
+        if( retval != NULL )
+          ferite_variable_destroy( script, retval );
+        return NULL;
+    }
+    return retval;
+}
+
+static int serialize_stream_write( FeriteScript *script, SerializeStream *s, unsigned char *data, size_t length )
+{
+    FeriteString chunk;
+    FeriteVariable *retval;
+
+    chunk.data = (char *)data;
+    chunk.length = length;
+    chunk.encoding = FE_CHARSET_DEFAULT;
+    chunk.pos = -1;
+    chunk.storage = NULL;
+    retval = serialize_stream_call( script, s, s->write, ferite_create_parameter_list_from_data( script, "s", &chunk ) );
+    if( retval == NULL )
+      return 0;
+    ferite_variable_destroy( script, retval );
+    return 1;
+}
+
+/* Sends the window as a frame; an empty window is the frame that ends the data */
+static int serialize_stream_flush( SerializeWriter *w )
+{
+    FeriteScript *script = w->script;
+    SerializeStream *s = w->odata;
+    FeriteVariable *retval;
+    unsigned char header[10];
+    size_t length = w->length, used = 0;
+
+    do
+    {
+        header[used++] = (unsigned char)((length & 0x7F) | (length >= 0x80 ? 0x80 : 0));
+        length >>= 7;
+    }
+    while( length > 0 );
+
+    if( !serialize_stream_write( script, s, header, used ) || (w->length > 0 && !serialize_stream_write( script, s, w->data, w->length )) )
+      return 0;
+    if( (retval = serialize_stream_call( script, s, s->flush, NULL )) == NULL )
+      return 0;
+    ferite_variable_destroy( script, retval );
+    w->length = 0;
+    return 1;
+}
+
+int Serialize_writer_to_stream( SerializeWriter *w, FeriteObject *stream )
+{
+    FeriteScript *script = w->script;
+    SerializeStream *s = serialize_stream_create( script, stream );
+
+    if( s == NULL || s->write == NULL || s->flush == NULL )
+    {
+        if( s != NULL )
+          ffree( s );
+        return 0;
+    }
+    w->odata = s;
+    w->flush = serialize_stream_flush;
+    return 1;
+}
+
+/* Sends what is left in the window followed by the end of the data */
+int Serialize_writer_finish( SerializeWriter *w )
+{
+    if( w->failed )
+      return 0;
+    if( w->length > 0 && !serialize_stream_flush( w ) )
+      return 0;
+    return serialize_stream_flush( w );
+}
+
+/* Reads up to length bytes into data, giving back how many turned up or -1 if the stream threw */
+static long serialize_stream_read( FeriteScript *script, SerializeStream *s, unsigned char *data, size_t length )
+{
+    FeriteVariable *retval;
+    long got;
+
+    retval = serialize_stream_call( script, s, s->read, ferite_create_parameter_list_from_data( script, "l", (long)length ) );
+    if( retval == NULL )
+      return -1;
+    got = 0;
+    if( F_VAR_TYPE(retval) == F_VAR_STR )
+    {
+        got = (FE_STRLEN(retval) > length ? (long)length : (long)FE_STRLEN(retval));
+        memcpy( data, FE_STR2PTR(retval), got );
+    }
+    ferite_variable_destroy( script, retval );
+    return got;
+}
+
+/* Reads the length of the next frame, a byte at a time so as not to read past it */
+static int serialize_stream_frame( SerializeReader *r, SerializeStream *s )
+{
+    unsigned int shift = 0;
+    unsigned char c;
+
+    s->frame = 0;
+    do
+    {
+        if( shift >= sizeof(size_t) * 8 )
+          return serialize_corrupt( r, "Corrupted serialized data: bad frame" );
+        if( serialize_stream_read( r->script, s, &c, 1 ) != 1 )
+          return serialize_corrupt( r, "Serialized variable is not complete." );
+        s->frame |= (size_t)(c & 0x7F) << shift;
+        shift += 7;
+    }
+    while( c & 0x80 );
+    return 1;
+}
+
+static int serialize_stream_fill( SerializeReader *r, size_t need )
+{
+    FeriteScript *script = r->script;
+    SerializeStream *s = r->odata;
+    size_t available = r->length - r->position;
+    size_t want;
+    long got;
+
+    /* Keep what has not been decoded at the front of the window */
+    if( r->position > 0 )
+    {
+        memmove( r->data, r->data + r->position, available );
+        r->length = available;
+        r->position = 0;
+    }
+    /* Nothing asks for more than a window: names are checked against it and strings are read in pieces */
+    if( need > r->size )
+      return serialize_corrupt( r, "Serialized variable is not complete." );
+
+    while( r->length < need )
+    {
+        if( s->frame == 0 )
+        {
+            if( !serialize_stream_frame( r, s ) )
+              return 0;
+            if( s->frame == 0 )
+              return serialize_corrupt( r, "Serialized variable is not complete." );
+        }
+        want = r->size - r->length;
+        if( want > s->frame )
+          want = s->frame;
+        if( (got = serialize_stream_read( script, s, r->data + r->length, want )) <= 0 )
+          return serialize_corrupt( r, "Serialized variable is not complete." );
+        r->length += got;
+        s->frame -= got;
+    }
+    return 1;
+}
+
+int Serialize_reader_from_stream( SerializeReader *r, FeriteObject *stream )
+{
+    FeriteScript *script = r->script;
+    SerializeStream *s = serialize_stream_create( script, stream );
+
+    if( s == NULL || s->read == NULL )
+    {
+        if( s != NULL )
+          ffree( s );
+        return 0;
+    }
+    r->odata = s;
+    r->fill = serialize_stream_fill;
+    r->size = SERIALIZE_STREAM_WINDOW;
+    r->data = fmalloc( r->size );
+    r->length = r->position = 0;
+    return 1;
+}
+
+/* Checks that the value took up all of the data, and reads the frame that ends it */
+int Serialize_reader_finish( SerializeReader *r )
+{
+    SerializeStream *s = r->odata;
+
+    if( r->position != r->length || s->frame != 0 )
+      return serialize_corrupt( r, "Serialized variable contains additional data." );
+    if( !serialize_stream_frame( r, s ) )
+      return 0;
+    if( s->frame != 0 )
+      return serialize_corrupt( r, "Serialized variable contains additional data." );
+    return 1;
+}
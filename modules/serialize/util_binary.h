@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2002-2007 Stephan Engstrom
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_UTIL_BINARY__
+#define __FERITE_UTIL_BINARY__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ferite.h"
+
+/*
+ * The binary format is a four byte header ("FEB" and a version) followed by a
+ * single value. A value is a one byte tag and whatever the tag calls for:
+ *
+ *   VOID, FALSE, TRUE, NULL  nothing more
+ *   LONG                     a zig-zag varint
+ *   DOUBLE                   eight bytes of IEEE 754, least significant first
+ *   STRING                   a varint length and that many bytes
+ *   OBJECT                   a name (the class), a varint member count and
+ *                            that many name and value pairs
+ *   REFERENCE                a varint: the n'th OBJECT in the data, from zero
+ *   ARRAY                    a varint count and that many name (the key, empty
+ *                            when there is none) and value pairs
+ *   CLASS, NAMESPACE         a name
+ *
+ * Names go through a string table that is built up on both sides as the data
+ * is walked: a varint with the low bit set refers to table entry (n >> 1),
+ * otherwise (n >> 1) bytes of new name follow and become the next entry. The
+ * member names of a class and the class name itself are therefore only ever
+ * written once.
+ *
+ * The writer and reader work on a window of bytes. When no flush or fill
+ * function is given, the writer grows its window to hold the whole output and
+ * the reader expects all of the data to be in its window already.
+ *
+ * On a Stream the data is cut into frames: a varint length and that many
+ * bytes, with a zero length frame after the last. The writer sends a frame
+ * each time its window fills and the reader never asks the stream for more
+ * than is left of the current frame, so a window's worth of memory is all
+ * either side needs and whatever follows the value in the stream is left
+ * where it is for the next reader.
+ */
+#define SERIALIZE_BINARY_MAGIC     "FEB"
+#define SERIALIZE_BINARY_VERSION   1
+#define SERIALIZE_BINARY_DEPTH     512
+#define SERIALIZE_BINARY_WINDOW    4096
+#define SERIALIZE_STREAM_WINDOW    65536
+
+#define SERIALIZE_BINARY_VOID      0
+#define SERIALIZE_BINARY_FALSE     1
+#define SERIALIZE_BINARY_TRUE      2
+#define SERIALIZE_BINARY_LONG      3
+#define SERIALIZE_BINARY_DOUBLE    4
+#define SERIALIZE_BINARY_STRING    5
+#define SERIALIZE_BINARY_NULL      6
+#define SERIALIZE_BINARY_OBJECT    7
+#define SERIALIZE_BINARY_REFERENCE 8
+#define SERIALIZE_BINARY_ARRAY     9
+#define SERIALIZE_BINARY_CLASS     10
+#define SERIALIZE_BINARY_NAMESPACE 11
+
+typedef struct serialize_pointer_map
+{
+    void **keys;
+    long *values;
+    size_t size;               /* always a power of two */
+    size_t count;
+}
+SerializePointerMap;
+
+typedef struct serialize_stream
+{
+    FeriteObject *stream;
+    FeriteFunction *read;
+    FeriteFunction *write;
+    FeriteFunction *flush;
+    size_t frame;              /* bytes of the current frame not yet read */
+}
+SerializeStream;
+
+typedef struct serialize_writer SerializeWriter;
+typedef struct serialize_reader SerializeReader;
+
+struct serialize_writer
+{
+    FeriteScript *script;
+    unsigned char *data;
+    size_t length;             /* bytes waiting in data */
+    size_t size;               /* bytes allocated for data */
+    int (*flush)( SerializeWriter *w );  /* hand data on and empty it, 0 on failure */
+    void *odata;
+
+    FeriteHash *names;         /* name -> table entry + 1 */
+    long name_count;
+    SerializePointerMap objects;  /* FeriteObject -> its number + 1 */
+    SerializePointerMap classes;  /* FeriteClass -> table entry of its name + 1 */
+    long object_count;
+    int failed;
+};
+
+typedef struct serialize_name
+{
+    char *name;
+    size_t length;
+    void *klass;               /* what the name was last found to be a class for */
+}
+SerializeName;
+
+struct serialize_reader
+{
+    FeriteScript *script;
+    unsigned char *data;
+    size_t length;             /* bytes in data */
+    size_t position;           /* bytes of data already decoded */
+    size_t size;               /* bytes allocated for data when it is ours, otherwise 0 */
+    int (*fill)( SerializeReader *r, size_t need );  /* make 'need' bytes available, 0 on failure */
+    void *odata;
+
+    SerializeName *names;
+    long name_count;
+    long name_size;
+    FeriteObject **objects;
+    long object_count;
+    long object_size;
+    int failed;
+};
+
+void Serialize_writer_init( FeriteScript *script, SerializeWriter *w, size_t size );
+void Serialize_writer_deinit( SerializeWriter *w );
+int Serialize_write_header( SerializeWriter *w );
+int Serialize_write_binary( SerializeWriter *w, FeriteVariable *v, int level );
+FeriteVariable *Serialize_writer_to_var( SerializeWriter *w );
+int Serialize_writer_to_stream( SerializeWriter *w, FeriteObject *stream );
+int Serialize_writer_finish( SerializeWriter *w );
+
+void Serialize_reader_init( FeriteScript *script, SerializeReader *r, unsigned char *data, size_t length );
+void Serialize_reader_deinit( SerializeReader *r );
+int Serialize_read_header( SerializeReader *r );
+FeriteVariable *Serialize_read_binary( SerializeReader *r, char *name, int level );
+void Serialize_reader_wakeup( SerializeReader *r );
+int Serialize_reader_from_stream( SerializeReader *r, FeriteObject *stream );
+int Serialize_reader_finish( SerializeReader *r );
+
+#endif /* __FERITE_UTIL_BINARY__ */
@@ -91,6 +91,7 @@ int Serialize_walk_native( FeriteScript *script, SerializeContex *ctx, FeriteVar
             break;
         case F_VAR_UARRAY:
             ferite_buffer_printf( script, ctx->buf, "%d:%d:%s\n", F_VAR_UARRAY, strlen(v->vname), v->vname );
+            ferite_uarray_resolve( script, VAUA(v) );
             for( i = 0; i < VAUA(v)->size; i++ )
             {
                 /* Recursive walk on arrays */
@@ -203,6 +204,7 @@ int Serialize_walk_XML( FeriteScript *script, SerializeContex *ctx, char *name,
             break;
         case F_VAR_UARRAY:
             ferite_buffer_printf( script, ctx->buf, "%.*s<array%s type=\"array\">\n",level,tab, namebuf );
+            ferite_uarray_resolve( script, VAUA(v) );
             for( i = 0; i < VAUA(v)->size; i++ )
             {
                 /* Recursive walk on arrays */
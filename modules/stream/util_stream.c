@@ -27,6 +27,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "../../libs/aphex/include/aphex.h"
 #include "util_stream.h"
 
 int stream_flush( FeriteScript *script, FeriteObject *self )
@@ -64,6 +65,51 @@ int stream_flush( FeriteScript *script, FeriteObject *self )
     StreamObject->output_buffer = ferite_buffer_new( script, 0 );
     return written;
 }
+/*
+ * printf() and printfWithArray() format straight into the output buffer when write() is
+ * the Stream's own, flushing under the same rules write() uses. A subclass that replaces
+ * write() gets the formatted string handed to it instead.
+ */
+FeriteVariable *stream_printf( FeriteScript *script, FeriteObject *self, FeriteFunction *function, FeriteString *fmt, FeriteVariable **values, int count )
+{
+    FeriteFunction *write = ferite_object_get_function( script, self, "write" );
+    FeriteFormat *format = ferite_format_get( script, ferite_str_cstr( script, fmt ), fmt->length );
+    FeriteBuffer *buf, *current;
+    FeriteVariable *str, *len, **args;
+    size_t before, eoflen;
+
+    if( write != NULL && write->klass == function->klass )
+    {
+        lock_object;
+        buf = StreamObject->output_buffer;
+        before = ferite_buffer_get_size( script, buf );
+        ferite_format_run( script, buf, format, values, count );
+        ferite_format_release( script, format );
+        before = ferite_buffer_get_size( script, buf ) - before;
+        current = buf->current;
+        eoflen = strlen( StreamObject->endofline );
+        /* When the end of line straddles two pages it is simplest to flush */
+        if( StreamObject->aggressive || current->count < eoflen ||
+            memcmp( (char*)current->ptr + current->count - eoflen, StreamObject->endofline, eoflen ) == 0 )
+          stream_flush( script, self );
+        unlock_object;
+        return ferite_create_number_long_variable( script, "printf", (long)before, FE_STATIC );
+    }
+
+    buf = ferite_buffer_new( script, 0 );
+    ferite_format_run( script, buf, format, values, count );
+    ferite_format_release( script, format );
+    str = ferite_buffer_to_var( script, buf );
+    ferite_buffer_delete( script, buf );
+
+    args = ferite_create_parameter_list( script, 2 );
+    args[0] = str;
+    MARK_VARIABLE_AS_DISPOSABLE( str ); /* Just so that we get this cleared up */
+    len = ferite_call_function( script, self, NULL, write, args );
+    ferite_delete_parameter_list( script, args );
+    return len;
+}
+
 FeriteVariable *system_create_pointer_var( FeriteScript *script, char *name, void *ptr )
 {
     FeriteVariable *pointer;
@@ -67,6 +67,7 @@ struct Stream
 };
 
 FERITE_API int stream_flush( FeriteScript *script, FeriteObject *self );
+FERITE_API FeriteVariable *stream_printf( FeriteScript *script, FeriteObject *self, FeriteFunction *function, FeriteString *fmt, FeriteVariable **values, int count );
 FERITE_API FeriteVariable *system_create_pointer_var( FeriteScript *script, char *name, void *ptr );
 FERITE_API FeriteVariable *system_create_stream_object( FeriteScript *script, char *stream_class, FILE *f );
 FERITE_API void stream_clear_input( struct Stream *s );
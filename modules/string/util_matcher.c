@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross, Stephan Engstrom, Alex Holden et al
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util_matcher.h"
+
+FeriteMatcher *matcher_create( FeriteScript *script, FeriteUnifiedArray *patterns, int flags )
+{
+    FeriteMatcher *matcher = NULL;
+    char **list = fmalloc( sizeof(char*) * (patterns->size + 1) );
+    size_t *lengths = fmalloc( sizeof(size_t) * (patterns->size + 1) );
+    int i;
+
+    for( i = 0; i < patterns->size; i++ )
+    {
+        FeriteVariable *v = patterns->array[i];
+        if( F_VAR_TYPE(v) != F_VAR_STR )
+        {
+            ffree( list );
+            ffree( lengths );
+            ferite_error( script, 0, "String.Matcher: pattern %d is a %s, not a string\n", i, ferite_variable_id_to_str( script, F_VAR_TYPE(v) ) );
+            return NULL;
+        }
+        list[i] = VAS(v)->data;
+        lengths[i] = VAS(v)->length;
+    }
+    matcher = ferite_matcher_create( script, list, lengths, patterns->size, flags );
+    ffree( list );
+    ffree( lengths );
+    return matcher;
+}
+
+int matcher_collect( FeriteMatcher *matcher, int pattern, size_t offset, void *data )
+{
+    MatcherRecord *record = data;
+    FeriteScript *script = record->script;
+    FeriteVariable *match = ferite_create_uarray_variable( script, "match", 3, FE_STATIC );
+    size_t length = matcher->lengths[pattern];
+
+    ferite_uarray_add( script, VAUA(match), ferite_create_number_long_variable( script, "pattern", pattern, FE_STATIC ), "pattern", FE_ARRAY_ADD_AT_END );
+    ferite_uarray_add( script, VAUA(match), ferite_create_number_long_variable( script, "offset", (long)offset, FE_STATIC ), "offset", FE_ARRAY_ADD_AT_END );
+    ferite_uarray_add( script, VAUA(match), ferite_create_string_variable_from_view( script, "text", record->text, offset, length, FE_STATIC ), "text", FE_ARRAY_ADD_AT_END );
+    ferite_uarray_add( script, VAUA(record->matches), match, NULL, FE_ARRAY_ADD_AT_END );
+    return 0;
+}
+
+int matcher_stop( FeriteMatcher *matcher, int pattern, size_t offset, void *data )
+{
+    return 1;
+}
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ferite.h"
+#include "thread_header.h"
+#include <sys/time.h>
+
+#define channel_load( p )  __atomic_load_n( (p), __ATOMIC_ACQUIRE )
+#define channel_fence()    __atomic_thread_fence( __ATOMIC_SEQ_CST )
+
+static double ferite_channel_now( void )
+{
+    struct timeval now;
+
+    gettimeofday( &now, NULL );
+    return (double)now.tv_sec + (now.tv_usec / 1000000.0);
+}
+
+FeriteChannel *ferite_channel_create( long capacity, int type )
+{
+    FeriteChannel *channel = NULL;
+    unsigned long i = 0;
+
+    if( capacity < 1 )
+        return NULL;
+
+    /*
+     * With a single cell the sequence for "filled at pos" and "free for the
+     * next lap" would be the same number, so one extra cell is kept and the
+     * capacity is enforced by the sender instead.
+     */
+    channel = fcalloc_ngc( 1, sizeof(FeriteChannel) );
+    channel->slots = (capacity < 2 ? 2 : capacity);
+    channel->cells = fcalloc_ngc( channel->slots, sizeof(FeriteChannelCell) );
+    channel->capacity = capacity;
+    channel->type = type;
+    for( i = 0; i < channel->slots; i++ )
+        channel->cells[i].sequence = i;
+    channel->lock = aphex_mutex_create();
+    channel->not_full = aphex_condition_create();
+    channel->not_empty = aphex_condition_create();
+    return channel;
+}
+
+/* Anything still queued goes with the channel */
+void ferite_channel_destroy( FeriteScript *script, FeriteChannel *channel )
+{
+    unsigned long pos = 0;
+
+    if( channel == NULL )
+        return;
+    for( pos = channel->dequeue_pos; pos != channel->enqueue_pos; pos++ )
+    {
+        FeriteChannelCell *cell = &channel->cells[pos % channel->slots];
+        if( cell->value != NULL )
+            ferite_variable_destroy( script, cell->value );
+    }
+    aphex_condition_destroy( channel->not_empty );
+    aphex_condition_destroy( channel->not_full );
+    aphex_mutex_destroy( channel->lock );
+    ffree_ngc( channel->cells );
+    ffree_ngc( channel );
+}
+
+/*
+ * A cell is free for position pos when its sequence is pos, and holds the
+ * value for pos once its sequence is pos + 1. Taking the value hands the
+ * cell on to position pos + slots.
+ */
+static int ferite_channel_try_push( FeriteChannel *channel, FeriteVariable *value )
+{
+    FeriteChannelCell *cell = NULL;
+    unsigned long pos = __atomic_load_n( &channel->enqueue_pos, __ATOMIC_RELAXED );
+    long diff = 0;
+
+    for( ;; )
+    {
+        cell = &channel->cells[pos % channel->slots];
+        diff = (long)(channel_load( &cell->sequence ) - pos);
+        if( diff == 0 && channel->capacity < channel->slots && pos - channel_load( &channel->dequeue_pos ) >= channel->capacity )
+            return FE_FALSE;
+        if( diff == 0 )
+        {
+            if( __atomic_compare_exchange_n( &channel->enqueue_pos, &pos, pos + 1, FE_TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                break;
+        }
+        else if( diff < 0 )
+            return FE_FALSE;
+        else
+            pos = __atomic_load_n( &channel->enqueue_pos, __ATOMIC_RELAXED );
+    }
+    cell->value = value;
+    __atomic_store_n( &cell->sequence, pos + 1, __ATOMIC_RELEASE );
+    return FE_TRUE;
+}
+
+static FeriteVariable *ferite_channel_try_pop( FeriteChannel *channel )
+{
+    FeriteChannelCell *cell = NULL;
+    FeriteVariable *value = NULL;
+    unsigned long pos = __atomic_load_n( &channel->dequeue_pos, __ATOMIC_RELAXED );
+    long diff = 0;
+
+    for( ;; )
+    {
+        cell = &channel->cells[pos % channel->slots];
+        diff = (long)(channel_load( &cell->sequence ) - (pos + 1));
+        if( diff == 0 )
+        {
+            if( __atomic_compare_exchange_n( &channel->dequeue_pos, &pos, pos + 1, FE_TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                break;
+        }
+        else if( diff < 0 )
+            return NULL;
+        else
+            pos = __atomic_load_n( &channel->dequeue_pos, __ATOMIC_RELAXED );
+    }
+    value = cell->value;
+    cell->value = NULL;
+    __atomic_store_n( &cell->sequence, pos + channel->slots, __ATOMIC_RELEASE );
+    return value;
+}
+
+/* Only take the lock if the other side has said it is parked */
+static void ferite_channel_wake( FeriteChannel *channel, int *parked, AphexCondition *cond )
+{
+    channel_fence();
+    if( __atomic_load_n( parked, __ATOMIC_RELAXED ) > 0 )
+    {
+        aphex_mutex_lock( channel->lock );
+        aphex_condition_signal( cond );
+        aphex_mutex_unlock( channel->lock );
+    }
+}
+
+/*
+ * Park until op succeeds, the channel is closed or the timeout passes. The
+ * parked count is raised before the final attempt, so anybody who makes room
+ * after that point is guaranteed to see it and signal us.
+ */
+static int ferite_channel_park( FeriteChannel *channel, int *parked, AphexCondition *cond, double timeout, int (*op)( FeriteChannel*, void* ), void *data )
+{
+    double deadline = 0, left = 0;
+    int result = FE_CHANNEL_TIMEOUT;
+
+    if( timeout > 0 )
+        deadline = ferite_channel_now() + timeout;
+
+    aphex_mutex_lock( channel->lock );
+    __atomic_add_fetch( parked, 1, __ATOMIC_SEQ_CST );
+    for( ;; )
+    {
+        channel_fence();
+        if( (op)( channel, data ) )
+        {
+            result = FE_CHANNEL_OK;
+            break;
+        }
+        if( channel_load( &channel->closed ) )
+        {
+            result = FE_CHANNEL_CLOSED;
+            break;
+        }
+        if( timeout > 0 )
+        {
+            left = deadline - ferite_channel_now();
+            if( left <= 0 || aphex_condition_timedwait( cond, channel->lock, (int)(left * 1000.0) + 1 ) != 0 )
+            {
+                /* One last look, the value may have turned up as we timed out */
+                if( (op)( channel, data ) )
+                    result = FE_CHANNEL_OK;
+                break;
+            }
+        }
+        else
+            aphex_condition_wait( cond, channel->lock );
+    }
+    __atomic_sub_fetch( parked, 1, __ATOMIC_SEQ_CST );
+    aphex_mutex_unlock( channel->lock );
+    return result;
+}
+
+static int ferite_channel_push_op( FeriteChannel *channel, void *data )
+{
+    return ferite_channel_try_push( channel, (FeriteVariable*)data );
+}
+
+static int ferite_channel_pop_op( FeriteChannel *channel, void *data )
+{
+    return ((*(FeriteVariable**)data = ferite_channel_try_pop( channel )) != NULL);
+}
+
+/*
+ * A timeout below zero waits for as long as it takes, zero does not wait at
+ * all. The channel keeps a copy of the value only if FE_CHANNEL_OK is returned.
+ * The copy belongs to the channel until it is received, and then to whoever
+ * received it: Channel.receive() hands it back marked as disposable, so it is
+ * only ever destroyed once, by the receiving side.
+ */
+int ferite_channel_send( FeriteScript *script, FeriteChannel *channel, FeriteVariable *value, double timeout )
+{
+    FeriteVariable *copy = NULL;
+    int result = FE_CHANNEL_OK;
+
+    if( channel_load( &channel->closed ) )
+        return FE_CHANNEL_CLOSED;
+
+    copy = ferite_duplicate_variable( script, value, NULL );
+    UNMARK_VARIABLE_AS_DISPOSABLE( copy );
+    if( !ferite_channel_try_push( channel, copy ) )
+    {
+        if( timeout == 0 )
+            result = FE_CHANNEL_TIMEOUT;
+        else
+            result = ferite_channel_park( channel, &channel->senders, channel->not_full, timeout, ferite_channel_push_op, copy );
+    }
+
+    if( result == FE_CHANNEL_OK )
+        ferite_channel_wake( channel, &channel->receivers, channel->not_empty );
+    else
+        ferite_variable_destroy( script, copy );
+    return result;
+}
+
+/* Values still queued when the channel is closed can be received */
+int ferite_channel_receive( FeriteScript *script, FeriteChannel *channel, FeriteVariable **value, double timeout )
+{
+    int result = FE_CHANNEL_OK;
+
+    if( (*value = ferite_channel_try_pop( channel )) == NULL )
+    {
+        if( channel_load( &channel->closed ) )
+        {
+            /* A sender may have got in just before the close */
+            if( (*value = ferite_channel_try_pop( channel )) == NULL )
+                return FE_CHANNEL_CLOSED;
+        }
+        else if( timeout == 0 )
+            return FE_CHANNEL_TIMEOUT;
+        else
+            result = ferite_channel_park( channel, &channel->receivers, channel->not_empty, timeout, ferite_channel_pop_op, value );
+    }
+
+    if( result == FE_CHANNEL_OK )
+        ferite_channel_wake( channel, &channel->senders, channel->not_full );
+    return result;
+}
+
+void ferite_channel_close( FeriteChannel *channel )
+{
+    aphex_mutex_lock( channel->lock );
+    __atomic_store_n( &channel->closed, FE_TRUE, __ATOMIC_SEQ_CST );
+    aphex_condition_broadcast( channel->not_full );
+    aphex_condition_broadcast( channel->not_empty );
+    aphex_mutex_unlock( channel->lock );
+}
+
+int ferite_channel_is_closed( FeriteChannel *channel )
+{
+    return channel_load( &channel->closed );
+}
+
+/* Only a snapshot, it may be out of date by the time the caller looks at it */
+long ferite_channel_size( FeriteChannel *channel )
+{
+    unsigned long out = channel_load( &channel->dequeue_pos );
+    unsigned long in = channel_load( &channel->enqueue_pos );
+    long size = (long)(in - out);
+
+    if( size < 0 )
+        return 0;
+    return (size > (long)channel->capacity ? (long)channel->capacity : size);
+}
+
+int ferite_channel_accepts( FeriteChannel *channel, FeriteVariable *value )
+{
+    if( channel->type == FE_CHANNEL_ANY || F_VAR_TYPE(value) == channel->type )
+        return FE_TRUE;
+    /* Numbers are numbers whether they are held as a long or a double */
+    return (channel->type == F_VAR_LONG && F_VAR_TYPE(value) == F_VAR_DOUBLE);
+}
+
+int ferite_channel_type_from_name( char *name )
+{
+    if( strcmp( name, "number" ) == 0 )
+        return F_VAR_LONG;
+    if( strcmp( name, "string" ) == 0 )
+        return F_VAR_STR;
+    if( strcmp( name, "array" ) == 0 )
+        return F_VAR_UARRAY;
+    if( strcmp( name, "object" ) == 0 )
+        return F_VAR_OBJ;
+    if( strcmp( name, "boolean" ) == 0 )
+        return F_VAR_BOOL;
+    if( strcmp( name, "void" ) == 0 )
+        return FE_CHANNEL_ANY;
+    return FE_CHANNEL_UNKNOWN;
+}
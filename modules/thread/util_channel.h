@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_UTIL_CHANNEL__
+#define __FERITE_UTIL_CHANNEL__
+
+#include "ferite.h"
+#include "../../libs/aphex/include/aphex.h"
+
+/*
+ * A Channel is a bounded multi-producer, multi-consumer queue of variables.
+ * The queue itself is lock free: every cell carries a sequence number that
+ * tells a sender whether the cell is free for the position it claimed and a
+ * receiver whether it has been filled, so senders and receivers only ever
+ * race on their own counter. The mutex and condition variables are only
+ * touched by threads that have to park because the channel is full or empty,
+ * and by the other side when it knows somebody is parked.
+ *
+ * Values are copied in with ferite_duplicate_variable, so strings, numbers
+ * and arrays belong to the channel until a receiver takes them over. Objects
+ * are shared rather than copied.
+ */
+#define FE_CHANNEL_OK       0
+#define FE_CHANNEL_TIMEOUT  1   /* Full on send, empty on receive */
+#define FE_CHANNEL_CLOSED   2
+
+#define FE_CHANNEL_ANY     -1   /* The channel is not typed */
+#define FE_CHANNEL_UNKNOWN -2   /* Not the name of a type a channel can carry */
+#define FE_CHANNEL_PAD      64  /* Keeps the two counters on their own cache lines */
+
+#define SelfChannel ((FeriteChannel*)self->odata)
+
+typedef struct __ferite_channel_cell
+{
+    unsigned long    sequence;
+    FeriteVariable  *value;
+} FeriteChannelCell;
+
+typedef struct __ferite_channel
+{
+    FeriteChannelCell *cells;
+    unsigned long    slots;         /* Number of cells, never less than two */
+    unsigned long    capacity;
+    int              type;          /* F_VAR_* accepted by send, or FE_CHANNEL_ANY */
+    char             pad0[FE_CHANNEL_PAD];
+    unsigned long    enqueue_pos;
+    char             pad1[FE_CHANNEL_PAD];
+    unsigned long    dequeue_pos;
+    char             pad2[FE_CHANNEL_PAD];
+    int              closed;
+
+    AphexMutex      *lock;          /* Only for parking */
+    AphexCondition  *not_full;
+    AphexCondition  *not_empty;
+    int              senders;       /* Parked on not_full */
+    int              receivers;     /* Parked on not_empty */
+} FeriteChannel;
+
+FeriteChannel *ferite_channel_create( long capacity, int type );
+void           ferite_channel_destroy( FeriteScript *script, FeriteChannel *channel );
+int            ferite_channel_send( FeriteScript *script, FeriteChannel *channel, FeriteVariable *value, double timeout );
+int            ferite_channel_receive( FeriteScript *script, FeriteChannel *channel, FeriteVariable **value, double timeout );
+void           ferite_channel_close( FeriteChannel *channel );
+int            ferite_channel_is_closed( FeriteChannel *channel );
+long           ferite_channel_size( FeriteChannel *channel );
+int            ferite_channel_accepts( FeriteChannel *channel, FeriteVariable *value );
+int            ferite_channel_type_from_name( char *name );
+
+#endif /* __FERITE_UTIL_CHANNEL__ */
@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ferite.h"
+#include "thread_header.h"
+
+#define cmap_hash( KEY )           ferite_hash_gen( (KEY)->data, (KEY)->length )
+#define cmap_stripe( MAP, HASH )   (&(MAP)->stripes[(HASH) & (FE_CMAP_STRIPES - 1)])
+/* The low bits picked the stripe, so the buckets use the ones above them */
+#define cmap_bucket( STRIPE, HASH ) (((HASH) / FE_CMAP_STRIPES) & ((STRIPE)->size - 1))
+
+FeriteAtomicNumber *ferite_atomic_number_create( long value )
+{
+    FeriteAtomicNumber *number = fcalloc_ngc( 1, sizeof(FeriteAtomicNumber) );
+
+    number->value = value;
+    return number;
+}
+
+void ferite_atomic_number_destroy( FeriteAtomicNumber *number )
+{
+    ffree_ngc( number );
+}
+
+FeriteConcurrentMap *ferite_cmap_create()
+{
+    FeriteConcurrentMap *map = fcalloc_ngc( 1, sizeof(FeriteConcurrentMap) );
+    int i = 0;
+
+    for( i = 0; i < FE_CMAP_STRIPES; i++ )
+    {
+        FeriteCMapStripe *stripe = &map->stripes[i];
+        stripe->lock = aphex_rwlock_create();
+        stripe->size = FE_CMAP_INITIAL_SIZE;
+        stripe->buckets = fcalloc_ngc( stripe->size, sizeof(FeriteCMapEntry*) );
+    }
+    return map;
+}
+
+static void ferite_cmap_entry_destroy( FeriteScript *script, FeriteCMapEntry *entry )
+{
+    ferite_variable_destroy( script, entry->value );
+    ffree_ngc( entry->key );
+    ffree_ngc( entry );
+}
+
+/* Empty a stripe, the caller holds its lock for writing */
+static void ferite_cmap_stripe_empty( FeriteScript *script, FeriteCMapStripe *stripe )
+{
+    FeriteCMapEntry *entry = NULL, *next = NULL;
+    unsigned int i = 0;
+
+    for( i = 0; i < stripe->size; i++ )
+    {
+        for( entry = stripe->buckets[i]; entry != NULL; entry = next )
+        {
+            next = entry->next;
+            ferite_cmap_entry_destroy( script, entry );
+        }
+        stripe->buckets[i] = NULL;
+    }
+    stripe->count = 0;
+}
+
+void ferite_cmap_destroy( FeriteScript *script, FeriteConcurrentMap *map )
+{
+    int i = 0;
+
+    if( map == NULL )
+        return;
+    for( i = 0; i < FE_CMAP_STRIPES; i++ )
+    {
+        ferite_cmap_stripe_empty( script, &map->stripes[i] );
+        ffree_ngc( map->stripes[i].buckets );
+        aphex_rwlock_destroy( map->stripes[i].lock );
+    }
+    ffree_ngc( map );
+}
+
+/* The caller holds the stripe's lock */
+static FeriteCMapEntry **ferite_cmap_find( FeriteCMapStripe *stripe, FeriteString *key, unsigned int hash )
+{
+    FeriteCMapEntry **link = &stripe->buckets[cmap_bucket( stripe, hash )];
+
+    for( ; *link != NULL; link = &(*link)->next )
+    {
+        FeriteCMapEntry *entry = *link;
+        if( entry->hash == hash && entry->length == key->length && memcmp( entry->key, key->data, key->length ) == 0 )
+            break;
+    }
+    return link;
+}
+
+/* Double a stripe's buckets once it averages more than two entries a bucket, the caller holds it for writing */
+static void ferite_cmap_stripe_grow( FeriteCMapStripe *stripe )
+{
+    FeriteCMapEntry **old = stripe->buckets, *entry = NULL, *next = NULL;
+    unsigned int old_size = stripe->size, i = 0;
+
+    if( stripe->count <= stripe->size * 2 )
+        return;
+    stripe->size *= 2;
+    stripe->buckets = fcalloc_ngc( stripe->size, sizeof(FeriteCMapEntry*) );
+    for( i = 0; i < old_size; i++ )
+    {
+        for( entry = old[i]; entry != NULL; entry = next )
+        {
+            unsigned int bucket = cmap_bucket( stripe, entry->hash );
+            next = entry->next;
+            entry->next = stripe->buckets[bucket];
+            stripe->buckets[bucket] = entry;
+        }
+    }
+    ffree_ngc( old );
+}
+
+static FeriteVariable *ferite_cmap_copy_in( FeriteScript *script, FeriteVariable *value )
+{
+    FeriteVariable *copy = ferite_duplicate_variable( script, value, NULL );
+
+    UNMARK_VARIABLE_AS_DISPOSABLE( copy );
+    return copy;
+}
+
+/* The caller holds the stripe for writing, and has checked the key is not there */
+static FeriteCMapEntry *ferite_cmap_insert( FeriteConcurrentMap *map, FeriteCMapStripe *stripe, FeriteCMapEntry **link, FeriteString *key, unsigned int hash, FeriteVariable *value )
+{
+    FeriteCMapEntry *entry = fcalloc_ngc( 1, sizeof(FeriteCMapEntry) );
+
+    entry->key = fmalloc_ngc( key->length + 1 );
+    memcpy( entry->key, key->data, key->length );
+    entry->key[key->length] = '\0';
+    entry->length = key->length;
+    entry->hash = hash;
+    entry->value = value;
+    *link = entry;
+    stripe->count++;
+    __atomic_add_fetch( &map->count, 1, __ATOMIC_RELAXED );
+    ferite_cmap_stripe_grow( stripe );
+    return entry;
+}
+
+void ferite_cmap_set( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key, FeriteVariable *value )
+{
+    unsigned int hash = cmap_hash( key );
+    FeriteCMapStripe *stripe = cmap_stripe( map, hash );
+    FeriteVariable *copy = ferite_cmap_copy_in( script, value ), *old = NULL;
+    FeriteCMapEntry **link = NULL;
+
+    aphex_rwlock_write_lock( stripe->lock );
+    link = ferite_cmap_find( stripe, key, hash );
+    if( *link != NULL )
+    {
+        old = (*link)->value;
+        (*link)->value = copy;
+    }
+    else
+        ferite_cmap_insert( map, stripe, link, key, hash, copy );
+    aphex_rwlock_unlock( stripe->lock );
+
+    /* Destroying an object can run script code, so it is kept out of the lock */
+    if( old != NULL )
+        ferite_variable_destroy( script, old );
+}
+
+int ferite_cmap_set_if_absent( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key, FeriteVariable *value )
+{
+    unsigned int hash = cmap_hash( key );
+    FeriteCMapStripe *stripe = cmap_stripe( map, hash );
+    FeriteCMapEntry **link = NULL;
+    int added = FE_FALSE;
+
+    aphex_rwlock_write_lock( stripe->lock );
+    link = ferite_cmap_find( stripe, key, hash );
+    if( *link == NULL )
+    {
+        ferite_cmap_insert( map, stripe, link, key, hash, ferite_cmap_copy_in( script, value ) );
+        added = FE_TRUE;
+    }
+    aphex_rwlock_unlock( stripe->lock );
+    return added;
+}
+
+/* Returns a copy of the value for the caller, or NULL if there is none */
+FeriteVariable *ferite_cmap_get( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key )
+{
+    unsigned int hash = cmap_hash( key );
+    FeriteCMapStripe *stripe = cmap_stripe( map, hash );
+    FeriteCMapEntry **link = NULL;
+    FeriteVariable *value = NULL;
+
+    aphex_rwlock_read_lock( stripe->lock );
+    link = ferite_cmap_find( stripe, key, hash );
+    if( *link != NULL )
+        value = ferite_duplicate_variable( script, (*link)->value, NULL );
+    aphex_rwlock_unlock( stripe->lock );
+    return value;
+}
+
+int ferite_cmap_has( FeriteConcurrentMap *map, FeriteString *key )
+{
+    unsigned int hash = cmap_hash( key );
+    FeriteCMapStripe *stripe = cmap_stripe( map, hash );
+    int found = FE_FALSE;
+
+    aphex_rwlock_read_lock( stripe->lock );
+    found = (*ferite_cmap_find( stripe, key, hash ) != NULL);
+    aphex_rwlock_unlock( stripe->lock );
+    return found;
+}
+
+int ferite_cmap_remove( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key )
+{
+    unsigned int hash = cmap_hash( key );
+    FeriteCMapStripe *stripe = cmap_stripe( map, hash );
+    FeriteCMapEntry **link = NULL, *entry = NULL;
+
+    aphex_rwlock_write_lock( stripe->lock );
+    link = ferite_cmap_find( stripe, key, hash );
+    if( (entry = *link) != NULL )
+    {
+        *link = entry->next;
+        stripe->count--;
+        __atomic_sub_fetch( &map->count, 1, __ATOMIC_RELAXED );
+    }
+    aphex_rwlock_unlock( stripe->lock );
+
+    if( entry == NULL )
+        return FE_FALSE;
+    ferite_cmap_entry_destroy( script, entry );
+    return FE_TRUE;
+}
+
+/*
+ * Add to the number held under a key, starting from zero if there is none,
+ * and return a copy of the result. Returns NULL if the key holds something
+ * other than a number.
+ */
+FeriteVariable *ferite_cmap_add( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key, double delta )
+{
+    unsigned int hash = cmap_hash( key );
+    FeriteCMapStripe *stripe = cmap_stripe( map, hash );
+    FeriteCMapEntry **link = NULL;
+    FeriteVariable *value = NULL, *result = NULL;
+
+    aphex_rwlock_write_lock( stripe->lock );
+    link = ferite_cmap_find( stripe, key, hash );
+    if( *link == NULL )
+    {
+        value = ferite_create_number_long_variable( script, "ConcurrentMap", 0, FE_ALLOC );
+        ferite_cmap_insert( map, stripe, link, key, hash, value );
+    }
+    else
+        value = (*link)->value;
+
+    if( F_VAR_TYPE(value) == F_VAR_LONG && delta == (double)(long)delta )
+        VAI(value) += (long)delta;
+    else if( F_VAR_TYPE(value) == F_VAR_LONG )
+    {
+        double sum = (double)VAI(value) + delta;
+        F_VAR_TYPE(value) = F_VAR_DOUBLE;
+        VAF(value) = sum;
+    }
+    else if( F_VAR_TYPE(value) == F_VAR_DOUBLE )
+        VAF(value) += delta;
+    else
+        value = NULL;
+
+    if( value != NULL )
+        result = ferite_duplicate_variable( script, value, NULL );
+    aphex_rwlock_unlock( stripe->lock );
+    return result;
+}
+
+/* A snapshot: keys added or removed while it is taken may or may not be in it */
+FeriteVariable *ferite_cmap_keys( FeriteScript *script, FeriteConcurrentMap *map )
+{
+    FeriteVariable *array = ferite_create_uarray_variable( script, "ConcurrentMap.keys", (int)ferite_cmap_size( map ), FE_STATIC );
+    FeriteCMapEntry *entry = NULL;
+    unsigned int i = 0;
+    int s = 0;
+
+    for( s = 0; s < FE_CMAP_STRIPES; s++ )
+    {
+        FeriteCMapStripe *stripe = &map->stripes[s];
+
+        aphex_rwlock_read_lock( stripe->lock );
+        for( i = 0; i < stripe->size; i++ )
+        {
+            for( entry = stripe->buckets[i]; entry != NULL; entry = entry->next )
+            {
+                FeriteVariable *key = ferite_create_string_variable_from_ptr( script, "", entry->key, entry->length, FE_CHARSET_DEFAULT, FE_STATIC );
+                ferite_uarray_add( script, VAUA(array), key, NULL, FE_ARRAY_ADD_AT_END );
+            }
+        }
+        aphex_rwlock_unlock( stripe->lock );
+    }
+    return array;
+}
+
+void ferite_cmap_clear( FeriteScript *script, FeriteConcurrentMap *map )
+{
+    FeriteCMapStripe old;
+    int s = 0;
+
+    for( s = 0; s < FE_CMAP_STRIPES; s++ )
+    {
+        FeriteCMapStripe *stripe = &map->stripes[s];
+
+        /* Swap the buckets out, and empty them once the lock has been dropped */
+        aphex_rwlock_write_lock( stripe->lock );
+        old.buckets = stripe->buckets;
+        old.size = stripe->size;
+        old.count = stripe->count;
+        stripe->size = FE_CMAP_INITIAL_SIZE;
+        stripe->buckets = fcalloc_ngc( stripe->size, sizeof(FeriteCMapEntry*) );
+        stripe->count = 0;
+        __atomic_sub_fetch( &map->count, (long)old.count, __ATOMIC_RELAXED );
+        aphex_rwlock_unlock( stripe->lock );
+
+        ferite_cmap_stripe_empty( script, &old );
+        ffree_ngc( old.buckets );
+    }
+}
+
+long ferite_cmap_size( FeriteConcurrentMap *map )
+{
+    return __atomic_load_n( &map->count, __ATOMIC_RELAXED );
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_UTIL_CONCURRENT__
+#define __FERITE_UTIL_CONCURRENT__
+
+#include "ferite.h"
+#include "../../libs/aphex/include/aphex.h"
+
+/*
+ * An AtomicNumber is a whole number that any number of threads can update
+ * with single atomic instructions, so keeping a count needs no Mutex. It is
+ * kept on a cache line of its own so that counters allocated together do not
+ * slow each other down.
+ *
+ * A ConcurrentMap is a string keyed hash split into stripes, each with its
+ * own read-write lock and its own buckets, so threads working on different
+ * keys rarely meet and readers never hold each other up. Values are copied in
+ * and out with ferite_duplicate_variable, as they are for a Channel: numbers,
+ * strings and arrays belong to the map, objects are shared.
+ */
+#define FE_CONCURRENT_PAD      64
+#define FE_CMAP_STRIPES        32   /* Must be a power of two */
+#define FE_CMAP_INITIAL_SIZE   8    /* Buckets per stripe to start with, also a power of two */
+
+#define SelfAtomic ((FeriteAtomicNumber*)self->odata)
+#define SelfCMap   ((FeriteConcurrentMap*)self->odata)
+
+typedef struct __ferite_atomic_number
+{
+    long             value;
+    char             pad[FE_CONCURRENT_PAD - sizeof(long)];
+} FeriteAtomicNumber;
+
+typedef struct __ferite_cmap_entry
+{
+    char            *key;
+    size_t           length;
+    unsigned int     hash;
+    FeriteVariable  *value;
+    struct __ferite_cmap_entry *next;
+} FeriteCMapEntry;
+
+typedef struct __ferite_cmap_stripe
+{
+    AphexRWLock      *lock;
+    FeriteCMapEntry **buckets;
+    unsigned int      size;
+    unsigned int      count;
+    char              pad[FE_CONCURRENT_PAD];
+} FeriteCMapStripe;
+
+typedef struct __ferite_concurrent_map
+{
+    FeriteCMapStripe stripes[FE_CMAP_STRIPES];
+    long             count;
+} FeriteConcurrentMap;
+
+FeriteAtomicNumber  *ferite_atomic_number_create( long value );
+void                 ferite_atomic_number_destroy( FeriteAtomicNumber *number );
+
+FeriteConcurrentMap *ferite_cmap_create();
+void                 ferite_cmap_destroy( FeriteScript *script, FeriteConcurrentMap *map );
+void                 ferite_cmap_set( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key, FeriteVariable *value );
+int                  ferite_cmap_set_if_absent( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key, FeriteVariable *value );
+FeriteVariable      *ferite_cmap_get( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key );
+int                  ferite_cmap_has( FeriteConcurrentMap *map, FeriteString *key );
+int                  ferite_cmap_remove( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key );
+FeriteVariable      *ferite_cmap_add( FeriteScript *script, FeriteConcurrentMap *map, FeriteString *key, double delta );
+FeriteVariable      *ferite_cmap_keys( FeriteScript *script, FeriteConcurrentMap *map );
+void                 ferite_cmap_clear( FeriteScript *script, FeriteConcurrentMap *map );
+long                 ferite_cmap_size( FeriteConcurrentMap *map );
+
+#endif /* __FERITE_UTIL_CONCURRENT__ */
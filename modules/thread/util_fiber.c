@@ -0,0 +1,541 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ferite.h"
+#include "thread_header.h"
+#include <sys/time.h>
+#include <errno.h>
+
+#ifdef FE_FIBERS_SUPPORTED
+# include <poll.h>
+# include <sys/mman.h>
+# ifndef MAP_ANONYMOUS
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+# ifdef MAP_NORESERVE
+#  define FE_MAP_NORESERVE MAP_NORESERVE
+# else
+#  define FE_MAP_NORESERVE 0
+# endif
+#endif
+
+/* Check the descriptors of parked fibers at least this often while others are runnable */
+#define FE_FIBER_POLL_INTERVAL 64
+
+static FE_THREAD_LOCAL FeriteFiberScheduler ferite_fiber_scheduler;
+
+static double ferite_fiber_now()
+{
+    struct timeval now;
+
+    gettimeofday( &now, NULL );
+    return (double)now.tv_sec + ((double)now.tv_usec / 1000000.0);
+}
+
+FeriteFiber *ferite_fiber_create( FeriteScript *script, FeriteObject *object, FeriteObject *closure )
+{
+    FeriteFiber *fiber = fcalloc_ngc( 1, sizeof(FeriteFiber) );
+
+    fiber->script = script;
+    fiber->object = object;
+    fiber->closure = closure;
+    FINCREF( closure );
+    fiber->status = FE_FIBER_NEW;
+    fiber->fd = -1;
+    fiber->wake = -1.0;
+    return fiber;
+}
+
+FeriteFiber *ferite_fiber_current()
+{
+    return ferite_fiber_scheduler.current;
+}
+
+int ferite_fiber_count()
+{
+    return ferite_fiber_scheduler.count;
+}
+
+#ifdef FE_FIBERS_SUPPORTED
+
+static void ferite_fiber_save( FeriteScript *script, FeriteFiberState *state )
+{
+    state->gc_stack = script->gc_stack;
+    state->stack_level = script->stack_level;
+    state->error_state = script->error_state;
+    state->current_op_file = script->current_op_file;
+    state->current_op_line = script->current_op_line;
+    memcpy( &state->exception_jmpback, &ferite_exception_jmpback, sizeof(jmp_buf) );
+    state->exception_status = ferite_exception_status;
+}
+
+static void ferite_fiber_restore( FeriteScript *script, FeriteFiberState *state )
+{
+    script->gc_stack = state->gc_stack;
+    script->stack_level = state->stack_level;
+    script->error_state = state->error_state;
+    script->current_op_file = state->current_op_file;
+    script->current_op_line = state->current_op_line;
+    memcpy( &ferite_exception_jmpback, &state->exception_jmpback, sizeof(jmp_buf) );
+    ferite_exception_status = state->exception_status;
+}
+
+static int ferite_fiber_io_wait( FeriteScript *script, int fd, int events )
+{
+    if( ferite_fiber_scheduler.current == NULL )
+        return FE_FALSE;
+    ferite_fiber_park( script, fd, events, -1.0 );
+    return FE_TRUE;
+}
+
+static void ferite_fiber_enqueue( FeriteFiberScheduler *scheduler, FeriteFiber *fiber )
+{
+    fiber->status = FE_FIBER_READY;
+    fiber->next = NULL;
+    if( scheduler->ready_tail != NULL )
+        scheduler->ready_tail->next = fiber;
+    else
+        scheduler->ready_head = fiber;
+    scheduler->ready_tail = fiber;
+}
+
+static FeriteFiber *ferite_fiber_dequeue( FeriteFiberScheduler *scheduler )
+{
+    FeriteFiber *fiber = scheduler->ready_head;
+
+    if( fiber != NULL )
+    {
+        if( (scheduler->ready_head = fiber->next) == NULL )
+            scheduler->ready_tail = NULL;
+        fiber->next = NULL;
+    }
+    return fiber;
+}
+
+/* Take a fiber out of whichever list it is on */
+static void ferite_fiber_unlink( FeriteFiberScheduler *scheduler, FeriteFiber *fiber )
+{
+    FeriteFiber **link = (fiber->status == FE_FIBER_READY ? &scheduler->ready_head : &scheduler->parked);
+    FeriteFiber *previous = NULL;
+
+    for( ; *link != NULL; link = &(*link)->next )
+    {
+        if( *link == fiber )
+        {
+            *link = fiber->next;
+            if( fiber->status == FE_FIBER_READY && scheduler->ready_tail == fiber )
+                scheduler->ready_tail = previous;
+            fiber->next = NULL;
+            return;
+        }
+        previous = *link;
+    }
+}
+
+static void ferite_fiber_free_stack( FeriteFiber *fiber )
+{
+    if( fiber->stack != NULL )
+    {
+        munmap( fiber->stack, fiber->stack_size );
+        fiber->stack = NULL;
+    }
+}
+
+/* Runs on the fiber's own stack */
+static void ferite_fiber_entry()
+{
+    FeriteFiber *fiber = ferite_fiber_scheduler.current;
+    FeriteScript *script = fiber->script;
+    FeriteVariable **plist = NULL, *rval = NULL;
+    FeriteFunction *function = NULL;
+
+    plist = ferite_create_parameter_list( script, 1 );
+    function = ferite_object_get_function_for_params( script, fiber->closure, "invoke", plist );
+    if( function != NULL )
+        rval = ferite_call_function( script, fiber->closure, NULL, function, plist );
+
+    if( script->error != NULL )
+    {
+        fiber->error = ferite_pool_error_string( script );
+        ferite_reset_errors( script );
+    }
+    else if( function == NULL )
+        fiber->error = fstrdup( "Unable to find an invoke() method that takes no arguments" );
+    else if( rval != NULL )
+        fiber->value = ferite_duplicate_variable( script, rval, NULL );
+    script->error_state = 0;
+
+    if( rval != NULL )
+        ferite_variable_destroy( script, rval );
+    ferite_delete_parameter_list( script, plist );
+
+    /* The scheduler frees the stack we are standing on, so there is no coming back */
+    fiber->status = FE_FIBER_DONE;
+    swapcontext( &fiber->context, &fiber->scheduler->context );
+}
+
+/* Called from the thread's own stack: run a fiber until it gives up the processor */
+static void ferite_fiber_resume( FeriteFiberScheduler *scheduler, FeriteFiber *fiber )
+{
+    FeriteScript *script = fiber->script;
+
+    ferite_fiber_save( script, &scheduler->state );
+    ferite_fiber_restore( script, &fiber->state );
+    scheduler->current = fiber;
+    fiber->status = FE_FIBER_RUNNING;
+    ferite_set_io_wait_hook( ferite_fiber_io_wait );
+
+    swapcontext( &scheduler->context, &fiber->context );
+
+    ferite_set_io_wait_hook( NULL );
+    scheduler->current = NULL;
+    ferite_fiber_save( script, &fiber->state );
+    ferite_fiber_restore( script, &scheduler->state );
+}
+
+/* Called from a fiber's stack: hand the processor back, having said why */
+static void ferite_fiber_suspend( FeriteFiber *fiber )
+{
+    swapcontext( &fiber->context, &fiber->scheduler->context );
+}
+
+static void ferite_fiber_finish( FeriteFiberScheduler *scheduler, FeriteFiber *fiber )
+{
+    FeriteFiber **link = &scheduler->parked;
+
+    ferite_fiber_free_stack( fiber );
+    scheduler->count--;
+
+    /* Wake anybody joining it */
+    while( *link != NULL )
+    {
+        FeriteFiber *parked = *link;
+        if( parked->target == fiber )
+        {
+            *link = parked->next;
+            parked->target = NULL;
+            ferite_fiber_enqueue( scheduler, parked );
+        }
+        else
+            link = &parked->next;
+    }
+
+    /* This may well be the last reference, and take the fiber with it */
+    FDECREF( fiber->object );
+}
+
+/*
+ * Move parked fibers whose descriptors are ready or whose time is up onto the
+ * ready queue. If block is set and nothing is ready, wait for something to be.
+ * Returns FE_FALSE if there is nothing that could ever wake any of them.
+ */
+static int ferite_fiber_poll( FeriteFiberScheduler *scheduler, int block )
+{
+    struct pollfd *fds = NULL;
+    FeriteFiber *fiber = NULL, **link = NULL;
+    double now = ferite_fiber_now(), nearest = -1.0;
+    int count = 0, i = 0, timeout = (block ? -1 : 0);
+
+    for( fiber = scheduler->parked; fiber != NULL; fiber = fiber->next )
+    {
+        if( fiber->fd >= 0 )
+            count++;
+        if( fiber->wake >= 0.0 && (nearest < 0.0 || fiber->wake < nearest) )
+            nearest = fiber->wake;
+    }
+    if( block )
+    {
+        if( count == 0 && nearest < 0.0 )
+            return FE_FALSE;
+        if( nearest >= 0.0 )
+            timeout = (nearest <= now ? 0 : (int)((nearest - now) * 1000.0) + 1);
+    }
+
+    if( count > 0 )
+    {
+        fds = fmalloc_ngc( sizeof(struct pollfd) * count );
+        for( fiber = scheduler->parked; fiber != NULL; fiber = fiber->next )
+        {
+            if( fiber->fd >= 0 )
+            {
+                fds[i].fd = fiber->fd;
+                fds[i].events = ((fiber->events & FE_IO_READ) ? POLLIN : 0) | ((fiber->events & FE_IO_WRITE) ? POLLOUT : 0);
+                fds[i].revents = 0;
+                i++;
+            }
+        }
+        if( poll( fds, count, timeout ) < 0 )
+            count = 0; /* Interrupted, the next round will look again */
+    }
+    else if( timeout > 0 )
+        usleep( timeout * 1000 );
+
+    now = ferite_fiber_now();
+    i = 0;
+    link = &scheduler->parked;
+    while( (fiber = *link) != NULL )
+    {
+        int revents = 0, ready = FE_FALSE;
+
+        if( fiber->fd >= 0 )
+        {
+            if( count > 0 && (revents = fds[i].revents) != 0 )
+            {
+                fiber->revents = ((revents & (POLLIN|POLLHUP|POLLERR|POLLNVAL)) ? FE_IO_READ : 0) |
+                                 ((revents & (POLLOUT|POLLERR|POLLNVAL)) ? FE_IO_WRITE : 0);
+                ready = FE_TRUE;
+            }
+            i++;
+        }
+        if( fiber->wake >= 0.0 && fiber->wake <= now )
+            ready = FE_TRUE;
+
+        if( ready )
+        {
+            *link = fiber->next;
+            ferite_fiber_enqueue( scheduler, fiber );
+        }
+        else
+            link = &fiber->next;
+    }
+    if( fds != NULL )
+        ffree_ngc( fds );
+    return FE_TRUE;
+}
+
+/* Run fibers until the given one has finished, or until they all have if it is NULL */
+static int ferite_fiber_schedule( FeriteScript *script, FeriteFiber *until )
+{
+    FeriteFiberScheduler *scheduler = &ferite_fiber_scheduler;
+    FeriteFiber *fiber = NULL;
+    int since_poll = 0;
+
+    for( ;; )
+    {
+        if( (until != NULL ? until->status == FE_FIBER_DONE : scheduler->count == 0) )
+            return FE_TRUE;
+        if( script->keep_execution == FE_FALSE )
+            return FE_FALSE;
+
+        if( scheduler->parked != NULL && (scheduler->ready_head == NULL || ++since_poll >= FE_FIBER_POLL_INTERVAL) )
+        {
+            since_poll = 0;
+            if( !ferite_fiber_poll( scheduler, scheduler->ready_head == NULL ) )
+            {
+                ferite_error( script, 0, "Every fiber is waiting for another one to finish\n" );
+                return FE_FALSE;
+            }
+        }
+        if( (fiber = ferite_fiber_dequeue( scheduler )) == NULL )
+            continue;
+
+        ferite_fiber_resume( scheduler, fiber );
+        if( fiber->status == FE_FIBER_DONE )
+            ferite_fiber_finish( scheduler, fiber );
+    }
+}
+
+int ferite_fiber_start( FeriteScript *script, FeriteFiber *fiber )
+{
+    FeriteFiberScheduler *scheduler = &ferite_fiber_scheduler;
+    size_t page = (size_t)getpagesize();
+    void *stack = NULL;
+
+    if( fiber->status != FE_FIBER_NEW )
+    {
+        ferite_error( script, 0, "This fiber has already been started\n" );
+        return FE_FALSE;
+    }
+
+    /* The lowest page is left inaccessible so that running off the end faults instead of trampling */
+    fiber->stack_size = FE_FIBER_STACK_SIZE + page;
+    stack = mmap( NULL, fiber->stack_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|FE_MAP_NORESERVE, -1, 0 );
+    if( stack == MAP_FAILED )
+    {
+        ferite_error( script, 0, "Unable to start fiber: %s\n", strerror( errno ) );
+        return FE_FALSE;
+    }
+    mprotect( stack, page, PROT_NONE );
+    fiber->stack = stack;
+
+    getcontext( &fiber->context );
+    fiber->context.uc_stack.ss_sp = fiber->stack + page;
+    fiber->context.uc_stack.ss_size = FE_FIBER_STACK_SIZE;
+    fiber->context.uc_link = NULL;
+    makecontext( &fiber->context, ferite_fiber_entry, 0 );
+
+    /* A fresh call chain of its own, which the executor will stop short of overrunning the stack */
+    memset( &fiber->state, 0, sizeof(FeriteFiberState) );
+    fiber->state.stack_level = FE_DEEPEST_STACK_LEVEL - FE_FIBER_STACK_LEVELS;
+    fiber->state.current_op_file = script->current_op_file;
+    fiber->state.current_op_line = script->current_op_line;
+
+    fiber->scheduler = scheduler;
+    FINCREF( fiber->object );
+    scheduler->count++;
+    ferite_fiber_enqueue( scheduler, fiber );
+    return FE_TRUE;
+}
+
+int ferite_fiber_yield( FeriteScript *script )
+{
+    FeriteFiber *fiber = ferite_fiber_scheduler.current;
+
+    if( fiber == NULL )
+        return FE_FALSE;
+    ferite_fiber_enqueue( fiber->scheduler, fiber );
+    ferite_fiber_suspend( fiber );
+    return FE_TRUE;
+}
+
+/* Returns the FE_IO_* events that turned up, or 0 if time ran out first */
+int ferite_fiber_park( FeriteScript *script, int fd, int events, double seconds )
+{
+    FeriteFiber *fiber = ferite_fiber_scheduler.current;
+
+    if( fiber == NULL )
+        return 0;
+    fiber->fd = fd;
+    fiber->events = events;
+    fiber->revents = 0;
+    fiber->wake = (seconds < 0.0 ? -1.0 : ferite_fiber_now() + seconds);
+    fiber->status = FE_FIBER_PARKED;
+    fiber->next = fiber->scheduler->parked;
+    fiber->scheduler->parked = fiber;
+
+    ferite_fiber_suspend( fiber );
+
+    fiber->fd = -1;
+    fiber->wake = -1.0;
+    return fiber->revents;
+}
+
+int ferite_fiber_join( FeriteScript *script, FeriteFiber *fiber )
+{
+    FeriteFiber *current = ferite_fiber_scheduler.current;
+
+    if( fiber->status == FE_FIBER_DONE )
+        return FE_TRUE;
+    if( fiber->status == FE_FIBER_NEW )
+    {
+        ferite_error( script, 0, "Unable to join a fiber that has not been started\n" );
+        return FE_FALSE;
+    }
+    if( fiber->scheduler != &ferite_fiber_scheduler )
+    {
+        ferite_error( script, 0, "A fiber can only be joined from the thread that started it\n" );
+        return FE_FALSE;
+    }
+    if( fiber == current )
+    {
+        ferite_error( script, 0, "A fiber can not join itself\n" );
+        return FE_FALSE;
+    }
+
+    if( current == NULL )
+        return ferite_fiber_schedule( script, fiber );
+
+    current->target = fiber;
+    current->status = FE_FIBER_PARKED;
+    current->next = current->scheduler->parked;
+    current->scheduler->parked = current;
+    ferite_fiber_suspend( current );
+    return FE_TRUE;
+}
+
+int ferite_fiber_run( FeriteScript *script )
+{
+    if( ferite_fiber_scheduler.current != NULL )
+    {
+        ferite_error( script, 0, "Fibers can only be run from outside a fiber\n" );
+        return FE_FALSE;
+    }
+    return ferite_fiber_schedule( script, NULL );
+}
+
+void ferite_fiber_destroy( FeriteScript *script, FeriteFiber *fiber )
+{
+    FeriteFiberScheduler *scheduler = fiber->scheduler;
+
+    /*
+     * The scheduler holds a reference while a fiber is unfinished, so this only
+     * happens to one that is still waiting when the script itself goes away. It
+     * can not be unwound, only forgotten.
+     */
+    if( scheduler != NULL && (fiber->status == FE_FIBER_READY || fiber->status == FE_FIBER_PARKED) )
+    {
+        ferite_fiber_unlink( scheduler, fiber );
+        scheduler->count--;
+    }
+    ferite_fiber_free_stack( fiber );
+    if( fiber->closure != NULL )
+        FDECREF( fiber->closure );
+    if( fiber->value != NULL )
+        ferite_variable_destroy( script, fiber->value );
+    if( fiber->error != NULL )
+        ffree_ngc( fiber->error );
+    ffree_ngc( fiber );
+}
+
+#else
+
+int ferite_fiber_start( FeriteScript *script, FeriteFiber *fiber )
+{
+    ferite_error( script, 0, "Fibers are not supported on this platform\n" );
+    return FE_FALSE;
+}
+
+int ferite_fiber_yield( FeriteScript *script )
+{
+    return FE_FALSE;
+}
+
+int ferite_fiber_park( FeriteScript *script, int fd, int events, double seconds )
+{
+    return 0;
+}
+
+int ferite_fiber_join( FeriteScript *script, FeriteFiber *fiber )
+{
+    return (fiber->status == FE_FIBER_DONE);
+}
+
+int ferite_fiber_run( FeriteScript *script )
+{
+    return FE_TRUE;
+}
+
+void ferite_fiber_destroy( FeriteScript *script, FeriteFiber *fiber )
+{
+    if( fiber->closure != NULL )
+        FDECREF( fiber->closure );
+    ffree_ngc( fiber );
+}
+
+#endif /* FE_FIBERS_SUPPORTED */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_UTIL_FIBER__
+#define __FERITE_UTIL_FIBER__
+
+#include <setjmp.h>
+
+#include "ferite.h"
+
+#ifndef WIN32
+# define FE_FIBERS_SUPPORTED
+# include <ucontext.h>
+#endif
+
+/*
+ * A Fiber runs a closure on a C stack of its own, so that the executor can be
+ * suspended half way through a call and picked up again later. Each operating
+ * system thread has its own scheduler; fibers only ever run on the thread that
+ * started them, one at a time, and only give up the processor when they yield,
+ * sleep, join another fiber or wait for a descriptor. While a fiber is running
+ * the scheduler is installed as the thread's I/O wait hook, so native functions
+ * that get EAGAIN from a non-blocking descriptor park the fiber rather than fail.
+ *
+ * The executor keeps a little state in the script and in thread locals that
+ * describes the call chain it is in the middle of. That belongs to the stack it
+ * was built on, so it is swapped along with the stack.
+ */
+#define FE_FIBER_NEW      0   /* Created but not started */
+#define FE_FIBER_READY    1   /* Waiting for its turn */
+#define FE_FIBER_RUNNING  2
+#define FE_FIBER_PARKED   3   /* Waiting for a descriptor, a time or another fiber */
+#define FE_FIBER_DONE     4
+
+#define FE_FIBER_STACK_SIZE   (1024 * 1024)
+#define FE_FIBER_STACK_LEVELS 256   /* Calls deep a fiber may go, well inside the stack above */
+
+#define SelfFiber ((FeriteFiber*)self->odata)
+
+typedef struct __ferite_fiber           FeriteFiber;
+typedef struct __ferite_fiber_scheduler FeriteFiberScheduler;
+
+/* What the executor needs put back when a stack is switched in */
+typedef struct __ferite_fiber_state
+{
+    FeriteExecuteRec *gc_stack;
+    unsigned int      stack_level;
+    unsigned int      error_state;
+    char             *current_op_file;
+    unsigned int      current_op_line;
+    jmp_buf           exception_jmpback;
+    int               exception_status;
+} FeriteFiberState;
+
+struct __ferite_fiber
+{
+#ifdef FE_FIBERS_SUPPORTED
+    ucontext_t        context;
+#endif
+    char             *stack;
+    size_t            stack_size;
+    FeriteFiberState  state;
+
+    FeriteScript     *script;
+    FeriteFiberScheduler *scheduler;  /* Set when started */
+    FeriteObject     *closure;
+    FeriteObject     *object;         /* The Fiber object, referenced while scheduled */
+    int               status;         /* FE_FIBER_* */
+    FeriteVariable   *value;          /* What the closure returned */
+    char             *error;          /* The error the closure failed with */
+
+    int               fd;             /* Parked on a descriptor, or -1 */
+    int               events;         /* FE_IO_* wanted ... */
+    int               revents;        /* ... and what turned up */
+    double            wake;           /* When to give up waiting, or < 0 for never */
+    FeriteFiber      *target;         /* The fiber being joined */
+
+    FeriteFiber      *next;           /* In the ready queue or the parked list */
+};
+
+struct __ferite_fiber_scheduler
+{
+#ifdef FE_FIBERS_SUPPORTED
+    ucontext_t        context;        /* The thread's own stack */
+#endif
+    FeriteFiberState  state;
+    FeriteFiber      *current;
+    FeriteFiber      *ready_head;
+    FeriteFiber      *ready_tail;
+    FeriteFiber      *parked;
+    int               count;          /* Started and not yet finished */
+};
+
+FeriteFiber *ferite_fiber_create( FeriteScript *script, FeriteObject *object, FeriteObject *closure );
+void         ferite_fiber_destroy( FeriteScript *script, FeriteFiber *fiber );
+int          ferite_fiber_start( FeriteScript *script, FeriteFiber *fiber );
+FeriteFiber *ferite_fiber_current();
+int          ferite_fiber_yield( FeriteScript *script );
+int          ferite_fiber_park( FeriteScript *script, int fd, int events, double seconds );
+int          ferite_fiber_join( FeriteScript *script, FeriteFiber *fiber );
+int          ferite_fiber_run( FeriteScript *script );
+int          ferite_fiber_count();
+
+#endif /* __FERITE_UTIL_FIBER__ */
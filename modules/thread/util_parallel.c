@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ferite.h"
+#include "thread_header.h"
+#include "util_parallel.h"
+
+typedef struct __ferite_parallel_job
+{
+    FeriteUnifiedArray *source;
+    FeriteObject       *block;
+    FeriteVariable    **results;    /* One slot per element for map, NULL for each */
+    int                 stop;       /* Set once a closure fails or each() is told to stop */
+    int                 stopped;    /* A closure passed to each() returned false */
+} FeriteParallelJob;
+
+typedef struct __ferite_parallel_chunk
+{
+    FeriteParallelJob  *job;
+    int                 from;
+    int                 to;
+    char               *error;
+} FeriteParallelChunk;
+
+typedef struct __ferite_parallel_run
+{
+    FeriteVariable    **items;
+    FeriteVariable    **tmp;
+    int                 from;
+    int                 mid;        /* -1 to sort the run, otherwise merge [from,mid) with [mid,to) */
+    int                 to;
+} FeriteParallelRun;
+
+/*
+ * Run every piece on the pool and wait for them all. Pieces are run in the
+ * calling script if there is only one of them or the pool is not available.
+ */
+static void ferite_parallel_dispatch( FeriteScript *script, FeritePool *pool, FeritePoolFunction function, char *pieces, size_t piece_size, int count )
+{
+    FeriteFuture **futures = fcalloc_ngc( count, sizeof(FeriteFuture*) );
+    int i = 0;
+
+    for( i = 0; i < count; i++ )
+    {
+        if( pool == NULL || count == 1 || (futures[i] = ferite_pool_submit_native( script, pool, function, pieces + (i * piece_size) )) == NULL )
+            (function)( script, pieces + (i * piece_size) );
+    }
+    for( i = 0; i < count; i++ )
+    {
+        if( futures[i] != NULL )
+        {
+            ferite_future_wait( script, futures[i] );
+            ferite_future_release( script, futures[i] );
+        }
+    }
+    ffree_ngc( futures );
+}
+
+static void ferite_parallel_apply( FeriteScript *script, void *data )
+{
+    FeriteParallelChunk *chunk = data;
+    FeriteParallelJob *job = chunk->job;
+    FeriteVariable **plist = NULL, *rval = NULL;
+    FeriteFunction *function = NULL;
+    int i = 0;
+
+    for( i = chunk->from; i < chunk->to && !__atomic_load_n( &job->stop, __ATOMIC_RELAXED ); i++ )
+    {
+        plist = ferite_create_parameter_list( script, 2 );
+        plist[0] = ferite_duplicate_variable( script, job->source->array[i], NULL );
+        MARK_VARIABLE_AS_DISPOSABLE( plist[0] );
+
+        rval = NULL;
+        if( (function = ferite_object_get_function_for_params( script, job->block, "invoke", plist )) != NULL )
+            rval = ferite_call_function( script, job->block, NULL, function, plist );
+
+        if( script->error != NULL || function == NULL )
+        {
+            if( script->error != NULL )
+                chunk->error = ferite_pool_error_string( script );
+            else
+                chunk->error = fstrdup( "Unable to find an invoke() method that takes one argument" );
+            ferite_reset_errors( script );
+            script->error_state = 0;
+            __atomic_store_n( &job->stop, FE_TRUE, __ATOMIC_RELAXED );
+        }
+        else if( rval != NULL )
+        {
+            if( job->results != NULL )
+                job->results[i] = ferite_duplicate_variable( script, rval, NULL );
+            else if( F_VAR_TYPE(rval) == F_VAR_BOOL && !VAB(rval) )
+            {
+                job->stopped = FE_TRUE;
+                __atomic_store_n( &job->stop, FE_TRUE, __ATOMIC_RELAXED );
+            }
+        }
+
+        if( rval != NULL )
+            ferite_variable_destroy( script, rval );
+        ferite_delete_parameter_list( script, plist );
+    }
+}
+
+/* Cut the array up and run the job. On failure the first error is raised in the caller. */
+static int ferite_parallel_run( FeriteScript *script, FeriteParallelJob *job, int chunk_size )
+{
+    FeritePool *pool = ferite_pool_default( script );
+    FeriteParallelChunk *chunks = NULL;
+    char *error = NULL;
+    int size = job->source->size, count = 0, i = 0;
+
+    if( size == 0 )
+        return FE_TRUE;
+    if( chunk_size <= 0 )
+        chunk_size = size / ((pool != NULL ? pool->count : 1) * 4);
+    if( chunk_size <= 0 )
+        chunk_size = 1;
+
+    count = (size + chunk_size - 1) / chunk_size;
+    chunks = fcalloc_ngc( count, sizeof(FeriteParallelChunk) );
+    for( i = 0; i < count; i++ )
+    {
+        chunks[i].job = job;
+        chunks[i].from = i * chunk_size;
+        chunks[i].to = (chunks[i].from + chunk_size < size ? chunks[i].from + chunk_size : size);
+    }
+    ferite_parallel_dispatch( script, pool, ferite_parallel_apply, (char*)chunks, sizeof(FeriteParallelChunk), count );
+
+    for( i = 0; i < count; i++ )
+    {
+        if( chunks[i].error != NULL )
+        {
+            if( error == NULL )
+                error = chunks[i].error;
+            else
+                ffree_ngc( chunks[i].error );
+        }
+    }
+    ffree_ngc( chunks );
+
+    if( error != NULL )
+    {
+        ferite_error( script, 0, "%s\n", error );
+        ffree_ngc( error );
+        return FE_FALSE;
+    }
+    return FE_TRUE;
+}
+
+static char *ferite_parallel_key( FeriteVariable *var )
+{
+    return (var->vname != NULL && var->vname[0] != '\0' ? var->vname : NULL);
+}
+
+FeriteVariable *ferite_parallel_map( FeriteScript *script, FeriteUnifiedArray *a, FeriteObject *block, int chunk )
+{
+    FeriteVariable *result = ferite_create_uarray_variable( script, "Array::parallelMap", a->size, FE_STATIC );
+    FeriteVariable *value = NULL;
+    FeriteParallelJob job;
+    int i = 0, ok = FE_FALSE;
+
+    /* Accessors run script code, so give lazy items their values here rather than on the workers */
+    ferite_uarray_resolve( script, a );
+    memset( &job, 0, sizeof(FeriteParallelJob) );
+    job.source = a;
+    job.block = block;
+    job.results = fcalloc_ngc( a->size + 1, sizeof(FeriteVariable*) );
+
+    ok = ferite_parallel_run( script, &job, chunk );
+    for( i = 0; i < a->size; i++ )
+    {
+        if( (value = job.results[i]) == NULL )
+        {
+            if( !ok )
+                continue;
+            value = ferite_create_void_variable( script, "", FE_STATIC );
+        }
+        if( ok )
+            ferite_uarray_add( script, VAUA(result), value, ferite_parallel_key( a->array[i] ), FE_ARRAY_ADD_AT_END );
+        else
+            ferite_variable_destroy( script, value );
+    }
+    ffree_ngc( job.results );
+    return result;
+}
+
+int ferite_parallel_each( FeriteScript *script, FeriteUnifiedArray *a, FeriteObject *block, int chunk )
+{
+    FeriteParallelJob job;
+
+    ferite_uarray_resolve( script, a );
+    memset( &job, 0, sizeof(FeriteParallelJob) );
+    job.source = a;
+    job.block = block;
+    if( !ferite_parallel_run( script, &job, chunk ) )
+        return FE_FALSE;
+    return !job.stopped;
+}
+
+/* Numbers compare by value, strings byte by byte with a prefix sorting first */
+static int ferite_parallel_compare( FeriteVariable *a, FeriteVariable *b )
+{
+    FeriteString *x = NULL, *y = NULL;
+    double p = 0.0, q = 0.0;
+    int r = 0;
+
+    if( F_VAR_TYPE(a) == F_VAR_STR )
+    {
+        x = VAS(a);
+        y = VAS(b);
+        if( (r = memcmp( x->data, y->data, (x->length < y->length ? x->length : y->length) )) != 0 )
+            return r;
+        return (x->length < y->length ? -1 : (x->length > y->length ? 1 : 0));
+    }
+    if( F_VAR_TYPE(a) == F_VAR_LONG && F_VAR_TYPE(b) == F_VAR_LONG )
+        return (VAI(a) < VAI(b) ? -1 : (VAI(a) > VAI(b) ? 1 : 0));
+    p = (F_VAR_TYPE(a) == F_VAR_LONG ? (double)VAI(a) : VAF(a));
+    q = (F_VAR_TYPE(b) == F_VAR_LONG ? (double)VAI(b) : VAF(b));
+    return (p < q ? -1 : (p > q ? 1 : 0));
+}
+
+/* Stable: on a tie the element from the left run goes first */
+static void ferite_parallel_merge( FeriteVariable **left, int nl, FeriteVariable **right, int nr, FeriteVariable **out )
+{
+    int i = 0, j = 0, k = 0;
+
+    while( i < nl && j < nr )
+        out[k++] = (ferite_parallel_compare( right[j], left[i] ) < 0 ? right[j++] : left[i++]);
+    while( i < nl )
+        out[k++] = left[i++];
+    while( j < nr )
+        out[k++] = right[j++];
+}
+
+static void ferite_parallel_merge_sort( FeriteVariable **items, FeriteVariable **tmp, int n )
+{
+    FeriteVariable *item = NULL;
+    int i = 0, j = 0, half = n / 2;
+
+    if( n <= 16 )
+    {
+        for( i = 1; i < n; i++ )
+        {
+            item = items[i];
+            for( j = i; j > 0 && ferite_parallel_compare( items[j - 1], item ) > 0; j-- )
+                items[j] = items[j - 1];
+            items[j] = item;
+        }
+        return;
+    }
+    ferite_parallel_merge_sort( items, tmp, half );
+    ferite_parallel_merge_sort( items + half, tmp + half, n - half );
+    if( ferite_parallel_compare( items[half - 1], items[half] ) <= 0 )
+        return;
+    ferite_parallel_merge( items, half, items + half, n - half, tmp );
+    memcpy( items, tmp, sizeof(FeriteVariable*) * n );
+}
+
+static void ferite_parallel_sort_run( FeriteScript *script, void *data )
+{
+    FeriteParallelRun *run = data;
+
+    if( run->mid < 0 )
+        ferite_parallel_merge_sort( run->items + run->from, run->tmp + run->from, run->to - run->from );
+    else
+    {
+        ferite_parallel_merge( run->items + run->from, run->mid - run->from, run->items + run->mid, run->to - run->mid, run->tmp + run->from );
+        memcpy( run->items + run->from, run->tmp + run->from, sizeof(FeriteVariable*) * (run->to - run->from) );
+    }
+}
+
+/*
+ * Each worker sorts one run, then neighbouring runs are merged pairwise,
+ * a round at a time, until only one is left.
+ */
+FeriteVariable *ferite_parallel_sort( FeriteScript *script, FeriteUnifiedArray *a, int direction )
+{
+    FeriteVariable *result = ferite_create_uarray_variable( script, "Array::parallelSort", a->size, FE_STATIC );
+    FeriteVariable **items = NULL, **tmp = NULL, *dup = NULL;
+    FeriteParallelRun *runs = NULL;
+    FeritePool *pool = NULL;
+    int *bounds = NULL;
+    int i = 0, count = 1, merges = 0, is_string = FE_FALSE;
+
+    if( a->size == 0 )
+        return result;
+
+    ferite_uarray_resolve( script, a );
+    is_string = (F_VAR_TYPE(a->array[0]) == F_VAR_STR);
+    for( i = 0; i < a->size; i++ )
+    {
+        int type = F_VAR_TYPE(a->array[i]);
+        if( is_string ? type != F_VAR_STR : (type != F_VAR_LONG && type != F_VAR_DOUBLE) )
+        {
+            ferite_set_error( script, -1, "Variables in array to be sorted in parallel must all be numbers or all be strings" );
+            return result;
+        }
+    }
+
+    items = fmalloc_ngc( sizeof(FeriteVariable*) * a->size );
+    tmp = fmalloc_ngc( sizeof(FeriteVariable*) * a->size );
+    memcpy( items, a->array, sizeof(FeriteVariable*) * a->size );
+
+    if( a->size >= FE_PARALLEL_SORT_CUTOFF && (pool = ferite_pool_default( script )) != NULL )
+        count = pool->count;
+    runs = fcalloc_ngc( count, sizeof(FeriteParallelRun) );
+    bounds = fcalloc_ngc( count + 1, sizeof(int) );
+    for( i = 0; i <= count; i++ )
+        bounds[i] = (int)(((long)a->size * i) / count);
+
+    for( i = 0; i < count; i++ )
+    {
+        runs[i].items = items;
+        runs[i].tmp = tmp;
+        runs[i].from = bounds[i];
+        runs[i].mid = -1;
+        runs[i].to = bounds[i + 1];
+    }
+    ferite_parallel_dispatch( script, pool, ferite_parallel_sort_run, (char*)runs, sizeof(FeriteParallelRun), count );
+
+    while( count > 1 )
+    {
+        merges = count / 2;
+        for( i = 0; i < merges; i++ )
+        {
+            runs[i].from = bounds[2 * i];
+            runs[i].mid = bounds[2 * i + 1];
+            runs[i].to = bounds[2 * i + 2];
+        }
+        ferite_parallel_dispatch( script, pool, ferite_parallel_sort_run, (char*)runs, sizeof(FeriteParallelRun), merges );
+
+        /* Keep every other bound, and the end of an odd run out */
+        for( i = 0; i <= merges; i++ )
+            bounds[i] = bounds[2 * i];
+        if( count % 2 )
+            bounds[++merges] = bounds[count];
+        count = merges;
+    }
+
+    for( i = 0; i < a->size; i++ )
+    {
+        if( (dup = ferite_duplicate_variable( script, items[i], NULL )) != NULL )
+            ferite_uarray_add( script, VAUA(result), dup, ferite_parallel_key( items[i] ), (direction == 1 ? FE_ARRAY_ADD_AT_START : FE_ARRAY_ADD_AT_END) );
+    }
+    ffree_ngc( bounds );
+    ffree_ngc( runs );
+    ffree_ngc( tmp );
+    ffree_ngc( items );
+    return result;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_UTIL_PARALLEL__
+#define __FERITE_UTIL_PARALLEL__
+
+#include "ferite.h"
+#include "util_pool.h"
+
+/*
+ * The Array.parallel* functions. An array is cut into chunks and every chunk
+ * becomes a native task on the script's default pool, so each worker runs
+ * the closure in its own copy of the script. The caller waits for all of the
+ * chunks (helping out if it is a worker itself) and then assembles the
+ * result in order.
+ */
+#define FE_PARALLEL_SORT_CUTOFF  4096   /* Smaller arrays are sorted by a single worker */
+
+FeriteVariable *ferite_parallel_map( FeriteScript *script, FeriteUnifiedArray *a, FeriteObject *block, int chunk );
+int             ferite_parallel_each( FeriteScript *script, FeriteUnifiedArray *a, FeriteObject *block, int chunk );
+FeriteVariable *ferite_parallel_sort( FeriteScript *script, FeriteUnifiedArray *a, int direction );
+
+#endif /* __FERITE_UTIL_PARALLEL__ */
@@ -0,0 +1,690 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ferite.h"
+#include "thread_header.h"
+#include <unistd.h>
+
+#define pool_inc( p )   __atomic_add_fetch( (p), 1, __ATOMIC_SEQ_CST )
+#define pool_dec( p )   __atomic_sub_fetch( (p), 1, __ATOMIC_SEQ_CST )
+
+#define FE_POOL_DEQUE_SIZE  16
+
+static void ferite_pool_run_task( FeriteScript *script, FeritePool *pool, FeritePoolWorker *local, FeritePoolTask *task );
+
+static AphexMutex *ferite_pool_default_lock = NULL;
+
+/*
+ * The deque. The owning worker pushes and pops at the tail, thieves take
+ * from the head. head and tail only ever grow and are masked into the ring,
+ * so they may safely wrap.
+ */
+static void ferite_pool_deque_push( FeritePoolWorker *w, FeritePoolTask *task )
+{
+    FeritePoolTask **tasks = NULL;
+    unsigned int i = 0, count = 0;
+
+    aphex_mutex_lock( w->lock );
+    count = w->tail - w->head;
+    if( count == w->size )
+    {
+        tasks = fcalloc_ngc( w->size * 2, sizeof(FeritePoolTask*) );
+        for( i = 0; i < count; i++ )
+            tasks[i] = w->tasks[(w->head + i) & (w->size - 1)];
+        ffree_ngc( w->tasks );
+        w->tasks = tasks;
+        w->size *= 2;
+        w->head = 0;
+        w->tail = count;
+    }
+    w->tasks[w->tail & (w->size - 1)] = task;
+    w->tail++;
+    aphex_mutex_unlock( w->lock );
+}
+
+static FeritePoolTask *ferite_pool_deque_pop( FeritePoolWorker *w )
+{
+    FeritePoolTask *task = NULL;
+
+    aphex_mutex_lock( w->lock );
+    if( w->tail != w->head )
+    {
+        w->tail--;
+        task = w->tasks[w->tail & (w->size - 1)];
+    }
+    aphex_mutex_unlock( w->lock );
+    return task;
+}
+
+static FeritePoolTask *ferite_pool_deque_steal( FeritePoolWorker *w )
+{
+    FeritePoolTask *task = NULL;
+
+    aphex_mutex_lock( w->lock );
+    if( w->tail != w->head )
+    {
+        task = w->tasks[w->head & (w->size - 1)];
+        w->head++;
+    }
+    aphex_mutex_unlock( w->lock );
+    return task;
+}
+
+static int ferite_pool_has_work( FeritePool *pool )
+{
+    int i = 0, found = FE_FALSE;
+
+    for( i = 0; i < pool->count && !found; i++ )
+    {
+        aphex_mutex_lock( pool->workers[i].lock );
+        found = (pool->workers[i].tail != pool->workers[i].head);
+        aphex_mutex_unlock( pool->workers[i].lock );
+    }
+    return found;
+}
+
+static FeritePoolWorker *ferite_pool_worker_for( FeritePool *pool, FeriteScript *script )
+{
+    int i = 0;
+
+    for( i = 0; pool != NULL && i < pool->count; i++ )
+    {
+        if( pool->workers[i].script == script )
+            return &pool->workers[i];
+    }
+    return NULL;
+}
+
+/* Our own deque first, then everybody else's starting from a random victim */
+static FeritePoolTask *ferite_pool_take( FeritePool *pool, FeritePoolWorker *w )
+{
+    FeritePoolTask *task = NULL;
+    int i = 0, start = 0;
+
+    if( (task = ferite_pool_deque_pop( w )) != NULL )
+        return task;
+
+    w->seed = w->seed * 1103515245 + 12345;
+    start = (int)((w->seed >> 16) % (unsigned int)pool->count);
+    for( i = 0; i < pool->count; i++ )
+    {
+        FeritePoolWorker *victim = &pool->workers[(start + i) % pool->count];
+        if( victim != w && (task = ferite_pool_deque_steal( victim )) != NULL )
+            return task;
+    }
+    return NULL;
+}
+
+/*
+ * Queue a task, on the calling worker's own deque if it is one of ours. While
+ * anything is outstanding the pool holds a place in the owner's thread group
+ * so that the script does not finish underneath its tasks.
+ */
+static int ferite_pool_push( FeritePool *pool, FeritePoolWorker *local, FeritePoolTask *task )
+{
+    FeritePoolWorker *w = local;
+
+    aphex_mutex_lock( pool->lock );
+    if( pool->stopping )
+    {
+        aphex_mutex_unlock( pool->lock );
+        return FE_FALSE;
+    }
+    if( pool->outstanding++ == 0 )
+        ferite_thread_group_attach( pool->owner, pool->owner->thread_group, pool->busy );
+    if( w == NULL )
+        w = &pool->workers[pool->next++ % (unsigned int)pool->count];
+    ferite_pool_deque_push( w, task );
+    if( pool->sleeping > 0 )
+        aphex_condition_signal( pool->wake );
+    aphex_mutex_unlock( pool->lock );
+    return FE_TRUE;
+}
+
+static void ferite_pool_finish( FeritePool *pool )
+{
+    aphex_mutex_lock( pool->lock );
+    if( --pool->outstanding == 0 )
+    {
+        ferite_thread_group_dettach( pool->owner, pool->owner->thread_group, pool->busy );
+        aphex_condition_broadcast( pool->idle );
+    }
+    aphex_mutex_unlock( pool->lock );
+}
+
+/* Once a pool has stopped, anything still chained on to its futures runs in the caller */
+static void ferite_pool_schedule( FeriteScript *script, FeritePool *pool, FeritePoolWorker *local, FeritePoolTask *task )
+{
+    if( pool == NULL || !ferite_pool_push( pool, local, task ) )
+        ferite_pool_run_task( script, pool, local, task );
+}
+
+static void *ferite_pool_worker_execute( void *ptr )
+{
+    FeritePoolWorker *w = ptr;
+    FeritePool *pool = w->pool;
+    FeriteScript *script = w->thread->script;
+    FeritePoolTask *task = NULL;
+    int dirty = FE_FALSE;
+
+    ferite_init_gc( script );
+    w->thread->running = FE_TRUE;
+    while( FE_TRUE )
+    {
+        if( (task = ferite_pool_take( pool, w )) != NULL )
+        {
+            ferite_pool_run_task( script, pool, w, task );
+            ferite_pool_finish( pool );
+            dirty = FE_TRUE;
+            continue;
+        }
+
+        /* Out of work: sweep what the last batch left behind before going to sleep */
+        if( dirty )
+        {
+            ferite_check_gc( script );
+            dirty = FE_FALSE;
+            continue;
+        }
+
+        aphex_mutex_lock( pool->lock );
+        if( !ferite_pool_has_work( pool ) )
+        {
+            if( pool->stopping )
+            {
+                aphex_mutex_unlock( pool->lock );
+                break;
+            }
+            pool->sleeping++;
+            aphex_condition_wait( pool->wake, pool->lock );
+            pool->sleeping--;
+        }
+        aphex_mutex_unlock( pool->lock );
+    }
+    w->thread->running = FE_FALSE;
+    return NULL;
+}
+
+/* Join the first 'started' workers and hand their objects over to the owner */
+static void ferite_pool_stop_workers( FeriteScript *script, FeritePool *pool )
+{
+    FeriteScript *owner = pool->owner;
+    FeritePoolWorker *w = NULL;
+    void *gc = NULL;
+    int i = 0;
+
+    aphex_mutex_lock( pool->lock );
+    pool->stopping = FE_TRUE;
+    aphex_condition_broadcast( pool->wake );
+    aphex_mutex_unlock( pool->lock );
+
+    for( i = 0; i < pool->count; i++ )
+    {
+        w = &pool->workers[i];
+        if( w->thread == NULL )
+            continue;
+        if( w->started )
+            aphex_thread_join( w->thread->ctxt );
+        if( w->thread->script->gc != NULL )
+        {
+            if( owner->gc != NULL && !owner->is_being_deleted )
+            {
+                ferite_collect_gc( w->thread->script );
+                gc = w->thread->script->gc;
+                w->thread->script->gc = NULL;
+                ferite_merge_gc( owner, gc );
+            }
+            else
+            {
+                /* The owner is going, so is everything the worker made: don't touch refcounts */
+                w->thread->script->is_being_deleted = FE_TRUE;
+                ferite_deinit_gc( w->thread->script );
+            }
+        }
+        ferite_thread_destroy_script( owner, w->thread, FE_TRUE );
+        w->thread = NULL;
+    }
+}
+
+FeritePool *ferite_pool_create( FeriteScript *script, int workers )
+{
+    FeritePool *pool = NULL;
+    FeritePoolWorker *w = NULL;
+    int i = 0;
+
+    if( workers <= 0 )
+        workers = (int)sysconf( _SC_NPROCESSORS_ONLN );
+    if( workers <= 0 )
+        workers = 1;
+
+    pool = fcalloc_ngc( 1, sizeof(FeritePool) );
+    pool->owner = script;
+    pool->count = workers;
+    pool->refcount = 1;
+    pool->busy = fcalloc_ngc( 1, sizeof(FeriteThread) );
+    pool->lock = aphex_mutex_create();
+    pool->wake = aphex_condition_create();
+    pool->idle = aphex_condition_create();
+
+    script->is_multi_thread = FE_TRUE;
+    if( script->parent != NULL )
+        script->parent->is_multi_thread = FE_TRUE;
+    ferite_enable_atomic_refcounts();
+
+    pool->workers = fcalloc_ngc( workers, sizeof(FeritePoolWorker) );
+    for( i = 0; i < workers; i++ )
+    {
+        w = &pool->workers[i];
+        w->pool = pool;
+        w->seed = (unsigned int)(i + 1) * 2654435761u;
+        w->size = FE_POOL_DEQUE_SIZE;
+        w->tasks = fcalloc_ngc( w->size, sizeof(FeritePoolTask*) );
+        w->lock = aphex_mutex_create();
+
+        w->thread = fcalloc( 1, sizeof(FeriteThread) );
+        w->thread->ctxt = aphex_thread_create();
+        w->thread->script = ferite_thread_create_script( script );
+        w->thread->script->is_multi_thread = FE_TRUE;
+        w->script = w->thread->script;
+    }
+
+    for( i = 0; i < workers; i++ )
+    {
+        w = &pool->workers[i];
+        if( aphex_thread_start( w->thread->ctxt, ferite_pool_worker_execute, w, FE_FALSE ) != 0 )
+        {
+            ferite_pool_stop_workers( script, pool );
+            ferite_pool_release( script, pool );
+            return NULL;
+        }
+        w->started = FE_TRUE;
+    }
+    return pool;
+}
+
+int ferite_pool_is_worker( FeritePool *pool, FeriteScript *script )
+{
+    return (ferite_pool_worker_for( pool, script ) != NULL);
+}
+
+int ferite_pool_outstanding( FeritePool *pool )
+{
+    int outstanding = 0;
+
+    aphex_mutex_lock( pool->lock );
+    outstanding = pool->outstanding;
+    aphex_mutex_unlock( pool->lock );
+    return outstanding;
+}
+
+/* Let everything queued finish, then stop the workers. Returns false if it has already been done. */
+int ferite_pool_shutdown( FeriteScript *script, FeritePool *pool )
+{
+    aphex_mutex_lock( pool->lock );
+    if( pool->stopping )
+    {
+        aphex_mutex_unlock( pool->lock );
+        return FE_FALSE;
+    }
+    while( pool->outstanding > 0 )
+        aphex_condition_wait( pool->idle, pool->lock );
+    aphex_mutex_unlock( pool->lock );
+
+    ferite_pool_stop_workers( script, pool );
+    return FE_TRUE;
+}
+
+void ferite_pool_release( FeriteScript *script, FeritePool *pool )
+{
+    int i = 0;
+
+    if( pool != NULL && pool_dec( &pool->refcount ) == 0 )
+    {
+        for( i = 0; i < pool->count; i++ )
+        {
+            aphex_mutex_destroy( pool->workers[i].lock );
+            ffree_ngc( pool->workers[i].tasks );
+        }
+        ffree_ngc( pool->workers );
+        ffree_ngc( pool->busy );
+        aphex_condition_destroy( pool->idle );
+        aphex_condition_destroy( pool->wake );
+        aphex_mutex_destroy( pool->lock );
+        ffree_ngc( pool );
+    }
+}
+
+static FeriteFuture *ferite_future_create( FeritePool *pool )
+{
+    FeriteFuture *future = fcalloc_ngc( 1, sizeof(FeriteFuture) );
+
+    future->lock = aphex_mutex_create();
+    future->settled = aphex_condition_create();
+    future->state = FE_FUTURE_PENDING;
+    future->refcount = 1;
+    future->pool = pool;
+    if( pool != NULL )
+        pool_inc( &pool->refcount );
+    return future;
+}
+
+void ferite_future_release( FeriteScript *script, FeriteFuture *future )
+{
+    if( future != NULL && pool_dec( &future->refcount ) == 0 )
+    {
+        if( future->value != NULL )
+            ferite_variable_destroy( script, future->value );
+        if( future->error != NULL )
+            ffree_ngc( future->error );
+        aphex_condition_destroy( future->settled );
+        aphex_mutex_destroy( future->lock );
+        ferite_pool_release( script, future->pool );
+        ffree_ngc( future );
+    }
+}
+
+/* Give the future its value and send its continuations on their way */
+static void ferite_future_settle( FeriteScript *script, FeritePoolWorker *local, FeriteFuture *future, FeriteVariable *value, char *error )
+{
+    FeriteStack *continuations = NULL;
+    int i = 0;
+
+    if( value == NULL && error == NULL )
+        value = ferite_create_void_variable( script, "future-value", FE_STATIC );
+
+    aphex_mutex_lock( future->lock );
+    future->value = value;
+    future->error = error;
+    future->state = (error != NULL ? FE_FUTURE_FAILED : FE_FUTURE_DONE);
+    continuations = future->continuations;
+    future->continuations = NULL;
+    aphex_condition_broadcast( future->settled );
+    aphex_mutex_unlock( future->lock );
+
+    if( continuations != NULL )
+    {
+        for( i = 1; i <= continuations->stack_ptr; i++ )
+            ferite_pool_schedule( script, future->pool, local, continuations->stack[i] );
+        ferite_delete_stack( NULL, continuations );
+    }
+}
+
+/* The error log reads "Error: ...\n", we keep just the message */
+char *ferite_pool_error_string( FeriteScript *script )
+{
+    char *log = ferite_get_error_string( script ), *msg = NULL;
+    char *start = log, *end = NULL;
+    size_t length = 0;
+
+    /* Only the message itself, the backtrace lines that follow it are dropped */
+    if( strncmp( start, "Error: ", 7 ) == 0 )
+        start += 7;
+    length = ((end = strchr( start, '\n' )) != NULL ? (size_t)(end - start) : strlen( start ));
+    msg = fmalloc_ngc( length + 1 );
+    memcpy( msg, start, length );
+    msg[length] = '\0';
+    ffree( log );
+    return msg;
+}
+
+static void ferite_pool_run_task( FeriteScript *script, FeritePool *pool, FeritePoolWorker *local, FeritePoolTask *task )
+{
+    FeriteVariable **plist = NULL, *rval = NULL, *value = NULL;
+    FeriteFunction *function = NULL;
+    FeriteFuture *source = task->source;
+    char *error = NULL;
+
+    if( task->function != NULL )
+    {
+        /* Native work reports its own errors */
+        (task->function)( script, task->data );
+    }
+    else if( source != NULL && source->state == FE_FUTURE_FAILED )
+    {
+        /* A failure falls straight through the chain */
+        error = fstrdup( source->error );
+    }
+    else
+    {
+        plist = ferite_create_parameter_list( script, 2 );
+        if( source != NULL )
+        {
+            plist[0] = ferite_duplicate_variable( script, source->value, NULL );
+            MARK_VARIABLE_AS_DISPOSABLE( plist[0] );
+        }
+        function = ferite_object_get_function_for_params( script, task->closure, "invoke", plist );
+        if( function != NULL )
+            rval = ferite_call_function( script, task->closure, NULL, function, plist );
+
+        if( script->error != NULL )
+        {
+            error = ferite_pool_error_string( script );
+            ferite_reset_errors( script );
+        }
+        else if( function == NULL )
+            error = fstrdup( "Unable to find an invoke() method that takes the supplied arguments" );
+        else if( rval != NULL )
+            value = ferite_duplicate_variable( script, rval, NULL );
+        script->error_state = 0;
+
+        if( rval != NULL )
+            ferite_variable_destroy( script, rval );
+        ferite_delete_parameter_list( script, plist );
+    }
+
+    ferite_future_settle( script, local, task->future, value, error );
+    if( task->closure != NULL )
+        FDECREF( task->closure );
+    ferite_future_release( script, task->future );
+    if( source != NULL )
+        ferite_future_release( script, source );
+    ffree_ngc( task );
+}
+
+static FeritePoolTask *ferite_pool_task_create( FeriteObject *closure, FeriteFuture *source, FeritePool *pool )
+{
+    FeritePoolTask *task = fcalloc_ngc( 1, sizeof(FeritePoolTask) );
+
+    task->closure = closure;
+    if( closure != NULL )
+        FINCREF( closure );
+    task->source = source;
+    if( source != NULL )
+        pool_inc( &source->refcount );
+    task->future = ferite_future_create( pool );
+    return task;
+}
+
+/* Returns the task's future with a reference for the caller, or NULL if the pool has been shut down */
+FeriteFuture *ferite_pool_submit( FeriteScript *script, FeritePool *pool, FeriteObject *closure )
+{
+    FeritePoolTask *task = ferite_pool_task_create( closure, NULL, pool );
+    FeriteFuture *future = task->future;
+
+    pool_inc( &future->refcount );
+    if( !ferite_pool_push( pool, ferite_pool_worker_for( pool, script ), task ) )
+    {
+        if( closure != NULL )
+            FDECREF( closure );
+        ferite_future_release( script, future );
+        ferite_future_release( script, future );
+        ffree_ngc( task );
+        return NULL;
+    }
+    return future;
+}
+
+FeriteFuture *ferite_pool_submit_native( FeriteScript *script, FeritePool *pool, FeritePoolFunction function, void *data )
+{
+    FeritePoolTask *task = ferite_pool_task_create( NULL, NULL, pool );
+    FeriteFuture *future = task->future;
+
+    task->function = function;
+    task->data = data;
+    pool_inc( &future->refcount );
+    if( !ferite_pool_push( pool, ferite_pool_worker_for( pool, script ), task ) )
+    {
+        ferite_future_release( script, future );
+        ferite_future_release( script, future );
+        ffree_ngc( task );
+        return NULL;
+    }
+    return future;
+}
+
+static void ferite_pool_default_cleanup( FeriteScript *script, int id, char *key, void *data )
+{
+    ferite_pool_shutdown( script, data );
+    ferite_pool_release( script, data );
+}
+
+/*
+ * The pool the Array.parallel* functions run on. There is one per top level
+ * script, with a worker per processor, started the first time it is needed
+ * and shut down with the script.
+ */
+FeritePool *ferite_pool_default( FeriteScript *script )
+{
+    FeriteScript *root = script;
+    FeritePool *pool = NULL;
+
+    while( root->parent != NULL )
+        root = root->parent;
+
+    aphex_mutex_lock( ferite_pool_default_lock );
+    if( root->_odata == NULL || (pool = ferite_script_fetch_data( root, "thread.pool" )) == NULL )
+    {
+        if( (pool = ferite_pool_create( root, 0 )) != NULL )
+            ferite_script_attach_data( root, "thread.pool", pool, ferite_pool_default_cleanup );
+    }
+    aphex_mutex_unlock( ferite_pool_default_lock );
+    return pool;
+}
+
+/* The lock guarding the default pools lives as long as the module is loaded */
+void ferite_pool_register( void )
+{
+    if( ferite_pool_default_lock == NULL )
+        ferite_pool_default_lock = aphex_mutex_create();
+}
+
+void ferite_pool_unregister( void )
+{
+    if( ferite_pool_default_lock != NULL )
+    {
+        aphex_mutex_destroy( ferite_pool_default_lock );
+        ferite_pool_default_lock = NULL;
+    }
+}
+
+FeriteFuture *ferite_future_then( FeriteScript *script, FeriteFuture *future, FeriteObject *closure )
+{
+    FeritePoolTask *task = ferite_pool_task_create( closure, future, future->pool );
+    FeriteFuture *next = task->future;
+
+    pool_inc( &next->refcount );
+    aphex_mutex_lock( future->lock );
+    if( future->state == FE_FUTURE_PENDING )
+    {
+        if( future->continuations == NULL )
+            future->continuations = ferite_create_stack( NULL, 4 );
+        ferite_stack_push( NULL, future->continuations, task );
+        aphex_mutex_unlock( future->lock );
+    }
+    else
+    {
+        aphex_mutex_unlock( future->lock );
+        ferite_pool_schedule( script, future->pool, ferite_pool_worker_for( future->pool, script ), task );
+    }
+    return next;
+}
+
+int ferite_future_is_settled( FeriteFuture *future )
+{
+    int settled = FE_FALSE;
+
+    aphex_mutex_lock( future->lock );
+    settled = (future->state != FE_FUTURE_PENDING);
+    aphex_mutex_unlock( future->lock );
+    return settled;
+}
+
+/*
+ * Block until the future settles. A worker waiting on a future from its own
+ * pool keeps running tasks in the meantime, otherwise a pool could easily
+ * wait on itself. Returns true if the task succeeded.
+ */
+int ferite_future_wait( FeriteScript *script, FeriteFuture *future )
+{
+    FeritePoolWorker *local = ferite_pool_worker_for( future->pool, script );
+    FeritePoolTask *task = NULL;
+    int result = FE_FALSE;
+
+    aphex_mutex_lock( future->lock );
+    while( future->state == FE_FUTURE_PENDING )
+    {
+        if( local == NULL )
+        {
+            aphex_condition_wait( future->settled, future->lock );
+            continue;
+        }
+
+        aphex_mutex_unlock( future->lock );
+        if( (task = ferite_pool_take( future->pool, local )) != NULL )
+        {
+            ferite_pool_run_task( script, future->pool, local, task );
+            ferite_pool_finish( future->pool );
+            aphex_mutex_lock( future->lock );
+            continue;
+        }
+        aphex_mutex_lock( future->lock );
+        if( future->state == FE_FUTURE_PENDING )
+        {
+            aphex_condition_timedwait( future->settled, future->lock, 1 );
+        }
+    }
+    result = (future->state == FE_FUTURE_DONE);
+    aphex_mutex_unlock( future->lock );
+    return result;
+}
+
+/* Wrap a future in a Future object, the object takes over the caller's reference */
+FeriteVariable *ferite_future_object( FeriteScript *script, FeriteFuture *future )
+{
+    FeriteClass *klass = ferite_find_class( script, script->mainns, "Future" );
+    FeriteVariable *object = NULL;
+
+    if( klass == NULL || (object = ferite_new_object( script, klass, NULL )) == NULL )
+    {
+        ferite_future_release( script, future );
+        return NULL;
+    }
+    VAO(object)->odata = future;
+    return object;
+}
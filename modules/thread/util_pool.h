@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2001-2007 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FERITE_UTIL_POOL__
+#define __FERITE_UTIL_POOL__
+
+#include "ferite.h"
+#include "../../libs/aphex/include/aphex.h"
+
+/*
+ * A ThreadPool owns a fixed set of workers, each running in its own copy of
+ * the script (see ferite_thread_create_script) with its own GC for the whole
+ * life of the pool. Every worker has a deque of tasks: the worker pushes and
+ * pops at the tail, so work it spawns itself runs depth first and stays warm,
+ * and idle workers steal from the head of somebody else's deque. Each deque
+ * has its own lock, which is only ever contended when a thief turns up.
+ * Tasks submitted from outside the pool are dealt round robin.
+ *
+ * A task settles a Future. Continuations registered with then() are parked
+ * on the future and pushed onto the settling worker's deque once it has a
+ * value. Native tasks run a C function in the worker's script instead of a
+ * closure, which is how the Array.parallel* functions spread their chunks.
+ */
+#define FE_FUTURE_PENDING  0
+#define FE_FUTURE_DONE     1
+#define FE_FUTURE_FAILED   2
+
+#define SelfPool   ((FeritePool*)self->odata)
+#define SelfFuture ((FeriteFuture*)self->odata)
+
+typedef struct __ferite_pool        FeritePool;
+typedef struct __ferite_pool_worker FeritePoolWorker;
+typedef struct __ferite_pool_task   FeritePoolTask;
+typedef struct __ferite_future      FeriteFuture;
+
+typedef void (*FeritePoolFunction)( FeriteScript *script, void *data );
+
+struct __ferite_future
+{
+    AphexMutex      *lock;
+    AphexCondition  *settled;
+    int              state;         /* FE_FUTURE_* */
+    FeriteVariable  *value;         /* A copy of what the task returned */
+    char            *error;         /* The error the task failed with */
+    FeriteStack     *continuations; /* Tasks waiting on the value */
+    FeritePool      *pool;
+    int              refcount;      /* Future objects and tasks holding on to us */
+};
+
+struct __ferite_pool_task
+{
+    FeriteObject    *closure;
+    FeritePoolFunction function;    /* Native work, run instead of a closure */
+    void            *data;
+    FeriteFuture    *source;        /* For continuations, the future whose value is passed in */
+    FeriteFuture    *future;        /* The future the task settles */
+};
+
+struct __ferite_pool_worker
+{
+    FeritePool      *pool;
+    FeriteThread    *thread;
+    FeriteScript    *script;        /* Only ever compared, to spot calls from inside the pool */
+    unsigned int     seed;          /* For picking a victim to steal from */
+    int              started;
+
+    AphexMutex      *lock;          /* Guards the deque */
+    FeritePoolTask **tasks;         /* Ring buffer, head is the oldest task */
+    unsigned int     size;          /* Always a power of two */
+    unsigned int     head;
+    unsigned int     tail;
+};
+
+struct __ferite_pool
+{
+    FeriteScript     *owner;
+    FeritePoolWorker *workers;
+    int               count;
+    unsigned int      next;         /* Round robin for outside submissions */
+
+    AphexMutex       *lock;         /* Guards everything below */
+    AphexCondition   *wake;         /* Signalled when work is pushed */
+    AphexCondition   *idle;         /* Broadcast when nothing is outstanding */
+    int               sleeping;
+    int               outstanding;  /* Tasks queued or running */
+    int               stopping;
+    FeriteThread     *busy;         /* Held in the owner's thread group while there is work */
+    int               refcount;     /* The pool object and futures */
+};
+
+FeritePool   *ferite_pool_create( FeriteScript *script, int workers );
+int           ferite_pool_shutdown( FeriteScript *script, FeritePool *pool );
+void          ferite_pool_release( FeriteScript *script, FeritePool *pool );
+int           ferite_pool_is_worker( FeritePool *pool, FeriteScript *script );
+int           ferite_pool_outstanding( FeritePool *pool );
+FeriteFuture *ferite_pool_submit( FeriteScript *script, FeritePool *pool, FeriteObject *closure );
+FeriteFuture *ferite_pool_submit_native( FeriteScript *script, FeritePool *pool, FeritePoolFunction function, void *data );
+FeritePool   *ferite_pool_default( FeriteScript *script );
+void          ferite_pool_register( void );
+void          ferite_pool_unregister( void );
+char         *ferite_pool_error_string( FeriteScript *script );
+
+FeriteFuture *ferite_future_then( FeriteScript *script, FeriteFuture *future, FeriteObject *closure );
+int           ferite_future_wait( FeriteScript *script, FeriteFuture *future );
+int           ferite_future_is_settled( FeriteFuture *future );
+void          ferite_future_release( FeriteScript *script, FeriteFuture *future );
+FeriteVariable *ferite_future_object( FeriteScript *script, FeriteFuture *future );
+
+#endif /* __FERITE_UTIL_POOL__ */
@@ -52,6 +52,7 @@ FeriteScript *ferite_thread_create_script( FeriteScript *script )
 	/* Create new GC for this thread */
 	new_script->gc = NULL;
 	new_script->gc_stack = NULL;
+	new_script->gc_incoming = NULL;
 
 	/* If we are here then we have not got any errors or warnings reset! :) */
 	new_script->error = NULL;
@@ -132,6 +133,11 @@ void *ferite_thread_execute( void *ptr )
     ferite_init_gc( script );
     ferite_variable_destroy( script, ferite_call_function( script, obj, NULL, function, NULL ) );
     target = script->thread_group->owner;
+    /*
+     * Free what we can while our own caches are still about, so only the survivors
+     * (and anything our own threads handed us) go on to the owner
+     */
+    ferite_collect_gc( script );
     gc = script->gc;
     script->gc = NULL;
 
@@ -28,60 +28,72 @@
 #include "xml_header.h"
 #include "sax_handlers.h"
 
-#define DELIVER_STRING_CALLBACK( NAME, STRING, LENGTH ) \
+static char *sax_callback_names[SAX_CALLBACKS] = {
+    "internalSubset", "externalSubset", "startDocument", "endDocument", "startElement", "endElement",
+    "attribute", "reference", "characters", "ignorableWhitespace", "processingInstruction", "command", "cdata"
+};
+
+/* Copy a string into one of the argument slots, reusing its memory; length < 0 means nul terminated */
+static void sax_set_string( SaxRecord *sr, int slot, const xmlChar *data, int length )
+{
+    FeriteScript *script = sr->script;
+    FeriteString *str = VAS(sr->strings[slot]);
+
+    if( data == NULL )
+      data = (const xmlChar *)"";
+    if( length < 0 )
+      length = strlen( (char *)data );
+    if( str->storage != NULL )
+    {
+        /* The script kept a slice of the last value, which now shares the buffer */
+        ferite_str_materialise( script, str );
+        sr->capacity[slot] = str->length + 1;
+    }
+    if( (size_t)length + 1 > sr->capacity[slot] )
+    {
+        sr->capacity[slot] = ((size_t)length + 64) & ~(size_t)63;
+        ffree( str->data );
+        str->data = fmalloc( sr->capacity[slot] );
+    }
+    memcpy( str->data, data, length );
+    str->data[length] = '\0';
+    str->length = length;
+}
+
+static void sax_deliver( SaxRecord *sr, int callback, FeriteVariable **params )
+{
+    FeriteScript *script = sr->script;
+
+    ferite_variable_destroy( script, ferite_call_function( script, sr->obj, NULL, sr->callbacks[callback], params ) );
+}
+
+#define DELIVER_STRING_CALLBACK( CALLBACK, STRING, LENGTH ) \
     do { \
-        SaxRecord             *sr = ctxt; \
-        FeriteObject          *obj = sr->obj; \
-        FeriteScript          *script = sr->script; \
-        FeriteFunction        *function = NULL; \
-        FeriteVariable        **params = NULL; \
-        FeriteString          *buf; \
-        if( (function = ferite_object_get_function( script, obj, NAME )) != NULL ) { \
-            buf = ferite_str_new(script,(char *)STRING, LENGTH, FE_CHARSET_DEFAULT); \
-            params = ferite_create_parameter_list_from_data( script, "s", buf ); \
-            ferite_variable_destroy( script, ferite_call_function( sr->script, obj, NULL, function, params ) ); \
-            ferite_delete_parameter_list( script, params ); \
-            ferite_str_destroy( script,buf ); \
+        SaxRecord *sr = ctxt; \
+        if( sr->callbacks[CALLBACK] != NULL ) { \
+            sax_set_string( sr, 0, STRING, LENGTH ); \
+            sax_deliver( sr, CALLBACK, sr->one ); \
         } \
     } while(0)
-#define DELIVER_2STRING_CALLBACK( NAME, STRING, LENGTH, STRING1, LENGTH1 ) \
+#define DELIVER_2STRING_CALLBACK( CALLBACK, STRING, LENGTH, STRING1, LENGTH1 ) \
     do { \
-        SaxRecord             *sr = ctxt; \
-        FeriteObject          *obj = sr->obj; \
-        FeriteScript          *script = sr->script; \
-        FeriteFunction        *function = NULL; \
-        FeriteVariable        **params = NULL; \
-        FeriteString          *buf, *buf1; \
-        if( (function = ferite_object_get_function( script, obj, NAME )) != NULL ) { \
-            buf = ferite_str_new(script,(char *)STRING, LENGTH, FE_CHARSET_DEFAULT); \
-            buf1 = ferite_str_new(script,(char *)STRING1, LENGTH1, FE_CHARSET_DEFAULT); \
-            params = ferite_create_parameter_list_from_data( script, "ss", buf, buf1 ); \
-            ferite_variable_destroy( script, ferite_call_function( sr->script, obj, NULL, function, params ) ); \
-            ferite_delete_parameter_list( script, params ); \
-            ferite_str_destroy( script,buf ); \
-            ferite_str_destroy( script,buf1 ); \
+        SaxRecord *sr = ctxt; \
+        if( sr->callbacks[CALLBACK] != NULL ) { \
+            sax_set_string( sr, 0, STRING, LENGTH ); \
+            sax_set_string( sr, 1, STRING1, LENGTH1 ); \
+            sax_deliver( sr, CALLBACK, sr->two ); \
         } \
     } while(0)
-#define DELIVER_3STRING_CALLBACK( NAME, STRING, LENGTH, STRING1, LENGTH1, STRING2, LENGTH2 ) \
+#define DELIVER_3STRING_CALLBACK( CALLBACK, STRING, LENGTH, STRING1, LENGTH1, STRING2, LENGTH2 ) \
     do { \
-        SaxRecord             *sr = ctxt; \
-        FeriteObject          *obj = sr->obj; \
-        FeriteScript          *script = sr->script; \
-        FeriteFunction        *function = NULL; \
-        FeriteVariable        **params = NULL; \
-        FeriteString          *buf, *buf1, *buf2; \
-        if( (function = ferite_object_get_function( script, obj, NAME )) != NULL ) { \
-            buf = ferite_str_new(script,(char *)STRING, LENGTH, FE_CHARSET_DEFAULT); \
-            buf1 = ferite_str_new(script,(char *)STRING1, LENGTH1, FE_CHARSET_DEFAULT); \
-            buf2 = ferite_str_new(script,(char *)STRING2, LENGTH2, FE_CHARSET_DEFAULT); \
-            params = ferite_create_parameter_list_from_data( script, "sss", buf, buf1, buf2 ); \
-            ferite_variable_destroy( script, ferite_call_function( sr->script, obj, NULL, function, params ) ); \
-            ferite_delete_parameter_list( script, params ); \
-            ferite_str_destroy( script,buf ); \
-            ferite_str_destroy( script,buf1 ); \
-            ferite_str_destroy( script,buf2 ); \
+        SaxRecord *sr = ctxt; \
+        if( sr->callbacks[CALLBACK] != NULL ) { \
+            sax_set_string( sr, 0, STRING, LENGTH ); \
+            sax_set_string( sr, 1, STRING1, LENGTH1 ); \
+            sax_set_string( sr, 2, STRING2, LENGTH2 ); \
+            sax_deliver( sr, CALLBACK, sr->three ); \
         } \
-    } while(0) 
+    } while(0)
 
 xmlParserInputPtr sax_resolveEntity(void *ctxt, const xmlChar *publicId, const xmlChar *systemId)
 {
@@ -91,12 +103,12 @@ xmlParserInputPtr sax_resolveEntity(void *ctxt, const xmlChar *publicId, const x
 
 void sax_internalSubset(void *ctxt, const xmlChar *name, const xmlChar *ExternalID, const xmlChar *SystemID)
 {
-    DELIVER_3STRING_CALLBACK("internalSubset", name, 0, ExternalID, 0, SystemID, 0);
+    DELIVER_3STRING_CALLBACK( SAX_INTERNAL_SUBSET, name, -1, ExternalID, -1, SystemID, -1 );
 }
 
 void sax_externalSubset (void *ctxt, const xmlChar *name, const xmlChar *ExternalID, const xmlChar *SystemID)
 {
-    DELIVER_3STRING_CALLBACK("externalSubset", name, 0, ExternalID, 0, SystemID, 0);
+    DELIVER_3STRING_CALLBACK( SAX_EXTERNAL_SUBSET, name, -1, ExternalID, -1, SystemID, -1 );
 }
 
 xmlEntityPtr sax_getEntity (void *ctxt, const xmlChar *name)
@@ -144,94 +156,83 @@ void sax_setDocumentLocator (void *ctxt, xmlSAXLocatorPtr loc)
 void sax_startDocument( void *ctxt )
 {
     SaxRecord             *sr = ctxt;
-    FeriteObject          *obj = sr->obj;
-    FeriteScript          *script = sr->script;
-    FeriteFunction        *function = NULL;
 
-    if( (function = ferite_object_get_function( script, obj, "startDocument" )) != NULL )
-        ferite_variable_destroy( script, ferite_call_function( sr->script, obj, NULL, function, NULL ) );
+    if( sr->callbacks[SAX_START_DOCUMENT] != NULL )
+        sax_deliver( sr, SAX_START_DOCUMENT, NULL );
 }
 
 void sax_endDocument( void *ctxt )
 {
     SaxRecord             *sr = ctxt;
-    FeriteObject          *obj = sr->obj;
-    FeriteScript          *script = sr->script;
-    FeriteFunction        *function = NULL;
 
-    if( (function = ferite_object_get_function( script, obj, "endDocument" )) != NULL )
-        ferite_variable_destroy( script, ferite_call_function( sr->script, obj, NULL, function, NULL ) );
+    if( sr->callbacks[SAX_END_DOCUMENT] != NULL )
+        sax_deliver( sr, SAX_END_DOCUMENT, NULL );
 }
 
 void sax_startElement (void *ctxt, const xmlChar *name, const xmlChar **atts)
 {
-    FeriteVariable        *array;
     int i = 0;
     SaxRecord             *sr = ctxt;
-    FeriteObject          *obj = sr->obj;
     FeriteScript          *script = sr->script;
-    FeriteFunction        *function = NULL;
-    FeriteVariable        **params = NULL, *var = NULL;
-    FeriteString          *tname;
+    FeriteUnifiedArray    *array = VAUA(sr->attributes);
+    FeriteVariable        *var = NULL;
 
-    if( (function = ferite_object_get_function( script, obj, "startElement" )) != NULL )
+    if( sr->callbacks[SAX_START_ELEMENT] != NULL )
     {
-        tname = ferite_str_new(script, (char *)name, 0, FE_CHARSET_DEFAULT);
-        array = ferite_create_uarray_variable( script, "retval-string_split", 10, FE_STATIC );
+        sax_set_string( sr, 0, name, -1 );
+        /* Emptied from the end, which keeps the memory the array and its hash already have */
+        while( array->size > 0 )
+            ferite_uarray_del_index( script, array, array->size - 1 );
         if( atts != NULL )
         {
-            for( i = 0; atts[i] != NULL; i++ )
+            for( i = 0; atts[i] != NULL; i += 2 )
             {
-                var = fe_new_str( (char *)atts[i], (atts[i++] == NULL ? "" : (char *)atts[i]), 0, FE_CHARSET_DEFAULT );
-                ferite_uarray_add( script, VAUA( array ), var, (char *)atts[i-1], FE_ARRAY_ADD_AT_END );
+                var = fe_new_str_static( "", (atts[i+1] == NULL ? "" : (char *)atts[i+1]), 0, FE_CHARSET_DEFAULT );
+                ferite_uarray_add( script, array, var, (char *)atts[i], FE_ARRAY_ADD_AT_END );
             }
         }
-        params = ferite_create_parameter_list_from_data( script, "sa", tname, VAUA(array) );
-        ferite_variable_destroy( script, ferite_call_function( sr->script, obj, NULL, function, params ) );
-        ferite_delete_parameter_list( script, params );
-        ferite_variable_destroy( script, array );
-        ferite_str_destroy( script, tname );
+        sax_deliver( sr, SAX_START_ELEMENT, sr->element );
     }
 }
 
 void sax_endElement (void *ctxt, const xmlChar *name)
 {
-    DELIVER_STRING_CALLBACK("endElement", name, 0);
+    DELIVER_STRING_CALLBACK( SAX_END_ELEMENT, name, -1 );
 }
 
 void sax_attribute (void *ctxt, const xmlChar *name, const xmlChar *value)
 {
-    DELIVER_2STRING_CALLBACK( "attribute", name, 0, value, 0 );
+    DELIVER_2STRING_CALLBACK( SAX_ATTRIBUTE, name, -1, value, -1 );
 }
 
 void sax_reference (void *ctxt, const xmlChar *name)
 {
-    DELIVER_STRING_CALLBACK( "reference", name, 0 );
+    DELIVER_STRING_CALLBACK( SAX_REFERENCE, name, -1 );
 }
 
 void sax_characters (void *ctxt, const xmlChar *ch, int len)
 {
-    DELIVER_STRING_CALLBACK( "characters", ch, len );
+    DELIVER_STRING_CALLBACK( SAX_CHARACTERS, ch, len );
 }
 
 void sax_ignorableWhitespace (void *ctxt, const xmlChar *ch, int len)
 {
-    DELIVER_STRING_CALLBACK( "ignorableWhitespace", ch, len );
+    DELIVER_STRING_CALLBACK( SAX_IGNORABLE_WHITESPACE, ch, len );
 }
 
 void sax_processingInstruction (void *ctxt, const xmlChar *target, const xmlChar *data)
 {
-    DELIVER_2STRING_CALLBACK( "processingInstruction", target, 0, data, 0 );
+    DELIVER_2STRING_CALLBACK( SAX_PROCESSING_INSTRUCTION, target, -1, data, -1 );
 }
 
 void sax_comment (void *ctxt, const xmlChar *value)
 {
-    DELIVER_STRING_CALLBACK( "command", value, strlen((char*)value) );
+    DELIVER_STRING_CALLBACK( SAX_COMMENT, value, -1 );
 }
 
 void sax_cdataBlock (void *ctxt, const xmlChar *value, int len)
 {
-    DELIVER_STRING_CALLBACK( "cdata", value, len );
+    DELIVER_STRING_CALLBACK( SAX_CDATA, value, len );
 }
 
 void sax_warning (void *ctxt, const char *msg, ...)
@@ -260,7 +261,7 @@ void sax_fatalError (void *ctxt, const char *msg, ...)
     va_list ap;
 
     va_start( ap, msg );
-    ferite_verror( sr->script, (char *)msg, &ap );
+    ferite_verror( sr->script, 0, (char *)msg, &ap );
     va_end( ap );
 }
 
@@ -282,36 +283,70 @@ int sax_hasExternalSubset (void *ctxt)
 	return FE_FALSE;
 }
 
-int sax_xmlParseFile( xmlSAXHandlerPtr sax, SaxRecord *obj, char *filename )
+SaxRecord *sax_record_create( FeriteScript *script, FeriteObject *obj )
 {
-    xmlParserCtxtPtr ctxt = NULL;
-
-    ctxt = xmlCreateFileParserCtxt( filename );
-    if( ctxt == NULL )
-    {
-        ferite_error( obj->script, 0, "Unable to find file %s\n", filename );
-        return 0;
-    }
-    ctxt->sax = sax;
-    ctxt->userData = obj;
-
-    return sax_xmlExecuteCtxt( ctxt );
+    SaxRecord *sr = fcalloc( 1, sizeof( SaxRecord ) );
+    int i;
+
+    sr->script = script;
+    sr->obj = obj;
+    sr->sax.internalSubset = sax_internalSubset;
+    sr->sax.isStandalone = sax_isStandalone;
+    sr->sax.hasInternalSubset = sax_hasInternalSubset;
+    sr->sax.hasExternalSubset = sax_hasExternalSubset;
+    sr->sax.resolveEntity = sax_resolveEntity;
+    sr->sax.getEntity = sax_getEntity;
+    sr->sax.entityDecl = sax_entityDecl;
+    sr->sax.notationDecl = sax_notationDecl;
+    sr->sax.attributeDecl = sax_attributeDecl;
+    sr->sax.elementDecl = sax_elementDecl;
+    sr->sax.unparsedEntityDecl = sax_unparsedEntityDecl;
+    sr->sax.setDocumentLocator = sax_setDocumentLocator;
+    sr->sax.startDocument = sax_startDocument;
+    sr->sax.endDocument = sax_endDocument;
+    sr->sax.startElement = sax_startElement;
+    sr->sax.endElement = sax_endElement;
+    sr->sax.reference = sax_reference;
+    sr->sax.characters = sax_characters;
+    sr->sax.ignorableWhitespace = sax_ignorableWhitespace;
+    sr->sax.processingInstruction = sax_processingInstruction;
+    sr->sax.comment = sax_comment;
+    sr->sax.warning = sax_warning;
+    sr->sax.error = sax_error;
+    sr->sax.fatalError = sax_fatalError;
+    sr->sax.getParameterEntity = sax_getParameterEntity;
+    sr->sax.cdataBlock = sax_cdataBlock;
+    sr->sax.externalSubset = sax_externalSubset;
+
+    for( i = 0; i < 3; i++ )
+        sr->strings[i] = fe_new_str_static( "sax-string", "", 0, FE_CHARSET_DEFAULT );
+    sr->attributes = ferite_create_uarray_variable( script, "sax-attributes", 0, FE_STATIC );
+    sr->one[0] = sr->two[0] = sr->three[0] = sr->element[0] = sr->strings[0];
+    sr->two[1] = sr->three[1] = sr->strings[1];
+    sr->three[2] = sr->strings[2];
+    sr->element[1] = sr->attributes;
+    return sr;
 }
 
-int sax_xmlParseChunk( xmlSAXHandlerPtr sax, SaxRecord *obj, FeriteString *chunk )
+void sax_record_destroy( FeriteScript *script, SaxRecord *sr )
 {
-    xmlParserCtxtPtr ctxt = NULL;
+    int i;
+
+    if( sr->push != NULL )
+        xmlFreeParserCtxt( sr->push );
+    for( i = 0; i < 3; i++ )
+        ferite_variable_destroy( script, sr->strings[i] );
+    ferite_variable_destroy( script, sr->attributes );
+    ffree( sr );
+}
 
-    ctxt = xmlCreateMemoryParserCtxt( chunk->data, chunk->length );
-    if( ctxt == NULL )
-    {
-        ferite_error( obj->script, 0, "Unable to parse chunk: %s\n", chunk );
-        return 0;
-    }
-    ctxt->sax = sax;
-    ctxt->userData = obj;
+/* The methods can't change part way through a document, so they are only looked for at the start */
+static void sax_find_callbacks( SaxRecord *sr )
+{
+    int i;
 
-    return sax_xmlExecuteCtxt( ctxt );
+    for( i = 0; i < SAX_CALLBACKS; i++ )
+        sr->callbacks[i] = ferite_object_get_function( sr->script, sr->obj, sax_callback_names[i] );
 }
 
 static int sax_xmlExecuteCtxt( xmlParserCtxtPtr ctxt )
@@ -331,3 +366,52 @@ static int sax_xmlExecuteCtxt( xmlParserCtxtPtr ctxt )
 
     return ret;
 }
+
+int sax_xmlParseFile( SaxRecord *sr, char *filename )
+{
+    xmlParserCtxtPtr ctxt = NULL;
+
+    ctxt = xmlCreateFileParserCtxt( filename );
+    if( ctxt == NULL )
+    {
+        ferite_error( sr->script, 0, "Unable to find file %s\n", filename );
+        return 0;
+    }
+    ctxt->sax = &sr->sax;
+    ctxt->userData = sr;
+    sax_find_callbacks( sr );
+
+    return sax_xmlExecuteCtxt( ctxt );
+}
+
+/*
+ * Feed part of a document to the push parser, starting a new document if
+ * there isn't one on the go. The callbacks are made as soon as libxml2 has
+ * seen enough to be sure of them, so an element can be reported before the
+ * rest of the document has arrived. When final is set the document is
+ * finished off. A document that turns out to be broken is dropped there and
+ * then, and the next chunk starts a new one.
+ */
+int sax_xmlParseChunk( SaxRecord *sr, FeriteString *chunk, int final )
+{
+    int ret = 0;
+
+    if( sr->push == NULL )
+    {
+        sax_find_callbacks( sr );
+        sr->push = xmlCreatePushParserCtxt( &sr->sax, sr, NULL, 0, NULL );
+        if( sr->push == NULL )
+        {
+            ferite_error( sr->script, 0, "Unable to create an XML push parser\n" );
+            return 0;
+        }
+    }
+
+    ret = (xmlParseChunk( sr->push, chunk->data, (int)chunk->length, final ) == 0 && sr->push->wellFormed);
+    if( final || !ret )
+    {
+        xmlFreeParserCtxt( sr->push );
+        sr->push = NULL;
+    }
+    return ret;
+}
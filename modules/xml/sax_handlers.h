@@ -30,10 +30,37 @@
 #include <libxml/parser.h>
 #include <libxml/parserInternals.h>
 
+/* The methods a parser may implement; they are looked up once for each document */
+#define SAX_INTERNAL_SUBSET          0
+#define SAX_EXTERNAL_SUBSET          1
+#define SAX_START_DOCUMENT           2
+#define SAX_END_DOCUMENT             3
+#define SAX_START_ELEMENT            4
+#define SAX_END_ELEMENT              5
+#define SAX_ATTRIBUTE                6
+#define SAX_REFERENCE                7
+#define SAX_CHARACTERS               8
+#define SAX_IGNORABLE_WHITESPACE     9
+#define SAX_PROCESSING_INSTRUCTION  10
+#define SAX_COMMENT                 11
+#define SAX_CDATA                   12
+#define SAX_CALLBACKS               13
+
 typedef struct __sax_record {
-   FeriteScript *script;
-   FeriteObject *obj;
-   int           firstParse;
+   FeriteScript    *script;
+   FeriteObject    *obj;
+   xmlSAXHandler    sax;
+   xmlParserCtxtPtr push;                      /* The document parseChunk() is part way through */
+   FeriteFunction  *callbacks[SAX_CALLBACKS];
+
+   /* The arguments handed to the methods are filled in for each call rather than made afresh */
+   FeriteVariable  *strings[3];
+   size_t           capacity[3];
+   FeriteVariable  *attributes;
+   FeriteVariable  *one[2];
+   FeriteVariable  *two[3];
+   FeriteVariable  *three[4];
+   FeriteVariable  *element[3];
 } SaxRecord;
 
 
@@ -66,11 +93,11 @@ int sax_isStandalone (void *ctx);
 int sax_hasInternalSubset (void *ctx);
 int sax_hasExternalSubset (void *ctx);
 
-int sax_xmlParseFile( xmlSAXHandlerPtr sax, SaxRecord *obj, char *filename );
-int sax_xmlParseChunk( xmlSAXHandlerPtr sax, SaxRecord *obj, FeriteString *chunk );
-
-static int sax_xmlExecuteCtxt( xmlParserCtxtPtr ctxt );
+SaxRecord *sax_record_create( FeriteScript *script, FeriteObject *obj );
+void sax_record_destroy( FeriteScript *script, SaxRecord *sr );
+int sax_xmlParseFile( SaxRecord *sr, char *filename );
+int sax_xmlParseChunk( SaxRecord *sr, FeriteString *chunk, int final );
 
-#define SAXObj  ((xmlSAXHandlerPtr)self->odata)
+#define SAXObj  ((SaxRecord*)self->odata)
 
 #endif /* __SAX_HANDLERS_H__ */
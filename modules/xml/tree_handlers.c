@@ -23,6 +23,7 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include "tree_handlers.h"
+#include "xpath_handlers.h"
 
 void tree_error_handler(void * ctxt, const char * msg, ...)
 {
@@ -49,7 +50,7 @@ FeriteVariable *create_element_node( FeriteScript *script, xmlDocPtr doc, xmlNod
     return obj;
 }
 
-xmlXPathObjectPtr get_nodes_with_name_xpath( XMLDoc *tree, FeriteString *str ) 
+xmlXPathObjectPtr get_nodes_with_name_xpath( FeriteScript *script, XMLDoc *tree, FeriteString *str ) 
 {
     char *xpath, *x = "descendant-or-self::node()";	
     xmlXPathCompExprPtr comp = NULL;
@@ -57,20 +58,12 @@ xmlXPathObjectPtr get_nodes_with_name_xpath( XMLDoc *tree, FeriteString *str )
     
     xpath = malloc(length);
     memset(xpath, '\0', length );
-    sprintf( xpath, "%s/%s", x, str->data );
-    comp = xmlXPathCompile( BAD_CAST xpath );
+    sprintf( xpath, "%s/%.*s", x, (int)str->length, str->data );
+    comp = xpath_compile_cached( script, tree->doc, xpath );
     free(xpath);
     
-    if( comp != NULL ) {
-        xmlXPathObjectPtr res = NULL; 
-        xmlXPathContextPtr ctxt = xmlXPathNewContext( tree->doc );
-        
-        ctxt->node = tree->node;
-        res = xmlXPathCompiledEval( comp, ctxt );
-        xmlXPathFreeContext( ctxt );
-        xmlXPathFreeCompExpr( comp );  
-        return res;
-    }
+    if( comp != NULL )
+        return xpath_evaluate( script, tree, comp );
     return NULL;
 }
 
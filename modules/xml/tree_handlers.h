@@ -46,7 +46,7 @@ typedef struct __xmldoc {
 
 void               tree_error_handler(void * ctxt, const char * msg, ...);
 FeriteVariable    *create_element_node( FeriteScript *script, xmlDocPtr doc, xmlNodePtr node );
-xmlXPathObjectPtr  get_nodes_with_name_xpath( XMLDoc *tree, FeriteString *str );
+xmlXPathObjectPtr  get_nodes_with_name_xpath( FeriteScript *script, XMLDoc *tree, FeriteString *str );
 void               recursive_namespace_copy( xmlNodePtr target, xmlNodePtr ref );
 
 #endif /* __TREE_HANDLERS_H__ */
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2000-2003 Chris Ross and various contributors
+ * Copyright (C) 1999-2000 Chris Ross
+ * Copyright (C) 2004 Christian M. Stamgren
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *   
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of the Software, its documentation and marketing & publicity 
+ * materials, and acknowledgment shall be given in the documentation, materials
+ * and software packages that this Software was used.
+ *    
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER 
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "writer_handlers.h"
+
+/* Calls one of the stream's methods, noting whether it threw */
+static int writer_call( WriterRecord *wr, FeriteFunction *func, FeriteVariable **params )
+{
+    FeriteScript *script = wr->script;
+    FeriteVariable *retval = ferite_call_function( script, wr->stream, NULL, func, params );
+
+    if( params != NULL )
+        ferite_delete_parameter_list( script, params );
+    if( retval != NULL )
+        ferite_variable_destroy( script, retval );
+    if( script->error_state == FE_ERROR_THROWN )
+        wr->failed = FE_TRUE;
+    return !wr->failed;
+}
+
+/*
+ * Hands length bytes to the stream's write() method and flushes it; a Stream
+ * only passes on its buffer by itself at the end of a line, which would leave
+ * the whole document sitting there.
+ */
+static int writer_send( WriterRecord *wr, const char *data, size_t length )
+{
+    FeriteScript *script = wr->script;
+    FeriteString chunk;
+
+    chunk.data = (char *)data;
+    chunk.length = length;
+    chunk.encoding = FE_CHARSET_DEFAULT;
+    chunk.pos = -1;
+    chunk.storage = NULL;
+    if( !writer_call( wr, wr->write, ferite_create_parameter_list_from_data( script, "s", &chunk ) ) )
+        return FE_FALSE;
+    return writer_call( wr, wr->flush, NULL );
+}
+
+/* The write callback of the xmlTextWriter's output buffer */
+static int writer_output( void *context, const char *buffer, int len )
+{
+    WriterRecord *wr = context;
+
+    if( wr->closing )
+        return len;
+    if( wr->failed )
+        return -1;
+
+    if( wr->length + len > XML_WRITER_WINDOW )
+    {
+        if( wr->length > 0 && !writer_send( wr, wr->window, wr->length ) )
+            return -1;
+        wr->length = 0;
+    }
+    if( len >= XML_WRITER_WINDOW )
+        return (writer_send( wr, buffer, len ) ? len : -1);
+
+    memcpy( wr->window + wr->length, buffer, len );
+    wr->length += len;
+    return len;
+}
+
+WriterRecord *writer_record_create( FeriteScript *script, FeriteObject *stream )
+{
+    WriterRecord *wr = NULL;
+    FeriteFunction *write = NULL, *flush = NULL;
+    xmlOutputBufferPtr out = NULL;
+
+    if( stream == NULL ||
+        (write = ferite_object_get_function( script, stream, "write" )) == NULL ||
+        (flush = ferite_object_get_function( script, stream, "flush" )) == NULL )
+        return NULL;
+
+    wr = fcalloc( 1, sizeof( WriterRecord ) );
+    wr->script = script;
+    wr->stream = stream;
+    wr->write = write;
+    wr->flush = flush;
+    wr->window = fmalloc( XML_WRITER_WINDOW );
+    wr->names = xmlDictCreate();
+    FINCREF( stream );
+
+    out = xmlOutputBufferCreateIO( writer_output, NULL, wr, NULL );
+    if( out != NULL )
+        wr->writer = xmlNewTextWriter( out );
+    if( wr->writer == NULL )
+    {
+        if( out != NULL )
+            xmlOutputBufferClose( out );
+        writer_record_destroy( script, wr );
+        return NULL;
+    }
+    return wr;
+}
+
+void writer_record_destroy( FeriteScript *script, WriterRecord *wr )
+{
+    /* Whatever was not flushed has nowhere safe to go by now */
+    wr->closing = FE_TRUE;
+    if( wr->writer != NULL )
+        xmlFreeTextWriter( wr->writer );
+    if( wr->names != NULL )
+        xmlDictFree( wr->names );
+    if( !ferite_script_being_deleted( script ) )
+        FDECREF( wr->stream );
+    ffree( wr->window );
+    ffree( wr );
+}
+
+const xmlChar *writer_name( WriterRecord *wr, FeriteString *name )
+{
+    FeriteScript *script = wr->script;
+    const xmlChar *known = xmlDictExists( wr->names, (xmlChar *)name->data, (int)name->length );
+
+    if( known == NULL )
+    {
+        if( name->length == 0 || strlen( ferite_str_cstr( script, name ) ) != name->length || xmlValidateQName( (xmlChar *)name->data, 0 ) != 0 )
+        {
+            ferite_error( script, 0, "XML.Writer: '%s' is not a valid XML name\n", name->data );
+            return NULL;
+        }
+        known = xmlDictLookup( wr->names, (xmlChar *)name->data, (int)name->length );
+    }
+    return known;
+}
+
+int writer_check( WriterRecord *wr, int rc, char *what )
+{
+    FeriteScript *script = wr->script;
+
+    if( rc >= 0 )
+        return FE_TRUE;
+    /* When the stream threw that error is already on its way */
+    if( !wr->failed )
+        ferite_error( script, 0, "XML.Writer: unable to %s\n", what );
+    return FE_FALSE;
+}
+
+/*
+ * A CDATA section ends at the first "]]>", so text holding one is split
+ * between the "]]" and the ">" and carried on in a new section. Read back,
+ * the sections join up to the text as it was given.
+ */
+int writer_cdata( WriterRecord *wr, FeriteString *text )
+{
+    char *start = text->data, *end = text->data + text->length, *p = start;
+
+    do
+    {
+        while( p + 2 < end && !(p[0] == ']' && p[1] == ']' && p[2] == '>') )
+            p++;
+        p = (p + 2 < end ? p + 2 : end);
+        if( !writer_check( wr, xmlTextWriterStartCDATA( wr->writer ), "write a CDATA section" ) ||
+            !writer_check( wr, xmlTextWriterWriteRawLen( wr->writer, (xmlChar *)start, (int)(p - start) ), "write a CDATA section" ) ||
+            !writer_check( wr, xmlTextWriterEndCDATA( wr->writer ), "write a CDATA section" ) )
+            return FE_FALSE;
+        start = p;
+    }
+    while( p < end );
+    return FE_TRUE;
+}
+
+int writer_flush( WriterRecord *wr )
+{
+    if( !writer_check( wr, xmlTextWriterFlush( wr->writer ), "flush the document" ) )
+        return FE_FALSE;
+    if( wr->length == 0 )
+        return writer_call( wr, wr->flush, NULL );
+    if( !writer_send( wr, wr->window, wr->length ) )
+        return FE_FALSE;
+    wr->length = 0;
+    return FE_TRUE;
+}
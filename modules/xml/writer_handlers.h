@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2000-2003 Chris Ross and various contributors
+ * Copyright (C) 1999-2000 Chris Ross
+ * Copyright (C) 2004 Christian M. Stamgren
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *   
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of the Software, its documentation and marketing & publicity 
+ * materials, and acknowledgment shall be given in the documentation, materials
+ * and software packages that this Software was used.
+ *    
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER 
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __WRITER_HANDLERS_H__
+#define __WRITER_HANDLERS_H__
+
+#include <ferite.h>
+#include <libxml/xmlwriter.h>
+#include <libxml/dict.h>
+
+/*
+ * XML.Writer drives an xmlTextWriter whose output buffer hands its bytes to a
+ * window here; when the window fills it is passed to the stream's write() and
+ * flush() methods, so nothing more than the window is ever held whatever the
+ * size of the document. Element and attribute names are checked the first time they
+ * are seen and kept in a dictionary, after which the same name costs a lookup.
+ */
+#define XML_WRITER_WINDOW (64 * 1024)
+
+typedef struct __writer_record {
+    FeriteScript     *script;
+    FeriteObject     *stream;
+    FeriteFunction   *write;
+    FeriteFunction   *flush;
+    xmlTextWriterPtr  writer;
+    xmlDictPtr        names;
+    char             *window;
+    size_t            length;
+    int               failed;       /* The stream threw, nothing more is sent */
+    int               closing;      /* Being destroyed, anything left is dropped */
+} WriterRecord;
+
+WriterRecord  *writer_record_create( FeriteScript *script, FeriteObject *stream );
+void           writer_record_destroy( FeriteScript *script, WriterRecord *wr );
+const xmlChar *writer_name( WriterRecord *wr, FeriteString *name );
+int            writer_check( WriterRecord *wr, int rc, char *what );
+int            writer_cdata( WriterRecord *wr, FeriteString *text );
+int            writer_flush( WriterRecord *wr );
+
+#define WriterObj ((WriterRecord*)self->odata)
+
+#endif /* __WRITER_HANDLERS_H__ */
@@ -23,78 +23,199 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include "tree_handlers.h"
+#include "tree_handlers.h"
 #include "xpath_handlers.h"
 
-FeriteVariable *ParseXPath( FeriteScript *script, XMLDoc *tree, const char *str )
+static void xpath_free_compiled( FeriteScript *script, void *data )
 {
-    xmlXPathObjectPtr res = NULL;
-    xmlNodeSetPtr cur = NULL;
+    xmlXPathFreeCompExpr( (xmlXPathCompExprPtr)data );
+}
+
+static void xpath_quiet_error( void *ctx, const char *msg, ... )
+{
+}
+
+/* Compiles without libxml2 printing its own complaint, for callers that raise their own */
+xmlXPathCompExprPtr xpath_compile_quietly( const char *str )
+{
+    xmlGenericErrorFunc handler = xmlGenericError;
+    void *context = xmlGenericErrorContext;
     xmlXPathCompExprPtr comp = NULL;
-    FeriteVariable *array = NULL,*element = NULL;
-    register int i = 0;
 
-    xmlXPathContextPtr ctxt = xmlXPathNewContext( tree->doc );
-    ctxt->node = tree->node;
+    xmlSetGenericErrorFunc( NULL, xpath_quiet_error );
+    comp = xmlXPathCompile( BAD_CAST str );
+    xmlSetGenericErrorFunc( context, handler );
+    return comp;
+}
 
-    array = ferite_create_uarray_variable( script, "xpath_result", FE_ARRAY_DEFAULT_SIZE, FE_STATIC );
-    comp = xmlXPathCompile(BAD_CAST str);
+static XPathDocumentCache *xpath_document_cache( FeriteScript *script, xmlDocPtr doc )
+{
+    XPathDocumentCache *cache = doc->_private;
 
-    if (comp != NULL)
+    if( cache == NULL )
     {
-        res = xmlXPathCompiledEval(comp, ctxt);
-        xmlXPathFreeCompExpr(comp);
+        cache = fmalloc( sizeof(XPathDocumentCache) );
+        cache->context = xmlXPathNewContext( doc );
+        cache->compiled = ferite_create_hash( script, XPATH_CACHE_SIZE );
+        cache->count = 0;
+        doc->_private = cache;
+    }
+    return cache;
+}
 
-        switch( res->type )
+void xpath_free_document( FeriteScript *script, xmlDocPtr doc )
+{
+    XPathDocumentCache *cache = doc->_private;
+
+    if( cache != NULL )
+    {
+        xmlXPathFreeContext( cache->context );
+        ferite_delete_hash( script, cache->compiled, xpath_free_compiled );
+        ffree( cache );
+        doc->_private = NULL;
+    }
+    xmlFreeDoc( doc );
+}
+
+xmlXPathCompExprPtr xpath_compile_cached( FeriteScript *script, xmlDocPtr doc, const char *str )
+{
+    XPathDocumentCache *cache = xpath_document_cache( script, doc );
+    xmlXPathCompExprPtr comp = ferite_hash_get( script, cache->compiled, (char *)str );
+
+    if( comp == NULL && (comp = xmlXPathCompile( BAD_CAST str )) != NULL )
+    {
+        /* Scripts that build expressions on the fly would otherwise grow this forever */
+        if( cache->count == XPATH_CACHE_SIZE )
         {
+            ferite_delete_hash( script, cache->compiled, xpath_free_compiled );
+            cache->compiled = ferite_create_hash( script, XPATH_CACHE_SIZE );
+            cache->count = 0;
+        }
+        ferite_hash_add( script, cache->compiled, (char *)str, comp );
+        cache->count++;
+    }
+    return comp;
+}
 
-          case XPATH_UNDEFINED:
-            ferite_error(NULL, 0, "Object is uninitialized\n");
-            break;
+xmlXPathObjectPtr xpath_evaluate( FeriteScript *script, XMLDoc *tree, xmlXPathCompExprPtr comp )
+{
+    XPathDocumentCache *cache = xpath_document_cache( script, tree->doc );
 
-          case XPATH_NODESET:
+    cache->context->node = tree->node;
+    return xmlXPathCompiledEval( comp, cache->context );
+}
 
-            cur = res->nodesetval;
-            for (i = 0 ; i < cur->nodeNr ; i++)
-            {
-                element = create_element_node( script, tree->doc, cur->nodeTab[i] );		
-                ferite_uarray_add( script, VAUA( array ), element, NULL, FE_ARRAY_ADD_AT_END );
-            }
-            break;
+/*
+ * The items of a node-set array start out as null objects carrying the node in
+ * a get accessor; the XML.Element is only made when the script fetches the item.
+ */
+static void xpath_node_get( FeriteScript *script, FeriteVariable *var )
+{
+    xmlNodePtr node = var->accessors->odata;
+    FeriteVariable *obj = NULL;
+
+    ffree( var->accessors );
+    obj = create_element_node( script, node->doc, node );
+    VAO(var) = VAO(obj);
+    VAO(obj) = NULL;
+    ferite_variable_destroy( script, obj );
+}
+
+FeriteVariable *xpath_node_set_array( FeriteScript *script, xmlNodeSetPtr set )
+{
+    FeriteVariable *array = NULL, *element = NULL;
+    int size = (set != NULL ? set->nodeNr : 0);
+    register int i = 0;
 
-          case XPATH_NUMBER:
+    array = ferite_create_uarray_variable( script, "xpath_result", (size > 0 ? size : FE_ARRAY_DEFAULT_SIZE), FE_STATIC );
+    for( i = 0; i < size; i++ )
+    {
+        /* Namespace nodes are copies that go away with the result */
+        if( set->nodeTab[i]->type == XML_NAMESPACE_DECL )
+            continue;
 
-            if (xmlXPathIsNaN(res->floatval))
-              element = fe_new_str_static("xpath_result", "NaN", 3, FE_CHARSET_DEFAULT);
-            else
-              element = fe_new_dbl_static("xpath_result", res->floatval);
+        element = ferite_create_object_variable( script, "xpath_result", FE_STATIC );
+        ferite_create_variable_accessors( script, element, xpath_node_get, NULL, NULL, set->nodeTab[i] );
+        ferite_uarray_add( script, VAUA( array ), element, NULL, FE_ARRAY_ADD_AT_END );
+    }
+    return array;
+}
 
-            ferite_uarray_add( script, VAUA( array ), element, NULL, FE_ARRAY_ADD_AT_END );
-            break;
+FeriteVariable *xpath_result_array( FeriteScript *script, xmlXPathObjectPtr res )
+{
+    FeriteVariable *array = NULL, *element = NULL;
+
+    if( res == NULL )
+        return ferite_create_uarray_variable( script, "xpath_result", FE_ARRAY_DEFAULT_SIZE, FE_STATIC );
 
-          case XPATH_STRING:
-            element = fe_new_str_static("xpath_result", res->stringval, 0, FE_CHARSET_DEFAULT);
-            ferite_uarray_add( script, VAUA( array ), element, NULL, FE_ARRAY_ADD_AT_END );
-            break;
+    switch( res->type )
+    {
+      case XPATH_NODESET:
+        return xpath_node_set_array( script, res->nodesetval );
+
+      case XPATH_UNDEFINED:
+        ferite_error(NULL, 0, "Object is uninitialized\n");
+        break;
+
+      case XPATH_NUMBER:
+        if (xmlXPathIsNaN(res->floatval))
+          element = fe_new_str_static("xpath_result", "NaN", 3, FE_CHARSET_DEFAULT);
+        else
+          element = fe_new_dbl_static("xpath_result", res->floatval);
+        break;
+
+      case XPATH_STRING:
+        element = fe_new_str_static("xpath_result", (char *)res->stringval, 0, FE_CHARSET_DEFAULT);
+        break;
+
+      case XPATH_BOOLEAN:
+        if (res->boolval)
+          element = fe_new_str_static("xpath_result", "true", 0, FE_CHARSET_DEFAULT);
+        else
+          element = fe_new_str_static("xpath_result", "false", 0, FE_CHARSET_DEFAULT);
+        break;
+
+      default:
+        ferite_error( script, 0, "Unimplemeted result type");
+        break;
+    }
 
-          case XPATH_BOOLEAN:
+    array = ferite_create_uarray_variable( script, "xpath_result", FE_ARRAY_DEFAULT_SIZE, FE_STATIC );
+    if( element != NULL )
+        ferite_uarray_add( script, VAUA( array ), element, NULL, FE_ARRAY_ADD_AT_END );
+    return array;
+}
 
-            if (res->boolval)
-              element = fe_new_str_static("xpath_result", "true", 0, FE_CHARSET_DEFAULT);
-            else
-              element = fe_new_str_static("xpath_result", "false", 0, FE_CHARSET_DEFAULT);
+XMLDoc *xpath_context_tree( FeriteScript *script, FeriteObject *context )
+{
+    FeriteClass *element = ferite_find_class( script, script->mainns, "XML.Element" );
+    FeriteClass *parser = ferite_find_class( script, script->mainns, "XML.TreeParser" );
+    XMLDoc *tree = NULL;
 
-            ferite_uarray_add( script, VAUA( array ), element, NULL, FE_ARRAY_ADD_AT_END );
-            break;
+    if( context != NULL && (ferite_class_is_subclass( element, context->klass ) || ferite_class_is_subclass( parser, context->klass )) )
+        tree = context->odata;
 
-          default:
-            ferite_error( script, 0, "Unimplemeted result type");
-            break;
-        }
+    if( tree == NULL || tree->doc == NULL )
+    {
+        ferite_error( script, 0, "XPath expressions can only be evaluated against a parsed XML.TreeParser or an XML.Element\n" );
+        return NULL;
     }
-    if( res != NULL)
-      xmlXPathFreeObject(res);
+    return tree;
+}
+
+FeriteVariable *ParseXPath( FeriteScript *script, XMLDoc *tree, const char *str )
+{
+    xmlXPathObjectPtr res = NULL;
+    xmlXPathCompExprPtr comp = NULL;
+    FeriteVariable *array = NULL;
+
+    comp = xpath_compile_cached( script, tree->doc, str );
+    if( comp != NULL )
+        res = xpath_evaluate( script, tree, comp );
 
-    xmlXPathFreeContext(ctxt);
+    array = xpath_result_array( script, res );
+    if( res != NULL )
+        xmlXPathFreeObject( res );
 
     return array;
 }
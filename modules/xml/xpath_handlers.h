@@ -38,6 +38,35 @@
 #include <libxml/xmlerror.h>
 #include <libxml/globals.h>
 
-FeriteVariable *ParseXPath( FeriteScript *script, XMLDoc *tree, const char *str);
+/*
+ * Each document keeps an XPath context, and the expressions that have been run
+ * against it, hanging off doc->_private. Repeated queries then neither build a
+ * new context nor recompile the expression. The cache is dropped with the
+ * document in xpath_free_document().
+ */
+#define XPATH_CACHE_SIZE 64   /* Expressions remembered per document before it starts over */
+
+typedef struct __xpath_document_cache {
+    xmlXPathContextPtr context;
+    FeriteHash *compiled;
+    int count;
+} XPathDocumentCache;
+
+/* An expression compiled once by XML.XPath and run against any document */
+typedef struct __xpath_expression {
+    char *source;
+    xmlXPathCompExprPtr comp;
+} XPathExpression;
+
+#define XPathObj ((XPathExpression*)self->odata)
+
+FeriteVariable     *ParseXPath( FeriteScript *script, XMLDoc *tree, const char *str);
+void                xpath_free_document( FeriteScript *script, xmlDocPtr doc );
+xmlXPathCompExprPtr xpath_compile_quietly( const char *str );
+xmlXPathCompExprPtr xpath_compile_cached( FeriteScript *script, xmlDocPtr doc, const char *str );
+xmlXPathObjectPtr   xpath_evaluate( FeriteScript *script, XMLDoc *tree, xmlXPathCompExprPtr comp );
+FeriteVariable     *xpath_node_set_array( FeriteScript *script, xmlNodeSetPtr set );
+FeriteVariable     *xpath_result_array( FeriteScript *script, xmlXPathObjectPtr res );
+XMLDoc             *xpath_context_tree( FeriteScript *script, FeriteObject *context );
 
 #endif /* __XPATH_HANDLERS_H__ */
@@ -36,6 +36,8 @@
 #include <math.h>
 #include <ferite/fmem_jedi.h>
 #include <ferite/fmem_libgc.h>
+#include "aphex.h"
+#include "fcache.h"
 
 
 int ferite_is_initialised = 0;
@@ -60,6 +62,7 @@ int ferite_pow_lookup[32];
  *			  --fe-use-classic - this will tell ferite to use malloc/free rather than the jedi memory manager<nl/>
  *			  --fe-debug - tell ferite to dump debug out to stdout, warning: this will produce a lot of output, ferite also has to be compiled with debugging support.<nl/>
  *			  --fe-show-mem-use - tell ferite to dump to stdout a set of memory statistics, this is useful for detecting leaks<nl/>
+ *			  --fe-atomic-refcounts - use atomic reference counts from the start, for embedders that share scripts between their own threads<nl/>
  *			  <nl/>
  *			  This function can be called multiple times without fear - it will only set things up
  *			  if they are needed.
@@ -70,6 +73,7 @@ int ferite_init( int argc, char **argv )
 {
 	int i = 0;
 	int wantDebugBanner = FE_TRUE;
+	int kernels = FE_KERNEL_AUTO;
 	
 	FE_ENTER_FUNCTION;
 
@@ -114,6 +118,7 @@ int ferite_init( int argc, char **argv )
 					ferite_deinit_gc = ferite_deinit_libgc_gc;
 					ferite_add_to_gc = ferite_add_to_libgc_gc;
 					ferite_check_gc = ferite_check_libgc_gc;
+					ferite_collect_gc = ferite_collect_libgc_gc;
 					ferite_merge_gc = ferite_merge_libgc_gc;
 #ifdef DEBUG
 					fprintf( stderr, "Using libgc memory\n");
@@ -127,6 +132,7 @@ int ferite_init( int argc, char **argv )
 					ferite_deinit_gc = ferite_deinit_std_gc;
 					ferite_add_to_gc = ferite_add_to_std_gc;
 					ferite_check_gc = ferite_check_std_gc;
+					ferite_collect_gc = ferite_collect_std_gc;
 					ferite_merge_gc = ferite_merge_std_gc;
 				}
 				if( strcmp( argv[i], "--fe-use-generation-gc" ) == 0 )
@@ -136,6 +142,7 @@ int ferite_init( int argc, char **argv )
 					ferite_deinit_gc = ferite_deinit_generation_gc;
 					ferite_add_to_gc = ferite_add_to_generation_gc;
 					ferite_check_gc = ferite_check_generation_gc;
+					ferite_collect_gc = ferite_collect_generation_gc;
 					ferite_merge_gc = ferite_merge_generation_gc;
 				}
 				if( strcmp( argv[i], "--fe-debug" ) == 0 )
@@ -148,6 +155,10 @@ int ferite_init( int argc, char **argv )
 					wantDebugBanner = FE_FALSE;
 				if( strcmp( argv[i], "--fe-show-partial-implementation") == 0 )
 					ferite_show_partial_implementation = FE_TRUE;
+				if( strcmp( argv[i], "--fe-atomic-refcounts" ) == 0 )
+					ferite_enable_atomic_refcounts();
+				if( strcmp( argv[i], "--fe-scalar-kernels" ) == 0 )
+					kernels = FE_KERNEL_SCALAR;
 			}
 		}
 
@@ -161,6 +172,7 @@ int ferite_init( int argc, char **argv )
 			ferite_deinit_gc = ferite_deinit_libgc_gc;
 			ferite_add_to_gc = ferite_add_to_libgc_gc;
 			ferite_check_gc = ferite_check_libgc_gc;
+			ferite_collect_gc = ferite_collect_libgc_gc;
 			ferite_merge_gc = ferite_merge_libgc_gc;
 #ifdef DEBUG
 			fprintf( stderr, "No memory/GC option specified - defaulting to libgc\n");
@@ -179,6 +191,7 @@ int ferite_init( int argc, char **argv )
 			ferite_deinit_gc = ferite_deinit_generation_gc;
 			ferite_add_to_gc = ferite_add_to_generation_gc;
 			ferite_check_gc = ferite_check_generation_gc;
+			ferite_collect_gc = ferite_collect_generation_gc;
 			ferite_merge_gc = ferite_merge_generation_gc;
 		}
 
@@ -195,6 +208,8 @@ int ferite_init( int argc, char **argv )
 		}
 
 		ferite_init_compiler();
+		ferite_cache_init();
+		ferite_kernel_select( kernels );
 		ferite_init_regex();
 		ferite_set_script_argv( 0, NULL );
 
@@ -217,6 +232,7 @@ int ferite_deinit()
 	if( ferite_is_initialised )
 	{
 		ferite_variable_destroy( NULL, ferite_ARGV );
+		ferite_cache_deinit();
 		ferite_deinit_module_list();
 		ferite_memory_deinit();
 		ferite_deinit_regex();
@@ -385,6 +401,7 @@ void ferite_show_help()
 	printf( " --fe-use-std-gc  \t	 Run w/ simple GC mode. (will cause slow downs)\n" );
 	printf( " --fe-show-mem-use\t	 Report memory use at script end.\n" );
 	printf( " --fe-use-mm-with-pcre\t Use PCRE [Regular Expression Engine] with ferite's MM\n" );
+	printf( " --fe-atomic-refcounts\t Use atomic reference counts before any thread is started.\n" );
 	printf( "\n MM = Memory Manager\n" );
 	FE_LEAVE_FUNCTION( NOWT );
 }
@@ -81,7 +81,7 @@ static inline int bitcount (unsigned int n)
 #define NODE_VALUE(NODE) ((NODE)->u.value.data)
 
 char *__ferite_amt_printbits( unsigned int map ) {
-	static char mapbuf[AMT_SHIFT_START + 1];
+	static FE_THREAD_LOCAL char mapbuf[AMT_SHIFT_START + 1];
 	int i = 0;
 	
 	memset( mapbuf, '\0', AMT_SHIFT_START + 1 );
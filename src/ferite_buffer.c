@@ -188,11 +188,19 @@ void ferite_buffer_add_str( FeriteScript *script, FeriteBuffer *buf, char *str )
  */
 void ferite_buffer_add_long( FeriteScript *script, FeriteBuffer *buf, long data )
 {
-    char str[100];
-    int i;
+    char str[32], *p = str + sizeof(str);
+    unsigned long value = (data < 0 ? 0UL - (unsigned long)data : (unsigned long)data);
     FE_ENTER_FUNCTION;
-    i = sprintf(str,"%ld",data);
-    ferite_buffer_add( script, buf, str, i );
+    /* This is on the formatting fast path, so it does not go through sprintf() */
+    do
+    {
+        *--p = '0' + (char)(value % 10);
+        value /= 10;
+    }
+    while( value > 0 );
+    if( data < 0 )
+      *--p = '-';
+    ferite_buffer_add( script, buf, p, (str + sizeof(str)) - p );
     FE_LEAVE_FUNCTION( NOWT );
 }
 
@@ -484,83 +492,430 @@ FeriteString *ferite_buffer_to_str( FeriteScript *script, FeriteBuffer *buf )
     str = fmalloc( sizeof(FeriteString) );
     str->data = ptr;
     str->length = len;
+    str->pos = -1;
+    str->storage = NULL;
     str->encoding = FE_CHARSET_DEFAULT;
     FE_LEAVE_FUNCTION( str );
 }
 
-/* These are not used below, so, we won't document them until stephan fixes them ;) */
+/*
+ * Formatting. A format string is compiled once into a list of directives, each either a run of
+ * literal text or one conversion with its flags, width and precision already picked out, and
+ * the compiled formats are kept per script so that the same format is never parsed twice.
+ * Running a format is then a walk down the list writing into a buffer. Strings, characters and
+ * plain %d go straight into the buffer; the other numeric conversions are handed to the C
+ * library's snprintf() with a specification rebuilt from the directive.
+ */
+
+#define FE_FORMAT_CONVERSIONS "diouxXfeEgGaAcCsSn"
 
-FeriteVariable *ferite_sprintf(FeriteScript *script, char *format, FeriteVariable **params )
+static long ferite_format_long( FeriteVariable *v )
 {
-    FeriteBuffer *buf;
-    FeriteVariable *v;
+    return (F_VAR_TYPE(v) == F_VAR_LONG ? VAI(v) : (long)VAF(v));
+}
 
-    FE_ENTER_FUNCTION;
-    buf = ferite_buffer_new(script, 0);
-    ferite_format( script, buf, format, params );
+static double ferite_format_double( FeriteVariable *v )
+{
+    return (F_VAR_TYPE(v) == F_VAR_LONG ? (double)VAI(v) : VAF(v));
+}
 
-    v = ferite_variable_alloc( NULL, NULL, 0 );
-    F_VAR_TYPE(v) = F_VAR_STR;
-	MARK_VARIABLENAME_AS_STATIC( v );
-    VAS(v) = ferite_buffer_get( script, buf , NULL);
-    FE_LEAVE_FUNCTION( v );
+static void ferite_format_padded( FeriteScript *script, FeriteBuffer *buf, char *data, size_t length, int width, int left )
+{
+    size_t pad = (width > 0 && (size_t)width > length ? (size_t)width - length : 0);
+
+    if( pad > 0 && !left )
+      memset( ferite_buffer_alloc( script, buf, pad ), ' ', pad );
+    ferite_buffer_add( script, buf, data, length );
+    if( pad > 0 && left )
+      memset( ferite_buffer_alloc( script, buf, pad ), ' ', pad );
 }
 
-int ferite_format( FeriteScript *script, FeriteBuffer *buf, char *format, FeriteVariable **params )
+static void ferite_format_library( FeriteScript *script, FeriteBuffer *buf, FeriteFormatDirective *d, char conversion, int width, int precision, int left, int is_double, long l, double f )
 {
-    int current = 0;
-	size_t len = strlen(format), i = 0;
-    FeriteVariable *arg;
+    char spec[32], out[128], *p = spec, *big = NULL;
+    int n, size = sizeof(out);
+
+    *p++ = '%';
+    strcpy( p, d->flags );
+    p += strlen( d->flags );
+    if( left && strchr( d->flags, '-' ) == NULL )
+      *p++ = '-';
+    if( width >= 0 )
+      p += sprintf( p, "%d", width );
+    if( precision >= 0 )
+      p += sprintf( p, ".%d", precision );
+    if( !is_double )
+      *p++ = 'l';
+    *p++ = conversion;
+    *p = '\0';
+
+    n = (is_double ? snprintf( out, size, spec, f ) : snprintf( out, size, spec, l ));
+    if( n > -1 && n < size )
+    {
+        ferite_buffer_add( script, buf, out, n );
+        return;
+    }
+    /* Some snprintf()s say how much room they needed, others just fail */
+    do
+    {
+        size = (n > -1 ? n + 1 : size * 2);
+        if( big != NULL )
+          ffree( big );
+        big = fmalloc( size );
+        n = (is_double ? snprintf( big, size, spec, f ) : snprintf( big, size, spec, l ));
+    }
+    while( n < 0 || n >= size );
+    ferite_buffer_add( script, buf, big, n );
+    ffree( big );
+}
+
+/**
+ * @function ferite_format_compile
+ * @declaration FeriteFormat *ferite_format_compile( FeriteScript *script, char *format, size_t length )
+ * @brief Compile a printf style format string
+ * @param FeriteScript *script The script context, NULL otherwise
+ * @param char *format The format string, it may contain NUL bytes
+ * @param size_t length The length of the format string
+ * @return The compiled format, to be freed with ferite_format_destroy()
+ * @description The conversions understood are d i o u x X f e E g G a A c C s S, and n which
+ *              prints a number in whichever of the %d and %f forms suits it. Flags, width and
+ *              precision work as they do in C, including '*' to take them from the arguments.
+ *              Length modifiers such as 'l' are accepted and ignored, as integers are always
+ *              formatted as longs. A '%' that does not start a valid directive is printed as it is.
+ */
+FeriteFormat *ferite_format_compile( FeriteScript *script, char *format, size_t length )
+{
+    FeriteFormat *compiled = NULL;
+    FeriteFormatDirective *d = NULL;
+    size_t i, j, literal = 0, percents = 0;
+    int n;
 
     FE_ENTER_FUNCTION;
-    for(i=0 ; i < len ; i++)
+    for( i = 0; i < length; i++ )
     {
-        arg = params[current];
         if( format[i] == '%' )
+          percents++;
+    }
+    compiled = fmalloc( sizeof(FeriteFormat) );
+    compiled->text = fmalloc( length + 1 );
+    memcpy( compiled->text, format, length );
+    compiled->text[length] = '\0';
+    compiled->length = length;
+    compiled->count = 0;
+    compiled->cached = FE_FALSE;
+    compiled->users = 0;
+    compiled->directives = fmalloc( sizeof(FeriteFormatDirective) * (percents * 2 + 1) );
+
+#define FE_FORMAT_LITERAL_UPTO( END ) \
+    if( (END) > literal ) { \
+        d = &compiled->directives[compiled->count++]; \
+        memset( d, 0, sizeof(FeriteFormatDirective) ); \
+        d->offset = literal; \
+        d->length = (END) - literal; \
+    }
+
+    for( i = 0; i < length; i++ )
+    {
+        if( format[i] != '%' || i + 1 == length )
+          continue;
+        if( format[i + 1] == '%' )
         {
+            /* The first % is kept as literal text and the second skipped */
+            FE_FORMAT_LITERAL_UPTO( i + 1 );
+            literal = i + 2;
             i++;
-            if( arg == NULL )
+            continue;
+        }
+
+        FE_FORMAT_LITERAL_UPTO( i );
+        d = &compiled->directives[compiled->count];
+        memset( d, 0, sizeof(FeriteFormatDirective) );
+        d->width = d->precision = -1;
+        for( j = i + 1, n = 0; j < length && strchr( "-+ #0", format[j] ) != NULL && format[j] != '\0'; j++ )
+        {
+            if( n < (int)sizeof(d->flags) - 1 && strchr( d->flags, format[j] ) == NULL )
+              d->flags[n++] = format[j];
+        }
+        if( j < length && format[j] == '*' )
+        {
+            d->width = FE_FORMAT_FROM_ARGUMENT;
+            j++;
+        }
+        else
+        {
+            for( ; j < length && format[j] >= '0' && format[j] <= '9'; j++ )
+              d->width = (d->width < 0 ? 0 : d->width * 10) + (format[j] - '0');
+        }
+        if( j < length && format[j] == '.' )
+        {
+            d->precision = 0;
+            if( ++j < length && format[j] == '*' )
             {
-                ferite_buffer_add(script, buf,"(null)",6);
-                continue;
+                d->precision = FE_FORMAT_FROM_ARGUMENT;
+                j++;
             }
-            switch( format[i] )
+            for( ; j < length && format[j] >= '0' && format[j] <= '9'; j++ )
+              d->precision = d->precision * 10 + (format[j] - '0');
+        }
+        for( ; j < length && strchr( "hlLqjzt", format[j] ) != NULL && format[j] != '\0'; j++ )
+          ;
+        if( j == length || format[j] == '\0' || strchr( FE_FORMAT_CONVERSIONS, format[j] ) == NULL )
+        {
+            /* Not a directive after all, so the % stays part of the literal text */
+            literal = i;
+            continue;
+        }
+        d->conversion = (format[j] == 'S' ? 's' : (format[j] == 'C' ? 'c' : format[j]));
+        d->left = (strchr( d->flags, '-' ) != NULL);
+        d->offset = i;
+        d->length = j + 1 - i;
+        compiled->count++;
+        literal = j + 1;
+        i = j;
+    }
+    FE_FORMAT_LITERAL_UPTO( length );
+#undef FE_FORMAT_LITERAL_UPTO
+    FE_LEAVE_FUNCTION( compiled );
+}
+
+/**
+ * @function ferite_format_destroy
+ * @declaration void ferite_format_destroy( FeriteScript *script, FeriteFormat *format )
+ * @brief Free a compiled format
+ * @param FeriteScript *script The script context, NULL otherwise
+ * @param FeriteFormat *format The format to free
+ */
+void ferite_format_destroy( FeriteScript *script, FeriteFormat *format )
+{
+    FE_ENTER_FUNCTION;
+    ffree( format->text );
+    ffree( format->directives );
+    ffree( format );
+    FE_LEAVE_FUNCTION( NOWT );
+}
+
+/* A format dropped from the cache while it is being run is freed when it is released */
+static void ferite_format_uncache( FeriteScript *script, void *data )
+{
+    FeriteFormat *format = data;
+
+    format->cached = FE_FALSE;
+    if( format->users <= 0 )
+      ferite_format_destroy( script, format );
+}
+
+/**
+ * @function ferite_format_get
+ * @declaration FeriteFormat *ferite_format_get( FeriteScript *script, char *format, size_t length )
+ * @brief Get the compiled form of a format string, compiling it only if it has not been seen before
+ * @param FeriteScript *script The script context, NULL otherwise
+ * @param char *format The format string
+ * @param size_t length The length of the format string
+ * @return The compiled format, to be handed back with ferite_format_release()
+ * @description Compiled formats are kept in the script's cache, which is per thread, so no
+ *              locking is needed. When FE_FORMAT_CACHE_SIZE formats are kept the cache is emptied
+ *              and starts again, so that scripts that build their format strings on the fly do not
+ *              fill memory and the formats in use now are the ones that end up kept. Formats
+ *              containing NUL bytes are compiled each time.
+ */
+FeriteFormat *ferite_format_get( FeriteScript *script, char *format, size_t length )
+{
+    FeriteFormat *compiled = NULL;
+    int cacheable;
+
+    FE_ENTER_FUNCTION;
+    cacheable = (script != NULL && script->formats != NULL && format[length] == '\0' && memchr( format, '\0', length ) == NULL);
+    if( cacheable && (compiled = ferite_hash_get( script, script->formats, format )) != NULL )
+    {
+        compiled->users++;
+        FE_LEAVE_FUNCTION( compiled );
+    }
+    compiled = ferite_format_compile( script, format, length );
+    compiled->users = 1;
+    if( cacheable )
+    {
+        if( script->formats->count >= FE_FORMAT_CACHE_SIZE )
+        {
+            ferite_delete_hash( NULL, script->formats, ferite_format_uncache );
+            script->formats = ferite_create_hash( NULL, 32 );
+        }
+        compiled->cached = FE_TRUE;
+        ferite_hash_add( script, script->formats, compiled->text, compiled );
+    }
+    FE_LEAVE_FUNCTION( compiled );
+}
+
+/**
+ * @function ferite_format_release
+ * @declaration void ferite_format_release( FeriteScript *script, FeriteFormat *format )
+ * @brief Hand back a format from ferite_format_get(), freeing it unless it is cached
+ * @param FeriteScript *script The script context, NULL otherwise
+ * @param FeriteFormat *format The format
+ */
+void ferite_format_release( FeriteScript *script, FeriteFormat *format )
+{
+    FE_ENTER_FUNCTION;
+    if( --format->users <= 0 && !format->cached )
+      ferite_format_destroy( script, format );
+    FE_LEAVE_FUNCTION( NOWT );
+}
+
+/**
+ * @function ferite_format_run
+ * @declaration int ferite_format_run( FeriteScript *script, FeriteBuffer *buf, FeriteFormat *format, FeriteVariable **params, int count )
+ * @brief Format a list of variables into a buffer
+ * @param FeriteScript *script The script context, NULL otherwise
+ * @param FeriteBuffer *buf The buffer to write into
+ * @param FeriteFormat *format The compiled format
+ * @param FeriteVariable **params The variables to format
+ * @param int count The number of variables
+ * @return The number of variables used
+ * @description A variable of the wrong type for its conversion, such as an array for %d, is used
+ *              up but prints nothing. Once the variables run out the remaining directives are
+ *              printed as they were written.
+ */
+int ferite_format_run( FeriteScript *script, FeriteBuffer *buf, FeriteFormat *format, FeriteVariable **params, int count )
+{
+    FeriteFormatDirective *d = NULL;
+    FeriteVariable *arg = NULL;
+    int i, used = 0, needed, width, precision, left, is_number;
+    char c;
+
+    FE_ENTER_FUNCTION;
+    for( i = 0; i < format->count; i++ )
+    {
+        d = &format->directives[i];
+        if( d->conversion == 0 )
+        {
+            ferite_buffer_add( script, buf, format->text + d->offset, d->length );
+            continue;
+        }
+
+        needed = 1 + (d->width == FE_FORMAT_FROM_ARGUMENT) + (d->precision == FE_FORMAT_FROM_ARGUMENT);
+        if( used + needed > count )
+        {
+            ferite_buffer_add( script, buf, format->text + d->offset, d->length );
+            used = count;
+            continue;
+        }
+        width = d->width;
+        precision = d->precision;
+        left = d->left;
+        if( width == FE_FORMAT_FROM_ARGUMENT )
+        {
+            arg = params[used++];
+            width = -1;
+            if( F_VAR_TYPE(arg) == F_VAR_LONG || F_VAR_TYPE(arg) == F_VAR_DOUBLE )
             {
-              case '%':
-                ferite_buffer_add_char(script, buf,'%');
-                break;
-              case 'n':
-                switch( F_VAR_TYPE(arg) )
+                width = (int)ferite_format_long( arg );
+                if( width < 0 )
                 {
-                  case F_VAR_LONG:
-                    ferite_buffer_add_long(script, buf, VAI(arg));
-                    break;
-                  case F_VAR_DOUBLE:
-                    ferite_buffer_add_double(script, buf, VAF(arg));
-                    break;
-                  default:
-               /* Error or not, that is the question */
-                    break;
+                    /* As in C, a negative width means left justify */
+                    left = FE_TRUE;
+                    width = -width;
                 }
-                break;
-              case 'd':
-                ferite_buffer_add_long(script, buf, ferite_number_as_long(NULL, arg));
-                break;
-              case 'f':
-                ferite_buffer_add_double(script, buf, ferite_number_as_double(NULL, arg));
-                break;
-              case 's':
-                ferite_buffer_add(script, buf, FE_STR2PTR(arg), FE_STRLEN(arg));
-                break;
-              case 'v':
-              default:
-            /* FIXME: ferite_buffer_add_variable(script, buf, arg);*/
-                break;
             }
-            current++;
+        }
+        if( precision == FE_FORMAT_FROM_ARGUMENT )
+        {
+            arg = params[used++];
+            precision = (F_VAR_TYPE(arg) == F_VAR_LONG || F_VAR_TYPE(arg) == F_VAR_DOUBLE ? (int)ferite_format_long( arg ) : -1);
+            if( precision < 0 )
+              precision = -1;
+        }
+        arg = params[used++];
+        is_number = (F_VAR_TYPE(arg) == F_VAR_LONG || F_VAR_TYPE(arg) == F_VAR_DOUBLE);
+
+        switch( d->conversion )
+        {
+          case 's':
+            if( F_VAR_TYPE(arg) == F_VAR_STR )
+              ferite_format_padded( script, buf, VAS(arg)->data, (precision >= 0 && (size_t)precision < VAS(arg)->length ? (size_t)precision : VAS(arg)->length), width, left );
+            break;
+          case 'c':
+            if( is_number )
+              c = (char)ferite_format_long( arg );
+            else if( F_VAR_TYPE(arg) == F_VAR_STR && VAS(arg)->length > 0 )
+              c = VAS(arg)->data[0];
+            else
+              break;
+            ferite_format_padded( script, buf, &c, 1, width, left );
+            break;
+          case 'd':
+          case 'i':
+            if( !is_number )
+              break;
+            if( width < 0 && precision < 0 && d->flags[0] == '\0' )
+              ferite_buffer_add_long( script, buf, ferite_format_long( arg ) );
+            else
+              ferite_format_library( script, buf, d, 'd', width, precision, left, FE_FALSE, ferite_format_long( arg ), 0.0 );
+            break;
+          case 'o':
+          case 'u':
+          case 'x':
+          case 'X':
+            if( is_number )
+              ferite_format_library( script, buf, d, d->conversion, width, precision, left, FE_FALSE, ferite_format_long( arg ), 0.0 );
+            break;
+          case 'n':
+            if( F_VAR_TYPE(arg) == F_VAR_LONG )
+              ferite_format_library( script, buf, d, 'd', width, precision, left, FE_FALSE, VAI(arg), 0.0 );
+            else if( F_VAR_TYPE(arg) == F_VAR_DOUBLE )
+              ferite_format_library( script, buf, d, 'f', width, precision, left, FE_TRUE, 0, VAF(arg) );
+            break;
+          default:
+            if( is_number )
+              ferite_format_library( script, buf, d, d->conversion, width, precision, left, FE_TRUE, 0, ferite_format_double( arg ) );
+            break;
         }
     }
-    return 0;
+    FE_LEAVE_FUNCTION( used );
+}
+
+/**
+ * @function ferite_format
+ * @declaration int ferite_format( FeriteScript *script, FeriteBuffer *buf, char *format, FeriteVariable **params )
+ * @brief Format a NULL terminated list of variables into a buffer
+ * @param FeriteScript *script The script context, NULL otherwise
+ * @param FeriteBuffer *buf The buffer to write into
+ * @param char *format The format string, see ferite_format_compile() for what it may contain
+ * @param FeriteVariable **params The variables to format, ending with NULL
+ * @return The number of variables used
+ */
+int ferite_format( FeriteScript *script, FeriteBuffer *buf, char *format, FeriteVariable **params )
+{
+    FeriteFormat *compiled = NULL;
+    int count = 0, used = 0;
+
+    FE_ENTER_FUNCTION;
+    while( params != NULL && params[count] != NULL )
+      count++;
+    compiled = ferite_format_get( script, format, strlen( format ) );
+    used = ferite_format_run( script, buf, compiled, params, count );
+    ferite_format_release( script, compiled );
+    FE_LEAVE_FUNCTION( used );
+}
+
+/**
+ * @function ferite_sprintf
+ * @declaration FeriteVariable *ferite_sprintf( FeriteScript *script, char *format, FeriteVariable **params )
+ * @brief Format a NULL terminated list of variables into a new string variable
+ * @param FeriteScript *script The script context, NULL otherwise
+ * @param char *format The format string, see ferite_format_compile() for what it may contain
+ * @param FeriteVariable **params The variables to format, ending with NULL
+ * @return A string variable holding the result
+ */
+FeriteVariable *ferite_sprintf( FeriteScript *script, char *format, FeriteVariable **params )
+{
+    FeriteBuffer *buf = NULL;
+    FeriteVariable *v = NULL;
+
+    FE_ENTER_FUNCTION;
+    buf = ferite_buffer_new( script, 0 );
+    ferite_format( script, buf, format, params );
+    v = ferite_buffer_to_var( script, buf );
+    ferite_buffer_delete( script, buf );
+    FE_LEAVE_FUNCTION( v );
 }
 
 /**
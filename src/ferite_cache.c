@@ -1,4 +1,3 @@
-
 #ifdef HAVE_CONFIG_HEADER
 #include "../config.h"
 #endif
@@ -8,7 +7,12 @@
 #include "aphex.h"
 #include "fcache.h"
 
-int        ferite_cache_enabled = FE_FALSE;
+int               ferite_cache_enabled = FE_FALSE;
+AphexRWLock      *ferite_cache_lock = NULL;
+FeriteAMT        *ferite_cache_table = NULL;    /* filename -> FeriteCacheEntry */
+FeriteCacheEntry *ferite_cache_newest = NULL;
+FeriteCacheEntry *ferite_cache_oldest = NULL;
+FeriteCacheStats  ferite_cache_counters;
 
 void ferite_parser_script_agressive_normalise( char *str );
 
@@ -19,17 +23,379 @@ int ferite_cache_toggle( int state ) {
 	return ferite_cache_enabled;
 }
 
-#define TAG_CACHED( ITEM ) ITEM; ITEM->cached = FE_TRUE; 
+void ferite_cache_init() {
+	if( ferite_cache_lock == NULL )
+		ferite_cache_lock = aphex_rwlock_create();
+	memset( &ferite_cache_counters, 0, sizeof(FeriteCacheStats) );
+}
+
+/*
+ * Sizes are estimates - they are there to make the bound meaningful, not to
+ * match what the allocator hands out.
+ */
+long ferite_cache_function_size( FeriteFunction *function ) {
+	long size = sizeof(FeriteFunction) + strlen(function->name) + 1;
+	size += function->arg_count * (sizeof(FeriteParameterRecord) + sizeof(FeriteVariable));
+	if( function->localvars != NULL )
+		size += function->localvars->stack_ptr * sizeof(FeriteVariable);
+	if( function->bytecode != NULL )
+		size += function->bytecode->size * (sizeof(FeriteOp) + sizeof(FeriteOp*));
+	return size;
+}
+long ferite_cache_closure_size( FeriteClass *klass ) {
+	return sizeof(FeriteClass) + strlen(klass->name) + 1;
+}
+
+IMPLEMENT_CACHE_LINE( FeriteClass*, NULL, closure, ferite_cache_closure_size )
+IMPLEMENT_CACHE_LINE( FeriteFunction*, NULL, function, ferite_cache_function_size )
+
+/* Lookups only hold the cache for reading, so several may count at once */
+void ferite_cache_count_lookup( int hit ) {
+#ifdef THREAD_SAFE
+	__atomic_fetch_add( (hit ? &ferite_cache_counters.hits : &ferite_cache_counters.misses), 1, __ATOMIC_RELAXED );
+#else
+	if( hit )
+		ferite_cache_counters.hits++;
+	else
+		ferite_cache_counters.misses++;
+#endif
+}
+
+void ferite_cache_trim( FeriteScript *script, FeriteCacheEntry *keep );
+
+void ferite_cache_account( FeriteScript *script, FeriteCacheEntry *entry, long bytes ) {
+	entry->bytes += bytes;
+	if( !entry->retired ) {
+		ferite_cache_counters.bytes += bytes;
+		ferite_cache_trim( script, entry );
+	}
+}
+
+void ferite_cache_destroy_function( FeriteScript *script, FeriteFunction *function ) {
+	/* Overloads are cached under their own paths */
+	function->next = NULL;
+	function->cached = FE_FALSE;
+	ferite_delete_function_list( script, function );
+}
+void ferite_cache_destroy_closure( FeriteScript *script, FeriteClass *klass ) {
+	/* The methods are still flagged as cached so they are left for the function line */
+	klass->cached = FE_FALSE;
+	ferite_delete_class( script, klass );
+}
+
+void ferite_cache_entry_destroy( FeriteScript *script, FeriteCacheEntry *entry ) {
+	CACHE_OUT(("Destroying cache line %s\n", entry->filename));
+	if( entry->closure != NULL )
+		ferite_amt_destroy( script, entry->closure, (void(*)(FeriteScript*,void*))ferite_cache_destroy_closure );
+	if( entry->function != NULL )
+		ferite_amt_destroy( script, entry->function, (void(*)(FeriteScript*,void*))ferite_cache_destroy_function );
+	if( entry->code != NULL )
+		ffree_ngc( entry->code );
+	ffree_ngc( entry->filename );
+	ffree_ngc( entry );
+}
+
+/*
+ * Take a line out of the cache. Scripts that already hold it carry on using it
+ * and the last of them to go frees it.
+ */
+void ferite_cache_entry_retire( FeriteScript *script, FeriteCacheEntry *entry ) {
+	if( entry->retired )
+		return;
+	ferite_hamt_delete( NULL, ferite_cache_table, entry->filename );
+	if( entry->newer != NULL )
+		entry->newer->older = entry->older;
+	else
+		ferite_cache_newest = entry->older;
+	if( entry->older != NULL )
+		entry->older->newer = entry->newer;
+	else
+		ferite_cache_oldest = entry->newer;
+	entry->newer = entry->older = NULL;
+	entry->retired = FE_TRUE;
+
+	ferite_cache_counters.entries--;
+	ferite_cache_counters.functions -= entry->function_count;
+	ferite_cache_counters.closures -= entry->closure_count;
+	ferite_cache_counters.bytes -= entry->bytes;
+	if( entry->users == 0 )
+		ferite_cache_entry_destroy( script, entry );
+	else
+		ferite_cache_counters.retired++;
+}
+
+void ferite_cache_entry_touch( FeriteCacheEntry *entry ) {
+	if( entry->retired || ferite_cache_newest == entry )
+		return;
+	/* unlink ... */
+	if( entry->newer != NULL )
+		entry->newer->older = entry->older;
+	if( entry->older != NULL )
+		entry->older->newer = entry->newer;
+	else if( ferite_cache_oldest == entry )
+		ferite_cache_oldest = entry->newer;
+	/* ... and put at the front */
+	entry->older = ferite_cache_newest;
+	entry->newer = NULL;
+	if( ferite_cache_newest != NULL )
+		ferite_cache_newest->newer = entry;
+	ferite_cache_newest = entry;
+	if( ferite_cache_oldest == NULL )
+		ferite_cache_oldest = entry;
+}
+
+/* Evict the least recently used lines until we are back under the bound */
+void ferite_cache_trim( FeriteScript *script, FeriteCacheEntry *keep ) {
+	FeriteCacheEntry *victim = ferite_cache_oldest;
+
+	while( ferite_cache_counters.limit > 0 &&
+		   ferite_cache_counters.bytes > ferite_cache_counters.limit &&
+		   victim != NULL ) {
+		FeriteCacheEntry *next = victim->newer;
+		if( victim != keep ) {
+			CACHE_OUT(("Evicting cache line %s\n", victim->filename));
+			ferite_cache_counters.evictions++;
+			ferite_cache_entry_retire( script, victim );
+		}
+		victim = next;
+	}
+}
+
+/*
+ * The line for a file if the script already holds it and using it would not move it in
+ * the LRU list - which is the common case of looking something up in the file that is
+ * being compiled. Needs the cache locked for reading only.
+ */
+FeriteCacheEntry *ferite_cache_entry_held( FeriteScript *script, char *filename ) {
+	FeriteCacheEntry *entry = NULL;
+	int i = 0;
+
+	if( !ferite_cache_enabled || filename == NULL || script == NULL || script->cache_entries == NULL )
+		return NULL;
+	for( i = script->cache_entries->stack_ptr; i >= 1; i-- ) {
+		entry = script->cache_entries->stack[i];
+		if( strcmp( entry->filename, filename ) == 0 )
+			return (entry->retired || entry == ferite_cache_newest ? entry : NULL);
+	}
+	return NULL;
+}
+
+/*
+ * Find the line for a file and make sure the script holds a reference on it. The first
+ * time a script touches a line the file is stat'd, and a line that no longer matches
+ * the file is dropped. Called with the cache locked.
+ */
+FeriteCacheEntry *ferite_cache_entry_acquire( FeriteScript *script, char *filename, int create ) {
+	FeriteCacheEntry *entry = NULL;
+	struct stat st;
+	int i = 0;
+
+	if( !ferite_cache_enabled || filename == NULL || script == NULL )
+		return NULL;
+
+	if( script->cache_entries != NULL ) {
+		for( i = 1; i <= script->cache_entries->stack_ptr; i++ ) {
+			entry = script->cache_entries->stack[i];
+			if( strcmp( entry->filename, filename ) == 0 ) {
+				ferite_cache_entry_touch( entry );
+				return entry;
+			}
+		}
+	}
+
+	/* Only things that came from a file we can stat can be checked for staleness */
+	if( stat( filename, &st ) != 0 || !S_ISREG(st.st_mode) )
+		return NULL;
+
+	if( ferite_cache_table == NULL )
+		ferite_cache_table = ferite_AMTHash_Create( NULL );
+
+	entry = ferite_hamt_get( NULL, ferite_cache_table, filename );
+	if( entry != NULL && (entry->mtime != st.st_mtime || entry->size != st.st_size) ) {
+		CACHE_OUT(("Cache line %s is stale\n", filename));
+		ferite_cache_counters.invalidations++;
+		ferite_cache_entry_retire( script, entry );
+		entry = NULL;
+	}
+
+	if( entry == NULL ) {
+		if( !create )
+			return NULL;
+		entry = fcalloc_ngc( sizeof(FeriteCacheEntry), 1 );
+		entry->filename = fstrdup( filename );
+		entry->mtime = st.st_mtime;
+		entry->size = st.st_size;
+		ferite_hamt_set( NULL, ferite_cache_table, entry->filename, entry );
+		ferite_cache_counters.entries++;
+		ferite_cache_account( script, entry, sizeof(FeriteCacheEntry) + strlen(filename) + 1 );
+	}
+
+	if( script->cache_entries == NULL )
+		script->cache_entries = ferite_create_stack( NULL, FE_COMPILER_INTERNAL_STACK_SIZE );
+	ferite_stack_push( NULL, script->cache_entries, entry );
+	entry->users++;
+	ferite_cache_entry_touch( entry );
+	return entry;
+}
+
+char *ferite_cache_has_code( FeriteScript *script, char *line ) {
+	FeriteCacheEntry *entry = NULL;
+	char *existing = NULL;
 
-IMPLEMENT_CACHE_LINE( char*, NULL, code, fstrdup )
-IMPLEMENT_CACHE_LINE( FeriteClass*, NULL, closure, TAG_CACHED )
-IMPLEMENT_CACHE_LINE( FeriteFunction*, NULL, function, TAG_CACHED )
+	if( !ferite_cache_enabled )
+		return NULL;
+	READ_LOCK_CACHE();
+	entry = ferite_cache_entry_held( script, line );
+	if( entry == NULL ) {
+		UNLOCK_CACHE();
+		LOCK_CACHE();
+		entry = ferite_cache_entry_acquire( script, line, FE_FALSE );
+	}
+	if( entry != NULL )
+		existing = entry->code;
+	ferite_cache_count_lookup( existing != NULL );
+	UNLOCK_CACHE();
+	CACHE_OUT(("Looking for code '%s' [%p]\n", line, existing));
+	return existing;
+}
+
+int ferite_cache_register_code( FeriteScript *script, char *line, char *line_value ) {
+	FeriteCacheEntry *entry = NULL;
+	int result = FE_FALSE;
+
+	if( !ferite_cache_enabled )
+		return FE_FALSE;
+	LOCK_CACHE();
+	entry = ferite_cache_entry_acquire( script, line, FE_TRUE );
+	if( entry != NULL && entry->code == NULL ) {
+		CACHE_OUT(("Registering code '%s'\n", line));
+		entry->code = fstrdup( line_value );
+		ferite_cache_account( script, entry, strlen(line_value) + 1 );
+		result = FE_TRUE;
+	}
+	UNLOCK_CACHE();
+	return result;
+}
 
 FeriteFunction *ferite_cache_reference_function( FeriteScript *script, char *fqfunction ) {
 	FeriteFunction *existing = ferite_cache_has_function( script, fqfunction );
 	if( existing ) {
 		existing = ferite_create_alias_function( script, existing );
+		/* The overload chain belongs to whichever script compiled the original,
+		 * which may still be alive; this compile builds its own. */
+		existing->next = NULL;
 	}
 	return existing;
 }
 
+/* Drop the script's references, freeing any retired lines it was the last user of */
+void ferite_cache_release_script( FeriteScript *script ) {
+	FeriteCacheEntry *entry = NULL;
+	int i = 0;
+
+	if( script->cache_entries == NULL )
+		return;
+	LOCK_CACHE();
+	for( i = 1; i <= script->cache_entries->stack_ptr; i++ ) {
+		entry = script->cache_entries->stack[i];
+		entry->users--;
+		if( entry->retired && entry->users == 0 ) {
+			ferite_cache_counters.retired--;
+			ferite_cache_entry_destroy( script, entry );
+		}
+	}
+	UNLOCK_CACHE();
+	ferite_delete_stack( NULL, script->cache_entries );
+	script->cache_entries = NULL;
+}
+
+/* A duplicated script shares its original's compiled functions, so it shares its lines */
+void ferite_cache_share_script( FeriteScript *from, FeriteScript *to ) {
+	FeriteCacheEntry *entry = NULL;
+	int i = 0;
+
+	if( from->cache_entries == NULL )
+		return;
+	LOCK_CACHE();
+	if( to->cache_entries == NULL )
+		to->cache_entries = ferite_create_stack( NULL, FE_COMPILER_INTERNAL_STACK_SIZE );
+	for( i = 1; i <= from->cache_entries->stack_ptr; i++ ) {
+		entry = from->cache_entries->stack[i];
+		entry->users++;
+		ferite_stack_push( NULL, to->cache_entries, entry );
+	}
+	UNLOCK_CACHE();
+}
+
+/**
+ * @function ferite_cache_set_limit
+ * @declaration void ferite_cache_set_limit( FeriteScript *script, size_t bytes )
+ * @brief Bound the approximate amount of memory the compile cache may hold
+ * @param FeriteScript *script The current script, NULL otherwise
+ * @param size_t bytes The bound, 0 means no bound (the default)
+ * @description Once the bound is passed the least recently used files are dropped from the
+ *              cache. Scripts that were compiled from them are unaffected.
+ */
+void ferite_cache_set_limit( FeriteScript *script, size_t bytes ) {
+	LOCK_CACHE();
+	ferite_cache_counters.limit = bytes;
+	ferite_cache_trim( script, NULL );
+	UNLOCK_CACHE();
+}
+
+/**
+ * @function ferite_cache_invalidate
+ * @declaration int ferite_cache_invalidate( FeriteScript *script, char *filename )
+ * @brief Drop a file from the compile cache
+ * @param FeriteScript *script The current script, NULL otherwise
+ * @param char *filename The path of the file, as it was compiled, or NULL to empty the cache
+ * @return The number of cache lines dropped
+ * @description Files are checked against their mtime and size the first time each compile uses
+ *              them, so this is only needed when a file changes in a way the stat can not see.
+ */
+int ferite_cache_invalidate( FeriteScript *script, char *filename ) {
+	FeriteCacheEntry *entry = NULL;
+	int count = 0;
+
+	LOCK_CACHE();
+	if( filename == NULL ) {
+		while( ferite_cache_oldest != NULL ) {
+			ferite_cache_entry_retire( script, ferite_cache_oldest );
+			count++;
+		}
+	}
+	else if( ferite_cache_table != NULL ) {
+		entry = ferite_hamt_get( NULL, ferite_cache_table, filename );
+		if( entry != NULL ) {
+			ferite_cache_entry_retire( script, entry );
+			count++;
+		}
+	}
+	ferite_cache_counters.invalidations += count;
+	UNLOCK_CACHE();
+	return count;
+}
+
+/**
+ * @function ferite_cache_stats
+ * @declaration void ferite_cache_stats( FeriteCacheStats *stats )
+ * @brief Get a consistent copy of the compile cache's counters
+ * @param FeriteCacheStats *stats The structure to fill in
+ */
+void ferite_cache_stats( FeriteCacheStats *stats ) {
+	LOCK_CACHE();
+	memcpy( stats, &ferite_cache_counters, sizeof(FeriteCacheStats) );
+	UNLOCK_CACHE();
+}
+
+void ferite_cache_deinit() {
+	if( ferite_cache_lock == NULL )
+		return;
+	ferite_cache_invalidate( NULL, NULL );
+	if( ferite_cache_table != NULL ) {
+		ferite_amt_destroy( NULL, ferite_cache_table, NULL );
+		ferite_cache_table = NULL;
+	}
+	aphex_rwlock_destroy( ferite_cache_lock );
+	ferite_cache_lock = NULL;
+}
@@ -104,7 +104,12 @@ FeriteClass *ferite_register_inherited_class( FeriteScript *script, FeriteNamesp
 	klass->class_vars = ferite_create_hash( script, FE_CLASS_VARIABLE_HASH_SIZE );
 	klass->object_methods = ferite_create_hash( script, FE_CLASS_FUNCTION_HASH_SIZE );
 	klass->class_methods = ferite_create_hash( script, FE_CLASS_FUNCTION_HASH_SIZE );
+#ifdef THREAD_SAFE
+	/* Classes can be built by several compiles at once */
+	klass->id = __atomic_add_fetch( &ferite_internal_class_counter, 1, __ATOMIC_RELAXED );
+#else
 	klass->id = ++ferite_internal_class_counter;
+#endif
 	klass->odata = NULL;
 	klass->parent = ptr;
 	klass->next = NULL;
@@ -57,18 +57,21 @@ typedef struct _ferite_directive
 
 /* these are used to keep track of verious bit's and pieces, and makes
 * it possible to compile ferite in one pass rather than several passes
-* like other langyages :) */
-FeriteStack *ferite_fwd_look_stack = NULL;
-FeriteStack *ferite_bck_look_stack = NULL;
-FeriteStack *ferite_break_look_stack = NULL;
-FeriteStack *ferite_compiled_arrays_stack = NULL;
-FeriteStack *ferite_argcount_stack = NULL;
-FeriteStack *ferite_directive_stack = NULL;
-FeriteStack *ferite_previous_directives_stack = NULL;
+* like other langyages :) 
+*
+* All of the compiler's state is per thread, so different threads can compile different
+* scripts at the same time without getting in each other's way. */
+FE_THREAD_LOCAL FeriteStack *ferite_fwd_look_stack = NULL;
+FE_THREAD_LOCAL FeriteStack *ferite_bck_look_stack = NULL;
+FE_THREAD_LOCAL FeriteStack *ferite_break_look_stack = NULL;
+FE_THREAD_LOCAL FeriteStack *ferite_compiled_arrays_stack = NULL;
+FE_THREAD_LOCAL FeriteStack *ferite_argcount_stack = NULL;
+FE_THREAD_LOCAL FeriteStack *ferite_directive_stack = NULL;
+FE_THREAD_LOCAL FeriteStack *ferite_previous_directives_stack = NULL;
 
 /* mwhahhaa, we can keep track of these things :) */
-FeriteStack *ferite_compile_stack = NULL;
-FeriteCompileRecord *ferite_current_compile = NULL;
+FE_THREAD_LOCAL FeriteStack *ferite_compile_stack = NULL;
+FE_THREAD_LOCAL FeriteCompileRecord *ferite_current_compile = NULL;
 
 /* make life easier :) */
 #define CURRENT_NAMESPACE  ferite_current_compile->ns
@@ -84,35 +87,39 @@ FeriteCompileRecord *ferite_current_compile = NULL;
 #define STOP_COMPILE()	 { longjmp( ferite_compiler_jmpback, 1 ); }
 
 /* stolen from ferite_scanner.l -> so we can report errors on files */
-extern char   *ferite_scanner_file;
-extern int	 ferite_scanner_lineno;
-int			ferite_compile_error = 0;
-int			ferite_compile_finishing_class = FE_FALSE;
-jmp_buf		ferite_compiler_jmpback;
+extern FE_THREAD_LOCAL char *ferite_scanner_file;
+extern FE_THREAD_LOCAL int	ferite_scanner_lineno;
+FE_THREAD_LOCAL int		ferite_compile_error = 0;
+FE_THREAD_LOCAL int		ferite_compile_finishing_class = FE_FALSE;
+FE_THREAD_LOCAL jmp_buf	ferite_compiler_jmpback;
+FE_THREAD_LOCAL int		ferite_compiler_current_block_depth = 0;
+FE_THREAD_LOCAL char  **ferite_compiler_paths = NULL; /* The extra search paths of this compile */
 int			ferite_keep_native_function_data = 0;
-int			ferite_compiler_current_block_depth = 0;
-AphexMutex	*ferite_compiler_lock = NULL;
 int			ferite_closure_count = 0;
 
 void ferite_init_compiler()
 {
 	FE_ENTER_FUNCTION;
-	if( ferite_compiler_lock == NULL )
-		ferite_compiler_lock = aphex_mutex_recursive_create();
 	FE_LEAVE_FUNCTION( NOWT );
 }
 
 void ferite_deinit_compiler()
 {
 	FE_ENTER_FUNCTION;
-	if( ferite_compiler_lock != NULL )
-	{
-		aphex_mutex_destroy( ferite_compiler_lock );
-		ferite_compiler_lock = NULL;
-	}
 	FE_LEAVE_FUNCTION( NOWT );
 }
 
+/**
+ * @function ferite_compiler_search_paths
+ * @declaration char **ferite_compiler_search_paths()
+ * @brief Get the extra search paths given to the compile running on this thread
+ * @return A NULL terminated array of paths, or NULL if there are none
+ */
+char **ferite_compiler_search_paths()
+{
+	return ferite_compiler_paths;
+}
+
 FeriteCompileRecord *ferite_compile_record_alloc()
 {
 	FeriteCompileRecord *ptr = fmalloc_ngc(sizeof(FeriteCompileRecord));
@@ -209,7 +216,6 @@ void ferite_delete_directives_collection( FeriteStack *stack )
 void ferite_start_compiler( FeriteScript *new_script )
 {
 	FE_ENTER_FUNCTION;
-	aphex_mutex_lock( ferite_compiler_lock );
 	ferite_current_compile = ferite_compile_record_alloc();
 	CURRENT_SCRIPT = new_script;
 	CURRENT_CLASS = NULL;
@@ -249,7 +255,6 @@ void ferite_clean_compiler()
 	ferite_previous_directives_stack = NULL;
 	ferite_directive_stack = NULL;
 	ferite_do_function_cleanup();
-	aphex_mutex_unlock( ferite_compiler_lock );
 	FE_LEAVE_FUNCTION( NOWT );
 }
 
@@ -322,7 +327,7 @@ char *ferite_compiler_build_current_path() {
 }
 char *ferite_compiler_entry_function( char *filename )
 {
-	static char entryFunctionNameBuffer[4096];
+	static FE_THREAD_LOCAL char entryFunctionNameBuffer[4096];
 
 	FE_ENTER_FUNCTION;
 	sprintf(entryFunctionNameBuffer, "entry:%s", filename);
@@ -632,8 +637,6 @@ FeriteScript *ferite_compile_string_with_path( char *str, char **paths )
  */
 FeriteScript *ferite_compile_string_with_script_and_path( FeriteScript *script, char *str, char **paths )
 {
-	int path_count = 0;
-
 	FE_ENTER_FUNCTION;
 	ferite_compile_error = 0;
 	if( script->filename )
@@ -684,18 +687,15 @@ FeriteScript *ferite_compile_string_with_script_and_path( FeriteScript *script,
 		rename->is_static = FE_FUNCTION_IS_DIRECTIVE;
 	}
 
-	/* we now have exclusive lock on the compiler, we now add our paths the list */
-	if( paths != NULL )
-	{
-		while( paths[path_count] != NULL )
-			ferite_add_library_search_path( paths[path_count++] );
-	}
+	/* our paths are only seen by this compile, other threads may be compiling too */
+	ferite_compiler_paths = paths;
 
 	FUD(("Setting up parser\n"));
 	ferite_prepare_parser( str );
 
 	if( ferite_module_do_preload( script ) == 0 )
 	{
+		ferite_compiler_paths = NULL;
 		ferite_clean_compiler();
 		ferite_script_clean( script );
 		FE_LEAVE_FUNCTION( script );
@@ -708,15 +708,7 @@ FeriteScript *ferite_compile_string_with_script_and_path( FeriteScript *script,
 		ferite_parse();
 		FUD(("Cleaning Up Parser\n"));
 
-		/* remove the paths from the system before we relinquish compiler control */
-		if( paths != NULL )
-		{
-			while( path_count > 0 )
-			{
-				ferite_pop_library_search_path();
-				path_count--;
-			}
-		}
+		ferite_compiler_paths = NULL;
 		if( ferite_current_compile->last_script_return ) {
 			ferite_variable_destroy( script, ferite_current_compile->last_script_return );
 			ferite_current_compile->last_script_return = NULL;
@@ -731,15 +723,7 @@ FeriteScript *ferite_compile_string_with_script_and_path( FeriteScript *script,
 		if( ferite_scanner_file == NULL || strcmp( ferite_scanner_file, "-e" ) == 0 )
 			ferite_error( CURRENT_SCRIPT, 0, "Fatal error compiling script\n" );
 
-		/* remove the paths from the system before we relinquish compiler control */
-		if( paths != NULL )
-		{
-			while( path_count > 0 )
-			{
-				ferite_pop_library_search_path();
-				path_count--;
-			}
-		}
+		ferite_compiler_paths = NULL;
 
 		ferite_clean_compiler();
 		ferite_script_clean( script );
@@ -997,11 +981,11 @@ void ferite_do_function_header( char *name, int is_static, int is_native, int is
 	FE_LEAVE_FUNCTION( NOWT );
 }
 
-extern int ferite_var_is_native;
+extern FE_THREAD_LOCAL int ferite_var_is_native;
 
 char *ferite_signature_to_string( FeriteScript *script, FeriteFunction *func )
 {
-	static char parameters_buffer[1024];
+	static FE_THREAD_LOCAL char parameters_buffer[1024];
 	int i = 0;
 	
 	memset( parameters_buffer, '\0', 1024 );
@@ -1579,7 +1563,11 @@ void ferite_do_closure_start()
 	char *current_path = ferite_compiler_build_current_path_wannotation_wfunction( FE_FALSE, FE_FALSE );
 	FeriteNamespace *space = CURRENT_NAMESPACE;
 
+#ifdef THREAD_SAFE
+	sprintf( name, "!closure:%d:%s", __atomic_add_fetch( &ferite_closure_count, 1, __ATOMIC_RELAXED ), current_path );
+#else
 	sprintf( name, "!closure:%d:%s", ++ferite_closure_count, current_path );
+#endif
 	ffree_ngc(current_path);
 	
 	CURRENT_NAMESPACE = CURRENT_SCRIPT->mainns;
@@ -1820,7 +1808,13 @@ void ferite_do_add_variable_with_value( char *name, FeriteVariable *new_variable
 
 		if( is_atomic ) {
 #ifdef THREAD_SAFE
-			new_variable->lock = (void*)aphex_mutex_recursive_create();
+			/*
+			 * A final variable can only be given its value once, after which
+			 * every access is a read, so it is left without a lock. This is
+			 * what lets threads share read-only objects without contending.
+			 */
+			if( !FE_VAR_IS_FINAL(new_variable) )
+				new_variable->lock = (void*)aphex_mutex_recursive_create();
 #else
 			ferite_warning( CURRENT_SCRIPT, "'atomic' keyword can not be used for variable '%s' - please compile ferite with threading!\n", name );
 			ferite_warning( CURRENT_SCRIPT, "  [on line %d, in %s]\n", ferite_scanner_lineno, ferite_scanner_file );
@@ -121,7 +121,7 @@ int ferite_script_execute( FeriteScript *script )
 				if( script->error == NULL )
 				{
 					script->error = ferite_buffer_new( script, 0 );
-					ferite_buffer_printf( script, script->error, "\n\n[ferite] Fatal Error: Execution stopped: On line %d, in file '%s':\n%s\n", script->current_op_line, script->current_op_file, VAS(errstr)->data );
+					ferite_buffer_printf( script, script->error, "\n\n[ferite] Fatal Error: Execution stopped: On line %d, in file '%s':\n%.*s\n", script->current_op_line, script->current_op_file, (int)VAS(errstr)->length, VAS(errstr)->data );
 				}
 				FE_LEAVE_FUNCTION( 0 );
 			}
@@ -194,7 +194,10 @@ FE_NATIVE_FUNCTION( ferite_script_function_execute )
 			}
 			else				
 			{	
-				if( !FE_VAR_IS_DISPOSABLE(params[i]) )
+				/* Compiled constants live in the bytecode: taking a reference would write to
+				 * pages that forked workers share with their master, and let the callee
+				 * modify the literal. They are passed by value instead. */
+				if( !FE_VAR_IS_DISPOSABLE(params[i]) && !FE_VAR_IS_COMPILED(params[i]) )
 				{
 					/* We delete the existing var and then replace with ours */
 					ferite_variable_destroy( script, exec.variable_list[i+offset] );
@@ -316,7 +319,7 @@ typedef struct __ferite_opcode_context
 
 char *ferite_parameters_to_string( FeriteScript *script, FeriteVariable **param_list )
 {
-	static char buffer[1024];
+	static FE_THREAD_LOCAL char buffer[1024];
 	int i = 0;
 	
 	memset( buffer, '\0', 1024 );
@@ -330,7 +333,7 @@ char *ferite_parameters_to_string( FeriteScript *script, FeriteVariable **param_
 	return buffer;
 }
 #ifdef DEBUG
-int ferite_execute_call_depth = 0;
+FE_THREAD_LOCAL int ferite_execute_call_depth = 0;
 #endif
 
 INLINE_OP( ferite_exec_funcall )
@@ -1214,7 +1217,7 @@ INLINE_OP( ferite_exec_raise )
 		FeriteVariable *global_error = ferite_find_namespace_element_contents( script, script->mainns, "err", FENS_VAR );
 
 		if( VAO(error) != VAO(global_error) ) {
-			ferite_error( script, 0, "%s", VAS(str)->data );
+			ferite_error( script, 0, "%.*s", (int)VAS(str)->length, VAS(str)->data );
 			ferite_variable_fast_assign( script, global_error, error );
 		} else {
 			script->error_state = FE_ERROR_THROWN;
@@ -156,6 +156,36 @@ void ferite_check_std_gc( FeriteScript *script )
 	script->gc_running = FE_FALSE;
     FE_LEAVE_FUNCTION( NOWT );
 }
+void ferite_collect_std_gc( FeriteScript *script )
+{
+    int i, freed;
+    FeriteStdGC *gc = NULL;
+
+    FE_ENTER_FUNCTION;
+    FE_ASSERT( script != NULL && script->gc != NULL );
+	script->gc_running = FE_TRUE;
+
+    gc = script->gc;
+    /* deleting an object can drop the last reference to one we have already passed */
+    do
+    {
+        freed = 0;
+        for( i = 0; i < gc->size; i++ )
+        {
+            if( gc->contents[i] != NULL && gc->contents[i]->refcount <= 0 )
+            {
+                ferite_delete_class_object( script, gc->contents[i], FE_TRUE );
+                gc->contents[i] = NULL;
+                freed++;
+            }
+        }
+    }
+    while( freed > 0 );
+	script->gc_count = 0;
+
+	script->gc_running = FE_FALSE;
+    FE_LEAVE_FUNCTION( NOWT );
+}
 void ferite_merge_std_gc( FeriteScript *script, void *g )
 {
     int i;
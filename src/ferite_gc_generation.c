@@ -59,6 +59,7 @@ FeriteGCGeneration *ferite_generation_create()
     ptr->contents = fcalloc_ngc(sizeof(FeriteObject*)*ptr->size,1);
     ptr->younger = NULL;
     ptr->older = NULL;
+    ptr->handoff = NULL;
     FE_LEAVE_FUNCTION(ptr);
 }
 
@@ -104,6 +105,7 @@ void ferite_deinit_generation_gc( FeriteScript *script )
     FE_ENTER_FUNCTION;
     if( script->gc != NULL )
     {
+        ferite_adopt_generation_gc( script );
         FUD(("GC: +-----------------------------+\n"));
         FUD(("GC: | CLEANING UP Generational GC |\n"));
         FUD(("GC: +-----------------------------+\n"));
@@ -173,6 +175,7 @@ void ferite_check_generation_gc( FeriteScript *script )
 		ferite_debug_catch( NULL, 0 );
 	}
 	script->gc_running = FE_TRUE;
+    ferite_adopt_generation_gc( script );
     ferite_check_gc_generation( script, script->gc );
 	script->gc_running = FE_FALSE;
     UNLOCK_GC;    
@@ -255,45 +258,131 @@ void ferite_check_gc_generation( FeriteScript *script, FeriteGCGeneration *g )
     FE_LEAVE_FUNCTION( NOWT );
 }
 
+/*
+ * Sweep a single generation in place, keeping the survivors where they are rather
+ * than promoting them. Returns the number of objects freed.
+ */
+int ferite_sweep_gc_generation( FeriteScript *script, FeriteGCGeneration *g )
+{
+    int i = 0, kept = 0, freed = 0;
+
+    FE_ENTER_FUNCTION;
+    for( i = 0; i < g->next_free; i++ )
+    {
+		FeriteObject *object = g->contents[i];
+		g->contents[i] = NULL;
+		if( object == NULL )
+			continue;
+		if( object->refcount <= 0 ) {
+			ferite_delete_class_object( script, object, FE_TRUE );
+			freed++;
+		}
+		else
+			g->contents[kept++] = object;
+    }
+    g->next_free = kept;
+    FE_LEAVE_FUNCTION( freed );
+}
+
+void ferite_collect_generation_gc( FeriteScript *script )
+{
+    FeriteGCGeneration *g = NULL;
+    int freed = 0;
+
+    FE_ENTER_FUNCTION;
+    LOCK_GC;
+	script->gc_running = FE_TRUE;
+    ferite_adopt_generation_gc( script );
+    do
+    {
+        freed = 0;
+        for( g = script->gc; g != NULL; g = g->older )
+            freed += ferite_sweep_gc_generation( script, g );
+    }
+    while( freed > 0 );
+	script->gc_count = 0;
+	script->gc_running = FE_FALSE;
+    UNLOCK_GC;
+    FE_LEAVE_FUNCTION( NOWT );
+}
+
+/*
+ * A thread that finishes hands its surviving objects to the script that owns
+ * it by pushing its whole chain of generations onto that script's gc_incoming
+ * stack. The push is a compare and swap, so the thread never waits on the
+ * owner's GC lock and the owner is never stopped while it happens. The owner
+ * takes everything on the stack in one exchange the next time it looks at its
+ * own GC and hangs the chains off the end of its oldest generation.
+ */
+static void ferite_generation_handoff( FeriteScript *script, FeriteGCGeneration *chain )
+{
+#ifdef THREAD_SAFE
+    void *head = __atomic_load_n( &script->gc_incoming, __ATOMIC_RELAXED );
+
+    do
+        chain->handoff = head;
+    while( !__atomic_compare_exchange_n( &script->gc_incoming, &head, chain, FE_TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+#else
+    chain->handoff = script->gc_incoming;
+    script->gc_incoming = chain;
+#endif
+}
+
+/* The caller must hold the script's GC lock, or be the only thread using the script */
+void ferite_adopt_generation_gc( FeriteScript *script )
+{
+    FeriteGCGeneration *chain = NULL, *next = NULL, *tail = NULL;
+
+    FE_ENTER_FUNCTION;
+    if( script->gc == NULL || __atomic_load_n( &script->gc_incoming, __ATOMIC_RELAXED ) == NULL )
+        FE_LEAVE_FUNCTION( NOWT );
+
+    chain = __atomic_exchange_n( &script->gc_incoming, NULL, __ATOMIC_ACQUIRE );
+    for( tail = script->gc; tail->older != NULL; tail = tail->older )
+        ;
+    for( ; chain != NULL; chain = next )
+    {
+        next = chain->handoff;
+        chain->handoff = NULL;
+        tail->older = chain;
+        chain->younger = tail;
+        for( tail = chain; tail->older != NULL; tail = tail->older )
+            ;
+    }
+    FE_LEAVE_FUNCTION( NOWT );
+}
+
 /*!
 * \fn void ferite_gc_generation_merge()
- * \brief Merge dead threads GC to parents GC, clear up all we can first
+ * \brief Hand a dead thread's GC over to its parent
+ *
+ * This runs on the dead thread, so it must not free anything: that would run
+ * destructors and fill the parent's caches while the parent is using them. The
+ * thread collects its generations under its own script before it gets here,
+ * so all that is left are the survivors.
  * */
 void ferite_merge_generation_gc( FeriteScript *script, void *g )
 {
-    int i = 0;
-#if 0
-	int count = 0;
-#endif
-    FeriteGCGeneration *lowerBound = g;
-    FeriteGCGeneration *upperBound = NULL;
-    FeriteGCGeneration *gc = NULL;
+    FeriteGCGeneration *chain = g, *gen = NULL, *older = NULL;
 
-    LOCK_GC;
-    for( gc = lowerBound; gc != NULL; gc = gc->older ) {
-        /* Make a note of the upper bound */
-        if( gc->older == NULL )
-            upperBound = gc;
-        /* Delete unreferenced objects */
-        for( i = 0; i < gc->next_free; i++ )
+    FE_ENTER_FUNCTION;
+    for( gen = chain; gen != NULL; gen = older )
+    {
+        older = gen->older;
+        if( gen->next_free == 0 )
         {
-            if( gc->contents[i] != NULL && gc->contents[i]->refcount <= 0 )
-                ferite_delete_class_object( script, gc->contents[i], FE_TRUE );
-            else {
-#if 0
-				FeriteVariable *var = ferite_call_function( script, gc->contents[i], NULL, ferite_object_get_function( script, gc->contents[i], "toString" ), NULL );
-				count++;
-				fprintf( stderr, "Merging object of class %s [%d]\n", gc->contents[i]->klass->name, gc->contents[i]->refcount );
-				fprintf( stderr, "  -> %s\n", VAS(var)->data );
-#endif
-                ferite_add_to_generation_gc_unlocked( script, gc->contents[i] );
-			}
-            gc->contents[i] = NULL;
+            /* Drop generations that have nothing left in them */
+            if( gen->younger != NULL )
+                gen->younger->older = older;
+            else
+                chain = older;
+            if( older != NULL )
+                older->younger = gen->younger;
+            gen->older = NULL;
+            ferite_generation_destroy( script, gen );
         }
     }
-    ferite_generation_destroy( script, lowerBound );
-#if 0
-	fprintf( stderr, "Merge GC [%p] %d objects\n", script, count );
-#endif
-    UNLOCK_GC; /* We unlock here because it means we don't clobber ourselves two lines down */
+    if( chain != NULL )
+        ferite_generation_handoff( script, chain );
+    FE_LEAVE_FUNCTION( NOWT );
 }
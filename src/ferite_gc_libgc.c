@@ -47,6 +47,7 @@ void ferite_init_libgc_gc( FeriteScript *script )
 	ferite_deinit_gc = ferite_deinit_libgc_gc;
 	ferite_add_to_gc = ferite_add_to_libgc_gc;
 	ferite_check_gc = ferite_check_libgc_gc;
+	ferite_collect_gc = ferite_collect_libgc_gc;
 	ferite_merge_gc = ferite_merge_libgc_gc;
     FE_LEAVE_FUNCTION( NOWT );
 }
@@ -74,6 +75,12 @@ void ferite_add_to_libgc_gc( FeriteScript *script, FeriteObject *obj )
 void ferite_check_libgc_gc( FeriteScript *script )
 {
 }
+void ferite_collect_libgc_gc( FeriteScript *script )
+{
+#ifdef HAVE_LIBGC
+	GC_gcollect();
+#endif
+}
 void ferite_merge_libgc_gc( FeriteScript *script, void *g )
 {
 }
@@ -38,8 +38,8 @@
  *              functions.
  */
 
-/* This is only used within debug to check function call traces  */
-int                ferite_call_level = 0;
+/* This is only used within debug to check function call traces, each thread has its own */
+FE_THREAD_LOCAL int ferite_call_level = 0;
 
 /** 
  * @variable ferite_show_debug
@@ -56,6 +56,15 @@ int                ferite_use_mm_with_pcre = 0;
 
 int                ferite_is_strict = 0;
 
+/**
+ * @variable ferite_atomic_refcounts
+ * @type int
+ * @brief Whether FINCREF and FDECREF use atomic operations
+ * @description This is off until the first thread is started, so scripts that never
+ *              start one do not pay for it. See ferite_enable_atomic_refcounts().
+ */
+int                ferite_atomic_refcounts = 0;
+
 int                ferite_show_partial_implementation = 0;
 
 /*! Generic function for memory management. Hides the actually memory manager */
@@ -120,6 +129,14 @@ void  (*ferite_add_to_gc)( FeriteScript *script, FeriteObject *obj );
  * @param FeriteScript *script The script
  */
 void  (*ferite_check_gc)( FeriteScript *script );
+
+/**
+ * @function ferite_collect_gc
+ * @declaration void ferite_collect_gc( FeriteScript *script )
+ * @brief Free every unreferenced object the garbage collector knows about, regardless of age
+ * @param FeriteScript *script The script
+ */
+void  (*ferite_collect_gc)( FeriteScript *script );
 void  (*ferite_merge_gc)( FeriteScript *script, void *gc );
 
 /**
@@ -129,8 +146,8 @@ void  (*ferite_merge_gc)( FeriteScript *script, void *gc );
  */
 FeriteVariable *ferite_ARGV = NULL;
 
-jmp_buf ferite_exception_jmpback;
-int ferite_exception_status;
+FE_THREAD_LOCAL jmp_buf ferite_exception_jmpback;
+FE_THREAD_LOCAL int ferite_exception_status;
 
 void ferite_debug_catch( void *p, int count ) 
 {
@@ -0,0 +1,1366 @@
+/*
+ * Copyright (C) 2000-2007 Chris Ross and various contributors
+ * Copyright (C) 1999-2000 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_HEADER
+#include "../config.h"
+#endif
+
+#include <ctype.h>
+#include "ferite.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+# define FE_KERNEL_HAVE_SSE2
+# include <emmintrin.h>
+# if __GNUC__ >= 5 || defined(__clang__)
+#  define FE_KERNEL_HAVE_AVX2
+#  include <immintrin.h>
+# endif
+#endif
+
+/**
+ * @group Kernels
+ * @description The string kernels are the inner loops of the String module: case mapping,
+ *              searching, scanning for delimiters, base64, UTF-8 and URL encoding. Each comes
+ *              in a plain C version and, on x86-64, SSE2 and AVX2 versions that look at 16 or
+ *              32 bytes at a time. ferite_init() picks the best set the processor supports;
+ *              every version gives exactly the same answers, so which one is in use is only
+ *              ever visible in how long things take. All of them work on a pointer and a
+ *              length and none of them need the data to be NUL terminated.
+ */
+
+#define FE_KERNEL_SET_MAX 16 /* Bigger sets of delimiters are looked up a byte at a time */
+
+typedef struct __ferite_kernel_table
+{
+    void   (*lower)( unsigned char *dst, const unsigned char *src, size_t length );
+    void   (*upper)( unsigned char *dst, const unsigned char *src, size_t length );
+    void   (*reverse)( unsigned char *dst, const unsigned char *src, size_t length );
+    long   (*find)( const unsigned char *haystack, size_t length, const unsigned char *needle, size_t count );
+    size_t (*scan)( const unsigned char *data, size_t length, const unsigned char *set, size_t count );
+    size_t (*span)( const unsigned char *data, size_t length, const unsigned char *set, size_t count );
+    size_t (*span_back)( const unsigned char *data, size_t length, const unsigned char *set, size_t count );
+    size_t (*printable)( const unsigned char *data, size_t length, const unsigned char *set, size_t count );
+    size_t (*unreserved)( const unsigned char *data, size_t length );
+    size_t (*base64_encode)( unsigned char *dst, const unsigned char *src, size_t length );   /* Whole groups only */
+    size_t (*base64_decode)( unsigned char *dst, const unsigned char *src, size_t length );   /* May stop early */
+    int    (*utf8_valid)( const unsigned char *data, size_t length );
+    size_t (*utf8_count)( const unsigned char *data, size_t length );
+    long   (*utf8_detect)( const unsigned char *data, size_t length );
+}
+FeriteKernelTable;
+
+static const char ferite_kernel_base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char ferite_kernel_hex[] = "0123456789ABCDEF";
+
+/* 0x80 marks a character that is not part of the alphabet; '=' reads as zero */
+static const unsigned char ferite_kernel_base64_values[256] = {
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,  62,0x80,0x80,0x80,  63,
+      52,  53,  54,  55,  56,  57,  58,  59,  60,  61,0x80,0x80,0x80,   0,0x80,0x80,
+    0x80,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+      15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,0x80,0x80,0x80,0x80,0x80,
+    0x80,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+      41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+    0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80
+};
+
+/*{{{ Scalar */
+static void kernel_lower_scalar( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    size_t i;
+
+    for( i = 0; i < length; i++ )
+      dst[i] = (unsigned char)tolower( src[i] );
+}
+
+static void kernel_upper_scalar( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    size_t i;
+
+    for( i = 0; i < length; i++ )
+      dst[i] = (unsigned char)toupper( src[i] );
+}
+
+static void kernel_reverse_scalar( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    size_t i;
+
+    for( i = 0; i < length; i++ )
+      dst[i] = src[length - 1 - i];
+}
+
+static long kernel_find_scalar( const unsigned char *haystack, size_t length, const unsigned char *needle, size_t count )
+{
+    size_t i;
+
+    if( count == 0 )
+      return 0;
+    if( count > length )
+      return -1;
+    for( i = 0; i <= length - count; i++ )
+    {
+        if( haystack[i] == needle[0] && memcmp( haystack + i + 1, needle + 1, count - 1 ) == 0 )
+          return (long)i;
+    }
+    return -1;
+}
+
+static void kernel_set_table( unsigned char *table, const unsigned char *set, size_t count )
+{
+    size_t i;
+
+    memset( table, 0, 256 );
+    for( i = 0; i < count; i++ )
+      table[set[i]] = 1;
+}
+
+static size_t kernel_scan_scalar( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    unsigned char table[256];
+    size_t i;
+
+    kernel_set_table( table, set, count );
+    for( i = 0; i < length && !table[data[i]]; i++ )
+      ;
+    return i;
+}
+
+static size_t kernel_span_scalar( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    unsigned char table[256];
+    size_t i;
+
+    kernel_set_table( table, set, count );
+    for( i = 0; i < length && table[data[i]]; i++ )
+      ;
+    return i;
+}
+
+static size_t kernel_span_back_scalar( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    unsigned char table[256];
+    size_t i;
+
+    kernel_set_table( table, set, count );
+    for( i = length; i > 0 && table[data[i - 1]]; i-- )
+      ;
+    return length - i;
+}
+
+static size_t kernel_printable_scalar( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    unsigned char table[256];
+    size_t i;
+
+    kernel_set_table( table, set, count );
+    for( i = 0; i < length && data[i] >= 0x20 && data[i] < 0x7F && !table[data[i]]; i++ )
+      ;
+    return i;
+}
+
+static int kernel_is_unreserved( unsigned char c )
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+           c == '-' || c == '_' || c == '.' || c == '~';
+}
+
+static size_t kernel_unreserved_scalar( const unsigned char *data, size_t length )
+{
+    size_t i;
+
+    for( i = 0; i < length && kernel_is_unreserved( data[i] ); i++ )
+      ;
+    return i;
+}
+
+static size_t kernel_base64_encode_scalar( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    size_t i;
+
+    for( i = 0; i + 3 <= length; i += 3, dst += 4 )
+    {
+        dst[0] = ferite_kernel_base64_alphabet[src[i] >> 2];
+        dst[1] = ferite_kernel_base64_alphabet[((src[i] & 0x03) << 4) | (src[i + 1] >> 4)];
+        dst[2] = ferite_kernel_base64_alphabet[((src[i + 1] & 0x0F) << 2) | (src[i + 2] >> 6)];
+        dst[3] = ferite_kernel_base64_alphabet[src[i + 2] & 0x3F];
+    }
+    return i;
+}
+
+static size_t kernel_base64_decode_scalar( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    /* Everything is left to ferite_kernel_base64_decode(), which copes with padding and rubbish */
+    return 0;
+}
+
+/* How long a well formed multi byte sequence starting at data is, or 0 if it is not one */
+static size_t kernel_utf8_sequence( const unsigned char *data, size_t length )
+{
+    unsigned char c = data[0], low = 0x80, high = 0xBF;
+    size_t size, i;
+
+    if( c >= 0xC2 && c <= 0xDF )
+      size = 2;
+    else if( c >= 0xE0 && c <= 0xEF )
+    {
+        size = 3;
+        if( c == 0xE0 )
+          low = 0xA0;  /* Overlong */
+        else if( c == 0xED )
+          high = 0x9F; /* Surrogates */
+    }
+    else if( c >= 0xF0 && c <= 0xF4 )
+    {
+        size = 4;
+        if( c == 0xF0 )
+          low = 0x90;  /* Overlong */
+        else if( c == 0xF4 )
+          high = 0x8F; /* Past U+10FFFF */
+    }
+    else
+      return 0;
+
+    if( length < size || data[1] < low || data[1] > high )
+      return 0;
+    for( i = 2; i < size; i++ )
+    {
+        if( (data[i] & 0xC0) != 0x80 )
+          return 0;
+    }
+    return size;
+}
+
+static int kernel_utf8_valid_scalar( const unsigned char *data, size_t length )
+{
+    size_t i = 0, size;
+
+    while( i < length )
+    {
+        if( data[i] < 0x80 )
+        {
+            i++;
+            continue;
+        }
+        if( (size = kernel_utf8_sequence( data + i, length - i )) == 0 )
+          return FE_FALSE;
+        i += size;
+    }
+    return FE_TRUE;
+}
+
+static size_t kernel_utf8_count_scalar( const unsigned char *data, size_t length )
+{
+    size_t i, count = 0;
+
+    for( i = 0; i < length; i++ )
+    {
+        if( (data[i] & 0xC0) != 0x80 )
+          count++;
+    }
+    return count;
+}
+
+static long kernel_utf8_detect_scalar( const unsigned char *data, size_t length )
+{
+    size_t i;
+
+    for( i = 0; i + 1 < length; i++ )
+    {
+        if( data[i] >= 0xC0 && data[i + 1] >= 0x80 )
+          return (long)i;
+    }
+    return -1;
+}
+/*}}}*/
+
+/*{{{ SSE2 */
+#ifdef FE_KERNEL_HAVE_SSE2
+/* Case mapping is only done in bulk on plain ASCII, bytes above 0x7F are left alone by the vector
+ * code and go through tolower() and toupper() so that a locale chosen with Sys.setlocale() still applies */
+static void kernel_lower_sse2( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    const __m128i before = _mm_set1_epi8( 'A' - 1 ), after = _mm_set1_epi8( 'Z' + 1 ), bit = _mm_set1_epi8( 0x20 );
+    __m128i c, m;
+    unsigned int high;
+    size_t i;
+
+    for( i = 0; i + 16 <= length; i += 16 )
+    {
+        c = _mm_loadu_si128( (const __m128i *)(src + i) );
+        high = (unsigned int)_mm_movemask_epi8( c );
+        m = _mm_and_si128( _mm_cmpgt_epi8( c, before ), _mm_cmplt_epi8( c, after ) );
+        _mm_storeu_si128( (__m128i *)(dst + i), _mm_xor_si128( c, _mm_and_si128( m, bit ) ) );
+        for( ; high; high &= high - 1 )
+          dst[i + __builtin_ctz( high )] = (unsigned char)tolower( src[i + __builtin_ctz( high )] );
+    }
+    kernel_lower_scalar( dst + i, src + i, length - i );
+}
+
+static void kernel_upper_sse2( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    const __m128i before = _mm_set1_epi8( 'a' - 1 ), after = _mm_set1_epi8( 'z' + 1 ), bit = _mm_set1_epi8( 0x20 );
+    __m128i c, m;
+    unsigned int high;
+    size_t i;
+
+    for( i = 0; i + 16 <= length; i += 16 )
+    {
+        c = _mm_loadu_si128( (const __m128i *)(src + i) );
+        high = (unsigned int)_mm_movemask_epi8( c );
+        m = _mm_and_si128( _mm_cmpgt_epi8( c, before ), _mm_cmplt_epi8( c, after ) );
+        _mm_storeu_si128( (__m128i *)(dst + i), _mm_xor_si128( c, _mm_and_si128( m, bit ) ) );
+        for( ; high; high &= high - 1 )
+          dst[i + __builtin_ctz( high )] = (unsigned char)toupper( src[i + __builtin_ctz( high )] );
+    }
+    kernel_upper_scalar( dst + i, src + i, length - i );
+}
+
+static void kernel_reverse_sse2( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    __m128i c;
+    size_t i;
+
+    for( i = 0; i + 16 <= length; i += 16 )
+    {
+        c = _mm_loadu_si128( (const __m128i *)(src + length - i - 16) );
+        c = _mm_shuffle_epi32( c, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+        c = _mm_shufflelo_epi16( c, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+        c = _mm_shufflehi_epi16( c, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+        c = _mm_or_si128( _mm_slli_epi16( c, 8 ), _mm_srli_epi16( c, 8 ) );
+        _mm_storeu_si128( (__m128i *)(dst + i), c );
+    }
+    for( ; i < length; i++ )
+      dst[i] = src[length - 1 - i];
+}
+
+/* Which bytes of a block are in a set that has already been spread across registers */
+static unsigned int kernel_set_mask_sse2( __m128i c, const __m128i *set, size_t count )
+{
+    __m128i m = _mm_cmpeq_epi8( c, set[0] );
+    size_t i;
+
+    for( i = 1; i < count; i++ )
+      m = _mm_or_si128( m, _mm_cmpeq_epi8( c, set[i] ) );
+    return (unsigned int)_mm_movemask_epi8( m );
+}
+
+static size_t kernel_scan_sse2( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    __m128i want[FE_KERNEL_SET_MAX];
+    unsigned int mask;
+    size_t i;
+
+    if( count == 0 || count > FE_KERNEL_SET_MAX )
+      return kernel_scan_scalar( data, length, set, count );
+    for( i = 0; i < count; i++ )
+      want[i] = _mm_set1_epi8( (char)set[i] );
+    for( i = 0; i + 16 <= length; i += 16 )
+    {
+        if( (mask = kernel_set_mask_sse2( _mm_loadu_si128( (const __m128i *)(data + i) ), want, count )) )
+          return i + __builtin_ctz( mask );
+    }
+    return i + kernel_scan_scalar( data + i, length - i, set, count );
+}
+
+static size_t kernel_span_sse2( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    __m128i want[FE_KERNEL_SET_MAX];
+    unsigned int mask;
+    size_t i;
+
+    if( count == 0 || count > FE_KERNEL_SET_MAX )
+      return kernel_span_scalar( data, length, set, count );
+    for( i = 0; i < count; i++ )
+      want[i] = _mm_set1_epi8( (char)set[i] );
+    for( i = 0; i + 16 <= length; i += 16 )
+    {
+        if( (mask = ~kernel_set_mask_sse2( _mm_loadu_si128( (const __m128i *)(data + i) ), want, count ) & 0xFFFF) )
+          return i + __builtin_ctz( mask );
+    }
+    return i + kernel_span_scalar( data + i, length - i, set, count );
+}
+
+static size_t kernel_span_back_sse2( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    __m128i want[FE_KERNEL_SET_MAX];
+    unsigned int mask;
+    size_t i;
+
+    if( count == 0 || count > FE_KERNEL_SET_MAX )
+      return kernel_span_back_scalar( data, length, set, count );
+    for( i = 0; i < count; i++ )
+      want[i] = _mm_set1_epi8( (char)set[i] );
+    for( i = length; i >= 16; i -= 16 )
+    {
+        if( (mask = ~kernel_set_mask_sse2( _mm_loadu_si128( (const __m128i *)(data + i - 16) ), want, count ) & 0xFFFF) )
+          return length - (i - 16) - (32 - __builtin_clz( mask ));
+    }
+    return length - i + kernel_span_back_scalar( data, i, set, count );
+}
+
+static size_t kernel_printable_sse2( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    const __m128i before = _mm_set1_epi8( 0x1F ), after = _mm_set1_epi8( 0x7F );
+    __m128i want[FE_KERNEL_SET_MAX], c;
+    unsigned int mask;
+    size_t i;
+
+    if( count > FE_KERNEL_SET_MAX )
+      return kernel_printable_scalar( data, length, set, count );
+    for( i = 0; i < count; i++ )
+      want[i] = _mm_set1_epi8( (char)set[i] );
+    for( i = 0; i + 16 <= length; i += 16 )
+    {
+        c = _mm_loadu_si128( (const __m128i *)(data + i) );
+        mask = ~_mm_movemask_epi8( _mm_and_si128( _mm_cmpgt_epi8( c, before ), _mm_cmplt_epi8( c, after ) ) ) & 0xFFFF;
+        if( count > 0 )
+          mask |= kernel_set_mask_sse2( c, want, count );
+        if( mask )
+          return i + __builtin_ctz( mask );
+    }
+    return i + kernel_printable_scalar( data + i, length - i, set, count );
+}
+
+static size_t kernel_unreserved_sse2( const unsigned char *data, size_t length )
+{
+    const __m128i zero = _mm_set1_epi8( '0' - 1 ), nine = _mm_set1_epi8( '9' + 1 );
+    const __m128i a = _mm_set1_epi8( 'a' - 1 ), z = _mm_set1_epi8( 'z' + 1 ), fold = _mm_set1_epi8( 0x20 );
+    const __m128i dash = _mm_set1_epi8( '-' ), underscore = _mm_set1_epi8( '_' ), dot = _mm_set1_epi8( '.' ), tilde = _mm_set1_epi8( '~' );
+    __m128i c, f, ok;
+    unsigned int mask;
+    size_t i;
+
+    for( i = 0; i + 16 <= length; i += 16 )
+    {
+        c = _mm_loadu_si128( (const __m128i *)(data + i) );
+        f = _mm_or_si128( c, fold ); /* Folds A-Z onto a-z, nothing else lands there */
+        ok = _mm_or_si128( _mm_and_si128( _mm_cmpgt_epi8( c, zero ), _mm_cmplt_epi8( c, nine ) ),
+                           _mm_and_si128( _mm_cmpgt_epi8( f, a ), _mm_cmplt_epi8( f, z ) ) );
+        ok = _mm_or_si128( ok, _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( c, dash ), _mm_cmpeq_epi8( c, underscore ) ),
+                                             _mm_or_si128( _mm_cmpeq_epi8( c, dot ), _mm_cmpeq_epi8( c, tilde ) ) ) );
+        if( (mask = ~_mm_movemask_epi8( ok ) & 0xFFFF) )
+          return i + __builtin_ctz( mask );
+    }
+    return i + kernel_unreserved_scalar( data + i, length - i );
+}
+
+static int kernel_utf8_valid_sse2( const unsigned char *data, size_t length )
+{
+    unsigned int mask;
+    size_t i = 0, size;
+
+    /* Runs of ASCII are skipped a block at a time, the odd sequence in between is checked by hand */
+    while( i + 16 <= length )
+    {
+        if( (mask = (unsigned int)_mm_movemask_epi8( _mm_loadu_si128( (const __m128i *)(data + i) ) )) == 0 )
+        {
+            i += 16;
+            continue;
+        }
+        i += __builtin_ctz( mask );
+        if( (size = kernel_utf8_sequence( data + i, length - i )) == 0 )
+          return FE_FALSE;
+        i += size;
+    }
+    return kernel_utf8_valid_scalar( data + i, length - i );
+}
+
+static size_t kernel_utf8_count_sse2( const unsigned char *data, size_t length )
+{
+    const __m128i continuation = _mm_set1_epi8( (char)0xBF );
+    size_t i, count = 0;
+
+    /* Anything above 0xBF as a signed byte is ASCII or a lead byte */
+    for( i = 0; i + 16 <= length; i += 16 )
+      count += __builtin_popcount( _mm_movemask_epi8( _mm_cmpgt_epi8( _mm_loadu_si128( (const __m128i *)(data + i) ), continuation ) ) );
+    return count + kernel_utf8_count_scalar( data + i, length - i );
+}
+
+static long kernel_utf8_detect_sse2( const unsigned char *data, size_t length )
+{
+    const __m128i top = _mm_set1_epi8( (char)0xC0 );
+    unsigned int mask;
+    size_t i;
+    long found;
+
+    for( i = 0; i + 17 <= length; i += 16 )
+    {
+        mask = (unsigned int)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_and_si128( _mm_loadu_si128( (const __m128i *)(data + i) ), top ), top ) );
+        mask &= (unsigned int)_mm_movemask_epi8( _mm_loadu_si128( (const __m128i *)(data + i + 1) ) );
+        if( mask )
+          return (long)(i + __builtin_ctz( mask ));
+    }
+    found = kernel_utf8_detect_scalar( data + i, length - i );
+    return found < 0 ? -1 : (long)i + found;
+}
+
+static long kernel_find_sse2( const unsigned char *haystack, size_t length, const unsigned char *needle, size_t count )
+{
+    __m128i first, last;
+    unsigned int mask, bit;
+    size_t i;
+    long found;
+
+    if( count < 2 || count > length )
+    {
+        if( count == 1 )
+          return (i = kernel_scan_sse2( haystack, length, needle, 1 )) < length ? (long)i : -1;
+        return kernel_find_scalar( haystack, length, needle, count );
+    }
+    /* Only places where both the first and the last byte match are looked at properly */
+    first = _mm_set1_epi8( (char)needle[0] );
+    last = _mm_set1_epi8( (char)needle[count - 1] );
+    for( i = 0; i + count + 15 <= length; i += 16 )
+    {
+        mask = (unsigned int)_mm_movemask_epi8( _mm_and_si128(
+                 _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)(haystack + i) ), first ),
+                 _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)(haystack + i + count - 1) ), last ) ) );
+        while( mask )
+        {
+            bit = __builtin_ctz( mask );
+            if( memcmp( haystack + i + bit + 1, needle + 1, count - 2 ) == 0 )
+              return (long)(i + bit);
+            mask &= mask - 1;
+        }
+    }
+    found = kernel_find_scalar( haystack + i, length - i, needle, count );
+    return found < 0 ? -1 : (long)i + found;
+}
+#endif
+/*}}}*/
+
+/*{{{ AVX2 */
+#ifdef FE_KERNEL_HAVE_AVX2
+__attribute__((target("avx2")))
+static void kernel_lower_avx2( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    const __m256i before = _mm256_set1_epi8( 'A' - 1 ), after = _mm256_set1_epi8( 'Z' + 1 ), bit = _mm256_set1_epi8( 0x20 );
+    __m256i c, m;
+    unsigned int high;
+    size_t i;
+
+    for( i = 0; i + 32 <= length; i += 32 )
+    {
+        c = _mm256_loadu_si256( (const __m256i *)(src + i) );
+        high = (unsigned int)_mm256_movemask_epi8( c );
+        m = _mm256_and_si256( _mm256_cmpgt_epi8( c, before ), _mm256_cmpgt_epi8( after, c ) );
+        _mm256_storeu_si256( (__m256i *)(dst + i), _mm256_xor_si256( c, _mm256_and_si256( m, bit ) ) );
+        for( ; high; high &= high - 1 )
+          dst[i + __builtin_ctz( high )] = (unsigned char)tolower( src[i + __builtin_ctz( high )] );
+    }
+    kernel_lower_scalar( dst + i, src + i, length - i );
+}
+
+__attribute__((target("avx2")))
+static void kernel_upper_avx2( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    const __m256i before = _mm256_set1_epi8( 'a' - 1 ), after = _mm256_set1_epi8( 'z' + 1 ), bit = _mm256_set1_epi8( 0x20 );
+    __m256i c, m;
+    unsigned int high;
+    size_t i;
+
+    for( i = 0; i + 32 <= length; i += 32 )
+    {
+        c = _mm256_loadu_si256( (const __m256i *)(src + i) );
+        high = (unsigned int)_mm256_movemask_epi8( c );
+        m = _mm256_and_si256( _mm256_cmpgt_epi8( c, before ), _mm256_cmpgt_epi8( after, c ) );
+        _mm256_storeu_si256( (__m256i *)(dst + i), _mm256_xor_si256( c, _mm256_and_si256( m, bit ) ) );
+        for( ; high; high &= high - 1 )
+          dst[i + __builtin_ctz( high )] = (unsigned char)toupper( src[i + __builtin_ctz( high )] );
+    }
+    kernel_upper_scalar( dst + i, src + i, length - i );
+}
+
+__attribute__((target("avx2")))
+static void kernel_reverse_avx2( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    const __m256i backwards = _mm256_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                                15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 );
+    __m256i c;
+    size_t i;
+
+    for( i = 0; i + 32 <= length; i += 32 )
+    {
+        c = _mm256_shuffle_epi8( _mm256_loadu_si256( (const __m256i *)(src + length - i - 32) ), backwards );
+        _mm256_storeu_si256( (__m256i *)(dst + i), _mm256_permute2x128_si256( c, c, 0x01 ) );
+    }
+    for( ; i < length; i++ )
+      dst[i] = src[length - 1 - i];
+}
+
+__attribute__((target("avx2")))
+static unsigned int kernel_set_mask_avx2( __m256i c, const __m256i *set, size_t count )
+{
+    __m256i m = _mm256_cmpeq_epi8( c, set[0] );
+    size_t i;
+
+    for( i = 1; i < count; i++ )
+      m = _mm256_or_si256( m, _mm256_cmpeq_epi8( c, set[i] ) );
+    return (unsigned int)_mm256_movemask_epi8( m );
+}
+
+__attribute__((target("avx2")))
+static size_t kernel_scan_avx2( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    __m256i want[FE_KERNEL_SET_MAX];
+    unsigned int mask;
+    size_t i;
+
+    if( count == 0 || count > FE_KERNEL_SET_MAX )
+      return kernel_scan_scalar( data, length, set, count );
+    for( i = 0; i < count; i++ )
+      want[i] = _mm256_set1_epi8( (char)set[i] );
+    for( i = 0; i + 32 <= length; i += 32 )
+    {
+        if( (mask = kernel_set_mask_avx2( _mm256_loadu_si256( (const __m256i *)(data + i) ), want, count )) )
+          return i + __builtin_ctz( mask );
+    }
+    return i + kernel_scan_scalar( data + i, length - i, set, count );
+}
+
+__attribute__((target("avx2")))
+static size_t kernel_printable_avx2( const unsigned char *data, size_t length, const unsigned char *set, size_t count )
+{
+    const __m256i before = _mm256_set1_epi8( 0x1F ), after = _mm256_set1_epi8( 0x7F );
+    __m256i want[FE_KERNEL_SET_MAX], c;
+    unsigned int mask;
+    size_t i;
+
+    if( count > FE_KERNEL_SET_MAX )
+      return kernel_printable_scalar( data, length, set, count );
+    for( i = 0; i < count; i++ )
+      want[i] = _mm256_set1_epi8( (char)set[i] );
+    for( i = 0; i + 32 <= length; i += 32 )
+    {
+        c = _mm256_loadu_si256( (const __m256i *)(data + i) );
+        mask = ~(unsigned int)_mm256_movemask_epi8( _mm256_and_si256( _mm256_cmpgt_epi8( c, before ), _mm256_cmpgt_epi8( after, c ) ) );
+        if( count > 0 )
+          mask |= kernel_set_mask_avx2( c, want, count );
+        if( mask )
+          return i + __builtin_ctz( mask );
+    }
+    return i + kernel_printable_scalar( data + i, length - i, set, count );
+}
+
+__attribute__((target("avx2")))
+static size_t kernel_unreserved_avx2( const unsigned char *data, size_t length )
+{
+    const __m256i zero = _mm256_set1_epi8( '0' - 1 ), nine = _mm256_set1_epi8( '9' + 1 );
+    const __m256i a = _mm256_set1_epi8( 'a' - 1 ), z = _mm256_set1_epi8( 'z' + 1 ), fold = _mm256_set1_epi8( 0x20 );
+    const __m256i dash = _mm256_set1_epi8( '-' ), underscore = _mm256_set1_epi8( '_' ), dot = _mm256_set1_epi8( '.' ), tilde = _mm256_set1_epi8( '~' );
+    __m256i c, f, ok;
+    unsigned int mask;
+    size_t i;
+
+    for( i = 0; i + 32 <= length; i += 32 )
+    {
+        c = _mm256_loadu_si256( (const __m256i *)(data + i) );
+        f = _mm256_or_si256( c, fold );
+        ok = _mm256_or_si256( _mm256_and_si256( _mm256_cmpgt_epi8( c, zero ), _mm256_cmpgt_epi8( nine, c ) ),
+                              _mm256_and_si256( _mm256_cmpgt_epi8( f, a ), _mm256_cmpgt_epi8( z, f ) ) );
+        ok = _mm256_or_si256( ok, _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( c, dash ), _mm256_cmpeq_epi8( c, underscore ) ),
+                                                   _mm256_or_si256( _mm256_cmpeq_epi8( c, dot ), _mm256_cmpeq_epi8( c, tilde ) ) ) );
+        if( (mask = ~(unsigned int)_mm256_movemask_epi8( ok )) )
+          return i + __builtin_ctz( mask );
+    }
+    return i + kernel_unreserved_scalar( data + i, length - i );
+}
+
+/* Three bytes become four characters: 24 bytes are spread over the two lanes twelve at a time,
+ * each group of three is shuffled and split into four six bit values with a pair of multiplies,
+ * which are then turned into the alphabet by adding an offset that depends on their range. */
+__attribute__((target("avx2")))
+static size_t kernel_base64_encode_avx2( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    const __m256i spread = _mm256_setr_epi8( 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10 );
+    const __m256i offsets = _mm256_setr_epi8( 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                              'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0 );
+    __m256i in, values, reduced;
+    size_t i;
+
+    for( i = 0; i + 28 <= length; i += 24, dst += 32 )
+    {
+        in = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)(src + i) ) ),
+                                      _mm_loadu_si128( (const __m128i *)(src + i + 12) ), 1 );
+        in = _mm256_shuffle_epi8( in, spread );
+        values = _mm256_or_si256( _mm256_mulhi_epu16( _mm256_and_si256( in, _mm256_set1_epi32( 0x0FC0FC00 ) ), _mm256_set1_epi32( 0x04000040 ) ),
+                                  _mm256_mullo_epi16( _mm256_and_si256( in, _mm256_set1_epi32( 0x003F03F0 ) ), _mm256_set1_epi32( 0x01000010 ) ) );
+        /* 0-25 pick 13, 26-51 pick 0, 52-61 pick 1-10, 62 and 63 pick 11 and 12 */
+        reduced = _mm256_subs_epu8( values, _mm256_set1_epi8( 51 ) );
+        reduced = _mm256_or_si256( reduced, _mm256_and_si256( _mm256_cmpgt_epi8( _mm256_set1_epi8( 26 ), values ), _mm256_set1_epi8( 13 ) ) );
+        _mm256_storeu_si256( (__m256i *)dst, _mm256_add_epi8( values, _mm256_shuffle_epi8( offsets, reduced ) ) );
+    }
+    return i + kernel_base64_encode_scalar( dst, src + i, length - i );
+}
+
+/* Four characters become three bytes. A block is only decoded here if all 32 characters are in
+ * the alphabet; padding or anything else leaves the rest to the careful version. */
+__attribute__((target("avx2")))
+static size_t kernel_base64_decode_avx2( unsigned char *dst, const unsigned char *src, size_t length )
+{
+    const __m256i valid_low = _mm256_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                                0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A );
+    const __m256i valid_high = _mm256_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                                 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+    const __m256i roll = _mm256_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+    const __m256i pack = _mm256_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+    const __m256i join = _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 0, 0 );
+    const __m256i store = _mm256_setr_epi32( -1, -1, -1, -1, -1, -1, 0, 0 );
+    const __m256i nibble = _mm256_set1_epi8( 0x0F ), slash = _mm256_set1_epi8( '/' );
+    __m256i in, high;
+    size_t i;
+
+    for( i = 0; i + 32 <= length; i += 32, dst += 24 )
+    {
+        in = _mm256_loadu_si256( (const __m256i *)(src + i) );
+        high = _mm256_and_si256( _mm256_srli_epi32( in, 4 ), nibble );
+        if( !_mm256_testz_si256( _mm256_shuffle_epi8( valid_low, _mm256_and_si256( in, nibble ) ), _mm256_shuffle_epi8( valid_high, high ) ) )
+          break;
+        in = _mm256_add_epi8( in, _mm256_shuffle_epi8( roll, _mm256_add_epi8( _mm256_cmpeq_epi8( in, slash ), high ) ) );
+        in = _mm256_maddubs_epi16( in, _mm256_set1_epi32( 0x01400140 ) );
+        in = _mm256_madd_epi16( in, _mm256_set1_epi32( 0x00011000 ) );
+        in = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( in, pack ), join );
+        _mm256_maskstore_epi32( (int *)dst, store, in );
+    }
+    return i;
+}
+
+#define UTF8_TOO_SHORT      (1 << 0)
+#define UTF8_TOO_LONG       (1 << 1)
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3)
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7)
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+#define UTF8_LANES(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p) \
+    _mm256_setr_epi8( a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p, a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p )
+
+/* Whole blocks are checked at once by looking up each byte together with the one before it in
+ * three small tables, by the high and low nibble of the first and the high nibble of the second.
+ * Each table entry is a set of ways the pair could be wrong, and only if all three agree is it an
+ * error. Third and fourth bytes of a sequence look like stray continuations to this, so they are
+ * worked out separately from the bytes two and three back. */
+__attribute__((target("avx2")))
+static __m256i kernel_utf8_errors_avx2( __m256i in, __m256i previous )
+{
+    const __m256i first_high = UTF8_LANES(
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4 );
+    const __m256i first_low = UTF8_LANES(
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        UTF8_CARRY,
+        UTF8_CARRY,
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 );
+    const __m256i second_high = UTF8_LANES(
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT );
+    const __m256i nibble = _mm256_set1_epi8( 0x0F );
+    __m256i carried = _mm256_permute2x128_si256( previous, in, 0x21 );
+    __m256i one_back = _mm256_alignr_epi8( in, carried, 15 );
+    __m256i two_back = _mm256_alignr_epi8( in, carried, 14 );
+    __m256i three_back = _mm256_alignr_epi8( in, carried, 13 );
+    __m256i special, must_continue;
+
+    special = _mm256_and_si256(
+                _mm256_and_si256( _mm256_shuffle_epi8( first_high, _mm256_and_si256( _mm256_srli_epi16( one_back, 4 ), nibble ) ),
+                                  _mm256_shuffle_epi8( first_low, _mm256_and_si256( one_back, nibble ) ) ),
+                _mm256_shuffle_epi8( second_high, _mm256_and_si256( _mm256_srli_epi16( in, 4 ), nibble ) ) );
+    must_continue = _mm256_or_si256( _mm256_subs_epu8( two_back, _mm256_set1_epi8( (char)(0xE0 - 0x80) ) ),
+                                     _mm256_subs_epu8( three_back, _mm256_set1_epi8( (char)(0xF0 - 0x80) ) ) );
+    return _mm256_xor_si256( _mm256_and_si256( must_continue, _mm256_set1_epi8( (char)0x80 ) ), special );
+}
+
+__attribute__((target("avx2")))
+static int kernel_utf8_valid_avx2( const unsigned char *data, size_t length )
+{
+    /* A lead byte in the last three places of a block needs the next block to finish it */
+    const __m256i unfinished = _mm256_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                 -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                 (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1) );
+    __m256i in, previous = _mm256_setzero_si256(), errors = _mm256_setzero_si256(), incomplete = _mm256_setzero_si256();
+    unsigned char tail[32];
+    size_t i = 0;
+    int last = FE_FALSE;
+
+    while( !last )
+    {
+        if( i + 32 <= length )
+          in = _mm256_loadu_si256( (const __m256i *)(data + i) );
+        else
+        {
+            /* The end is padded out with NULs, which also shows up anything left unfinished */
+            memset( tail, 0, sizeof(tail) );
+            memcpy( tail, data + i, length - i );
+            in = _mm256_loadu_si256( (const __m256i *)tail );
+            last = FE_TRUE;
+        }
+        if( _mm256_movemask_epi8( in ) == 0 )
+          errors = _mm256_or_si256( errors, incomplete );
+        else
+        {
+            errors = _mm256_or_si256( errors, kernel_utf8_errors_avx2( in, previous ) );
+            incomplete = _mm256_subs_epu8( in, unfinished );
+        }
+        previous = in;
+        i += 32;
+    }
+    return _mm256_testz_si256( errors, errors ) ? FE_TRUE : FE_FALSE;
+}
+
+__attribute__((target("avx2")))
+static size_t kernel_utf8_count_avx2( const unsigned char *data, size_t length )
+{
+    const __m256i continuation = _mm256_set1_epi8( (char)0xBF );
+    size_t i, count = 0;
+
+    for( i = 0; i + 32 <= length; i += 32 )
+      count += __builtin_popcount( _mm256_movemask_epi8( _mm256_cmpgt_epi8( _mm256_loadu_si256( (const __m256i *)(data + i) ), continuation ) ) );
+    return count + kernel_utf8_count_scalar( data + i, length - i );
+}
+
+__attribute__((target("avx2")))
+static long kernel_utf8_detect_avx2( const unsigned char *data, size_t length )
+{
+    const __m256i top = _mm256_set1_epi8( (char)0xC0 );
+    unsigned int mask;
+    size_t i;
+    long found;
+
+    for( i = 0; i + 33 <= length; i += 32 )
+    {
+        mask = (unsigned int)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_and_si256( _mm256_loadu_si256( (const __m256i *)(data + i) ), top ), top ) );
+        mask &= (unsigned int)_mm256_movemask_epi8( _mm256_loadu_si256( (const __m256i *)(data + i + 1) ) );
+        if( mask )
+          return (long)(i + __builtin_ctz( mask ));
+    }
+    found = kernel_utf8_detect_scalar( data + i, length - i );
+    return found < 0 ? -1 : (long)i + found;
+}
+
+__attribute__((target("avx2")))
+static long kernel_find_avx2( const unsigned char *haystack, size_t length, const unsigned char *needle, size_t count )
+{
+    __m256i first, last;
+    unsigned int mask, bit;
+    size_t i;
+    long found;
+
+    if( count < 2 || count > length )
+    {
+        if( count == 1 )
+          return (i = kernel_scan_avx2( haystack, length, needle, 1 )) < length ? (long)i : -1;
+        return kernel_find_scalar( haystack, length, needle, count );
+    }
+    first = _mm256_set1_epi8( (char)needle[0] );
+    last = _mm256_set1_epi8( (char)needle[count - 1] );
+    for( i = 0; i + count + 31 <= length; i += 32 )
+    {
+        mask = (unsigned int)_mm256_movemask_epi8( _mm256_and_si256(
+                 _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)(haystack + i) ), first ),
+                 _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)(haystack + i + count - 1) ), last ) ) );
+        while( mask )
+        {
+            bit = __builtin_ctz( mask );
+            if( memcmp( haystack + i + bit + 1, needle + 1, count - 2 ) == 0 )
+              return (long)(i + bit);
+            mask &= mask - 1;
+        }
+    }
+    found = kernel_find_scalar( haystack + i, length - i, needle, count );
+    return found < 0 ? -1 : (long)i + found;
+}
+#endif
+/*}}}*/
+
+static const FeriteKernelTable ferite_kernels_scalar = {
+    kernel_lower_scalar, kernel_upper_scalar, kernel_reverse_scalar, kernel_find_scalar,
+    kernel_scan_scalar, kernel_span_scalar, kernel_span_back_scalar, kernel_printable_scalar,
+    kernel_unreserved_scalar, kernel_base64_encode_scalar, kernel_base64_decode_scalar,
+    kernel_utf8_valid_scalar, kernel_utf8_count_scalar, kernel_utf8_detect_scalar
+};
+
+#ifdef FE_KERNEL_HAVE_SSE2
+/* SSE2 has no byte shuffle, which is what base64 needs to go any faster */
+static const FeriteKernelTable ferite_kernels_sse2 = {
+    kernel_lower_sse2, kernel_upper_sse2, kernel_reverse_sse2, kernel_find_sse2,
+    kernel_scan_sse2, kernel_span_sse2, kernel_span_back_sse2, kernel_printable_sse2,
+    kernel_unreserved_sse2, kernel_base64_encode_scalar, kernel_base64_decode_scalar,
+    kernel_utf8_valid_sse2, kernel_utf8_count_sse2, kernel_utf8_detect_sse2
+};
+#endif
+
+#ifdef FE_KERNEL_HAVE_AVX2
+/* Runs trimmed off the ends of a string are short, wider blocks do not help them */
+static const FeriteKernelTable ferite_kernels_avx2 = {
+    kernel_lower_avx2, kernel_upper_avx2, kernel_reverse_avx2, kernel_find_avx2,
+    kernel_scan_avx2, kernel_span_sse2, kernel_span_back_sse2, kernel_printable_avx2,
+    kernel_unreserved_avx2, kernel_base64_encode_avx2, kernel_base64_decode_avx2,
+    kernel_utf8_valid_avx2, kernel_utf8_count_avx2, kernel_utf8_detect_avx2
+};
+#endif
+
+static const FeriteKernelTable *ferite_kernels = &ferite_kernels_scalar;
+static int ferite_kernels_kind = FE_KERNEL_SCALAR;
+
+/**
+ * @function ferite_kernel_select
+ * @declaration int ferite_kernel_select( int kind )
+ * @brief Choose which set of string kernels is used
+ * @param int kind FE_KERNEL_SCALAR, FE_KERNEL_SSE2, FE_KERNEL_AVX2 or FE_KERNEL_AUTO for the best the processor can do
+ * @return The kind now in use, or -1 if the one asked for is not available here
+ * @description This is called by ferite_init(). The kernels keep no state, but the choice is global, so
+ *              it should not be changed while other threads may be running scripts.
+ */
+int ferite_kernel_select( int kind )
+{
+    FE_ENTER_FUNCTION;
+    if( kind == FE_KERNEL_AUTO )
+    {
+        kind = FE_KERNEL_SCALAR;
+#ifdef FE_KERNEL_HAVE_SSE2
+        kind = FE_KERNEL_SSE2;
+#endif
+#ifdef FE_KERNEL_HAVE_AVX2
+        __builtin_cpu_init();
+        if( __builtin_cpu_supports( "avx2" ) )
+          kind = FE_KERNEL_AVX2;
+#endif
+    }
+    switch( kind )
+    {
+        case FE_KERNEL_SCALAR:
+            ferite_kernels = &ferite_kernels_scalar;
+            break;
+#ifdef FE_KERNEL_HAVE_SSE2
+        case FE_KERNEL_SSE2:
+            ferite_kernels = &ferite_kernels_sse2;
+            break;
+#endif
+#ifdef FE_KERNEL_HAVE_AVX2
+        case FE_KERNEL_AVX2:
+            __builtin_cpu_init();
+            if( !__builtin_cpu_supports( "avx2" ) )
+            {
+                FE_LEAVE_FUNCTION( -1 );
+            }
+            ferite_kernels = &ferite_kernels_avx2;
+            break;
+#endif
+        default:
+            FE_LEAVE_FUNCTION( -1 );
+    }
+    ferite_kernels_kind = kind;
+    FE_LEAVE_FUNCTION( kind );
+}
+
+/**
+ * @function ferite_kernel_kind
+ * @declaration int ferite_kernel_kind()
+ * @brief Find out which set of string kernels is in use
+ * @return FE_KERNEL_SCALAR, FE_KERNEL_SSE2 or FE_KERNEL_AVX2
+ */
+int ferite_kernel_kind()
+{
+    return ferite_kernels_kind;
+}
+
+/**
+ * @function ferite_kernel_name
+ * @declaration char *ferite_kernel_name( int kind )
+ * @brief Get a printable name for a set of kernels
+ * @param int kind The kind of kernels
+ * @return "scalar", "sse2" or "avx2"
+ */
+char *ferite_kernel_name( int kind )
+{
+    switch( kind )
+    {
+        case FE_KERNEL_SSE2: return "sse2";
+        case FE_KERNEL_AVX2: return "avx2";
+    }
+    return "scalar";
+}
+
+/**
+ * @function ferite_kernel_lower
+ * @declaration void ferite_kernel_lower( char *dst, const char *src, size_t length )
+ * @brief Copy a block of text translating it to lower case
+ * @param char *dst Where to put the result, this may be the same as src
+ * @param const char *src The text
+ * @param size_t length The number of bytes
+ */
+void ferite_kernel_lower( char *dst, const char *src, size_t length )
+{
+    ferite_kernels->lower( (unsigned char *)dst, (const unsigned char *)src, length );
+}
+
+/**
+ * @function ferite_kernel_upper
+ * @declaration void ferite_kernel_upper( char *dst, const char *src, size_t length )
+ * @brief Copy a block of text translating it to upper case
+ * @param char *dst Where to put the result, this may be the same as src
+ * @param const char *src The text
+ * @param size_t length The number of bytes
+ */
+void ferite_kernel_upper( char *dst, const char *src, size_t length )
+{
+    ferite_kernels->upper( (unsigned char *)dst, (const unsigned char *)src, length );
+}
+
+/**
+ * @function ferite_kernel_reverse
+ * @declaration void ferite_kernel_reverse( char *dst, const char *src, size_t length )
+ * @brief Copy a block of bytes in reverse order
+ * @param char *dst Where to put the result, this must not overlap src
+ * @param const char *src The bytes
+ * @param size_t length The number of bytes
+ */
+void ferite_kernel_reverse( char *dst, const char *src, size_t length )
+{
+    ferite_kernels->reverse( (unsigned char *)dst, (const unsigned char *)src, length );
+}
+
+/**
+ * @function ferite_kernel_find
+ * @declaration long ferite_kernel_find( const char *haystack, size_t length, const char *needle, size_t count )
+ * @brief Find the first occurrence of one block of bytes in another
+ * @param const char *haystack The bytes to search
+ * @param size_t length The length of haystack
+ * @param const char *needle The bytes to search for
+ * @param size_t count The length of needle
+ * @return The offset of the match, or -1 if there is none. An empty needle is found at 0.
+ */
+long ferite_kernel_find( const char *haystack, size_t length, const char *needle, size_t count )
+{
+    return ferite_kernels->find( (const unsigned char *)haystack, length, (const unsigned char *)needle, count );
+}
+
+/**
+ * @function ferite_kernel_scan
+ * @declaration size_t ferite_kernel_scan( const char *data, size_t length, const char *set, size_t count )
+ * @brief Find the first byte that is one of a set of delimiters
+ * @param const char *data The bytes to search
+ * @param size_t length The length of data
+ * @param const char *set The delimiters
+ * @param size_t count The number of delimiters
+ * @return The offset of the first delimiter, or length if there is none
+ */
+size_t ferite_kernel_scan( const char *data, size_t length, const char *set, size_t count )
+{
+    return ferite_kernels->scan( (const unsigned char *)data, length, (const unsigned char *)set, count );
+}
+
+/**
+ * @function ferite_kernel_span
+ * @declaration size_t ferite_kernel_span( const char *data, size_t length, const char *set, size_t count )
+ * @brief Measure the run of delimiters at the start of a block of bytes
+ * @param const char *data The bytes to search
+ * @param size_t length The length of data
+ * @param const char *set The delimiters
+ * @param size_t count The number of delimiters
+ * @return The number of bytes at the start of data that are in set
+ */
+size_t ferite_kernel_span( const char *data, size_t length, const char *set, size_t count )
+{
+    return ferite_kernels->span( (const unsigned char *)data, length, (const unsigned char *)set, count );
+}
+
+/**
+ * @function ferite_kernel_span_back
+ * @declaration size_t ferite_kernel_span_back( const char *data, size_t length, const char *set, size_t count )
+ * @brief Measure the run of delimiters at the end of a block of bytes
+ * @param const char *data The bytes to search
+ * @param size_t length The length of data
+ * @param const char *set The delimiters
+ * @param size_t count The number of delimiters
+ * @return The number of bytes at the end of data that are in set
+ */
+size_t ferite_kernel_span_back( const char *data, size_t length, const char *set, size_t count )
+{
+    return ferite_kernels->span_back( (const unsigned char *)data, length, (const unsigned char *)set, count );
+}
+
+/**
+ * @function ferite_kernel_span_printable
+ * @declaration size_t ferite_kernel_span_printable( const char *data, size_t length, const char *set, size_t count )
+ * @brief Measure the run of printable ASCII at the start of a block of bytes
+ * @param const char *data The bytes to search
+ * @param size_t length The length of data
+ * @param const char *set Bytes that end the run even though they are printable
+ * @param size_t count The number of bytes in set
+ * @return The number of bytes from space to tilde, and not in set, at the start of data
+ */
+size_t ferite_kernel_span_printable( const char *data, size_t length, const char *set, size_t count )
+{
+    return ferite_kernels->printable( (const unsigned char *)data, length, (const unsigned char *)set, count );
+}
+
+/**
+ * @function ferite_kernel_base64_encode
+ * @declaration size_t ferite_kernel_base64_encode( char *dst, const char *src, size_t length )
+ * @brief Encode a block of bytes as base64
+ * @param char *dst Where to put the result, it needs room for ((length + 2) / 3) * 4 characters
+ * @param const char *src The bytes
+ * @param size_t length The number of bytes
+ * @return The number of characters written, the last group is padded out with '='
+ */
+size_t ferite_kernel_base64_encode( char *dst, const char *src, size_t length )
+{
+    const unsigned char *in = (const unsigned char *)src;
+    size_t done = ferite_kernels->base64_encode( (unsigned char *)dst, in, length );
+    size_t out = done / 3 * 4;
+    unsigned char second;
+
+    if( done < length )
+    {
+        second = (done + 1 < length ? in[done + 1] : 0);
+        dst[out++] = ferite_kernel_base64_alphabet[in[done] >> 2];
+        dst[out++] = ferite_kernel_base64_alphabet[((in[done] & 0x03) << 4) | (second >> 4)];
+        dst[out++] = (done + 1 < length ? ferite_kernel_base64_alphabet[(second & 0x0F) << 2] : '=');
+        dst[out++] = '=';
+    }
+    return out;
+}
+
+/**
+ * @function ferite_kernel_base64_decode
+ * @declaration size_t ferite_kernel_base64_decode( char *dst, const char *src, size_t length )
+ * @brief Decode a block of base64
+ * @param char *dst Where to put the result, it needs room for (length / 4) * 3 + 3 bytes
+ * @param const char *src The characters
+ * @param size_t length The number of characters
+ * @return The number of bytes written
+ * @description Decoding stops after the first group with padding in it. A short group at the end
+ *              is read as if it had been padded. Characters outside the alphabet are not skipped,
+ *              they decode to rubbish just as they always have in String.base64decode().
+ */
+size_t ferite_kernel_base64_decode( char *dst, const char *src, size_t length )
+{
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *out = (unsigned char *)dst, a[4], b[4];
+    size_t i = ferite_kernels->base64_decode( out, in, length ), written = i / 4 * 3, n, j;
+
+    while( length - i > 1 )
+    {
+        a[2] = a[3] = '=';
+        b[2] = b[3] = 0;
+        for( n = 0; n < 4 && i < length; n++, i++ )
+        {
+            a[n] = in[i];
+            b[n] = ferite_kernel_base64_values[in[i]];
+        }
+        out[written] = (unsigned char)((b[0] << 2) | (b[1] >> 4));
+        out[written + 1] = (unsigned char)((b[1] << 4) | (b[2] >> 2));
+        out[written + 2] = (unsigned char)((b[2] << 6) | b[3]);
+        j = (a[2] == '=' ? 1 : (a[3] == '=' ? 2 : 3));
+        written += j;
+        if( j < 3 )
+          break;
+    }
+    return written;
+}
+
+/**
+ * @function ferite_kernel_utf8_valid
+ * @declaration int ferite_kernel_utf8_valid( const char *data, size_t length )
+ * @brief Check that a block of bytes is well formed UTF-8
+ * @param const char *data The bytes
+ * @param size_t length The number of bytes
+ * @return FE_TRUE if it is, FE_FALSE if there are overlong forms, surrogates, code points past U+10FFFF or broken sequences
+ */
+int ferite_kernel_utf8_valid( const char *data, size_t length )
+{
+    return ferite_kernels->utf8_valid( (const unsigned char *)data, length );
+}
+
+/* The length String.nextCharacterLength() gives: a lead byte followed by enough bytes with the top bit
+ * set makes a character, whatever those bytes are, and anything else is a character on its own */
+static size_t kernel_utf8_step( const unsigned char *data, size_t length )
+{
+    if( data[0] >= 0xC0 && length > 1 && data[1] >= 0x80 )
+    {
+        if( data[0] >= 0xE0 && length > 2 && data[2] >= 0x80 )
+        {
+            if( data[0] >= 0xF0 && length > 3 && data[3] >= 0x80 )
+              return 4;
+            return 3;
+        }
+        return 2;
+    }
+    return 1;
+}
+
+/**
+ * @function ferite_kernel_utf8_length
+ * @declaration size_t ferite_kernel_utf8_length( const char *data, size_t length )
+ * @brief Count the characters in a block of UTF-8
+ * @param const char *data The bytes
+ * @param size_t length The number of bytes
+ * @return The number of characters
+ * @description Well formed text is counted a block at a time. Anything else is stepped through the
+ *              way String.nextCharacterLength() does, so broken text gives the same count it always has.
+ */
+size_t ferite_kernel_utf8_length( const char *data, size_t length )
+{
+    const unsigned char *in = (const unsigned char *)data;
+    size_t i, count = 0;
+
+    if( ferite_kernels->utf8_valid( in, length ) )
+      return ferite_kernels->utf8_count( in, length );
+    for( i = 0; i < length; i += kernel_utf8_step( in + i, length - i ) )
+      count++;
+    return count;
+}
+
+/**
+ * @function ferite_kernel_utf8_detect
+ * @declaration long ferite_kernel_utf8_detect( const char *data, size_t length )
+ * @brief Look for something that could be a multi byte UTF-8 character
+ * @param const char *data The bytes
+ * @param size_t length The number of bytes
+ * @return The offset of the first lead byte that is followed by a byte with the top bit set, or -1
+ */
+long ferite_kernel_utf8_detect( const char *data, size_t length )
+{
+    return ferite_kernels->utf8_detect( (const unsigned char *)data, length );
+}
+
+/**
+ * @function ferite_kernel_url_encode
+ * @declaration size_t ferite_kernel_url_encode( char *dst, const char *src, size_t length )
+ * @brief Percent encode a block of UTF-8 for use in a URL
+ * @param char *dst Where to put the result, or NULL to find out how much room it needs
+ * @param const char *src The text
+ * @param size_t length The number of bytes
+ * @return The number of characters written, or that would have been
+ * @description Letters, digits and '-', '_', '.' and '~' are copied, every other byte of a character
+ *              is written as %XX. Characters are split up as String.nextCharacter() does and then
+ *              written back out as UTF-8, so a stray byte from 0x80 up is taken as a Latin-1 code point.
+ */
+size_t ferite_kernel_url_encode( char *dst, const char *src, size_t length )
+{
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char bytes[4];
+    unsigned long point;
+    size_t i = 0, out = 0, run, size, n, j;
+
+    while( i < length )
+    {
+        run = ferite_kernels->unreserved( in + i, length - i );
+        if( dst != NULL )
+          memcpy( dst + out, in + i, run );
+        out += run;
+        if( (i += run) >= length )
+          break;
+
+        size = kernel_utf8_step( in + i, length - i );
+        switch( size )
+        {
+            case 1: point = in[i]; break;
+            case 2: point = ((in[i] & 0x1F) << 6) | (in[i + 1] & 0x3F); break;
+            case 3: point = ((in[i] & 0x0F) << 12) | ((in[i + 1] & 0x3F) << 6) | (in[i + 2] & 0x3F); break;
+            default: point = ((unsigned long)(in[i] & 0x07) << 18) | ((in[i + 1] & 0x3F) << 12) | ((in[i + 2] & 0x3F) << 6) | (in[i + 3] & 0x3F); break;
+        }
+        i += size;
+
+        if( point < 0x80 )
+        {
+            bytes[0] = (unsigned char)point;
+            n = 1;
+        }
+        else if( point < 0x800 )
+        {
+            bytes[0] = (unsigned char)((point >> 6) | 0xC0);
+            bytes[1] = (unsigned char)((point & 0x3F) | 0x80);
+            n = 2;
+        }
+        else if( point < 0x10000 )
+        {
+            bytes[0] = (unsigned char)((point >> 12) | 0xE0);
+            bytes[1] = (unsigned char)(((point >> 6) & 0x3F) | 0x80);
+            bytes[2] = (unsigned char)((point & 0x3F) | 0x80);
+            n = 3;
+        }
+        else
+        {
+            bytes[0] = (unsigned char)((point >> 18) | 0xF0);
+            bytes[1] = (unsigned char)(((point >> 12) & 0x3F) | 0x80);
+            bytes[2] = (unsigned char)(((point >> 6) & 0x3F) | 0x80);
+            bytes[3] = (unsigned char)((point & 0x3F) | 0x80);
+            n = 4;
+        }
+        for( j = 0; j < n; j++, out += 3 )
+        {
+            if( dst != NULL )
+            {
+                dst[out] = '%';
+                dst[out + 1] = ferite_kernel_hex[bytes[j] >> 4];
+                dst[out + 2] = ferite_kernel_hex[bytes[j] & 0x0F];
+            }
+        }
+    }
+    return out;
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2000-2007 Chris Ross and various contributors
+ * Copyright (C) 1999-2000 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_HEADER
+#include "../config.h"
+#endif
+
+#include "ferite.h"
+
+/**
+ * @group Matcher
+ * @description A matcher finds every occurrence of any of a set of literal patterns in one pass
+ *              over the text, however many patterns there are. It is an Aho-Corasick automaton
+ *              with the failure links already followed, so each byte of text costs one table
+ *              lookup. The table only has a column for each byte that appears in the patterns,
+ *              which keeps it small for the usual sets of words. While the automaton is back at
+ *              the start and few enough bytes can begin a match, the string kernels are used to
+ *              skip ahead to the next of them. A matcher is never changed once it has been made,
+ *              so any number of threads can scan with the same one at once.
+ */
+
+#define FE_MATCHER_SHORT_SKIP    16
+#define FE_MATCHER_SKIP_BACKOFF  64
+
+static unsigned char ferite_matcher_fold( unsigned char c )
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/**
+ * @function ferite_matcher_create
+ * @declaration FeriteMatcher *ferite_matcher_create( FeriteScript *script, char **patterns, size_t *lengths, int count, int flags )
+ * @brief Build a matcher for a set of patterns
+ * @param FeriteScript *script The script context
+ * @param char **patterns The patterns, which may contain NUL bytes
+ * @param size_t *lengths The length of each pattern
+ * @param int count The number of patterns
+ * @param int flags FE_MATCHER_IGNORE_CASE to match ASCII letters regardless of case, otherwise 0
+ * @return The matcher, which should be freed with ferite_matcher_destroy()
+ * @description Patterns are reported by their position in the list. Empty patterns never match.
+ */
+FeriteMatcher *ferite_matcher_create( FeriteScript *script, char **patterns, size_t *lengths, int count, int flags )
+{
+    FeriteMatcher *matcher = NULL;
+    int *fail = NULL, *queue = NULL;
+    int i, c, s, u, head = 0, tail = 0, classes = 1, state;
+    size_t j, total = 1;
+    unsigned char byte;
+
+    FE_ENTER_FUNCTION;
+    matcher = fmalloc( sizeof(FeriteMatcher) );
+    memset( matcher, 0, sizeof(FeriteMatcher) );
+    matcher->patterns = count;
+    matcher->lengths = fmalloc( sizeof(size_t) * (count + 1) );
+    matcher->same = fmalloc( sizeof(int) * (count + 1) );
+
+    /* Each byte used in a pattern gets a column of its own, everything else shares column 0 */
+    for( i = 0; i < count; i++ )
+    {
+        matcher->lengths[i] = lengths[i];
+        matcher->same[i] = -1;
+        total += lengths[i];
+        for( j = 0; j < lengths[i]; j++ )
+        {
+            byte = (unsigned char)patterns[i][j];
+            if( flags & FE_MATCHER_IGNORE_CASE )
+              byte = ferite_matcher_fold( byte );
+            if( matcher->class_of[byte] == 0 )
+              matcher->class_of[byte] = classes++;
+        }
+    }
+    if( flags & FE_MATCHER_IGNORE_CASE )
+    {
+        for( c = 'A'; c <= 'Z'; c++ )
+          matcher->class_of[c] = matcher->class_of[ferite_matcher_fold( c )];
+    }
+    matcher->classes = classes;
+
+    /* The trie, with -1 for the transitions that are filled in from the failure links */
+    matcher->next = fmalloc( sizeof(int) * total * classes );
+    matcher->output = fmalloc( sizeof(int) * total );
+    matcher->output_link = fmalloc( sizeof(int) * total );
+    for( j = 0; j < total * classes; j++ )
+      matcher->next[j] = -1;
+    matcher->output[0] = -1;
+    matcher->output_link[0] = 0;
+    matcher->states = 1;
+    /* Going backwards leaves patterns with the same text chained in the order they were given */
+    for( i = count - 1; i >= 0; i-- )
+    {
+        state = 0;
+        if( lengths[i] == 0 )
+          continue;
+        for( j = 0; j < lengths[i]; j++ )
+        {
+            c = matcher->class_of[(unsigned char)patterns[i][j]];
+            if( matcher->next[state * classes + c] < 0 )
+            {
+                matcher->output[matcher->states] = -1;
+                matcher->next[state * classes + c] = matcher->states++;
+            }
+            state = matcher->next[state * classes + c];
+        }
+        matcher->same[i] = matcher->output[state];
+        matcher->output[state] = i;
+    }
+
+    for( c = 0; c < 256; c++ )
+    {
+        if( matcher->class_of[c] != 0 && matcher->next[matcher->class_of[c]] >= 0 )
+        {
+            if( matcher->skip_count == (int)sizeof(matcher->skip) )
+            {
+                matcher->skip_count = 0;
+                break;
+            }
+            matcher->skip[matcher->skip_count++] = (char)c;
+        }
+    }
+
+    /* Breadth first, so the failure state of each state has all its transitions by the time it is needed */
+    fail = fmalloc( sizeof(int) * matcher->states );
+    queue = fmalloc( sizeof(int) * matcher->states );
+    for( c = 0; c < classes; c++ )
+    {
+        u = matcher->next[c];
+        if( u < 0 )
+          matcher->next[c] = 0;
+        else
+        {
+            fail[u] = 0;
+            matcher->output_link[u] = 0;
+            queue[tail++] = u;
+        }
+    }
+    while( head < tail )
+    {
+        s = queue[head++];
+        for( c = 0; c < classes; c++ )
+        {
+            u = matcher->next[s * classes + c];
+            if( u < 0 )
+              matcher->next[s * classes + c] = matcher->next[fail[s] * classes + c];
+            else
+            {
+                fail[u] = matcher->next[fail[s] * classes + c];
+                matcher->output_link[u] = (matcher->output[fail[u]] >= 0 ? fail[u] : matcher->output_link[fail[u]]);
+                queue[tail++] = u;
+            }
+        }
+    }
+    ffree( fail );
+    ffree( queue );
+
+    matcher->next = frealloc( matcher->next, sizeof(int) * matcher->states * classes );
+    matcher->output = frealloc( matcher->output, sizeof(int) * matcher->states );
+    matcher->output_link = frealloc( matcher->output_link, sizeof(int) * matcher->states );
+
+    /* Scanning wants where the next state's row starts, and whether it has anything to report */
+    for( j = 0; j < (size_t)matcher->states * classes; j++ )
+    {
+        u = matcher->next[j];
+        matcher->next[j] = ((u * classes) << 1) | (matcher->output[u] >= 0 || matcher->output_link[u] > 0);
+    }
+    FE_LEAVE_FUNCTION( matcher );
+}
+
+/**
+ * @function ferite_matcher_destroy
+ * @declaration void ferite_matcher_destroy( FeriteScript *script, FeriteMatcher *matcher )
+ * @brief Free a matcher
+ * @param FeriteScript *script The script context
+ * @param FeriteMatcher *matcher The matcher to free
+ */
+void ferite_matcher_destroy( FeriteScript *script, FeriteMatcher *matcher )
+{
+    FE_ENTER_FUNCTION;
+    ffree( matcher->lengths );
+    ffree( matcher->same );
+    ffree( matcher->next );
+    ffree( matcher->output );
+    ffree( matcher->output_link );
+    ffree( matcher );
+    FE_LEAVE_FUNCTION( NOWT );
+}
+
+/**
+ * @function ferite_matcher_scan
+ * @declaration size_t ferite_matcher_scan( FeriteMatcher *matcher, const char *data, size_t length, FeriteMatcherCallback callback, void *user )
+ * @brief Find every match of a matcher's patterns in some text
+ * @param FeriteMatcher *matcher The matcher
+ * @param const char *data The text, which need not be NUL terminated
+ * @param size_t length The length of the text
+ * @param FeriteMatcherCallback callback Called with the pattern and the offset it starts at for each match, may be NULL
+ * @param void *user Handed on to the callback
+ * @return The number of matches found
+ * @description Matches are found in the order they end in the text, longest first when several end
+ *              at the same place, and may overlap. The scan stops early if the callback returns
+ *              non-zero, counting the match it was called for.
+ */
+size_t ferite_matcher_scan( FeriteMatcher *matcher, const char *data, size_t length, FeriteMatcherCallback callback, void *user )
+{
+    const unsigned char *text = (const unsigned char *)data;
+    size_t i = 0, found = 0, resume = 0, start;
+    int row = 0, entry, s, p;
+
+    FE_ENTER_FUNCTION;
+    if( matcher->states == 1 )
+      FE_LEAVE_FUNCTION( 0 );
+    while( i < length )
+    {
+        /* Skipping only pays when the bytes that start a match are rare, so back off when they are not */
+        if( row == 0 && matcher->skip_count > 0 && i >= resume )
+        {
+            start = i;
+            i += ferite_kernel_scan( data + i, length - i, matcher->skip, matcher->skip_count );
+            if( i == length )
+              break;
+            if( i - start < FE_MATCHER_SHORT_SKIP )
+              resume = i + FE_MATCHER_SKIP_BACKOFF;
+        }
+        entry = matcher->next[row + matcher->class_of[text[i++]]];
+        row = entry >> 1;
+        if( !(entry & 1) )
+          continue;
+        s = row / matcher->classes;
+        for( s = (matcher->output[s] >= 0 ? s : matcher->output_link[s]); s > 0; s = matcher->output_link[s] )
+        {
+            for( p = matcher->output[s]; p >= 0; p = matcher->same[p] )
+            {
+                found++;
+                if( callback != NULL && callback( matcher, p, i - matcher->lengths[p], user ) )
+                  FE_LEAVE_FUNCTION( found );
+            }
+        }
+    }
+    FE_LEAVE_FUNCTION( found );
+}
+
+/**
+ * @end
+ */
@@ -62,11 +62,16 @@
 #define PTR_GET_HEADER( ptr )   (FeriteMemoryChunkHeader*)((char *)ptr - sizeof(FeriteMemoryChunkHeader))
 #define PTR_GET_BODY( ptr )     (void*)((char *)ptr + sizeof(FeriteMemoryChunkHeader))
 
-/* threading stuff */
+/* threading stuff: each thread allocates from and frees onto its own chains, so the lock is
+ * only taken when a thread has to go to the OS, or to the depot of chains that threads hand
+ * back. A chain goes back to the depot when its thread finishes, and part of it goes back
+ * whenever it grows past two blocks' worth: memory one thread allocates and another frees
+ * would otherwise pile up on the freeing thread where the allocating thread can't reuse it */
 #ifdef THREAD_SAFE
 AphexMutex *ferite_jedi_memory_lock = NULL;
-# define LOCK_MEMORY()     		if( script && script->is_multi_thread ) aphex_mutex_lock( ferite_jedi_memory_lock )
-# define UNLOCK_MEMORY()   		if( script && script->is_multi_thread ) aphex_mutex_unlock( ferite_jedi_memory_lock )
+AphexThreadKey *ferite_jedi_thread_key = NULL;
+# define LOCK_MEMORY()     		aphex_mutex_lock( ferite_jedi_memory_lock )
+# define UNLOCK_MEMORY()   		aphex_mutex_unlock( ferite_jedi_memory_lock )
 #else
 # define LOCK_MEMORY()
 # define UNLOCK_MEMORY()
@@ -86,9 +91,6 @@ union ferite_memory_chunk_header
     double alignment; /* force dword alignment */
 };
 extern int ferite_pow_lookup[];
-static FeriteMemoryChunkHeader *ferite_jedi_free_chunks[NBUCKETS];
-static long                     ferite_jedi_chunk_allocs[NBUCKETS];
-static FeriteMemoryChunkHeader *ferite_jedi_big_chunks = NULL;
 
 typedef struct
 {
@@ -99,8 +101,90 @@ typedef struct
 }
 FeriteMemoryStats;
 
-FeriteMemoryStats       real_stats; /* how many times we hit the OS */
-FeriteMemoryStats       vrtl_stats; /* how many times we hit the local heap */
+/* Per thread */
+static FE_THREAD_LOCAL FeriteMemoryChunkHeader *ferite_jedi_free_chunks[NBUCKETS];
+static FE_THREAD_LOCAL long                     ferite_jedi_chunk_allocs[NBUCKETS];
+static FE_THREAD_LOCAL int                      ferite_jedi_free_count[NBUCKETS]; /* length of each free chain */
+static FE_THREAD_LOCAL int                      ferite_jedi_thread_attached = FE_FALSE;
+FE_THREAD_LOCAL FeriteMemoryStats               vrtl_stats; /* how many times we hit the local heap */
+
+/* Shared, under ferite_jedi_memory_lock */
+static FeriteMemoryChunkHeader *ferite_jedi_big_chunks = NULL;
+static FeriteMemoryChunkHeader *ferite_jedi_depot[NBUCKETS]; /* chains handed back by threads */
+static long                     ferite_jedi_retired_allocs[NBUCKETS];
+static FeriteMemoryStats        ferite_jedi_retired_stats;  /* vrtl_stats of finished threads */
+FeriteMemoryStats               real_stats; /* how many times we hit the OS */
+
+static void ferite_jedi_stats_merge( FeriteMemoryStats *into, FeriteMemoryStats *from )
+{
+    into->malloc_c += from->malloc_c;
+    into->calloc_c += from->calloc_c;
+    into->realloc_c += from->realloc_c;
+    into->free_c += from->free_c;
+    from->malloc_c = from->calloc_c = from->realloc_c = from->free_c = 0;
+}
+
+/* How many chunks of a bucket one trip to the OS gets */
+static int ferite_jedi_block_count( int bucket )
+{
+    return BLOCK_COUNT - (bucket < 10 ? 0 : bucket);
+}
+
+/* Hand all but one block's worth of this thread's chain for a bucket over to the depot */
+static void ferite_jedi_spill( int bucket )
+{
+    FeriteMemoryChunkHeader *keep_tail = NULL, *spill = NULL, *tail = NULL;
+    int i = 0, keep = ferite_jedi_block_count( bucket );
+
+    for( keep_tail = ferite_jedi_free_chunks[bucket]; i < keep - 1 && keep_tail->storage.next != NULL; i++ )
+        keep_tail = keep_tail->storage.next;
+    if( (spill = keep_tail->storage.next) == NULL )
+        return;
+    keep_tail->storage.next = NULL;
+    for( tail = spill; tail->storage.next != NULL; tail = tail->storage.next )
+        ;
+    ferite_jedi_free_count[bucket] = i + 1;
+
+    LOCK_MEMORY();
+    tail->storage.next = ferite_jedi_depot[bucket];
+    ferite_jedi_depot[bucket] = spill;
+    UNLOCK_MEMORY();
+}
+
+/* Called as a thread that has used the allocator exits: its chains and numbers are handed
+ * over so that the next thread to run short can pick them up */
+static void ferite_jedi_thread_detach( void *unused )
+{
+    FeriteMemoryChunkHeader *tail = NULL;
+    int i = 0;
+
+    LOCK_MEMORY();
+    for( i = 0; i < NBUCKETS; i++ )
+    {
+        if( ferite_jedi_free_chunks[i] != NULL )
+        {
+            for( tail = ferite_jedi_free_chunks[i]; tail->storage.next != NULL; tail = tail->storage.next )
+              ;
+            tail->storage.next = ferite_jedi_depot[i];
+            ferite_jedi_depot[i] = ferite_jedi_free_chunks[i];
+            ferite_jedi_free_chunks[i] = NULL;
+        }
+        ferite_jedi_free_count[i] = 0;
+        ferite_jedi_retired_allocs[i] += ferite_jedi_chunk_allocs[i];
+        ferite_jedi_chunk_allocs[i] = 0;
+    }
+    ferite_jedi_stats_merge( &ferite_jedi_retired_stats, &vrtl_stats );
+    ferite_jedi_thread_attached = FE_FALSE;
+    UNLOCK_MEMORY();
+}
+
+static void ferite_jedi_thread_attach()
+{
+    ferite_jedi_thread_attached = FE_TRUE;
+#ifdef THREAD_SAFE
+    aphex_thread_key_set( ferite_jedi_thread_key, &ferite_jedi_thread_attached );
+#endif
+}
 
 void ferite_jedi_catch() {
 	fprintf( stderr, "ferite_jedi_catch(): Sleeping for gdb interruption for 30 seconds; (process id: %d)\n", getpid() );
@@ -130,6 +214,7 @@ void ferite_jedi_memory_init(void)
     vrtl_stats.calloc_c = 0;
     vrtl_stats.realloc_c = 0;
     vrtl_stats.free_c = 0;
+    ferite_jedi_retired_stats = vrtl_stats;
 
     if( !ferite_hide_mem_use )
     {
@@ -141,9 +226,13 @@ void ferite_jedi_memory_init(void)
     for( i = 0; i < NBUCKETS; i++ ) {
         ferite_jedi_free_chunks[i] = NULL;
 		ferite_jedi_chunk_allocs[i] = 0;
+        ferite_jedi_free_count[i] = 0;
+        ferite_jedi_depot[i] = NULL;
+        ferite_jedi_retired_allocs[i] = 0;
 	}
 #ifdef THREAD_SAFE
     ferite_jedi_memory_lock = aphex_mutex_recursive_create();
+    ferite_jedi_thread_key = aphex_thread_key_create( ferite_jedi_thread_detach );
 #endif
     FE_LEAVE_FUNCTION(NOWT);
 }
@@ -154,12 +243,16 @@ void ferite_jedi_memory_deinit(void)
 	int i = 0;
 
     FE_ENTER_FUNCTION;
+    ferite_jedi_thread_detach( NULL );
     while( ferite_jedi_big_chunks != NULL )
     {
         ptr = ferite_jedi_big_chunks->storage.next;
         rfree( ferite_jedi_big_chunks );
         ferite_jedi_big_chunks = ptr;
     }
+	for( i = 0; i < NBUCKETS; i++ )
+		ferite_jedi_depot[i] = NULL;
+	vrtl_stats = ferite_jedi_retired_stats;
 	
     if( !ferite_hide_mem_use ) /* 2/3's of all statistics are made up. unfortunatly not here */
     {
@@ -175,11 +268,12 @@ void ferite_jedi_memory_deinit(void)
 		
 		printf( "\nFerite Allocation Distribution\n" );
 		for( i = 0; i < NBUCKETS; i++ ) {
-			printf( " %c- Memory Bucket[%d] = %ld (size %d)\n", (i < (NBUCKETS - 1) ? '|' : '`'), i, ferite_jedi_chunk_allocs[i], ferite_pow_lookup[i] );
+			printf( " %c- Memory Bucket[%d] = %ld (size %d)\n", (i < (NBUCKETS - 1) ? '|' : '`'), i, ferite_jedi_retired_allocs[i], ferite_pow_lookup[i] );
 		}
     }
 	
 #ifdef THREAD_SAFE
+    aphex_thread_key_destroy( ferite_jedi_thread_key );
     aphex_mutex_destroy( ferite_jedi_memory_lock );
 #endif
     FE_LEAVE_FUNCTION(NOWT);
@@ -218,7 +312,6 @@ void *ferite_jedi_malloc( size_t size, char *file, int line, FeriteScript *scrip
 	
     FUD(( "Target bucket for data of %ld is %d(%d)\n", size, target_bucket, ferite_pow_lookup[target_bucket] ));
 
-    LOCK_MEMORY();
 	/* check to see if we have memory :), if not go a eat some :) */
     if( ferite_jedi_free_chunks[target_bucket] == NULL ) 
 	{
@@ -237,7 +330,6 @@ void *ferite_jedi_malloc( size_t size, char *file, int line, FeriteScript *scrip
 #ifdef FERITE_MEM_DEBUG
         fprintf( stderr, "JEDI: Out of memory. Oh dear. Oh dear. Go out and buy some more :)\n" );
 #endif
-        UNLOCK_MEMORY();
         ferite_jedi_catch();
 		return NULL; /* Never reached */
     }
@@ -246,6 +338,7 @@ void *ferite_jedi_malloc( size_t size, char *file, int line, FeriteScript *scrip
     FUD(( "ferite_jedi_free_chunks[target_bucket]: %p\n", ferite_jedi_free_chunks[target_bucket] ));
     FUD(( "new ferite_jedi_free_chunks:            %p\n", ptr->storage.next ));
     ferite_jedi_free_chunks[target_bucket] = ptr->storage.next;
+    ferite_jedi_free_count[target_bucket]--;
 
 	/* Setup the information for the wild goose chase :) */
     ptr->assigned_info.index = target_bucket;
@@ -265,7 +358,6 @@ void *ferite_jedi_malloc( size_t size, char *file, int line, FeriteScript *scrip
 	
     FUD(( "returning: %p, %d\n", return_ptr, (int)((void *)return_ptr - (void *)ptr) ));
     vrtl_stats.malloc_c++;
-    UNLOCK_MEMORY();
 	
 	/* Check for 4 byte alignment */
 	if( ((long)return_ptr % 4) != 0 ) {
@@ -408,14 +500,14 @@ void *ferite_jedi_realloc( void *ptr, size_t size, FeriteScript *script )
         new_ptr = ferite_jedi_malloc( size, __FILE__, __LINE__, script );
         memcpy( new_ptr, ptr, (size > allocated_size ? allocated_size : size) );
 		
-		LOCK_MEMORY();
 		/* now we move the older ptr onto it's old block */
         hdr->storage.next = ferite_jedi_free_chunks[old_index];
 		hdr->storage.magic = DEAD_MAGIC;
         ferite_jedi_free_chunks[old_index] = hdr;
+        if( ++ferite_jedi_free_count[old_index] > 2 * ferite_jedi_block_count( old_index ) )
+            ferite_jedi_spill( old_index );
         vrtl_stats.malloc_c--;
         vrtl_stats.realloc_c++;
-        UNLOCK_MEMORY();
     } else if( allocated_size == 0 ) {
 		/* FIXME */
 	}
@@ -434,12 +526,14 @@ void ferite_jedi_free( void *ptr, char *file, int line, FeriteScript *script )
 		bucket = hdr->assigned_info.index;
 		/* relink the chain */
 		FUD(( "Setting next as %p\n", ferite_jedi_free_chunks[bucket] ));
-		LOCK_MEMORY();
+		if( !ferite_jedi_thread_attached )
+			ferite_jedi_thread_attach();
 		hdr->storage.next = ferite_jedi_free_chunks[bucket];
 		hdr->storage.magic = DEAD_MAGIC;
 		FUD(( "Setting new header as %p\n", hdr ));
 		ferite_jedi_free_chunks[bucket] = hdr;
-		UNLOCK_MEMORY();
+		if( ++ferite_jedi_free_count[bucket] > 2 * ferite_jedi_block_count( bucket ) )
+			ferite_jedi_spill( bucket );
 		vrtl_stats.free_c++;
 	}
 }
@@ -450,7 +544,7 @@ void ferite_jedi_morecore( int bucket )
     void *new_block = NULL;
 	int footer_size = sizeof(int) + 4; /* Int for the chunk size, 2 for the fill byte and magic, and 2 for buffering */
     int chunk_size = ferite_pow_lookup[bucket] + sizeof(FeriteMemoryChunkHeader) + footer_size;
-    int actual_block_count = BLOCK_COUNT - (bucket < 10 ? 0 : bucket);
+    int actual_block_count = ferite_jedi_block_count( bucket );
     FeriteMemoryChunkHeader *hdr = NULL, *free_chunks = NULL;
     //printf("%d\n",jedi_count++);
     FUD(( "in more core -> allocating for %d\n", bucket ));
@@ -458,13 +552,36 @@ void ferite_jedi_morecore( int bucket )
 	/* check to see if we have actually run out of space on bucket list */
     if( ferite_jedi_free_chunks[bucket] )
 		return;
+	if( !ferite_jedi_thread_attached )
+		ferite_jedi_thread_attach();
+	
+	LOCK_MEMORY();
+	/* take up to a block's worth from the depot before asking the OS */
+	if( ferite_jedi_depot[bucket] != NULL )
+	{
+		free_chunks = hdr = ferite_jedi_depot[bucket];
+		for( i = 1; i < actual_block_count && hdr->storage.next != NULL; i++ )
+			hdr = hdr->storage.next;
+		ferite_jedi_depot[bucket] = hdr->storage.next;
+		UNLOCK_MEMORY();
+		hdr->storage.next = NULL;
+		ferite_jedi_free_chunks[bucket] = free_chunks;
+		ferite_jedi_free_count[bucket] = i;
+		return;
+	}
 	
 	/* this is where the buckets will be */
     new_block = rmalloc( (chunk_size * actual_block_count) + /* blocks of memory */
                          sizeof(FeriteMemoryChunkHeader) );  /* initial header   */
+    if( new_block == NULL )
+    {
+        UNLOCK_MEMORY();
+        return;
+    }
     ((FeriteMemoryChunkHeader*)new_block)->storage.next = ferite_jedi_big_chunks; /* hook up  header */
     ((FeriteMemoryChunkHeader*)new_block)->storage.magic = DEAD_MAGIC; /* hook up  header */
     ferite_jedi_big_chunks = new_block; /* this now becomes the headerder */
+	UNLOCK_MEMORY();
 
    /* the memory on this chunk needs to be setup as follows:
     *       /---------------------\
@@ -497,6 +614,7 @@ void ferite_jedi_morecore( int bucket )
 
    /* link the memory in */
     ferite_jedi_free_chunks[bucket] =  free_chunks;
+    ferite_jedi_free_count[bucket] = actual_block_count;
    /* dump the table so that we can check that is correlates with the above table */
 #ifdef FERITE_MEM_DEBUG
     ferite_jedi_dump_memory( bucket );
@@ -50,13 +50,15 @@
 FeriteModule *ferite_root_module = NULL;
 FeriteModule *ferite_current_module = NULL;
 FeriteAMT    *ferite_native_function_hash = NULL;
+AphexRWLock  *ferite_native_function_lock = NULL; /* Lookups vastly outnumber registrations */
+AphexMutex   *ferite_module_lock = NULL;          /* Guards the list of loaded modules */
 FeriteStack  *ferite_module_search_list = NULL;
 FeriteStack  *ferite_module_preload_list = NULL;
 FeriteStack  *ferite_module_native_search_list = NULL;
 char         *ferite_script_extensions[] = { ".fec", ".feh", ".fe", NULL };
 int         (*ferite_module_can_be_loaded)( char *module );
 
-extern int    ferite_compile_error;
+extern FE_THREAD_LOCAL int ferite_compile_error;
 
 int __ferite_module_can_be_loaded( char *module )
 {
@@ -95,6 +97,8 @@ int ferite_init_module_list()
         ferite_module_native_search_list = ferite_create_stack( NULL, 5 );
         ferite_module_preload_list = ferite_create_stack( NULL, 5 );
         ferite_native_function_hash = ferite_AMTHash_Create( NULL );
+        ferite_native_function_lock = aphex_rwlock_create();
+        ferite_module_lock = aphex_mutex_recursive_create();
         ferite_root_module = ferite_create_module( "ferite_root_module", "" );
         ferite_current_module = ferite_root_module;
         ferite_module_can_be_loaded = __ferite_module_can_be_loaded;
@@ -165,6 +169,8 @@ void ferite_deinit_module_list()
 
     ferite_destroy_module_list( ferite_root_module );
     ferite_root_module = NULL;
+    aphex_mutex_destroy( ferite_module_lock );
+    ferite_module_lock = NULL;
 
     FUD(( "MODULE LOADER: closing down module loader\n" ));
 
@@ -227,10 +233,40 @@ int ferite_load_module( FeriteScript *script, FeriteNamespace *ns, char *name )
     FE_LEAVE_FUNCTION(0);
 }
 
+int ferite_load_script_module_from_path( char *path, char *name, int do_extension )
+{
+    char file[PATH_MAX];
+    char *filename = file;
+    int j = 0, result = -1;
+
+    FE_ENTER_FUNCTION;
+    if( do_extension == 1 )
+    {
+        for( j = 0; ferite_script_extensions[j] != NULL; j++ )
+        {
+            memset( filename, '\0', PATH_MAX );
+            FUD(( "module_path: %s, %s, '%c', %s\n", path, name, DIR_DELIM, ferite_script_extensions[j] ));
+            snprintf( filename, PATH_MAX, "%s%c%s%s", path, DIR_DELIM, name, ferite_script_extensions[j] );
+            FUD(( "module_filename: %s\n", filename ));
+            result = ferite_do_load_script( filename );
+            if( result > -1 ){
+                FE_LEAVE_FUNCTION( result );
+            }
+        }
+    }
+    else
+    {
+        snprintf( filename, PATH_MAX, "%s%c%s", path, DIR_DELIM, name );
+        result = ferite_do_load_script(filename);
+    }
+    FE_LEAVE_FUNCTION( result );
+}
+
 int ferite_load_script_module( FeriteScript *script, char *name, int do_extension )
 {
     char file[PATH_MAX];
     char *filename = file;
+    char **paths = ferite_compiler_search_paths();
     int i = 0, j = 0, result = 0;
 
     FE_ENTER_FUNCTION;
@@ -239,31 +275,20 @@ int ferite_load_script_module( FeriteScript *script, char *name, int do_extensio
     {
         if( ferite_module_search_list->stack[i] != NULL )
         {
-            /* we check this path */
-            if( do_extension == 1 )
-            {
-                for( j = 0; ferite_script_extensions[j] != NULL; j++ )
-                {
-                    memset( filename, '\0', PATH_MAX );
-                    FUD(( "module_path: %s, %s, '%c', %s\n", (char *)ferite_module_search_list->stack[i], name, DIR_DELIM, ferite_script_extensions[j] ));
-                    snprintf( filename, PATH_MAX, "%s%c%s%s", (char *)ferite_module_search_list->stack[i], DIR_DELIM, name, ferite_script_extensions[j] );
-                    FUD(( "module_filename: %s\n", filename ));
-                    result = ferite_do_load_script( filename );
-                    if( result > -1 ){
-                        FE_LEAVE_FUNCTION( result );
-                    }
-                }
-            }
-            else
-            {
-                snprintf( filename, PATH_MAX, "%s%c%s", (char *)ferite_module_search_list->stack[i], DIR_DELIM, name );
-                result = ferite_do_load_script(filename);
-                if( result > -1 ){
-                    FE_LEAVE_FUNCTION( result );
-                }
+            result = ferite_load_script_module_from_path( ferite_module_search_list->stack[i], name, do_extension );
+            if( result > -1 ){
+                FE_LEAVE_FUNCTION( result );
             }
         }
     }
+    /* then those given to just this compile */
+    for( i = 0; paths != NULL && paths[i] != NULL; i++ )
+    {
+        result = ferite_load_script_module_from_path( paths[i], name, do_extension );
+        if( result > -1 ){
+            FE_LEAVE_FUNCTION( result );
+        }
+    }
 
     if( do_extension == 1 )
     {
@@ -303,6 +328,7 @@ FeriteModule *ferite_module_find( char *name )
 
     FE_ENTER_FUNCTION;
     FUD(( "MODULE LOADER: Trying to locate module \"%s\"\n", name ));
+    aphex_mutex_lock( ferite_module_lock );
    /* check it'#s not already loaded */
     for( ptr = ferite_root_module; ptr != NULL; ptr = ptr->next )
     {
@@ -310,10 +336,11 @@ FeriteModule *ferite_module_find( char *name )
         if( strcmp( name, ptr->name ) == 0 )
         {
             FUD(( "MODULE LOADER: Module \"%s\" is allready loaded\n", name ));
-            FE_LEAVE_FUNCTION(ptr); /* we return 1 because we have it :) */
+            break; /* we have it :) */
         }
     }
-    FE_LEAVE_FUNCTION(NULL);
+    aphex_mutex_unlock( ferite_module_lock );
+    FE_LEAVE_FUNCTION(ptr);
 }
 
 int ferite_unload_native_module( char *name, FeriteScript *script )
@@ -353,9 +380,12 @@ int ferite_load_native_module( char *module_name, FeriteScript *script )
     {
         if( ferite_compiler_include_in_list( script, name ) == 0 )
         {
+            /* Other threads may be loading modules too, the list is only changed with this held */
+            aphex_mutex_lock( ferite_module_lock );
             ptr = ferite_module_find( name );
             if( ptr != NULL )
             {
+                aphex_mutex_unlock( ferite_module_lock );
                 (ptr->module_init)( script );
                 ferite_stack_push( FE_NoScript, script->include_list, fstrdup(name) );
                 ffree_ngc( name );
@@ -377,6 +407,7 @@ int ferite_load_native_module( char *module_name, FeriteScript *script )
                     if( aphex_file_exists( "%s%s", buf, triton_library_ext() ) == 1 )
                     {
                         ferite_error( script, 0, "Library Loader: %s\n", triton_error() );
+                        aphex_mutex_unlock( ferite_module_lock );
                         ffree_ngc( name );
                         FE_LEAVE_FUNCTION(0);
                     }
@@ -402,12 +433,14 @@ int ferite_load_native_module( char *module_name, FeriteScript *script )
                     if( aphex_file_exists( "%s%s", buf, triton_library_ext() ) == 1 )
                     {
                         ferite_error( script, 0, "Library Loader: %s\n", triton_error() );
+                        aphex_mutex_unlock( ferite_module_lock );
                         ffree_ngc( name );
                         FE_LEAVE_FUNCTION(0);
                     }
                     else
                     {
                         ferite_error( script, 0, "Library Loader: Can't find module '%s'\n", module_name );
+                        aphex_mutex_unlock( ferite_module_lock );
                         ffree_ngc( name );
                         FE_LEAVE_FUNCTION(0);
                     }
@@ -432,6 +465,7 @@ int ferite_load_native_module( char *module_name, FeriteScript *script )
                     triton_close( handle );  /* close the lib */
                     ferite_destroy_module_list( ferite_current_module->next );
                     ferite_current_module->next = NULL;
+                    aphex_mutex_unlock( ferite_module_lock );
                     ferite_error( script, 0, "Library Loader: can't find '%s' in module '%s', ferite needs this to function correctly.\n", buf, name );
                     ffree_ngc( name );
                     FE_LEAVE_FUNCTION(0);
@@ -451,13 +485,17 @@ int ferite_load_native_module( char *module_name, FeriteScript *script )
                 ferite_current_module->module_unregister = (void (*)())triton_getsym( handle, buf );
                 
                 (ferite_current_module->module_register)();
+                ptr = ferite_current_module;
+                aphex_mutex_unlock( ferite_module_lock );
+
                 FUD(( "MODULE LOADER: Calling %s::module_init()\n", name ));
-                (ferite_current_module->module_init)( script );
+                (ptr->module_init)( script );
                 
                 ferite_stack_push( FE_NoScript, script->include_list, fstrdup(name) );
             }
             else
             {
+                aphex_mutex_unlock( ferite_module_lock );
                 ferite_error( script, 0, "Library Loader: can't load module '%s', %s.", name, triton_error() );
                 ffree_ngc( name );
                 FE_LEAVE_FUNCTION(0);
@@ -543,6 +581,7 @@ void ferite_module_register_native_function( char *lookupname,
     FE_ENTER_FUNCTION;
     if( ferite_native_function_hash != NULL )
     {
+        aphex_rwlock_write_lock( ferite_native_function_lock );
         record = ferite_hamt_get( NULL, ferite_native_function_hash, lookupname );
         if( record == NULL )
         {
@@ -553,6 +592,7 @@ void ferite_module_register_native_function( char *lookupname,
         }
         else
           fprintf( stderr, "The native function '%s' has already exists, will not re-register.\n", lookupname );
+        aphex_rwlock_unlock( ferite_native_function_lock );
     }
     FE_LEAVE_FUNCTION(NOWT);
 }
@@ -573,6 +613,7 @@ void ferite_module_register_native_function( char *lookupname,
 void ferite_module_register_fake_module( char *name, void *_register, void *_unregister, void *_init, void *_deinit )
 {
     FE_ENTER_FUNCTION;
+    aphex_mutex_lock( ferite_module_lock );
     ferite_current_module->next = ferite_create_module( name, "-fake-module-" );    
     ferite_current_module->next->handle = NULL;
     
@@ -583,6 +624,7 @@ void ferite_module_register_fake_module( char *name, void *_register, void *_unr
     (ferite_current_module->next->module_register)();
     
     ferite_current_module = ferite_current_module->next;
+    aphex_mutex_unlock( ferite_module_lock );
     FE_LEAVE_FUNCTION(NOWT);    
 }
 
@@ -602,6 +644,11 @@ void ferite_module_delete_native_function_list()
         ferite_amt_destroy( NULL, ferite_native_function_hash, ferite_delete_native_function_record );
         ferite_native_function_hash = NULL;
     }
+    if( ferite_native_function_lock != NULL )
+    {
+        aphex_rwlock_destroy( ferite_native_function_lock );
+        ferite_native_function_lock = NULL;
+    }
     FE_LEAVE_FUNCTION(NOWT);
 }
 
@@ -622,9 +669,11 @@ void *ferite_module_find_function( char *name )
     FeriteNativeFunctionRecord *record = NULL;
 
     FE_ENTER_FUNCTION;
+    aphex_rwlock_read_lock( ferite_native_function_lock );
     record = ferite_hamt_get( NULL, ferite_native_function_hash, name );
     if( record != NULL )
       ptr = record->function;
+    aphex_rwlock_unlock( ferite_native_function_lock );
     FE_LEAVE_FUNCTION(ptr);
 }
 
@@ -517,8 +517,8 @@ char *ferite_namespace_bucket_type_to_str( FeriteScript *script, int type )
 
 FE_NATIVE_FUNCTION( ferite_namespace_item_rename )
 {
-    char *from = VAS(params[0])->data;
-	char *to = VAS(params[1])->data;
+    char *from = FE_STR2PTR(params[0]);
+	char *to = FE_STR2PTR(params[1]);
 	FeriteNamespace *self = FE_CONTAINER_TO_NS;
 	FeriteVariable *ptr = fe_new_void_static("");
 	
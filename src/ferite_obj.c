@@ -62,10 +62,10 @@ FE_NATIVE_FUNCTION( ferite_obj_callFunction )
 		MARK_VARIABLE_AS_DISPOSABLE(np[i]);
 	}
 
-	callfunction = ferite_object_get_function_for_params( script, self, VAS(functionName)->data, np );
+	callfunction = ferite_object_get_function_for_params( script, self, FE_STR2PTR(functionName), np );
 	if( callfunction == NULL ) {
 		ferite_error( script, 0, "Unable to find function %s(%s) for use in callFunction\n", 
-										VAS(functionName)->data, ferite_parameters_to_string(script,np) );
+										FE_STR2PTR(functionName), ferite_parameters_to_string(script,np) );
 		FE_RETURN_VOID;
 	}
 	ret = ferite_call_function(script, self, current_recipient, callfunction, np);
@@ -80,15 +80,15 @@ FE_NATIVE_FUNCTION( ferite_obj_callFunction )
 FE_NATIVE_FUNCTION( ferite_obj_setVariable ) 
 {
 	FeriteObject *self = __container__;
-	FeriteVariable *target = ferite_object_get_var( script, self, VAS(params[0])->data );
+	FeriteVariable *target = ferite_object_get_var( script, self, FE_STR2PTR(params[0]) );
 	if( target ) {
 		if( ! ferite_variable_fast_assign( script, target, params[1] ) ) {
-			ferite_error( script, 1, "Unable to assign value to object for attribute %s\n", VAS(params[0])->data );
+			ferite_error( script, 1, "Unable to assign value to object for attribute %s\n", FE_STR2PTR(params[0]) );
 			FE_RETURN_VOID;
 		}
 		FE_RETURN_TRUE;
 	}
-	ferite_error( script, 1, "Object has no such attribute %s\n", VAS(params[0])->data );
+	ferite_error( script, 1, "Object has no such attribute %s\n", FE_STR2PTR(params[0]) );
 	FE_RETURN_VOID;
 }
 
@@ -239,7 +239,7 @@ FE_NATIVE_FUNCTION( ferite_obj_respondsToMethod )
 	
 	FE_ENTER_FUNCTION;
 	
-	func = ferite_object_get_function( script, self, VAS(params[0])->data );
+	func = ferite_object_get_function( script, self, FE_STR2PTR(params[0]) );
 	ptr = ferite_create_number_long_variable( script, "", (func != NULL), FE_STATIC );
 	
 	MARK_VARIABLE_AS_DISPOSABLE( ptr );
@@ -303,8 +303,8 @@ FE_NATIVE_FUNCTION( ferite_obj_hash )
 FE_NATIVE_FUNCTION( ferite_obj_alias ) 
 {
 	FeriteVariable *ptr = fe_new_void_static("");
-	char *from = VAS(params[0])->data;
-	char *to = VAS(params[1])->data;
+	char *from = FE_STR2PTR(params[0]);
+	char *to = FE_STR2PTR(params[1]);
 	FeriteFunction *fromfunc = NULL;
 	FeriteFunction *tofunc = NULL;
 	FeriteClass *self = FE_CONTAINER_TO_CLASS;
@@ -360,8 +360,8 @@ FE_NATIVE_FUNCTION( ferite_obj_alias )
 FE_NATIVE_FUNCTION( ferite_obj_rename ) 
 {
 	FeriteVariable *ptr = fe_new_void_static("");
-	char *from = VAS(params[0])->data;
-	char *to = VAS(params[1])->data;
+	char *from = FE_STR2PTR(params[0]);
+	char *to = FE_STR2PTR(params[1]);
 	FeriteClass *self = FE_CONTAINER_TO_CLASS;
 	FeriteVariable *var = NULL;
 	FeriteFunction *func = NULL;
@@ -1145,8 +1145,7 @@ FERITE_MANY_OP(array_slice)
 {
     FeriteVariable *result = NULL;
     FeriteVariable *array = NULL, *a = NULL, *b = NULL, *tmp = NULL;
-    long size,lower,upper,ii,cal_lo,cal_up;
-    char *buf = NULL;
+    long size,lower,upper,cal_lo,cal_up;
     FeriteString *str = NULL;
 
     FE_ENTER_FUNCTION;
@@ -1208,31 +1207,15 @@ FERITE_MANY_OP(array_slice)
     }
     if(F_VAR_TYPE(array) == F_VAR_STR)
     {
-        str = ferite_str_new( script, NULL, FE_STRLEN(array), FE_CHARSET_DEFAULT );
-        buf = str->data;
-        ii = 0;
         if(cal_lo > cal_up)
         {
-            for(size=cal_lo;size >= cal_up; size--)
-            {
-                buf[ii] = FE_STR2PTR(array)[size];
-                ii++;
-            }
+            str = ferite_str_new( script, NULL, cal_lo - cal_up + 1, FE_CHARSET_DEFAULT );
+            ferite_kernel_reverse( str->data, VAS(array)->data + cal_up, str->length );
+            result = ferite_create_string_variable( script, "spliced_content", str, FE_STATIC );
+            ferite_str_destroy( script, str );
         }
-        else
-        {
-            for(size=cal_lo;size <= cal_up; size++)
-            {
-                buf[ii] = FE_STR2PTR(array)[size];
-                ii++;
-            }
-        }
-
-        buf[ii] = '\0';
-        str->length = ii;
-
-        result = ferite_create_string_variable( script, "spliced_content", str, FE_STATIC );
-        ferite_str_destroy( script, str );
+        else /* A forward slice shares the data of the string it was taken from */
+          result = ferite_create_string_variable_from_view( script, "spliced_content", VAS(array), cal_lo, cal_up - cal_lo + 1, FE_STATIC );
     }
     else
     {
@@ -1306,7 +1289,7 @@ FERITE_BINARY_OP( array_index )
                     {
                         offset = VAI(b);
                     }
-                    s[0] = FE_STR2PTR(a)[offset];
+                    s[0] = VAS(a)->data[offset];
                     s[1] = '\0';
                     ptr = ferite_create_string_variable_from_ptr( script, "array_String_return", s, 1, FE_CHARSET_DEFAULT, FE_STATIC );
                     MARK_VARIABLE_AS_DISPOSABLE( ptr );
@@ -1327,7 +1310,7 @@ FERITE_BINARY_OP( array_index )
                     {
                         index = FE_STRLEN( a ) + index;
                     }
-                    s[0] = FE_STR2PTR( a )[index];
+                    s[0] = VAS(a)->data[index];
                     s[1] = '\0';
                     ptr = ferite_create_string_variable_from_ptr( script, "array_String_return", s, 1, FE_CHARSET_DEFAULT, FE_STATIC );
                     MARK_VARIABLE_AS_DISPOSABLE( ptr );
@@ -1348,6 +1331,11 @@ FERITE_BINARY_OP( array_index )
 					ptr = ferite_create_void_variable( script, "no-entry", FE_STATIC );
 					MARK_VARIABLE_AS_DISPOSABLE( ptr );
 				}
+				else if( FE_VAR_IS_DISPOSABLE( a ) ) {
+					/* The array is thrown away once we return, taking its contents with it */
+					ptr = ferite_duplicate_variable( script, ptr, NULL );
+					MARK_VARIABLE_AS_DISPOSABLE( ptr );
+				}
 			}
 			else 
 	            ferite_error( script, 0, "You have provided an bad index method for the array (%s) - it could be an empty string, null object etc.\n", ferite_variable_id_to_str( script, F_VAR_TYPE(b) ) );
@@ -1679,7 +1667,7 @@ FERITE_BINARY_OP( isa )
     LOCK_VARIABLE(a);
     LOCK_VARIABLE(b);
     GET_INPUT_VARS;
-    FE_VAR_TEST( (strcmp( VAS(b)->data, ferite_variable_id_to_str(script,F_VAR_TYPE(a)) ) == 0), "isa" );
+    FE_VAR_TEST( (strcmp( FE_STR2PTR(b), ferite_variable_id_to_str(script,F_VAR_TYPE(a)) ) == 0), "isa" );
     UNLOCK_VARIABLE(a);
     UNLOCK_VARIABLE(b);
     if( ptr != NULL )
@@ -50,50 +50,50 @@
 
 #define YYERROR_VERBOSE
 
-extern jmp_buf  ferite_compiler_jmpback;
-extern int	    ferite_scanner_lineno;
-extern char	   *ferite_scanner_file;
-extern int	    ferite_compile_error;
-extern char	   *ferite_last_token_alloc;
-extern FeriteCompileRecord *ferite_current_compile;
-
-extern FeriteStack *ferite_compiled_arrays_stack;
-extern FeriteStack *ferite_argcount_stack;
-
-char		   *ferite_last_function = NULL;
-int			 	ferite_last_type = 0;
-FeriteString   *ferite_last_clamp = NULL;
-FeriteVariable *ferite_temp_variable = NULL;
-char			ferite_fetypebuf[1024];
-char			ferite_fenamebuf[1024];
-int			 	ferite_var_is_global = FE_FALSE;
-int			 	ferite_var_is_params = FE_FALSE;
-int			 	ferite_var_is_final = FE_FALSE;
-int			 	ferite_var_is_static = FE_FALSE;
-int			 	ferite_var_is_atomic = FE_FALSE;
-int			 	ferite_var_is_native = FE_FALSE;
-int			 	ferite_var_pass_type = FE_BY_VALUE;
-int			 	ferite_item_state = FE_ITEM_IS_PRIVATE;
-int			 	ferite_class_state = 0;
-int			 	ferite_current_arg_count = 0;
-int			 	ferite_var_array_count = 0;
-int			 	ferite_namespace_naturaln = 0;
-int			 	ferite_function_is_directive = 0;
-FeriteStack	   *ferite_directive_parameters = NULL;
-FeriteHash	   *ferite_expansion_hash = NULL;
-FeriteHash	   *ferite_expansion_map_hash = NULL;
-long		 	ferite_expansion_map_offset = 0;
-int			 	ferite_objcall_is_self = FE_FALSE;
-int			 	ferite_objcall_is_super = FE_FALSE;
-int				ferite_function_return_type = F_VAR_VOID;
-FeriteOp	   *ferite_assign_op_to_change[128];
-int			 	ferite_assign_is_array[128];
-int			 	ferite_assign_loc = 0;
-int				ferite_return_type_was_provided = FE_FALSE;
-int				ferite_seeking_return_type_fix = FE_FALSE;
-int				ferite_hint_depth = 0;
-char			ferite_hint_typestring[512];
-FeriteVariableSubType *ferite_hint_current_type = NULL;
+extern FE_THREAD_LOCAL jmp_buf  ferite_compiler_jmpback;
+extern FE_THREAD_LOCAL int	    ferite_scanner_lineno;
+extern FE_THREAD_LOCAL char	   *ferite_scanner_file;
+extern FE_THREAD_LOCAL int	    ferite_compile_error;
+extern FE_THREAD_LOCAL char	   *ferite_last_token_alloc;
+extern FE_THREAD_LOCAL FeriteCompileRecord *ferite_current_compile;
+
+extern FE_THREAD_LOCAL FeriteStack *ferite_compiled_arrays_stack;
+extern FE_THREAD_LOCAL FeriteStack *ferite_argcount_stack;
+
+FE_THREAD_LOCAL char		   *ferite_last_function = NULL;
+FE_THREAD_LOCAL int			 	ferite_last_type = 0;
+FE_THREAD_LOCAL FeriteString   *ferite_last_clamp = NULL;
+FE_THREAD_LOCAL FeriteVariable *ferite_temp_variable = NULL;
+FE_THREAD_LOCAL char			ferite_fetypebuf[1024];
+FE_THREAD_LOCAL char			ferite_fenamebuf[1024];
+FE_THREAD_LOCAL int			 	ferite_var_is_global = FE_FALSE;
+FE_THREAD_LOCAL int			 	ferite_var_is_params = FE_FALSE;
+FE_THREAD_LOCAL int			 	ferite_var_is_final = FE_FALSE;
+FE_THREAD_LOCAL int			 	ferite_var_is_static = FE_FALSE;
+FE_THREAD_LOCAL int			 	ferite_var_is_atomic = FE_FALSE;
+FE_THREAD_LOCAL int			 	ferite_var_is_native = FE_FALSE;
+FE_THREAD_LOCAL int			 	ferite_var_pass_type = FE_BY_VALUE;
+FE_THREAD_LOCAL int			 	ferite_item_state = FE_ITEM_IS_PRIVATE;
+FE_THREAD_LOCAL int			 	ferite_class_state = 0;
+FE_THREAD_LOCAL int			 	ferite_current_arg_count = 0;
+FE_THREAD_LOCAL int			 	ferite_var_array_count = 0;
+FE_THREAD_LOCAL int			 	ferite_namespace_naturaln = 0;
+FE_THREAD_LOCAL int			 	ferite_function_is_directive = 0;
+FE_THREAD_LOCAL FeriteStack	   *ferite_directive_parameters = NULL;
+FE_THREAD_LOCAL FeriteHash	   *ferite_expansion_hash = NULL;
+FE_THREAD_LOCAL FeriteHash	   *ferite_expansion_map_hash = NULL;
+FE_THREAD_LOCAL long		 	ferite_expansion_map_offset = 0;
+FE_THREAD_LOCAL int			 	ferite_objcall_is_self = FE_FALSE;
+FE_THREAD_LOCAL int			 	ferite_objcall_is_super = FE_FALSE;
+FE_THREAD_LOCAL int				ferite_function_return_type = F_VAR_VOID;
+FE_THREAD_LOCAL FeriteOp	   *ferite_assign_op_to_change[128];
+FE_THREAD_LOCAL int			 	ferite_assign_is_array[128];
+FE_THREAD_LOCAL int			 	ferite_assign_loc = 0;
+FE_THREAD_LOCAL int				ferite_return_type_was_provided = FE_FALSE;
+FE_THREAD_LOCAL int				ferite_seeking_return_type_fix = FE_FALSE;
+FE_THREAD_LOCAL int				ferite_hint_depth = 0;
+FE_THREAD_LOCAL char			ferite_hint_typestring[512];
+FE_THREAD_LOCAL FeriteVariableSubType *ferite_hint_current_type = NULL;
 
 int  feplex();
 void feperror( char *message );
@@ -125,8 +125,8 @@ void ferite_scanner_stop_end_hint();
 	 /***
 	* Native Code Support
 	***/
-	 extern char ferite_current_native_block_file[4096];
-	 extern int  ferite_current_native_block_line;
+	 extern FE_THREAD_LOCAL char ferite_current_native_block_file[4096];
+	 extern FE_THREAD_LOCAL int  ferite_current_native_block_line;
 
 %}
 
@@ -1,5 +1,12 @@
 
-#line 3 "lex.fep.c"
+#line 38 "ferite_scanner.l"
+/* Pulled in ahead of flex's own state so that ferite_scanner.sed can make it per thread */
+#ifdef HAVE_CONFIG_HEADER
+#include "../config.h"
+#endif
+#include "ferite.h"
+
+#line 10 "lex.fep.c"
 
 #define  YY_INT_ALIGNED short int
 
@@ -176,9 +183,9 @@ typedef struct yy_buffer_state *YY_BUFFER_STATE;
 typedef size_t yy_size_t;
 #endif
 
-extern yy_size_t fepleng;
+extern FE_THREAD_LOCAL yy_size_t fepleng;
 
-extern FILE *fepin, *fepout;
+extern FE_THREAD_LOCAL FILE *fepin, *fepout;
 
 #define EOB_ACT_CONTINUE_SCAN 0
 #define EOB_ACT_END_OF_FILE 1
@@ -268,9 +275,9 @@ struct yy_buffer_state
 #endif /* !YY_STRUCT_YY_BUFFER_STATE */
 
 /* Stack of input buffers. */
-static size_t yy_buffer_stack_top = 0; /**< index of top of stack. */
-static size_t yy_buffer_stack_max = 0; /**< capacity of stack. */
-static YY_BUFFER_STATE * yy_buffer_stack = 0; /**< Stack as an array. */
+static FE_THREAD_LOCAL size_t yy_buffer_stack_top = 0; /**< index of top of stack. */
+static FE_THREAD_LOCAL size_t yy_buffer_stack_max = 0; /**< capacity of stack. */
+static FE_THREAD_LOCAL YY_BUFFER_STATE * yy_buffer_stack = 0; /**< Stack as an array. */
 
 /* We provide macros for accessing buffer states in case in the
  * future we want to put the buffer states in a more general
@@ -288,19 +295,19 @@ static YY_BUFFER_STATE * yy_buffer_stack = 0; /**< Stack as an array. */
 #define YY_CURRENT_BUFFER_LVALUE (yy_buffer_stack)[(yy_buffer_stack_top)]
 
 /* yy_hold_char holds the character lost when feptext is formed. */
-static char yy_hold_char;
-static yy_size_t yy_n_chars;		/* number of characters read into yy_ch_buf */
-yy_size_t fepleng;
+static FE_THREAD_LOCAL char yy_hold_char;
+static FE_THREAD_LOCAL yy_size_t yy_n_chars;		/* number of characters read into yy_ch_buf */
+FE_THREAD_LOCAL yy_size_t fepleng;
 
 /* Points to current character in buffer. */
-static char *yy_c_buf_p = (char *) 0;
-static int yy_init = 0;		/* whether we need to initialize */
-static int yy_start = 0;	/* start state number */
+static FE_THREAD_LOCAL char *yy_c_buf_p = (char *) 0;
+static FE_THREAD_LOCAL int yy_init = 0;		/* whether we need to initialize */
+static FE_THREAD_LOCAL int yy_start = 0;	/* start state number */
 
 /* Flag which is used to allow fepwrap()'s to do buffer switches
  * instead of setting up a fresh fepin.  A bit of a hack ...
  */
-static int yy_did_buffer_switch_on_eof;
+static FE_THREAD_LOCAL int yy_did_buffer_switch_on_eof;
 
 void feprestart (FILE *input_file  );
 void fep_switch_to_buffer (YY_BUFFER_STATE new_buffer  );
@@ -355,15 +362,15 @@ void fepfree (void *  );
 
 typedef unsigned char YY_CHAR;
 
-FILE *fepin = (FILE *) 0, *fepout = (FILE *) 0;
+FE_THREAD_LOCAL FILE *fepin = (FILE *) 0, *fepout = (FILE *) 0;
 
 typedef int yy_state_type;
 
-extern int feplineno;
+extern FE_THREAD_LOCAL int feplineno;
 
-int feplineno = 1;
+FE_THREAD_LOCAL int feplineno = 1;
 
-extern char *feptext;
+extern FE_THREAD_LOCAL char *feptext;
 #define yytext_ptr feptext
 static yyconst flex_int16_t yy_nxt[][256] =
     {
@@ -20755,8 +20762,8 @@ static yyconst flex_int16_t yy_accept[642] =
        97
     } ;
 
-static yy_state_type yy_last_accepting_state;
-static char *yy_last_accepting_cpos;
+static FE_THREAD_LOCAL yy_state_type yy_last_accepting_state;
+static FE_THREAD_LOCAL char *yy_last_accepting_cpos;
 
 static yyconst yy_state_type yy_NUL_trans[642] =
     {   0,
@@ -20843,7 +20850,7 @@ int fep_flex_debug = 0;
 #define yymore() yymore_used_but_not_detected
 #define YY_MORE_ADJ 0
 #define YY_RESTORE_YY_MORE_OFFSET
-char *feptext;
+FE_THREAD_LOCAL char *feptext;
 #line 1 "ferite_scanner.l"
 #line 2 "ferite_scanner.l"
 /*
@@ -20933,44 +20940,44 @@ typedef struct _ferite_lex_state {
 # define FUD( var )
 #endif
 
-	extern jmp_buf ferite_compiler_jmpback;
-	extern int ferite_compile_error;
-	int   ferite_scanner_lineno = 1;
-	int   ferite_i;
+	extern FE_THREAD_LOCAL jmp_buf ferite_compiler_jmpback;
+	extern FE_THREAD_LOCAL int ferite_compile_error;
+	FE_THREAD_LOCAL int   ferite_scanner_lineno = 1;
+	FE_THREAD_LOCAL int   ferite_i;
 
 #define BUFFER_LENGTH   32768
 
-	char  ferite_cstring_buf[BUFFER_LENGTH]; /* should be big enough */
-	char *ferite_cstrptr;
-	FeriteBuffer *ferite_cstring_buffer = NULL;
-	int   ferite_scanner_buffer_counter = 0;
-	int   ferite_scanner_in_expression = FE_FALSE;
+	FE_THREAD_LOCAL char  ferite_cstring_buf[BUFFER_LENGTH]; /* should be big enough */
+	FE_THREAD_LOCAL char *ferite_cstrptr;
+	FE_THREAD_LOCAL FeriteBuffer *ferite_cstring_buffer = NULL;
+	FE_THREAD_LOCAL int   ferite_scanner_buffer_counter = 0;
+	FE_THREAD_LOCAL int   ferite_scanner_in_expression = FE_FALSE;
 
-	char  ferite_variablenamebuf[4096];
-	char  ferite_regex_buf[4096];
-	char *ferite_rgxptr;
-	char *ferite_last_token_alloc = NULL;
+	FE_THREAD_LOCAL char  ferite_variablenamebuf[4096];
+	FE_THREAD_LOCAL char  ferite_regex_buf[4096];
+	FE_THREAD_LOCAL char *ferite_rgxptr;
+	FE_THREAD_LOCAL char *ferite_last_token_alloc = NULL;
 
-	extern FeriteStack *ferite_compiled_arrays_stack;
-	extern FeriteCompileRecord *ferite_current_compile;
+	extern FE_THREAD_LOCAL FeriteStack *ferite_compiled_arrays_stack;
+	extern FE_THREAD_LOCAL FeriteCompileRecord *ferite_current_compile;
 
-	YY_BUFFER_STATE ferite_fp_state;
+	FE_THREAD_LOCAL YY_BUFFER_STATE ferite_fp_state;
 
-	char *ferite_scanner_file = NULL;
+	FE_THREAD_LOCAL char *ferite_scanner_file = NULL;
 
-	FeriteStack *ferite_scanner_stack = NULL;
-	FeriteLexState *ferite_save_state;
+	FE_THREAD_LOCAL FeriteStack *ferite_scanner_stack = NULL;
+	FE_THREAD_LOCAL FeriteLexState *ferite_save_state;
 
 	/*****
 	 ***** NATIVE CODE HANDLING STUFF
 	 *****/
-	int ferite_native_code_bracket_depth = 0;
-	int ferite_native_code_has_started = 0;
-	char ferite_current_native_block_file[4096];
-	int  ferite_current_native_block_line;
+	FE_THREAD_LOCAL int ferite_native_code_bracket_depth = 0;
+	FE_THREAD_LOCAL int ferite_native_code_has_started = 0;
+	FE_THREAD_LOCAL char ferite_current_native_block_file[4096];
+	FE_THREAD_LOCAL int  ferite_current_native_block_line;
 
 	/* For caching */
-	FeriteStack *ferite_compiled_lengths_stack = NULL;
+	FE_THREAD_LOCAL FeriteStack *ferite_compiled_lengths_stack = NULL;
 
 
 	void fepwarning( char *message );
@@ -21072,9 +21079,9 @@ static int input (void );
 
 #endif
 
-        static int yy_start_stack_ptr = 0;
-        static int yy_start_stack_depth = 0;
-        static int *yy_start_stack = NULL;
+        static FE_THREAD_LOCAL int yy_start_stack_ptr = 0;
+        static FE_THREAD_LOCAL int yy_start_stack_depth = 0;
+        static FE_THREAD_LOCAL int *yy_start_stack = NULL;
     
     static void yy_push_state (int new_state );
     
@@ -23678,7 +23685,7 @@ void ferite_clean_parser()
 	FE_LEAVE_FUNCTION( NOWT );
 }
 
-char *last_yytext_ptr = NULL;
+FE_THREAD_LOCAL char *last_yytext_ptr = NULL;
 
 void ferite_save_lexer()
 {
@@ -78,6 +78,7 @@ FeriteScript *ferite_new_script()
     ptr->gc_count = 0;
     ptr->gc_lock = NULL;
 	ptr->gc_stack = NULL;
+	ptr->gc_incoming = NULL;
 	ptr->lock = NULL;
     ptr->thread_group = NULL;
     ptr->parent = NULL;
@@ -92,6 +93,7 @@ FeriteScript *ferite_new_script()
 	ptr->vars = NULL;
 	ptr->objects = NULL;
 	ptr->stacks = NULL;
+	ptr->formats = NULL;
 
     ferite_init_cache( ptr );
     ptr->_odata = NULL;
@@ -99,6 +101,8 @@ FeriteScript *ferite_new_script()
 
 	ptr->globals = ferite_AMTHash_Create(ptr);
 	ptr->types = ferite_AMTHash_Create(ptr);
+	ptr->snapshot = NULL;
+	ptr->cache_entries = NULL;
 	
     FE_LEAVE_FUNCTION( ptr );
 }
@@ -220,6 +224,8 @@ int ferite_script_clean( FeriteScript *script )
 	    ferite_delete_hash( script, script->_odata, NULL );
 		script->_odata = NULL;
 	 }
+
+        ferite_script_snapshot_delete( script );
        
         /* delete the garbage collector */
         if( script->gc != NULL )
@@ -252,17 +258,25 @@ int ferite_script_clean( FeriteScript *script )
             script->include_list = NULL;
         }
 
+		/*
+		 * The static bindings to global variables point straight at the variables in the
+		 * main namespace, so they have to go before the namespace takes the variables with it
+		 */
+		if( script->globals ) {
+			ferite_amt_destroy( script, script->globals, (void(*)(FeriteScript*,void*))ferite_script_global_variable_destroy );
+			script->globals = NULL;
+		}
+
         /* delete the body of the script */
         if( script->mainns != NULL )
         {
             ferite_delete_namespace( script, script->mainns );
             script->mainns = NULL;
         }
+
+        /* now nothing refers to them, let go of the compile cache lines we used */
+        ferite_cache_release_script( script );
   
-		if( script->globals ) {
-			ferite_amt_destroy( script, script->globals, (void(*)(FeriteScript*,void*))ferite_script_global_variable_destroy );
-			script->globals = NULL;
-		}
 		if( script->types ) {
 			ferite_amt_destroy( script, script->types, (void(*)(FeriteScript*,void*))ferite_subtype_destroy );
 			script->types = NULL;
@@ -307,6 +321,154 @@ int ferite_script_delete( FeriteScript *script )
     FE_LEAVE_FUNCTION(0);
 }
 
+void ferite_script_snapshot_delete( FeriteScript *script )
+{
+    int i = 0;
+
+    FE_ENTER_FUNCTION;
+    if( script->snapshot != NULL )
+    {
+        /* the stack holds (live, saved) pairs - we only own the saved copies */
+        for( i = 2; i <= script->snapshot->stack_ptr; i += 2 )
+        {
+            if( script->snapshot->stack[i] != NULL )
+              ferite_variable_destroy( script, script->snapshot->stack[i] );
+        }
+        ferite_delete_stack( NULL, script->snapshot );
+        script->snapshot = NULL;
+    }
+    FE_LEAVE_FUNCTION(NOWT);
+}
+
+void ferite_script_snapshot_variable( FeriteScript *script, FeriteVariable *var )
+{
+    FE_ENTER_FUNCTION;
+    /* accessor backed variables belong to native code, so we leave them be */
+    if( var != NULL && var->accessors == NULL )
+    {
+        ferite_stack_push( NULL, script->snapshot, var );
+        ferite_stack_push( NULL, script->snapshot, ferite_duplicate_variable( script, var, NULL ) );
+    }
+    FE_LEAVE_FUNCTION(NOWT);
+}
+
+void ferite_script_snapshot_namespace( FeriteScript *script, FeriteNamespace *ns )
+{
+    FeriteIterator *iter = NULL, *citer = NULL;
+    FeriteHashBucket *bucket = NULL, *cbucket = NULL;
+    FeriteNamespaceBucket *nsb = NULL;
+    FeriteClass *klass = NULL;
+
+    FE_ENTER_FUNCTION;
+    /* variables live in the data fork, namespaces and classes in the code fork */
+    iter = ferite_create_iterator( script );
+    while( (bucket = ferite_hash_walk( script, ns->data_fork, iter )) != NULL )
+      ferite_script_snapshot_variable( script, ((FeriteNamespaceBucket*)bucket->data)->data );
+    ffree( iter );
+
+    iter = ferite_create_iterator( script );
+    while( (bucket = ferite_hash_walk( script, ns->code_fork, iter )) != NULL )
+    {
+        nsb = bucket->data;
+        switch( nsb->type )
+        {
+          case FENS_NS:
+            ferite_script_snapshot_namespace( script, nsb->data );
+            break;
+          case FENS_CLS:
+            klass = nsb->data;
+            if( klass->class_vars != NULL )
+            {
+                citer = ferite_create_iterator( script );
+                while( (cbucket = ferite_hash_walk( script, klass->class_vars, citer )) != NULL )
+                  ferite_script_snapshot_variable( script, cbucket->data );
+                ffree( citer );
+            }
+            break;
+        }
+    }
+    ffree( iter );
+    FE_LEAVE_FUNCTION(NOWT);
+}
+
+/**
+ * @function ferite_script_snapshot
+ * @declaration int ferite_script_snapshot( FeriteScript *script )
+ * @brief Record the values of a compiled script's global, namespace and static class variables
+ * @param FeriteScript *script The script to snapshot
+ * @return 1 on success, 0 on fail
+ * @description This should be called straight after compilation, before the script is executed.
+ *              ferite_script_reset() can then be used to put the script back into this state
+ *              between executions. Taking a new snapshot replaces the previous one.
+ */
+int ferite_script_snapshot( FeriteScript *script )
+{
+    FE_ENTER_FUNCTION;
+    if( script != NULL && script->mainns != NULL )
+    {
+        ferite_script_snapshot_delete( script );
+        script->snapshot = ferite_create_stack( NULL, FE_COMPILER_INTERNAL_STACK_SIZE );
+        ferite_script_snapshot_namespace( script, script->mainns );
+        FE_LEAVE_FUNCTION( 1 );
+    }
+    FE_LEAVE_FUNCTION(0);
+}
+
+/**
+ * @function ferite_script_reset
+ * @declaration int ferite_script_reset( FeriteScript *script )
+ * @brief Put an executed script back into the state recorded by ferite_script_snapshot()
+ * @param FeriteScript *script The script to reset
+ * @return 1 on success, 0 on fail
+ * @description The variables are restored in place, so classes, functions, compiled code and
+ *              the static bindings to globals are all kept. Errors, warnings and the return
+ *              value are cleared and the garbage collector is run so that the objects created
+ *              by the previous execution are released. The script's caches of spare variables,
+ *              objects and stacks and of compiled format strings are then emptied, so nothing
+ *              from one execution is held on to for the next. This makes it cheap to execute the
+ *              same script repeatedly. Namespaces and classes added or renamed at runtime are not
+ *              undone.
+ */
+int ferite_script_reset( FeriteScript *script )
+{
+    FeriteVariable *live = NULL, *saved = NULL;
+    int i = 0;
+
+    FE_ENTER_FUNCTION;
+    if( script == NULL || script->snapshot == NULL )
+    {
+        FE_LEAVE_FUNCTION(0);
+    }
+
+    for( i = 1; i < script->snapshot->stack_ptr; i += 2 )
+    {
+        live = script->snapshot->stack[i];
+        saved = script->snapshot->stack[i+1];
+        if( !ferite_variable_fast_assign( script, live, saved ) )
+        {
+            ferite_variable_convert_to_type( script, live, F_VAR_VOID );
+            ferite_variable_fast_assign( script, live, saved );
+        }
+        live->flags = (live->flags & ~FE_FLAG_FINALSET) | (saved->flags & FE_FLAG_FINALSET);
+    }
+
+    ferite_reset_errors( script );
+    ferite_reset_warnings( script );
+    script->error_state = 0;
+    script->keep_execution = FE_FALSE;
+    script->is_executing = FE_FALSE;
+    script->return_value = 0;
+    script->stack_level = 0;
+    script->last_regex_count = 0;
+
+    if( script->gc != NULL )
+      ferite_collect_gc( script );
+    /* the collection above fills the caches, so they are emptied afterwards */
+    ferite_free_cache( script );
+    ferite_init_cache( script );
+    FE_LEAVE_FUNCTION(1);
+}
+
 /**
  * @function ferite_duplicate_script
  * @declaration FeriteScript *ferite_duplicate_script( FeriteScript *script )
@@ -371,6 +533,8 @@ FeriteScript *ferite_duplicate_script( FeriteScript *script )
             /* setup the gc */
             ferite_init_gc( ptr );
         }
+
+        ferite_cache_share_script( script, ptr );
     }
     FE_LEAVE_FUNCTION( ptr );
 }
@@ -383,6 +547,7 @@ void ferite_init_cache( FeriteScript *script )
 		script->vars = ferite_create_stack( NULL, FE_CACHE_SIZE );
         script->objects = ferite_create_stack( NULL, FE_CACHE_SIZE );
         script->stacks = ferite_create_stack( NULL, FE_CACHE_SIZE );
+        script->formats = ferite_create_hash( NULL, 32 );
     }
     FE_LEAVE_FUNCTION( NOWT );
 }
@@ -424,6 +589,12 @@ void ferite_free_cache( FeriteScript *script )
         script->stacks = NULL;
     }
 
+    if( script->formats != NULL )
+    {
+        ferite_delete_hash( NULL, script->formats, (void (*)(FeriteScript *,void *))ferite_format_destroy );
+        script->formats = NULL;
+    }
+
     FE_LEAVE_FUNCTION( NOWT );
 }
 
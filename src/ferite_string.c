@@ -33,6 +33,9 @@
 #endif
 
 #include "ferite.h"
+#include "aphex.h"
+
+static void ferite_str_release_data( FeriteScript *script, FeriteString *str );
 
 /**
  * @group Strings
@@ -59,6 +62,7 @@ FeriteString *ferite_str_new( FeriteScript *script, char *str, size_t length, in
     ptr = fmalloc( sizeof( FeriteString ) );
     ptr->pos = -1;
     ptr->encoding = encoding;
+    ptr->storage = NULL;
 
     if( str == NULL || *str == '\0' )
     {
@@ -94,9 +98,11 @@ FeriteString *ferite_bin_str_new( FeriteScript *script, char *str, size_t length
 	ptr = fmalloc( sizeof( FeriteString ) );
 	ptr->pos = -1;
 	ptr->encoding = encoding;
+	ptr->storage = NULL;
 	
 	ptr->data = fmalloc( length + 1 );
 	memcpy( ptr->data, str, length );
+	ptr->data[length] = '\0';
 	
 	ptr->length = length;
 	FE_LEAVE_FUNCTION( ptr );
@@ -106,6 +112,8 @@ FeriteString *ferite_bin_str_new( FeriteScript *script, char *str, size_t length
  * @function ferite_str_dup
  * @declaration FeriteString *ferite_str_dup( FeriteString *str )
  * @brief Duplicate a ferite string
+ * @description If the string points into shared storage the new string will share it too rather
+ *              than copying the data.
  * @param FeriteScript *script The script context
  * @param FeriteString *str The string to duplicate
  * @return A new string 
@@ -118,10 +126,15 @@ FeriteString *ferite_str_dup( FeriteScript *script, FeriteString *str )
     {
         ptr = ferite_str_new( script, NULL, 0, FE_CHARSET_DEFAULT );
     }
+    else if( str->storage != NULL )
+    {
+        ptr = ferite_str_new_from_storage( script, str->storage, str->data - str->storage->data, str->length, str->encoding );
+    }
     else
     {
         ptr = fmalloc( sizeof( FeriteString ) );
         ptr->pos = -1;
+        ptr->storage = NULL;
         ptr->data = fmalloc( str->length + 1 );
         memcpy( ptr->data, str->data, str->length );
         ptr->data[str->length] = '\0';
@@ -144,8 +157,7 @@ FeriteString *ferite_str_dup( FeriteScript *script, FeriteString *str )
 void ferite_str_set( FeriteScript *script, FeriteString *str, char *data, size_t length, int encoding )
 {
     FE_ENTER_FUNCTION;
-    if( str->data )
-      ffree( str->data );
+    ferite_str_release_data( script, str );
     if( data == NULL )
       data = "";
     if( length == 0 )
@@ -170,10 +182,7 @@ void ferite_str_destroy( FeriteScript *script, FeriteString *str )
     FE_ENTER_FUNCTION;
     if( str )
     {
-        if( str->data )
-        {
-            ffree( str->data );
-        }
+        ferite_str_release_data( script, str );
         ffree( str );
     }
     FE_LEAVE_FUNCTION( NOWT );
@@ -300,7 +309,16 @@ int ferite_str_case_ncmp( FeriteScript *script, FeriteString *str1, FeriteString
 int ferite_str_cpy( FeriteScript *script, FeriteString *str1, FeriteString *str2 )
 {
     FE_ENTER_FUNCTION;
-    ffree( str1->data);
+    if( str2->storage != NULL )
+    {
+        FINCREF( str2->storage );
+        ferite_str_release_data( script, str1 );
+        str1->storage = str2->storage;
+        str1->data = str2->data;
+        str1->length = str2->length;
+        FE_LEAVE_FUNCTION((int)str1->length);
+    }
+    ferite_str_release_data( script, str1 );
     str1->data = fmalloc( str2->length + 1 );
     memcpy( str1->data, str2->data, str2->length );
     str1->data[str2->length] = '\0';
@@ -323,8 +341,17 @@ int ferite_str_ncpy( FeriteScript *script, FeriteString *str1, FeriteString *str
     size_t len;
 
     FE_ENTER_FUNCTION;
-    ffree( str1->data);
     len = (size >= str2->length) ? str2->length : size;
+    if( str2->storage != NULL )
+    {
+        FINCREF( str2->storage );
+        ferite_str_release_data( script, str1 );
+        str1->storage = str2->storage;
+        str1->data = str2->data;
+        str1->length = len;
+        FE_LEAVE_FUNCTION((int)len);
+    }
+    ferite_str_release_data( script, str1 );
     str1->data = fmalloc( len + 1 );
     str1->length = len;
     memcpy( str1->data, str2->data, len );
@@ -349,7 +376,7 @@ int ferite_str_cat( FeriteScript *script, FeriteString *str1, FeriteString *str2
     memcpy( newbuf, str1->data, str1->length );
     memcpy( newbuf + str1->length, str2->data, str2->length );
     newbuf[ str1->length + str2->length ] = '\0';
-    ffree( str1->data );
+    ferite_str_release_data( script, str1 );
     str1->data = newbuf;
     str1->length = str1->length + str2->length;
     FE_LEAVE_FUNCTION(0);
@@ -372,7 +399,7 @@ int ferite_str_data_cat( FeriteScript *script, FeriteString *str, void *data, si
     memcpy( newbuf, str->data, str->length );
     memcpy( newbuf + str->length, data, size );
     newbuf[ str->length + size ] = '\0';
-    ffree( str->data );
+    ferite_str_release_data( script, str );
     str->data = newbuf;
     str->length = str->length + size;
     FE_LEAVE_FUNCTION(1);
@@ -387,18 +414,40 @@ int ferite_str_data_cat( FeriteScript *script, FeriteString *str, void *data, si
  * @param FeriteString *what The string to scan for
  * @param FeriteString *with The string to replace 'what' with
  * @return A new string with the replacements
+ * @description The strings may contain NUL bytes. The matches are counted first so that the result
+ *              can be built in a single allocation.
  */
 FeriteString *ferite_str_replace( FeriteScript *script, FeriteString *str, FeriteString *what, FeriteString *with )
 {
     FeriteString *ptr = NULL;
-    char *data = NULL;
+    size_t start = 0, length = 0, matches = 0;
+    long found = 0;
+    char *out = NULL;
 
     FE_ENTER_FUNCTION;
     if( str != NULL && what != NULL && with != NULL )
     {
-        data = ferite_replace_string( str->data, what->data, with->data );
-        ptr = ferite_str_new( script, data, strlen(data), FE_CHARSET_DEFAULT );
-        ffree( data );
+        if( what->length == 0 )
+        {
+            FE_LEAVE_FUNCTION( ferite_bin_str_new( script, str->data, str->length, FE_CHARSET_DEFAULT ) );
+        }
+        while( (found = ferite_kernel_find( str->data + start, str->length - start, what->data, what->length )) >= 0 )
+        {
+            start += found + what->length;
+            matches++;
+        }
+        length = str->length - matches * what->length + matches * with->length;
+        ptr = ferite_str_new( script, NULL, length, FE_CHARSET_DEFAULT );
+        out = ptr->data;
+        for( start = 0; matches > 0; matches-- )
+        {
+            found = ferite_kernel_find( str->data + start, str->length - start, what->data, what->length );
+            memcpy( out, str->data + start, found );
+            memcpy( out + found, with->data, with->length );
+            out += found + with->length;
+            start += found + what->length;
+        }
+        memcpy( out, str->data + start, str->length - start );
         FE_LEAVE_FUNCTION( ptr );
     }
     ptr = ferite_str_new( script, "", 0, FE_CHARSET_DEFAULT );
@@ -408,36 +457,270 @@ FeriteString *ferite_str_replace( FeriteScript *script, FeriteString *str, Ferit
 FeriteString *ferite_str_escape( FeriteScript *script, FeriteString *str )
 {
 	FeriteString *ptr = NULL;
-	char *data = NULL, *data2 = NULL, *data3 = NULL;;
-	
+	size_t i, length;
+	char *out = NULL;
+
 	FE_ENTER_FUNCTION;
     if( str != NULL )
     {
-        data = ferite_replace_string( str->data, "\\", "\\\\" );
-        data2 = ferite_replace_string( data, "\"", "\\\"" );
-		data3 = ferite_replace_string( data2, "$", "\\$" );
-        ptr = ferite_str_new( script, data3, strlen(data3), FE_CHARSET_DEFAULT );
-        ffree( data );
-		ffree( data2 );
-		ffree( data3 );
+        /* Walked by length: a view is not followed by a '\0' and a string may hold one */
+        for( i = 0, length = str->length; i < str->length; i++ )
+        {
+            if( str->data[i] == '\\' || str->data[i] == '"' || str->data[i] == '$' )
+              length++;
+        }
+        ptr = ferite_str_new( script, NULL, length, FE_CHARSET_DEFAULT );
+        for( i = 0, out = ptr->data; i < str->length; i++ )
+        {
+            if( str->data[i] == '\\' || str->data[i] == '"' || str->data[i] == '$' )
+              *out++ = '\\';
+            *out++ = str->data[i];
+        }
         FE_LEAVE_FUNCTION( ptr );
     }
     ptr = ferite_str_new( script, "", 0, FE_CHARSET_DEFAULT );
 	FE_LEAVE_FUNCTION( ptr );
 }
 
-/* FIXME
-FeriteString *ferite_str_copy( FeriteString *str, size_t from, size_t to )
+/**
+ * @function ferite_str_storage_new
+ * @declaration FeriteStringStorage *ferite_str_storage_new( FeriteScript *script, char *data, size_t length, FeriteStringStorageRelease release, void *odata )
+ * @brief Wrap a block of read-only data so that it can be shared between strings
+ * @param FeriteScript *script The script context
+ * @param char *data The data to share
+ * @param int length The length of the data
+ * @param FeriteStringStorageRelease release The function to call when the last string lets go of the data
+ * @param void *odata Data for the release function
+ * @return The storage, it has no references until a string is created from it
+ * @description The data must remain valid and unchanged until the release function is called. It is
+ *              expected that the byte following the data is a '\0' so that strings covering the end
+ *              of the storage can be passed to code wanting a C string.
+ */
+FeriteStringStorage *ferite_str_storage_new( FeriteScript *script, char *data, size_t length, FeriteStringStorageRelease release, void *odata )
 {
-    FeriteString *ptr = NULL;
+    FeriteStringStorage *storage;
+
+    FE_ENTER_FUNCTION;
+    storage = fmalloc( sizeof( FeriteStringStorage ) );
+    storage->refcount = 0;
+    storage->data = data;
+    storage->length = length;
+    storage->release = release;
+    storage->odata = odata;
+    FE_LEAVE_FUNCTION( storage );
+}
 
+/**
+ * @function ferite_str_storage_release
+ * @declaration void ferite_str_storage_release( FeriteScript *script, FeriteStringStorage *storage )
+ * @brief Drop a reference to shared storage, releasing it once it is no longer used
+ * @param FeriteScript *script The script context
+ * @param FeriteStringStorage *storage The storage
+ */
+void ferite_str_storage_release( FeriteScript *script, FeriteStringStorage *storage )
+{
     FE_ENTER_FUNCTION;
+    if( storage != NULL && FE_REFCOUNT_ADD( storage, -1 ) <= 0 )
+    {
+        if( storage->release != NULL )
+          (storage->release)( script, storage );
+        ffree( storage );
+    }
+    FE_LEAVE_FUNCTION( NOWT );
+}
+
+/**
+ * @function ferite_str_new_from_storage
+ * @declaration FeriteString *ferite_str_new_from_storage( FeriteScript *script, FeriteStringStorage *storage, size_t offset, size_t length, int encoding )
+ * @brief Create a string that points into shared storage without copying it
+ * @param FeriteScript *script The script context
+ * @param FeriteStringStorage *storage The storage to use
+ * @param int offset The offset into the storage the string starts at
+ * @param int length The length of the string
+ * @param int encoding The encoding to use, if you are not sure use FE_CHARSET_DEFAULT
+ * @return A FeriteString referencing the storage
+ */
+FeriteString *ferite_str_new_from_storage( FeriteScript *script, FeriteStringStorage *storage, size_t offset, size_t length, int encoding )
+{
+    FeriteString *ptr;
+
+    FE_ENTER_FUNCTION;
+    ptr = fmalloc( sizeof( FeriteString ) );
+    ptr->pos = -1;
+    ptr->encoding = encoding;
+    ptr->storage = storage;
+    ptr->data = storage->data + offset;
+    ptr->length = length;
+    FINCREF( storage );
     FE_LEAVE_FUNCTION( ptr );
 }
 
-FeriteUnifiedArray *ferite_str_split( FeriteScript *script, FeriteString *str, FeriteString *spliter )
+/**
+ * @function ferite_str_materialise
+ * @declaration void ferite_str_materialise( FeriteScript *script, FeriteString *str )
+ * @brief Make sure that the string owns its data so that it can be modified in place
+ * @param FeriteScript *script The script context
+ * @param FeriteString *str The string
+ * @description Strings that point into shared storage are read-only. Native code that wishes to change
+ *              the contents of a string it did not create itself must call this first.
+ */
+void ferite_str_materialise( FeriteScript *script, FeriteString *str )
 {
-    FeriteUnifiedArray *ptr = NULL;
+    char *data;
+
+    FE_ENTER_FUNCTION;
+    if( str != NULL && str->storage != NULL )
+    {
+        data = fmalloc( str->length + 1 );
+        memcpy( data, str->data, str->length );
+        data[str->length] = '\0';
+        ferite_str_storage_release( script, str->storage );
+        str->storage = NULL;
+        str->data = data;
+    }
+    FE_LEAVE_FUNCTION( NOWT );
+}
+
+/**
+ * @function ferite_str_cstr
+ * @declaration char *ferite_str_cstr( FeriteScript *script, FeriteString *str )
+ * @brief Get the data of a string so that it can be used as a C string
+ * @param FeriteScript *script The script context
+ * @param FeriteString *str The string
+ * @return The string's data, followed by a '\0'
+ * @description A view into the middle of another string is not followed by a '\0'. Such a string is
+ *              given a copy of its own here, anything else is returned as it is.
+ */
+char *ferite_str_cstr( FeriteScript *script, FeriteString *str )
+{
+    FE_ENTER_FUNCTION;
+    if( str->storage != NULL && str->data[str->length] != '\0' )
+      ferite_str_materialise( script, str );
+    FE_LEAVE_FUNCTION( str->data );
+}
+
+static void ferite_str_release_shared_data( FeriteScript *script, FeriteStringStorage *storage )
+{
+    ffree( storage->data );
+}
+
+/**
+ * @function ferite_str_view
+ * @declaration FeriteString *ferite_str_view( FeriteScript *script, FeriteString *str, size_t offset, size_t length )
+ * @brief Create a string that covers part of another string without copying it
+ * @param FeriteScript *script The script context
+ * @param FeriteString *str The string to take the view of
+ * @param int offset The offset into the string the view starts at
+ * @param int length The length of the view
+ * @return A new string sharing the data of the original
+ * @description If the string owns its data it is handed over to shared storage, so from then on both
+ *              the string and the view are read-only and will make a copy of their own when they are
+ *              changed. The whole of the original data is kept until the last view of it has gone.
+ */
+FeriteString *ferite_str_view( FeriteScript *script, FeriteString *str, size_t offset, size_t length )
+{
+    FE_ENTER_FUNCTION;
+    if( length == 0 )
+    {
+        FE_LEAVE_FUNCTION( ferite_str_new( script, NULL, 0, str->encoding ) );
+    }
+    if( str->storage == NULL )
+    {
+        str->storage = ferite_str_storage_new( script, str->data, str->length, ferite_str_release_shared_data, NULL );
+        FINCREF( str->storage );
+    }
+    FE_LEAVE_FUNCTION( ferite_str_new_from_storage( script, str->storage, (str->data - str->storage->data) + offset, length, str->encoding ) );
+}
+
+/**
+ * @function ferite_str_split
+ * @declaration int ferite_str_split( FeriteScript *script, FeriteUnifiedArray *array, FeriteString *str, FeriteString *delimiter, int limit )
+ * @brief Split a string on a delimiter adding the pieces to an array
+ * @param FeriteScript *script The script context
+ * @param FeriteUnifiedArray *array The array to add the pieces to
+ * @param FeriteString *str The string to split
+ * @param FeriteString *delimiter The string to split on, it may contain NUL bytes
+ * @param int limit If greater than zero, the most times the string is split
+ * @return The number of times the string was split
+ * @description The pieces are views of the string rather than copies, see ferite_str_view().
+ */
+int ferite_str_split( FeriteScript *script, FeriteUnifiedArray *array, FeriteString *str, FeriteString *delimiter, int limit )
+{
+    FeriteVariable *piece = NULL;
+    size_t start = 0;
+    long i = 0;
+    int splits = 0;
+
+    FE_ENTER_FUNCTION;
+    if( str->length > 0 && delimiter->length > 0 )
+    {
+        while( (i = ferite_kernel_find( str->data + start, str->length - start, delimiter->data, delimiter->length )) >= 0 )
+        {
+            piece = ferite_create_string_variable_from_view( script, "", str, start, i, FE_STATIC );
+            ferite_uarray_add( script, array, piece, NULL, FE_ARRAY_ADD_AT_END );
+            start += i + delimiter->length;
+            splits++;
+            if( limit > 0 && splits == limit )
+              break;
+        }
+        if( start < str->length )
+        {
+            piece = ferite_create_string_variable_from_view( script, "", str, start, str->length - start, FE_STATIC );
+            ferite_uarray_add( script, array, piece, NULL, FE_ARRAY_ADD_AT_END );
+        }
+    }
+    FE_LEAVE_FUNCTION( splits );
+}
+
+static void ferite_str_release_data( FeriteScript *script, FeriteString *str )
+{
+    if( str->storage != NULL )
+    {
+        ferite_str_storage_release( script, str->storage );
+        str->storage = NULL;
+    }
+    else if( str->data )
+    {
+        ffree( str->data );
+    }
+    str->data = NULL;
+}
+
+static void ferite_str_release_mapped_file( FeriteScript *script, FeriteStringStorage *storage )
+{
+    aphex_unmap_file( storage->odata );
+}
+
+/**
+ * @function ferite_str_map_file
+ * @declaration FeriteString *ferite_str_map_file( FeriteScript *script, char *filename )
+ * @brief Create a read-only string with the contents of a file without reading it into memory
+ * @param FeriteScript *script The script context
+ * @param char *filename The file to map
+ * @return A FeriteString backed by the mapped file, or NULL on failure with errno set
+ * @description The file is mapped into memory and the pages are only brought in as they are
+ *              touched. Copies of the string share the mapping, which is unmapped once the
+ *              last of them has been destroyed.
+ */
+FeriteString *ferite_str_map_file( FeriteScript *script, char *filename )
+{
+    AphexMappedFile *map = NULL;
+    FeriteStringStorage *storage = NULL;
+
+    FE_ENTER_FUNCTION;
+    if( (map = aphex_map_file( filename )) == NULL )
+    {
+        FE_LEAVE_FUNCTION( NULL );
+    }
+    storage = ferite_str_storage_new( script, map->data, map->size, ferite_str_release_mapped_file, map );
+    FE_LEAVE_FUNCTION( ferite_str_new_from_storage( script, storage, 0, map->size, FE_CHARSET_DEFAULT ) );
+}
+
+/* FIXME
+FeriteString *ferite_str_copy( FeriteString *str, size_t from, size_t to )
+{
+    FeriteString *ptr = NULL;
+
     FE_ENTER_FUNCTION;
     FE_LEAVE_FUNCTION( ptr );
 }
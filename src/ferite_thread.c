@@ -195,4 +195,71 @@ void ferite_thread_group_wait( FeriteScript *script, FeriteThreadGroup *group )
     FE_LEAVE_FUNCTION(NOWT);
 }
 
+/**
+ * @function ferite_enable_atomic_refcounts
+ * @declaration void ferite_enable_atomic_refcounts()
+ * @brief Switch reference counting over to atomic operations
+ * @description Reference counts are plain integers while a process only runs one
+ *              thread, and this switches them over for good. It must be called
+ *              before the second thread that can touch a script's objects is
+ *              started; the thread module does this for Thread, ThreadPool and
+ *              Array.parallel*, embedders that run scripts on threads of their
+ *              own should call it themselves. Calling it more than once is harmless.
+ */
+void ferite_enable_atomic_refcounts()
+{
+    FE_ENTER_FUNCTION;
+#ifdef THREAD_SAFE
+    if( !ferite_atomic_refcounts )
+        __atomic_store_n( &ferite_atomic_refcounts, FE_TRUE, __ATOMIC_SEQ_CST );
+#endif
+    FE_LEAVE_FUNCTION(NOWT);
+}
+
+/** @end */
+
+/**
+ * @group Waiting For I/O
+ * @brief A native function that finds a non-blocking descriptor is not ready can hand the wait over
+ *        to whatever is scheduling work on the current thread, such as the thread module's fibers,
+ *        instead of failing or spinning.
+ */
+
+static FE_THREAD_LOCAL FeriteIOWaitHook ferite_io_wait_hook = NULL;
+
+/**
+ * @function ferite_set_io_wait_hook
+ * @declaration void ferite_set_io_wait_hook( FeriteIOWaitHook hook )
+ * @brief Set the function that waits for descriptors on the calling thread
+ * @param FeriteIOWaitHook hook The function, or NULL when nothing is scheduling work on this thread
+ * @description The hook is per thread. It is called with the descriptor and the FE_IO_* events the
+ *              caller is waiting for, and returns FE_TRUE once the caller should try again.
+ */
+void ferite_set_io_wait_hook( FeriteIOWaitHook hook )
+{
+    FE_ENTER_FUNCTION;
+    ferite_io_wait_hook = hook;
+    FE_LEAVE_FUNCTION(NOWT);
+}
+
+/**
+ * @function ferite_io_wait
+ * @declaration int ferite_io_wait( FeriteScript *script, int fd, int events )
+ * @brief Wait for a non-blocking descriptor to become ready
+ * @param FeriteScript *script The script context
+ * @param int fd The descriptor that returned EAGAIN
+ * @param int events FE_IO_READ, FE_IO_WRITE or both
+ * @return FE_TRUE if the operation should be retried, FE_FALSE if nobody on this thread can wait
+ *         for the caller, in which case it should report EAGAIN as it always has
+ */
+int ferite_io_wait( FeriteScript *script, int fd, int events )
+{
+    int retval = FE_FALSE;
+
+    FE_ENTER_FUNCTION;
+    if( ferite_io_wait_hook != NULL && fd >= 0 )
+        retval = (ferite_io_wait_hook)( script, fd, events );
+    FE_LEAVE_FUNCTION(retval);
+}
+
 /** @end */
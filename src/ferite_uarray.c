@@ -248,10 +248,35 @@ FeriteVariable *ferite_uarray_get_index( FeriteScript *script, FeriteUnifiedArra
     
     if( array->array[index] == NULL )
         array->array[index] = ferite_create_void_variable( script, "uvar", FE_STATIC );
+    else if( array->array[index]->accessors != NULL && array->array[index]->accessors->get != NULL )
+        (array->array[index]->accessors->get)( script, array->array[index] );
     
     FE_LEAVE_FUNCTION( array->array[index] );
 }
 
+/**
+ * @function ferite_uarray_resolve
+ * @declaration void ferite_uarray_resolve( FeriteScript *script, FeriteUnifiedArray *array )
+ * @brief Run the get accessor of every item in an array that has one
+ * @param FeriteScript *script The script
+ * @param FeriteUnifiedArray *array The array to resolve
+ * @description Items can be placeholders whose value is only filled in by their get accessor, which
+ *              ferite_uarray_get_index() runs for you. Code that walks array->array directly should
+ *              call this first so that it sees the same values a script would.
+ */
+void ferite_uarray_resolve( FeriteScript *script, FeriteUnifiedArray *array )
+{
+    int i;
+
+    FE_ENTER_FUNCTION;
+    for( i = 0; i < array->size; i++ )
+    {
+        if( array->array[i] != NULL && array->array[i]->accessors != NULL && array->array[i]->accessors->get != NULL )
+          (array->array[i]->accessors->get)( script, array->array[i] );
+    }
+    FE_LEAVE_FUNCTION( NOWT );
+}
+
 /**
  * @function ferite_uarray_get_from_string
  * @declaration FeriteVariable *ferite_uarray_get_from_string( FeriteScript *script, FeriteUnifiedArray *array, char *id )
@@ -544,6 +569,7 @@ FeriteString *ferite_uarray_to_str( FeriteScript *script, FeriteUnifiedArray *ar
 
 	     FE_ENTER_FUNCTION;	 
 
+	     ferite_uarray_resolve( script, array );
 	     buf = ferite_buffer_new(script, FE_DEFAULT_BUFFER_SIZE);	 
 
 	     ferite_buffer_add_char(script, buf, '[');	 
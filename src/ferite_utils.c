@@ -343,7 +343,7 @@ int *ferite_int_to_ptr( int i )
  */
 char *ferite_stroflen(char c, int l)
 {
-    static char buf[1024];
+    static FE_THREAD_LOCAL char buf[1024];
     int i = 0;
 
     buf[0] = '\0';
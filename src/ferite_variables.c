@@ -98,11 +98,15 @@ FeriteVariable *ferite_variable_alloc(FeriteScript *script, char *name, int allo
  */
 void ferite_variable_destroy( FeriteScript *script, FeriteVariable *var )
 {
+    int refcount = 0;
+
     FE_ENTER_FUNCTION;
     if( var != NULL )
     {
-		FDECREF(var);
-        if( var->refcount > 0 )
+		/* Only the thread that takes the count to zero may free the variable */
+		if( (refcount = FE_REFCOUNT_ADD( var, -1 )) < 0 )
+			ferite_debug_catch( var, refcount );
+        if( refcount > 0 )
         {
             if( F_VAR_TYPE(var) == F_VAR_OBJ && VAO(var) != NULL ) {
 				FDECREF(VAO(var));
@@ -200,6 +204,9 @@ FeriteVariable *ferite_duplicate_variable( FeriteScript *script, FeriteVariable
     int alloc;
     FE_ENTER_FUNCTION;
     FE_ASSERT( var != NULL );
+    /* The copy should carry the value a read would see, not whatever placeholder the accessor fills in */
+    if( var->accessors != NULL && var->accessors->get != NULL )
+      (var->accessors->get)( script, var );
     alloc = (FE_VAR_NAME_IS_STATIC( var )) ? FE_STATIC : FE_ALLOC;
     switch( F_VAR_TYPE(var) )
     {
@@ -318,6 +325,31 @@ FeriteVariable *ferite_create_string_variable_from_ptr( FeriteScript *script, ch
     FE_LEAVE_FUNCTION( ptr );
 }
 
+/**
+ * @function ferite_create_string_variable_from_view
+ * @declaration FeriteVariable *ferite_create_string_variable_from_view( FeriteScript *script, char *name, FeriteString *str, size_t offset, size_t length, int alloc )
+ * @brief Create a FeriteVariable holding part of an existing string without copying it
+ * @param FeriteScript *script The script
+ * @param char *name The name of the variable
+ * @param FeriteString *str The string the variable shares its data with
+ * @param int offset Where in the string the variable's value starts
+ * @param int length The length of the variable's value
+ * @param int alloc Whether or not to set the variable's name as static or allocated
+ * @return Returns a newly created string variable
+ * @description See ferite_str_view() for how the data is shared.
+ */
+FeriteVariable *ferite_create_string_variable_from_view( FeriteScript *script, char *name, FeriteString *str, size_t offset, size_t length, int alloc )
+{
+    FeriteVariable *ptr;
+
+    FE_ENTER_FUNCTION;
+    ptr = ferite_variable_alloc( script, name, alloc );
+    F_VAR_TYPE(ptr) = F_VAR_STR;
+    VAS(ptr) = ferite_str_view( script, str, offset, length );
+	ptr->subtype = ferite_subtype_link( script, "S" );
+    FE_LEAVE_FUNCTION( ptr );
+}
+
 /**
  * @function ferite_create_binary_string_variable_from_ptr
  * @declaration FeriteVariable *ferite_create_binary_string_variable_from_ptr( FeriteScript *script, char *name, char *data, int length, int encoding, int alloc )
@@ -1145,6 +1177,10 @@ void ferite_delete_pointer( FeriteScript *script, void *p )
  *   The method can then modify the variable as it wants, and then return. It
  *   does not return the variable.<nl/>
  * <nl/>
+ *   Items are also 'gotten' as they are fetched out of an array by index. This
+ *   allows a native function to hand back an array of placeholders that are only
+ *   filled in when the script reaches for them.<nl/>
+ * <nl/>
  *   The get function has the prototype:<nl/>
  * <nl/>
  * <code>void get( FeriteScript *script, FeriteVariable *var )</code>
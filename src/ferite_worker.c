@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2000-2007 Chris Ross and various contributors
+ * Copyright (C) 1999-2000 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_HEADER
+#include "../config.h"
+#endif
+
+#include "ferite.h"
+#include "aphex.h"
+
+#ifndef WIN32
+# include <sys/types.h>
+# include <sys/wait.h>
+# include <signal.h>
+# include <errno.h>
+#endif
+
+/**
+ * @group Worker Pools
+ * @description A worker pool lets an embedder serve requests from a number of pre-forked
+ *              processes. The master compiles the script once and takes a snapshot of it;
+ *              every worker it forks inherits the compiled namespaces, classes, bytecode and
+ *              loaded modules copy-on-write. Each request executes that same script and then
+ *              resets it to the snapshot with ferite_script_reset(), so nothing is compiled in
+ *              a worker and the pages holding the code stay shared between all of them.
+ *              Workers are replaced after a set number of requests to bound any growth.
+ */
+
+#ifndef WIN32
+
+static int ferite_worker_main( FeriteWorkerPool *pool )
+{
+	FeriteScript *script = pool->script;
+	int served = 0;
+
+	while( pool->max_requests == 0 || served < pool->max_requests )
+	{
+		if( pool->accept != NULL && !(pool->accept)( pool, pool->data ) )
+			return FE_WORKER_RETIRED;
+
+		if( pool->setup != NULL )
+			(pool->setup)( pool, script, pool->data );
+		ferite_script_execute( script );
+		if( pool->finish != NULL )
+			(pool->finish)( pool, script, pool->data );
+		ferite_script_reset( script );
+		served++;
+	}
+	return 0;
+}
+
+static int ferite_worker_spawn( FeriteWorkerPool *pool, int slot )
+{
+	pid_t pid = fork();
+
+	if( pid == -1 )
+		return FE_FALSE;
+	if( pid == 0 )
+	{
+		int retval = 0;
+		signal( SIGTERM, SIG_DFL );
+		signal( SIGINT, SIG_DFL );
+		retval = ferite_worker_main( pool );
+		/* _exit so that nothing the master registered with atexit() runs twice */
+		fflush( NULL );
+		_exit( retval );
+	}
+	pool->pids[slot] = pid;
+	return FE_TRUE;
+}
+
+/**
+ * @function ferite_worker_pool_create
+ * @declaration FeriteWorkerPool *ferite_worker_pool_create( char *filename, int workers, int max_requests )
+ * @brief Compile a script in the master process ready to be served by a pool of workers
+ * @param char *filename The script to run for each request
+ * @param int workers The number of worker processes to keep running
+ * @param int max_requests How many requests a worker serves before it is replaced, 0 for no limit
+ * @description The callbacks and their data can be set on the returned pool before
+ *              ferite_worker_pool_run() is called: accept is called in the worker to wait for
+ *              the next request, setup is given the script before it is executed and finish is
+ *              given it afterwards, before it is reset for the next request. Without an accept
+ *              callback a worker runs the script back to back.
+ * @return The pool. Check pool->script with ferite_has_compile_error() before running it.
+ */
+FeriteWorkerPool *ferite_worker_pool_create( char *filename, int workers, int max_requests )
+{
+	FeriteWorkerPool *pool = NULL;
+
+	FE_ENTER_FUNCTION;
+	pool = fmalloc_ngc( sizeof(FeriteWorkerPool) );
+	pool->filename = fstrdup( filename );
+	pool->workers = (workers > 0 ? workers : 1);
+	pool->max_requests = (max_requests > 0 ? max_requests : 0);
+	pool->pids = fcalloc_ngc( pool->workers, sizeof(int) );
+	pool->running = FE_FALSE;
+	pool->accept = NULL;
+	pool->setup = NULL;
+	pool->finish = NULL;
+	pool->data = NULL;
+
+	pool->script = ferite_script_compile( filename );
+	if( !ferite_has_compile_error( pool->script ) )
+		ferite_script_snapshot( pool->script );
+	FE_LEAVE_FUNCTION( pool );
+}
+
+/**
+ * @function ferite_worker_pool_run
+ * @declaration int ferite_worker_pool_run( FeriteWorkerPool *pool )
+ * @brief Fork the workers and supervise them until the pool is stopped
+ * @param FeriteWorkerPool *pool The pool
+ * @description A worker that exits after serving its quota of requests, or dies, is replaced.
+ *              A worker whose accept callback returns FE_FALSE is not. The function returns
+ *              once ferite_worker_pool_stop() has been called, or every worker has retired.
+ * @return FE_TRUE once all the workers have gone, FE_FALSE if the script failed to compile
+ */
+int ferite_worker_pool_run( FeriteWorkerPool *pool )
+{
+	int i = 0, live = 0, status = 0;
+	pid_t pid = 0;
+
+	FE_ENTER_FUNCTION;
+	if( pool->script == NULL || ferite_has_compile_error( pool->script ) )
+	{
+		FE_LEAVE_FUNCTION( FE_FALSE );
+	}
+
+	pool->running = FE_TRUE;
+	fflush( NULL );
+	for( i = 0; i < pool->workers; i++ )
+	{
+		if( ferite_worker_spawn( pool, i ) )
+			live++;
+	}
+
+	while( live > 0 )
+	{
+		pid = waitpid( -1, &status, 0 );
+		if( pid == -1 )
+		{
+			if( errno == EINTR )
+				continue;
+			break;
+		}
+		for( i = 0; i < pool->workers && pool->pids[i] != pid; i++ )
+			;
+		if( i == pool->workers )
+			continue;
+
+		pool->pids[i] = 0;
+		live--;
+		if( pool->running && !(WIFEXITED(status) && WEXITSTATUS(status) == FE_WORKER_RETIRED) )
+		{
+			if( ferite_worker_spawn( pool, i ) )
+				live++;
+		}
+	}
+	pool->running = FE_FALSE;
+	FE_LEAVE_FUNCTION( FE_TRUE );
+}
+
+/**
+ * @function ferite_worker_pool_stop
+ * @declaration void ferite_worker_pool_stop( FeriteWorkerPool *pool )
+ * @brief Stop replacing workers and ask the current ones to terminate
+ * @param FeriteWorkerPool *pool The pool
+ * @description This only uses async-signal-safe calls so it may be called from a signal handler.
+ */
+void ferite_worker_pool_stop( FeriteWorkerPool *pool )
+{
+	int i = 0;
+
+	pool->running = FE_FALSE;
+	for( i = 0; i < pool->workers; i++ )
+	{
+		if( pool->pids[i] > 0 )
+			kill( pool->pids[i], SIGTERM );
+	}
+}
+
+#else
+
+FeriteWorkerPool *ferite_worker_pool_create( char *filename, int workers, int max_requests )
+{
+	return NULL;
+}
+int ferite_worker_pool_run( FeriteWorkerPool *pool )
+{
+	return FE_FALSE;
+}
+void ferite_worker_pool_stop( FeriteWorkerPool *pool )
+{
+}
+
+#endif
+
+/**
+ * @function ferite_worker_pool_destroy
+ * @declaration void ferite_worker_pool_destroy( FeriteWorkerPool *pool )
+ * @brief Free a pool and the master's copy of its script
+ * @param FeriteWorkerPool *pool The pool
+ */
+void ferite_worker_pool_destroy( FeriteWorkerPool *pool )
+{
+	FE_ENTER_FUNCTION;
+	if( pool != NULL )
+	{
+		if( pool->script != NULL )
+			ferite_script_delete( pool->script );
+		ffree_ngc( pool->filename );
+		ffree_ngc( pool->pids );
+		ffree_ngc( pool );
+	}
+	FE_LEAVE_FUNCTION( NOWT );
+}
@@ -288,9 +288,10 @@ inline static double get_time(void)
 int main( int argc, char **argv )
 {
 	int i = 0, retval = 0;
+	FeriteCacheStats stats;
 	char *errmsg = NULL, *tmp = NULL;
     double start = 0, end = 0;
-    double compile_diff, dup_diff;
+    double compile_diff, dup_diff = 0, reset_diff = 0;
 
 #ifndef WIN32
 	signal( SIGTERM, sig_ctrl );
@@ -535,7 +536,42 @@ int main( int argc, char **argv )
 					printf("average cache compile time: %f\n", dup_diff);
 				    printf( "cache compile is %f%% faster than compilation\n", (compile_diff/dup_diff) * 100 );
 				}
+
+				/* compile once and put the script back to its post compile state between runs */
+				if( attempt_cache && !opt.compile_only ) {
+				    script = ferite_script_compile( opt.scriptname );
+					if( !ferite_has_compile_error( script ) )
+					{
+						ferite_reset_warnings( script );
+						ferite_script_snapshot( script );
+						for( i = 0; i < opt.iterations; i++ ) {
+						    start = get_time();
+							ferite_script_execute( script );
+							if( ferite_has_runtime_error( script ) )
+							{
+								errmsg = ferite_get_error_log( script );
+								fprintf( stderr, "[ferite: execution]\n%s", errmsg );
+								ffree( errmsg );
+								retval = 2;
+								break;
+							}
+							retval = script->return_value;
+							ferite_script_reset( script );
+						    end = get_time();
+						    reset_diff += end - start;
+						}
+						if( i > 0 ) {
+							reset_diff = reset_diff / i;
+							printf( "average reset execution time: %f\n", reset_diff );
+						    printf( "reset is %f%% faster than cache compilation\n", (dup_diff/reset_diff) * 100 );
+						}
+					}
+					ferite_script_delete( script );
+				}
 				
+				ferite_cache_stats( &stats );
+				printf( "cache: %ld lines (%ld retired), %ld functions, %lu bytes, %ld hits, %ld misses\n",
+						stats.entries, stats.retired, stats.functions, (unsigned long)stats.bytes, stats.hits, stats.misses );
 				free( buf );
 			}
 
@@ -0,0 +1,116 @@
+#include "tap.h"
+#include "ferite.h"
+#include <unistd.h>
+
+#define FILES 3
+
+char filenames[FILES][32];
+FeriteCacheStats before, after;
+
+void write_script(char *filename, int n)
+{
+	char source[256];
+	int fd = mkstemp(filename);
+
+	sprintf(source,
+		"function twice%d( number n ) { return n * 2; }\n"
+		"function thrice%d( number n ) { return n * 3; }\n"
+		"return twice%d(1) + thrice%d(1);\n", n, n, n, n);
+	write(fd, source, strlen(source));
+	close(fd);
+}
+
+/* Compile a file and report whether the compile came from the cache */
+int compile(char *filename)
+{
+	FeriteScript *script;
+
+	ferite_cache_stats(&before);
+	script = ferite_script_compile(filename);
+	ferite_script_delete(script);
+	ferite_cache_stats(&after);
+	return after.hits > before.hits;
+}
+
+void test_stats(void)
+{
+	ok(!compile(filenames[0]), "A file is compiled the first time");
+	is(after.entries, 1, "... which gives the cache a line");
+	is(after.functions, 2, "... holding its functions");
+	ok(after.bytes > 0, "... and accounts for their memory");
+	ok(after.misses > before.misses, "... after missing the lookups");
+	ok(compile(filenames[0]), "The second compile comes from the cache");
+	is(after.entries, 1, "... without a new line");
+}
+
+void test_invalidate(void)
+{
+	FeriteScript *holder;
+
+	is(ferite_cache_invalidate(NULL, filenames[0]), 1, "A file can be dropped from the cache");
+	ferite_cache_stats(&after);
+	ok(after.entries == 0 && after.functions == 0 && after.bytes == 0, "... taking its functions and memory with it");
+	is(after.invalidations, 1, "... and counting it");
+	is(ferite_cache_invalidate(NULL, filenames[0]), 0, "A file that is not cached can not be dropped");
+	ok(!compile(filenames[0]), "A dropped file is compiled again");
+
+	holder = ferite_script_compile(filenames[0]);
+	ferite_cache_invalidate(holder, filenames[0]);
+	ferite_cache_stats(&after);
+	is(after.retired, 1, "A line still used by a script is kept until it is deleted");
+	ferite_script_execute(holder);
+	is(holder->return_value, 5, "... and the script still runs");
+	ferite_script_delete(holder);
+	ferite_cache_stats(&after);
+	is(after.retired, 0, "... after which it is freed");
+}
+
+void test_limit(void)
+{
+	size_t all;
+	int i;
+
+	ferite_cache_invalidate(NULL, NULL);
+	for (i = 0; i < FILES; i++)
+		compile(filenames[i]);
+	ok(compile(filenames[0]), "The first file is used again");
+	ferite_cache_stats(&after);
+	is(after.entries, FILES, "Every file has a line");
+	all = after.bytes;
+
+	ferite_cache_set_limit(NULL, all - 1);
+	ferite_cache_stats(&after);
+	ok(after.entries == FILES - 1 && after.evictions == 1, "Going over the limit evicts one line");
+	ok(after.bytes <= all - 1 && after.limit == all - 1, "... which brings the cache under it");
+	ok(compile(filenames[0]), "The most recently used file is kept");
+	ok(compile(filenames[2]), "... as is the next");
+	ok(!compile(filenames[1]), "The least recently used file was evicted");
+
+	ferite_cache_set_limit(NULL, 1);
+	ferite_cache_stats(&after);
+	is(after.entries, 0, "A tiny limit empties the cache");
+	ferite_cache_set_limit(NULL, 0);
+	compile(filenames[1]);
+	ok(compile(filenames[1]), "Without a limit files are cached again");
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	ferite_init(argc, argv);
+	ferite_cache_toggle(FE_TRUE);
+	for (i = 0; i < FILES; i++) {
+		strcpy(filenames[i], "/tmp/ferite-cache-XXXXXX");
+		write_script(filenames[i], i);
+	}
+
+	test_stats();
+	test_invalidate();
+	test_limit();
+
+	for (i = 0; i < FILES; i++)
+		unlink(filenames[i]);
+	ferite_deinit();
+	return done_testing();
+}
@@ -0,0 +1,86 @@
+#include "tap.h"
+#include "ferite.h"
+#include "test-time.h"
+
+#define LINES 200000
+#define RUNS 3
+
+FeriteScript *script;
+FeriteBuffer *buf;
+FeriteVariable *vars[5];
+char *log_format = "[%s] %-8s request %d took %.3f ms\n";
+
+/* What formatting cost before: the format is worked out again on every call */
+size_t old_lines(void)
+{
+	FeriteFormat *compiled;
+	int i;
+
+	for (i = 0; i < LINES; i++) {
+		compiled = ferite_format_compile(script, log_format, strlen(log_format));
+		ferite_format_run(script, buf, compiled, vars, 4);
+		ferite_format_destroy(script, compiled);
+	}
+	return ferite_buffer_get_size(script, buf);
+}
+
+size_t new_lines(void)
+{
+	int i;
+
+	for (i = 0; i < LINES; i++)
+		ferite_format(script, buf, log_format, vars);
+	return ferite_buffer_get_size(script, buf);
+}
+
+unsigned long best_of(size_t (*runner)(void), size_t *result)
+{
+	unsigned long best = 0, start, duration;
+	int i;
+
+	for (i = 0; i < RUNS; i++) {
+		buf = ferite_buffer_new(script, 0);
+		start = get_time_nanos();
+		*result = runner();
+		duration = get_time_nanos() - start;
+		ferite_buffer_delete(script, buf);
+		if (i == 0 || duration < best)
+			best = duration;
+	}
+	return best ? best : 1;
+}
+
+void test_log_lines(void)
+{
+	unsigned long old_duration, new_duration;
+	size_t old_result, new_result;
+	double ratio;
+
+	old_duration = best_of(old_lines, &old_result);
+	new_duration = best_of(new_lines, &new_result);
+	is(new_result, old_result, "A cached format writes the same output");
+	ratio = (double)old_duration / new_duration;
+	diag("log lines      old %8lu us, new %8lu us, %.2fx", old_duration / 1000, new_duration / 1000, ratio);
+	ok(ratio > 1, "Formatting with a cached format is faster: %f", ratio);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	ferite_init(argc, argv);
+	script = ferite_new_script();
+	vars[0] = ferite_create_string_variable_from_ptr(script, "time", "12:00:01", 8, FE_CHARSET_DEFAULT, FE_STATIC);
+	vars[1] = ferite_create_string_variable_from_ptr(script, "level", "info", 4, FE_CHARSET_DEFAULT, FE_STATIC);
+	vars[2] = ferite_create_number_long_variable(script, "id", 1234567, FE_STATIC);
+	vars[3] = ferite_create_number_double_variable(script, "ms", 12.5, FE_STATIC);
+	vars[4] = NULL;
+
+	test_log_lines();
+
+	for (i = 0; vars[i] != NULL; i++)
+		ferite_variable_destroy(script, vars[i]);
+	ferite_script_delete(script);
+	ferite_deinit();
+	return done_testing();
+}
@@ -0,0 +1,171 @@
+#include "tap.h"
+#include "ferite.h"
+
+#define SAMPLES 2000
+
+FeriteVariable *vars[8];
+
+/* Format into a C string, so the answers can be compared with is_str() */
+char *format(FeriteScript *script, char *fmt, int count)
+{
+	static char out[1024];
+	FeriteBuffer *buf = ferite_buffer_new(script, 0);
+	FeriteFormat *compiled = ferite_format_get(script, fmt, strlen(fmt));
+	char *flat;
+	int length;
+
+	ferite_format_run(script, buf, compiled, vars, count);
+	ferite_format_release(script, compiled);
+	flat = ferite_buffer_get(script, buf, &length);
+	memcpy(out, flat, length);
+	out[length] = '\0';
+	ffree(flat);
+	ferite_buffer_delete(script, buf);
+	return out;
+}
+
+void set_vars(FeriteScript *script)
+{
+	vars[0] = ferite_create_number_long_variable(script, "l", 42, FE_STATIC);
+	vars[1] = ferite_create_number_double_variable(script, "d", 3.14159, FE_STATIC);
+	vars[2] = ferite_create_string_variable_from_ptr(script, "s", "text", 4, FE_CHARSET_DEFAULT, FE_STATIC);
+	vars[3] = ferite_create_number_long_variable(script, "n", -7, FE_STATIC);
+	vars[4] = NULL;
+}
+
+void free_vars(FeriteScript *script)
+{
+	int i;
+
+	for (i = 0; vars[i] != NULL; i++)
+		ferite_variable_destroy(script, vars[i]);
+}
+
+void test_known_answers(void)
+{
+	FeriteFormat *compiled;
+	FeriteVariable *saved;
+
+	set_vars(NULL);
+	is_str(format(NULL, "%d|%.2f|%s|%d", 4), "42|3.14|text|-7", "One of each");
+	is_str(format(NULL, "[%5d][%-5d][%05d][%+d]", 4), "[   42][3    ][][-7]", "Flags and widths, with a double as an integer and a string as nothing");
+	is_str(format(NULL, "[%6s][%-6s][%.2s]", 0), "[%6s][%-6s][%.2s]", "Directives with nothing to format are left as they are");
+	is_str(format(NULL, "%x %o [%X] %u", 4), "2a 3 [] 18446744073709551609", "A string for %X prints nothing");
+	is_str(format(NULL, "%c%c%c", 3), "*\x03t", "Characters from numbers and strings");
+	saved = vars[0];
+	vars[0] = vars[3];
+	is_str(format(NULL, "%*d|%.*f", 4), "3      |-7.000000", "Widths and precisions from the arguments");
+	vars[0] = saved;
+	is_str(format(NULL, "%n %n", 2), "42 3.141590", "Numbers in their natural form");
+	is_str(format(NULL, "100%% done %", 0), "100% done %", "%% and a lone % at the end");
+	is_str(format(NULL, "%q %lld %hd", 1), "%q 42 %hd", "Bad directives are text, length modifiers are ignored");
+	free_vars(NULL);
+
+	compiled = ferite_format_compile(NULL, "a%sb%%c%5.2fd", 13);
+	is(compiled->count, 6, "A format compiles to literal text and directives");
+	ok(compiled->directives[1].conversion == 's' && compiled->directives[4].conversion == 'f', "... with the conversions picked out");
+	ok(compiled->directives[4].width == 5 && compiled->directives[4].precision == 2, "... and their widths and precisions");
+	ferite_format_destroy(NULL, compiled);
+}
+
+/* Random numeric directives, checked against the C library doing the same job */
+void test_against_snprintf(void)
+{
+	static const char *conversions = "dioxXufeEgG";
+	static const char *flags = "-+ #0";
+	char fmt[64], spec[64], want[512], *got;
+	int i, mismatches = 0, width, precision;
+	long l;
+	double d;
+	char conversion;
+
+	srand(5);
+	for (i = 0; i < SAMPLES; i++) {
+		char *p = fmt, *q = spec;
+		int f;
+
+		*p++ = '%';
+		*q++ = '%';
+		for (f = 0; f < 5; f++) {
+			if (rand() % 4 == 0) {
+				*p++ = flags[f];
+				*q++ = flags[f];
+			}
+		}
+		width = rand() % 3 == 0 ? rand() % 20 : -1;
+		precision = rand() % 3 == 0 ? rand() % 10 : -1;
+		if (width >= 0) {
+			p += sprintf(p, "%d", width);
+			q += sprintf(q, "%d", width);
+		}
+		if (precision >= 0) {
+			p += sprintf(p, ".%d", precision);
+			q += sprintf(q, ".%d", precision);
+		}
+		conversion = conversions[rand() % strlen(conversions)];
+		sprintf(p, "%c", conversion);
+		l = (long)rand() * (rand() % 2 ? 1 : -1) * (rand() % 3 ? 1 : 100000);
+		d = (double)l / (rand() % 1000 + 1);
+		if (strchr("dioxXu", conversion) != NULL) {
+			sprintf(q, "l%c", conversion);
+			snprintf(want, sizeof(want), spec, l);
+			vars[0] = ferite_create_number_long_variable(NULL, "l", l, FE_STATIC);
+		} else {
+			sprintf(q, "%c", conversion);
+			snprintf(want, sizeof(want), spec, d);
+			vars[0] = ferite_create_number_double_variable(NULL, "d", d, FE_STATIC);
+		}
+		vars[1] = NULL;
+		got = format(NULL, fmt, 1);
+		if (strcmp(got, want) != 0 && mismatches++ == 0)
+			diag("first mismatch: '%s' gave '%s', not '%s'", fmt, got, want);
+		free_vars(NULL);
+	}
+	is(mismatches, 0, "Numeric directives agree with snprintf()");
+}
+
+void test_cache(void)
+{
+	FeriteScript *script = ferite_new_script();
+	FeriteFormat *first, *again, *held;
+	char fmt[32];
+	int i;
+
+	first = ferite_format_get(script, "%s=%d\n", 6);
+	again = ferite_format_get(script, "%s=%d\n", 6);
+	ok(first == again && first->cached, "A script keeps the formats it has compiled");
+	ferite_format_release(script, first);
+	ferite_format_release(script, again);
+
+	held = ferite_format_get(script, "%s held\n", 8);
+	for (i = 0; i < FE_FORMAT_CACHE_SIZE + 10; i++) {
+		sprintf(fmt, "%d:%%d", i);
+		ferite_format_release(script, ferite_format_get(script, fmt, strlen(fmt)));
+	}
+	ok(script->formats->count > 0 && script->formats->count <= FE_FORMAT_CACHE_SIZE, "... but only so many of them");
+	again = ferite_format_get(script, fmt, strlen(fmt));
+	ok(again->cached && again->users == 1, "... and once it is full the newest formats are still kept");
+	ferite_format_release(script, again);
+	ok(!held->cached && held->count == 2, "A format emptied out of the cache while in use is left alone");
+	ferite_format_release(script, held);
+	first = ferite_format_get(script, "a\0%d", 4);
+	ok(!first->cached, "Formats with NUL bytes are not kept");
+	ferite_format_release(script, first);
+
+	set_vars(script);
+	is_str(format(script, "%s-%s", 3), "-", "Numbers are not strings, even from the cache");
+	free_vars(script);
+	ferite_script_delete(script);
+}
+
+int main(int argc, char *argv[])
+{
+	ferite_init(argc, argv);
+
+	test_known_answers();
+	test_against_snprintf();
+	test_cache();
+
+	ferite_deinit();
+	return done_testing();
+}
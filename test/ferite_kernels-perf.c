@@ -0,0 +1,331 @@
+#include "tap.h"
+#include "ferite.h"
+#include "test-time.h"
+
+#define MALLOC(x) (ferite_malloc)((x), __FILE__, __LINE__, NULL)
+#define FREE(x) (ferite_free)((x), __FILE__, __LINE__, NULL)
+
+#define TEXT_LENGTH (1024 * 1024)
+#define RUNS 5
+
+typedef size_t (*Runner)(char *out, char *text, size_t length);
+
+char *text, *encoded, *old_out, *new_out;
+size_t encoded_length;
+
+/* Mostly ASCII prose with the odd accented character, the common case */
+void make_text(void)
+{
+	static const char *words[] = { "the ", "quick ", "brown ", "fox ", "caf\xc3\xa9 ", "JUMPS ", "over ", "na\xc3\xafve ", "12 ", "lazy\n" };
+	size_t length = 0;
+
+	text = MALLOC(TEXT_LENGTH + 16);
+	srand(7);
+	while (length + 10 < TEXT_LENGTH) {
+		const char *word = words[rand() % 10];
+		memcpy(text + length, word, strlen(word));
+		length += strlen(word);
+	}
+	while (length < TEXT_LENGTH)
+		text[length++] = ' ';
+	text[length] = '\0';
+	old_out = MALLOC(TEXT_LENGTH * 6 + 16);
+	new_out = MALLOC(TEXT_LENGTH * 6 + 16);
+}
+
+/* What the String module did before the kernels */
+
+size_t old_lower(char *out, char *text, size_t length)
+{
+	size_t i;
+
+	memcpy(out, text, length);
+	for (i = 0; i < length; i++)
+		out[i] = tolower(out[i]);
+	return length;
+}
+
+size_t old_reverse(char *out, char *text, size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++)
+		out[i] = text[length - 1 - i];
+	return length;
+}
+
+size_t old_trim(char *out, char *text, size_t length)
+{
+	const char *delims = " \t\n\r";
+	size_t i, j, total = 0;
+
+	/* Trim every line, as a config or log reader would */
+	for (i = 0; i < length; i = j + 1) {
+		size_t start, end;
+		for (j = i; j < length && text[j] != '\n'; j++)
+			;
+		for (start = i; start < j && strchr(delims, text[start]) != NULL; start++)
+			;
+		for (end = j; end > start && strchr(delims, text[end - 1]) != NULL; end--)
+			;
+		total += end - start;
+	}
+	(void)out;
+	return total;
+}
+
+size_t old_base64_encode(char *out, char *text, size_t length)
+{
+	static unsigned char dtable[64];
+	FeriteBuffer *output = ferite_buffer_new(NULL, length * 2);
+	size_t loc, n;
+	char *flat;
+	int i, c, count;
+
+	for (i = 0; i < 26; i++) {
+		dtable[i] = 'A' + i;
+		dtable[26 + i] = 'a' + i;
+	}
+	for (i = 0; i < 10; i++)
+		dtable[52 + i] = '0' + i;
+	dtable[62] = '+';
+	dtable[63] = '/';
+
+	for (loc = 0; loc < length; ) {
+		unsigned char igroup[3], ogroup[4];
+
+		igroup[0] = igroup[1] = igroup[2] = 0;
+		for (n = 0; n < 3 && loc < length; n++, loc++) {
+			c = text[loc];
+			igroup[n] = (unsigned char)c;
+		}
+		if (n > 0) {
+			ogroup[0] = dtable[igroup[0] >> 2];
+			ogroup[1] = dtable[((igroup[0] & 3) << 4) | (igroup[1] >> 4)];
+			ogroup[2] = dtable[((igroup[1] & 0xF) << 2) | (igroup[2] >> 6)];
+			ogroup[3] = dtable[igroup[2] & 0x3F];
+			if (n < 3) {
+				ogroup[3] = '=';
+				if (n < 2)
+					ogroup[2] = '=';
+			}
+			for (i = 0; i < 4; i++)
+				ferite_buffer_add_char(NULL, output, ogroup[i]);
+		}
+	}
+	flat = ferite_buffer_get(NULL, output, &count);
+	memcpy(out, flat, count);
+	FREE(flat);
+	ferite_buffer_delete(NULL, output);
+	return count;
+}
+
+size_t old_base64_decode(char *out, char *text, size_t length)
+{
+	static unsigned char dtable[256];
+	FeriteBuffer *output = ferite_buffer_new(NULL, length * 2);
+	size_t loc;
+	char *flat;
+	int i, j, n;
+
+	for (i = 0; i < 256; i++)
+		dtable[i] = 0x80;
+	for (i = 0; i < 26; i++) {
+		dtable['A' + i] = i;
+		dtable['a' + i] = 26 + i;
+	}
+	for (i = 0; i < 10; i++)
+		dtable['0' + i] = 52 + i;
+	dtable['+'] = 62;
+	dtable['/'] = 63;
+	dtable['='] = 0;
+
+	for (loc = 0; loc < length; ) {
+		unsigned char a[4], b[4], o[3];
+
+		for (i = 0; i < 4 && loc < length; i++, loc++) {
+			int c = (unsigned char)text[loc];
+			a[i] = (unsigned char)c;
+			b[i] = dtable[c];
+		}
+		o[0] = (b[0] << 2) | (b[1] >> 4);
+		o[1] = (b[1] << 4) | (b[2] >> 2);
+		o[2] = (b[2] << 6) | b[3];
+		i = a[2] == '=' ? 1 : (a[3] == '=' ? 2 : 3);
+		for (j = 0; j < i; j++)
+			ferite_buffer_add_char(NULL, output, o[j]);
+		if (i < 3)
+			break;
+	}
+	flat = ferite_buffer_get(NULL, output, &n);
+	memcpy(out, flat, n);
+	FREE(flat);
+	ferite_buffer_delete(NULL, output);
+	return n;
+}
+
+/* The script version of String.utf8Length(), byte by byte, in C */
+size_t old_utf8_length(char *out, char *text, size_t length)
+{
+	size_t i, count = 0;
+
+	for (i = 0; i < length; i++) {
+		unsigned char b1 = text[i];
+		unsigned char b2 = (i + 1 < length ? text[i + 1] : 0);
+		unsigned char b3 = (i + 2 < length ? text[i + 2] : 0);
+		unsigned char b4 = (i + 3 < length ? text[i + 3] : 0);
+
+		if ((b1 & 0xC0) == 0xC0) {
+			if ((b1 & 0xF0) == 0xF0 && (b2 & 0x80) && (b3 & 0x80) && (b4 & 0x80))
+				i += 3;
+			else if ((b1 & 0xE0) == 0xE0 && (b2 & 0x80) && (b3 & 0x80))
+				i += 2;
+			else if (b2 & 0x80)
+				i += 1;
+		}
+		count++;
+	}
+	(void)out;
+	return count;
+}
+
+/* The script version of String.urlEncode() for well formed text, in C */
+size_t old_url_encode(char *out, char *text, size_t length)
+{
+	static const char *unreserved = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz-_.~";
+	static const char *hex = "0123456789ABCDEF";
+	size_t i, n = 0;
+
+	for (i = 0; i < length; i++) {
+		unsigned char c = text[i];
+		if (c != '\0' && strchr(unreserved, c) != NULL) {
+			out[n++] = c;
+		} else {
+			out[n++] = '%';
+			out[n++] = hex[c >> 4];
+			out[n++] = hex[c & 0xF];
+		}
+	}
+	return n;
+}
+
+/* ... and the kernels doing the same jobs */
+
+size_t new_lower(char *out, char *text, size_t length)
+{
+	ferite_kernel_lower(out, text, length);
+	return length;
+}
+
+size_t new_reverse(char *out, char *text, size_t length)
+{
+	ferite_kernel_reverse(out, text, length);
+	return length;
+}
+
+size_t new_trim(char *out, char *text, size_t length)
+{
+	const char *delims = " \t\n\r";
+	size_t i, j, total = 0;
+
+	for (i = 0; i < length; i = j + 1) {
+		size_t start, end;
+		j = i + ferite_kernel_scan(text + i, length - i, "\n", 1);
+		start = ferite_kernel_span(text + i, j - i, delims, 4);
+		end = (j - i) - ferite_kernel_span_back(text + i + start, j - i - start, delims, 4);
+		total += end - start;
+	}
+	(void)out;
+	return total;
+}
+
+size_t new_base64_encode(char *out, char *text, size_t length)
+{
+	return ferite_kernel_base64_encode(out, text, length);
+}
+
+size_t new_base64_decode(char *out, char *text, size_t length)
+{
+	return ferite_kernel_base64_decode(out, text, length);
+}
+
+size_t new_utf8_length(char *out, char *text, size_t length)
+{
+	(void)out;
+	return ferite_kernel_utf8_length(text, length);
+}
+
+size_t new_url_encode(char *out, char *text, size_t length)
+{
+	return ferite_kernel_url_encode(out, text, length);
+}
+
+/* The best of a few runs, so one slow run does not decide it */
+unsigned long time_runner(Runner runner, char *out, char *input, size_t length, size_t *result)
+{
+	unsigned long best = 0, start, duration;
+	int i;
+
+	*result = runner(out, input, length);
+	for (i = 0; i < RUNS; i++) {
+		start = get_time_nanos();
+		*result = runner(out, input, length);
+		duration = get_time_nanos() - start;
+		if (i == 0 || duration < best)
+			best = duration;
+	}
+	return best ? best : 1;
+}
+
+double compare(char *name, Runner old_runner, Runner new_runner, char *input, size_t length, int same_output)
+{
+	unsigned long old_duration, new_duration;
+	size_t old_result, new_result;
+	double ratio;
+
+	old_duration = time_runner(old_runner, old_out, input, length, &old_result);
+	new_duration = time_runner(new_runner, new_out, input, length, &new_result);
+	if (same_output)
+		ok(old_result == new_result && memcmp(old_out, new_out, old_result) == 0, "%s: old and new give the same output", name);
+	else
+		is(new_result, old_result, "%s: old and new give the same answer", name);
+	ratio = (double)old_duration / new_duration;
+	diag("%-14s old %8lu us, new %8lu us, %.2fx", name, old_duration / 1000, new_duration / 1000, ratio);
+	return ratio;
+}
+
+void test_kernels(void)
+{
+	double ratio;
+
+	diag("using %s kernels on %d bytes", ferite_kernel_name(ferite_kernel_kind()), TEXT_LENGTH);
+
+	compare("toLower", old_lower, new_lower, text, TEXT_LENGTH, 1);
+	compare("reverse", old_reverse, new_reverse, text, TEXT_LENGTH, 1);
+	compare("trim", old_trim, new_trim, text, TEXT_LENGTH, 0);
+	compare("utf8Length", old_utf8_length, new_utf8_length, text, TEXT_LENGTH, 0);
+	compare("urlEncode", old_url_encode, new_url_encode, text, TEXT_LENGTH, 1);
+
+	/* The old base64 code went through the buffer a character at a time */
+	ratio = compare("base64encode", old_base64_encode, new_base64_encode, text, TEXT_LENGTH, 1);
+	ok(ratio > 1, "base64encode is faster: %f", ratio);
+	encoded = MALLOC(TEXT_LENGTH * 2);
+	encoded_length = ferite_kernel_base64_encode(encoded, text, TEXT_LENGTH);
+	ratio = compare("base64decode", old_base64_decode, new_base64_decode, encoded, encoded_length, 1);
+	ok(ratio > 1, "base64decode is faster: %f", ratio);
+	FREE(encoded);
+}
+
+int main(int argc, char *argv[])
+{
+	ferite_init(argc, argv);
+	make_text();
+
+	test_kernels();
+
+	FREE(text);
+	FREE(old_out);
+	FREE(new_out);
+	ferite_deinit();
+	return done_testing();
+}
@@ -0,0 +1,203 @@
+#include "tap.h"
+#include "ferite.h"
+
+#define SAMPLES 2000
+#define MAX_LENGTH 300
+
+int kinds[] = { FE_KERNEL_SSE2, FE_KERNEL_AVX2 };
+
+/* Random text with more of the interesting bytes than chance would give */
+size_t make_sample(char *buffer, unsigned int seed)
+{
+	static const char interesting[] = "aZ09 \t\n\\\"'?=+/-_.~%\x80\xbf\xc2\xc3\xa9\xe0\xe2\x82\xac\xed\xa0\xf0\x90\xf4\x8f\xff";
+	size_t length, i;
+
+	srand(seed);
+	length = rand() % MAX_LENGTH;
+	for (i = 0; i < length; i++) {
+		switch (rand() % 4) {
+			case 0: buffer[i] = (char)(rand() % 256); break;
+			case 1: buffer[i] = interesting[rand() % (sizeof(interesting) - 1)]; break;
+			default: buffer[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[rand() % 64]; break;
+		}
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+/* What every kernel gives for one sample, compared as a whole */
+size_t run_kernels(char *out, char *data, size_t length)
+{
+	char buffer[MAX_LENGTH * 6 + 64], *p = out;
+	long found;
+	size_t n;
+
+	ferite_kernel_lower(buffer, data, length);
+	memcpy(p, buffer, length); p += length;
+	ferite_kernel_upper(buffer, data, length);
+	memcpy(p, buffer, length); p += length;
+	ferite_kernel_reverse(buffer, data, length);
+	memcpy(p, buffer, length); p += length;
+	found = ferite_kernel_find(data, length, data + length / 2, length / 7);
+	p += sprintf(p, "[%ld]", found);
+	found = ferite_kernel_find(data, length, "\xe2\x82\xac", 3);
+	p += sprintf(p, "[%ld]", found);
+	p += sprintf(p, "[%lu]", (unsigned long)ferite_kernel_scan(data, length, "\\\"'?", 4));
+	p += sprintf(p, "[%lu]", (unsigned long)ferite_kernel_scan(data, length, "ABCDEFGHIJKLMNOPQRSTUVWXYZ", 26));
+	p += sprintf(p, "[%lu]", (unsigned long)ferite_kernel_span(data, length, "abcdefghijklmnopqrstuvwxyz+/", 28));
+	p += sprintf(p, "[%lu]", (unsigned long)ferite_kernel_span(data, length, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz", 52));
+	p += sprintf(p, "[%lu]", (unsigned long)ferite_kernel_span_back(data, length, "0123456789+/", 12));
+	p += sprintf(p, "[%lu]", (unsigned long)ferite_kernel_span_printable(data, length, "\\\"'?", 4));
+	n = ferite_kernel_base64_encode(buffer, data, length);
+	memcpy(p, buffer, n); p += n;
+	n = ferite_kernel_base64_decode(buffer, data, length);
+	memcpy(p, buffer, n); p += n;
+	p += sprintf(p, "[%d]", ferite_kernel_utf8_valid(data, length));
+	p += sprintf(p, "[%lu]", (unsigned long)ferite_kernel_utf8_length(data, length));
+	p += sprintf(p, "[%ld]", ferite_kernel_utf8_detect(data, length));
+	n = ferite_kernel_url_encode(buffer, data, length);
+	memcpy(p, buffer, n); p += n;
+	p += sprintf(p, "[%lu]", (unsigned long)ferite_kernel_url_encode(NULL, data, length));
+	return p - out;
+}
+
+void test_known_answers(void)
+{
+	char buffer[256];
+	size_t n;
+
+	ferite_kernel_lower(buffer, "Hello WORLD, it's 42!", 22);
+	is_str(buffer, "hello world, it's 42!", "Lower case");
+	ferite_kernel_upper(buffer, "Hello world, it's 42!", 22);
+	is_str(buffer, "HELLO WORLD, IT'S 42!", "Upper case");
+	ferite_kernel_reverse(buffer, "gninnuc", 7);
+	buffer[7] = '\0';
+	is_str(buffer, "cunning", "Reverse");
+	is(ferite_kernel_find("Hello World", 11, "World", 5), 6, "Find a word");
+	is(ferite_kernel_find("Hello World", 11, "world", 5), -1, "Find is case sensitive");
+	is(ferite_kernel_find("Hello", 5, "", 0), 0, "An empty needle is found at the start");
+	is(ferite_kernel_find("a\0b\0c", 5, "\0c", 2), 3, "Find copes with NUL bytes");
+	is(ferite_kernel_scan("key = value", 11, "=:", 2), 4, "Scan for delimiters");
+	is(ferite_kernel_span(" \t trimmed", 10, " \t", 2), 3, "Span of leading delimiters");
+	is(ferite_kernel_span_back("trimmed \n ", 10, " \n", 2), 3, "Span of trailing delimiters");
+	is(ferite_kernel_span_printable("plain \"quoted\"", 14, "\"", 1), 6, "Span of printable characters");
+
+	n = ferite_kernel_base64_encode(buffer, "Hello World From Ferite", 23);
+	buffer[n] = '\0';
+	is_str(buffer, "SGVsbG8gV29ybGQgRnJvbSBGZXJpdGU=", "Base64 encode with padding");
+	n = ferite_kernel_base64_decode(buffer, "SGVsbG8gV29ybGQgRnJvbSBGZXJpdGU=", 32);
+	buffer[n] = '\0';
+	is_str(buffer, "Hello World From Ferite", "Base64 decode with padding");
+	n = ferite_kernel_base64_decode(buffer, "SGk", 3);
+	buffer[n] = '\0';
+	is_str(buffer, "Hi", "A short last group is read as if padded");
+
+	ok(ferite_kernel_utf8_valid("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", 14), "Well formed UTF-8 is valid");
+	ok(!ferite_kernel_utf8_valid("\xc0\xaf", 2), "Overlong forms are not");
+	ok(!ferite_kernel_utf8_valid("\xed\xa0\x80", 3), "Surrogates are not");
+	ok(!ferite_kernel_utf8_valid("\xf4\x90\x80\x80", 4), "Code points past U+10FFFF are not");
+	ok(!ferite_kernel_utf8_valid("abc\xe2\x82", 5), "Sequences cut short are not");
+	is(ferite_kernel_utf8_length("caf\xc3\xa9 \xe2\x82\xac", 9), 6, "Characters are counted");
+	is(ferite_kernel_utf8_length("\xc3\xa9\xa9", 3), 2, "Stray continuation bytes count on their own");
+	is(ferite_kernel_utf8_detect("plain caf\xc3\xa9", 11), 9, "A multi byte character is detected");
+	is(ferite_kernel_utf8_detect("plain \xc3", 7), -1, "A lead byte at the end is not");
+
+	n = ferite_kernel_url_encode(buffer, "a b&c=d/caf\xc3\xa9~", 14);
+	buffer[n] = '\0';
+	is_str(buffer, "a%20b%26c%3Dd%2Fcaf%C3%A9~", "URL encoding");
+	n = ferite_kernel_url_encode(buffer, "\xe9", 1);
+	buffer[n] = '\0';
+	is_str(buffer, "%C3%A9", "A stray high byte is taken as Latin-1");
+}
+
+void test_kinds_agree(void)
+{
+	static char data[MAX_LENGTH + 1], want[MAX_LENGTH * 24 + 512], got[MAX_LENGTH * 24 + 512];
+	size_t i, k, length, want_length, got_length;
+	int mismatches;
+
+	for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+		if (ferite_kernel_select(kinds[k]) < 0) {
+			diag("%s kernels are not available here", ferite_kernel_name(kinds[k]));
+			continue;
+		}
+		mismatches = 0;
+		for (i = 0; i < SAMPLES; i++) {
+			length = make_sample(data, (unsigned int)i);
+			ferite_kernel_select(FE_KERNEL_SCALAR);
+			want_length = run_kernels(want, data, length);
+			ferite_kernel_select(kinds[k]);
+			got_length = run_kernels(got, data, length);
+			if (want_length != got_length || memcmp(want, got, want_length) != 0) {
+				if (mismatches++ == 0)
+					diag("first mismatch on sample %lu", (unsigned long)i);
+			}
+		}
+		is(mismatches, 0, "%s kernels give the same answers as the scalar ones", ferite_kernel_name(kinds[k]));
+	}
+	ferite_kernel_select(FE_KERNEL_AUTO);
+}
+
+/* Long runs of well formed text, where the block at a time paths do all the work */
+void test_long_text(void)
+{
+	static char data[64 * 1024], want[64 * 1024 * 3], got[64 * 1024 * 3];
+	static const char *pieces[] = { "plain ascii text ", "caf\xc3\xa9 ", "\xe2\x82\xac", "\xf0\x9f\x98\x80" };
+	static char broken[64 * 1024];
+	size_t length = 0, k, want_length, got_length, i, at;
+	int mismatches;
+
+	srand(42);
+	while (length + 32 < sizeof(data)) {
+		const char *piece = pieces[rand() % 4];
+		memcpy(data + length, piece, strlen(piece));
+		length += strlen(piece);
+	}
+	/* So that cutting off the last byte leaves half a character */
+	memcpy(data + length, pieces[2], 3);
+	length += 3;
+
+	for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+		if (ferite_kernel_select(kinds[k]) < 0)
+			continue;
+		ok(ferite_kernel_utf8_valid(data, length), "%s: long UTF-8 text is valid", ferite_kernel_name(kinds[k]));
+		ok(!ferite_kernel_utf8_valid(data, length - 1), "%s: ... and cutting the last byte off breaks it", ferite_kernel_name(kinds[k]));
+
+		ferite_kernel_select(FE_KERNEL_SCALAR);
+		want_length = ferite_kernel_base64_encode(want, data, length);
+		ferite_kernel_select(kinds[k]);
+		got_length = ferite_kernel_base64_encode(got, data, length);
+		ok(want_length == got_length && memcmp(want, got, want_length) == 0, "%s: base64 encoding agrees", ferite_kernel_name(kinds[k]));
+		got_length = ferite_kernel_base64_decode(got, want, want_length);
+		ok(got_length == length && memcmp(got, data, length) == 0, "%s: base64 decoding gives the text back", ferite_kernel_name(kinds[k]));
+
+		/* One bad byte anywhere has to be noticed, whichever block it lands in */
+		mismatches = 0;
+		for (i = 0; i < 500; i++) {
+			memcpy(broken, data, length);
+			at = rand() % length;
+			broken[at] = (char)(rand() % 256);
+			ferite_kernel_select(FE_KERNEL_SCALAR);
+			want_length = ferite_kernel_utf8_valid(broken, length) * 1000000 + ferite_kernel_utf8_length(broken, length);
+			ferite_kernel_select(kinds[k]);
+			got_length = ferite_kernel_utf8_valid(broken, length) * 1000000 + ferite_kernel_utf8_length(broken, length);
+			if (want_length != got_length && mismatches++ == 0)
+				diag("first mismatch with byte %lu set to %02x", (unsigned long)at, (unsigned char)broken[at]);
+		}
+		is(mismatches, 0, "%s: damaged text is judged the same as by the scalar kernels", ferite_kernel_name(kinds[k]));
+	}
+	ferite_kernel_select(FE_KERNEL_AUTO);
+}
+
+int main(int argc, char *argv[])
+{
+	ferite_init(argc, argv);
+	diag("using %s kernels", ferite_kernel_name(ferite_kernel_kind()));
+
+	test_known_answers();
+	test_kinds_agree();
+	test_long_text();
+
+	ferite_deinit();
+	return done_testing();
+}
@@ -0,0 +1,127 @@
+#include "tap.h"
+#include "ferite.h"
+#include "test-time.h"
+
+#define MALLOC(x) (ferite_malloc)((x), __FILE__, __LINE__, NULL)
+#define FREE(x) (ferite_free)((x), __FILE__, __LINE__, NULL)
+
+#define TEXT_LENGTH (1024 * 1024)
+#define KEYWORDS 300
+#define RUNS 3
+
+char *text, *keywords[KEYWORDS];
+size_t lengths[KEYWORDS];
+
+/* Made up words, so that most of them are rare in the text and a few are common */
+void make_keywords(void)
+{
+	static const char *syllables[] = { "ka", "lo", "mi", "ne", "ru", "ta", "so", "vi", "de", "po" };
+	int i, j, parts;
+
+	srand(3);
+	for (i = 0; i < KEYWORDS; i++) {
+		keywords[i] = MALLOC(32);
+		keywords[i][0] = '\0';
+		parts = 2 + rand() % 3;
+		for (j = 0; j < parts; j++)
+			strcat(keywords[i], syllables[rand() % 10]);
+		lengths[i] = strlen(keywords[i]);
+	}
+}
+
+void make_text(void)
+{
+	size_t length = 0;
+	int word;
+
+	text = MALLOC(TEXT_LENGTH + 64);
+	while (length + 40 < TEXT_LENGTH) {
+		word = rand() % (KEYWORDS * 20);
+		if (word < KEYWORDS) {
+			memcpy(text + length, keywords[word], lengths[word]);
+			length += lengths[word];
+		} else {
+			memcpy(text + length, "message text ", 13);
+			length += 13;
+		}
+		text[length++] = ' ';
+	}
+	while (length < TEXT_LENGTH)
+		text[length++] = ' ';
+}
+
+/* What a script does today: look for each keyword in turn */
+size_t old_count(void)
+{
+	size_t found = 0, at;
+	long hit;
+	int i;
+
+	for (i = 0; i < KEYWORDS; i++) {
+		for (at = 0; at < TEXT_LENGTH; at += hit + 1) {
+			hit = ferite_kernel_find(text + at, TEXT_LENGTH - at, keywords[i], lengths[i]);
+			if (hit < 0)
+				break;
+			found++;
+		}
+	}
+	return found;
+}
+
+FeriteMatcher *matcher;
+
+size_t new_count(void)
+{
+	return ferite_matcher_scan(matcher, text, TEXT_LENGTH, NULL, NULL);
+}
+
+unsigned long best_of(size_t (*runner)(void), size_t *result)
+{
+	unsigned long best = 0, start, duration;
+	int i;
+
+	for (i = 0; i < RUNS; i++) {
+		start = get_time_nanos();
+		*result = runner();
+		duration = get_time_nanos() - start;
+		if (i == 0 || duration < best)
+			best = duration;
+	}
+	return best ? best : 1;
+}
+
+void test_keywords(void)
+{
+	unsigned long old_duration, new_duration, start;
+	size_t old_result, new_result;
+	double ratio;
+
+	start = get_time_nanos();
+	matcher = ferite_matcher_create(NULL, keywords, lengths, KEYWORDS, 0);
+	diag("%d keywords compiled into %d states in %lu us", KEYWORDS, matcher->states, (get_time_nanos() - start) / 1000);
+
+	old_duration = best_of(old_count, &old_result);
+	new_duration = best_of(new_count, &new_result);
+	is(new_result, old_result, "The matcher finds as many keywords as searching for each in turn");
+	ratio = (double)old_duration / new_duration;
+	diag("keywords       old %8lu us, new %8lu us, %.2fx", old_duration / 1000, new_duration / 1000, ratio);
+	ok(ratio > 1, "The matcher is faster: %f", ratio);
+	ferite_matcher_destroy(NULL, matcher);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	ferite_init(argc, argv);
+	make_keywords();
+	make_text();
+
+	test_keywords();
+
+	for (i = 0; i < KEYWORDS; i++)
+		FREE(keywords[i]);
+	FREE(text);
+	ferite_deinit();
+	return done_testing();
+}
@@ -0,0 +1,219 @@
+#include "tap.h"
+#include "ferite.h"
+#include "aphex.h"
+
+#define SAMPLES   2000
+#define PATTERNS  12
+#define MAX_MATCHES 4096
+#define THREADS   4
+
+struct Found {
+	int count;
+	int pattern[MAX_MATCHES];
+	size_t offset[MAX_MATCHES];
+};
+
+int record(FeriteMatcher *matcher, int pattern, size_t offset, void *data)
+{
+	struct Found *found = data;
+
+	if (found->count < MAX_MATCHES) {
+		found->pattern[found->count] = pattern;
+		found->offset[found->count] = offset;
+	}
+	found->count++;
+	return 0;
+}
+
+int stop_at_second(FeriteMatcher *matcher, int pattern, size_t offset, void *data)
+{
+	return ++*(int *)data == 2;
+}
+
+char fold(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+int same_text(const char *a, const char *b, size_t length, int ignore_case)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		if (ignore_case ? fold(a[i]) != fold(b[i]) : a[i] != b[i])
+			return 0;
+	}
+	return 1;
+}
+
+/* Every pattern tried at every place, listed the way the matcher lists them */
+void brute_force(struct Found *found, char **patterns, size_t *lengths, int count, const char *text, size_t length, int ignore_case)
+{
+	size_t end, longest = 0, l;
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (lengths[i] > longest)
+			longest = lengths[i];
+	found->count = 0;
+	for (end = 1; end <= length; end++) {
+		for (l = longest; l > 0; l--) {
+			for (i = 0; i < count; i++) {
+				if (lengths[i] == l && l <= end && same_text(patterns[i], text + end - l, l, ignore_case))
+					record(NULL, i, end - l, found);
+			}
+		}
+	}
+}
+
+int same_found(struct Found *a, struct Found *b)
+{
+	int i;
+
+	if (a->count != b->count)
+		return 0;
+	for (i = 0; i < a->count && i < MAX_MATCHES; i++) {
+		if (a->pattern[i] != b->pattern[i] || a->offset[i] != b->offset[i])
+			return 0;
+	}
+	return 1;
+}
+
+void test_known_answers(void)
+{
+	char *patterns[] = { "he", "she", "his", "hers", "", "she" };
+	size_t lengths[] = { 2, 3, 3, 4, 0, 3 };
+	FeriteMatcher *matcher = ferite_matcher_create(NULL, patterns, lengths, 6, 0);
+	struct Found found;
+	int calls = 0;
+
+	found.count = 0;
+	is(ferite_matcher_scan(matcher, "ushers", 6, record, &found), 4, "All the matches in ushers are found");
+	ok(found.pattern[0] == 1 && found.offset[0] == 1, "... she first");
+	ok(found.pattern[1] == 5 && found.offset[1] == 1, "... then the same text again under its own number");
+	ok(found.pattern[2] == 0 && found.offset[2] == 2, "... then he, which ends in the same place");
+	ok(found.pattern[3] == 3 && found.offset[3] == 2, "... then hers");
+	is(ferite_matcher_scan(matcher, "HERS", 4, NULL, NULL), 0, "Case matters by default");
+	is(ferite_matcher_scan(matcher, "", 0, NULL, NULL), 0, "Nothing is found in nothing");
+	is(ferite_matcher_scan(matcher, "she said his", 12, stop_at_second, &calls), 2, "The callback can stop the scan");
+	ferite_matcher_destroy(NULL, matcher);
+
+	matcher = ferite_matcher_create(NULL, patterns, lengths, 6, FE_MATCHER_IGNORE_CASE);
+	is(ferite_matcher_scan(matcher, "uSHeRS", 6, NULL, NULL), 4, "Case can be ignored");
+	ferite_matcher_destroy(NULL, matcher);
+
+	matcher = ferite_matcher_create(NULL, patterns + 4, lengths + 4, 1, 0);
+	is(ferite_matcher_scan(matcher, "anything", 8, NULL, NULL), 0, "An empty pattern never matches");
+	ferite_matcher_destroy(NULL, matcher);
+
+	patterns[0] = "a\0b";
+	lengths[0] = 3;
+	matcher = ferite_matcher_create(NULL, patterns, lengths, 1, 0);
+	is(ferite_matcher_scan(matcher, "xa\0bya\0b", 8, NULL, NULL), 2, "Patterns and text can contain NUL bytes");
+	ferite_matcher_destroy(NULL, matcher);
+}
+
+/* Random patterns from a small alphabet, so that there are plenty of overlapping matches */
+void make_patterns(char store[PATTERNS][8], char **patterns, size_t *lengths, const char *alphabet)
+{
+	int i;
+	size_t j;
+
+	for (i = 0; i < PATTERNS; i++) {
+		if (i > 0 && rand() % 8 == 0) {
+			memcpy(store[i], store[i - 1], sizeof(store[i]));
+			lengths[i] = lengths[i - 1];
+		} else {
+			lengths[i] = rand() % 6;
+			for (j = 0; j < lengths[i]; j++)
+				store[i][j] = alphabet[rand() % strlen(alphabet)];
+		}
+		patterns[i] = store[i];
+	}
+}
+
+void test_against_brute_force(void)
+{
+	static const char *alphabet = "abcAB\xff";
+	char store[PATTERNS][8], *patterns[PATTERNS], text[256];
+	size_t lengths[PATTERNS], length, j;
+	struct Found want, got;
+	int i, flags, mismatches[2] = { 0, 0 };
+
+	srand(11);
+	for (i = 0; i < SAMPLES; i++) {
+		make_patterns(store, patterns, lengths, alphabet);
+		length = rand() % sizeof(text);
+		for (j = 0; j < length; j++)
+			text[j] = (rand() % 10 == 0) ? (char)(rand() % 256) : alphabet[rand() % strlen(alphabet)];
+		for (flags = 0; flags < 2; flags++) {
+			FeriteMatcher *matcher = ferite_matcher_create(NULL, patterns, lengths, PATTERNS, flags);
+
+			brute_force(&want, patterns, lengths, PATTERNS, text, length, flags);
+			got.count = 0;
+			ferite_matcher_scan(matcher, text, length, record, &got);
+			if (!same_found(&want, &got) && mismatches[flags]++ == 0)
+				diag("first mismatch on sample %d: %d matches wanted, %d found", i, want.count, got.count);
+			ferite_matcher_destroy(NULL, matcher);
+		}
+	}
+	is(mismatches[0], 0, "The matcher finds what trying every pattern everywhere does");
+	is(mismatches[1], 0, "... and the same when ignoring case");
+}
+
+struct Worker {
+	AphexThread *thread;
+	FeriteMatcher *matcher;
+	const char *text;
+	size_t length;
+	size_t found;
+};
+
+void *run_worker(void *arg)
+{
+	struct Worker *worker = arg;
+	int i;
+
+	worker->found = 0;
+	for (i = 0; i < 200; i++)
+		worker->found += ferite_matcher_scan(worker->matcher, worker->text, worker->length, NULL, NULL);
+	return NULL;
+}
+
+void test_threads(void)
+{
+	char *patterns[] = { "error", "fail", "warn", "timeout" };
+	size_t lengths[] = { 5, 4, 4, 7 };
+	const char *text = "warning: request failed with a timeout error, will retry after the timeout";
+	struct Worker workers[THREADS];
+	FeriteMatcher *matcher = ferite_matcher_create(NULL, patterns, lengths, 4, 0);
+	size_t expected = ferite_matcher_scan(matcher, text, strlen(text), NULL, NULL);
+	int i;
+
+	is(expected, 5, "A matcher finds every keyword in a log line");
+	for (i = 0; i < THREADS; i++) {
+		workers[i].matcher = matcher;
+		workers[i].text = text;
+		workers[i].length = strlen(text);
+		workers[i].thread = aphex_thread_create();
+		aphex_thread_start(workers[i].thread, run_worker, &workers[i], FE_FALSE);
+	}
+	for (i = 0; i < THREADS; i++) {
+		aphex_thread_join(workers[i].thread);
+		aphex_thread_destroy(workers[i].thread);
+		is(workers[i].found, expected * 200, "Thread %d: the shared matcher gives the same answers", i);
+	}
+	ferite_matcher_destroy(NULL, matcher);
+}
+
+int main(int argc, char *argv[])
+{
+	ferite_init(argc, argv);
+
+	test_known_answers();
+	test_against_brute_force();
+	test_threads();
+
+	ferite_deinit();
+	return done_testing();
+}
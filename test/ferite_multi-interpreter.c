@@ -0,0 +1,160 @@
+#include "tap.h"
+#include "ferite.h"
+#include "aphex.h"
+
+#define THREADS    4
+#define ITERATIONS 20
+#define HANDOFF    1000
+
+/* Each thread compiles its own variant of this, so that both the compiler and the engine are
+ * busy in several threads at once */
+#define SCRIPT_TEMPLATE \
+	"class Tally%d {\n" \
+	"    number total;\n" \
+	"    function constructor( number start ) { .total = start; }\n" \
+	"    function add( number n ) { .total += n; return self; }\n" \
+	"}\n" \
+	"function twice%d( number n ) { return n * 2; }\n" \
+	"number i;\n" \
+	"object t = new Tally%d( %d );\n" \
+	"array a;\n" \
+	"for( i = 0; i < 100; i++ ) { t.add( i ); a[] = twice%d( i ); }\n" \
+	"return t.total + a[99];\n"
+
+struct Worker {
+	AphexThread *thread;
+	int seed;
+	int compiled;
+	int executed;
+	int correct;
+};
+
+void *run_worker(void *arg)
+{
+	struct Worker *worker = arg;
+	char source[1024];
+	int i;
+
+	for (i = 0; i < ITERATIONS; i++) {
+		FeriteScript *script;
+		int seed = worker->seed + i;
+
+		snprintf(source, sizeof(source), SCRIPT_TEMPLATE, seed, seed, seed, seed, seed);
+		script = ferite_compile_string(source);
+		if (script == NULL)
+			continue;
+		if (!ferite_has_compile_error(script)) {
+			worker->compiled++;
+			if (ferite_script_execute(script)) {
+				worker->executed++;
+				/* seed + (0 + ... + 99) + 2 * 99 */
+				if (script->return_value == (unsigned int)(seed + 4950 + 198))
+					worker->correct++;
+			}
+		}
+		ferite_script_delete(script);
+	}
+	return NULL;
+}
+
+void test_parallel_scripts()
+{
+	struct Worker workers[THREADS];
+	int i;
+
+	for (i = 0; i < THREADS; i++) {
+		workers[i].seed = (i + 1) * 1000;
+		workers[i].compiled = workers[i].executed = workers[i].correct = 0;
+		workers[i].thread = aphex_thread_create();
+		aphex_thread_start(workers[i].thread, run_worker, &workers[i], FE_FALSE);
+	}
+	for (i = 0; i < THREADS; i++) {
+		aphex_thread_join(workers[i].thread);
+		aphex_thread_destroy(workers[i].thread);
+		is(workers[i].compiled, ITERATIONS, "Thread %d: every script compiled", i);
+		is(workers[i].executed, ITERATIONS, "Thread %d: every script ran", i);
+		is(workers[i].correct, ITERATIONS, "Thread %d: every script returned its own answer", i);
+	}
+}
+
+void test_after_threads()
+{
+	/* Memory handed back by the finished threads must be usable from this one; the compiler
+	 * normalises the source in place, so it cannot be a literal */
+	char source[] = "number n = 0; while( n < 1000 ) { n++; } return n;";
+	FeriteScript *script = ferite_compile_string(source);
+
+	ok(script != NULL && !ferite_has_compile_error(script), "Compile after threads finished");
+	if (script != NULL) {
+		ok(ferite_script_execute(script), "Execute after threads finished");
+		is(script->return_value, 1000, "Result after threads finished");
+		ferite_script_delete(script);
+	}
+}
+
+struct Handoff {
+	void *blocks[HANDOFF];
+	AphexMutex *hold;
+	int freed;
+};
+
+void *free_blocks(void *arg)
+{
+	struct Handoff *handoff = arg;
+	int i;
+
+	for (i = 0; i < HANDOFF; i++)
+		ffree_ngc(handoff->blocks[i]);
+	__atomic_store_n(&handoff->freed, FE_TRUE, __ATOMIC_RELEASE);
+	/* Stay alive, so nothing gets handed back just because this thread finished */
+	aphex_mutex_lock(handoff->hold);
+	aphex_mutex_unlock(handoff->hold);
+	return NULL;
+}
+
+void test_cross_thread_free()
+{
+	struct Handoff handoff;
+	AphexThread *thread = aphex_thread_create();
+	void *first[HANDOFF];
+	int i, j, reused = 0;
+
+	for (i = 0; i < HANDOFF; i++)
+		handoff.blocks[i] = first[i] = fmalloc_ngc(100);
+	handoff.hold = aphex_mutex_create();
+	handoff.freed = FE_FALSE;
+	aphex_mutex_lock(handoff.hold);
+	aphex_thread_start(thread, free_blocks, &handoff, FE_FALSE);
+	while (!__atomic_load_n(&handoff.freed, __ATOMIC_ACQUIRE))
+		usleep(1000);
+
+	for (i = 0; i < HANDOFF; i++) {
+		handoff.blocks[i] = fmalloc_ngc(100);
+		for (j = 0; j < HANDOFF; j++) {
+			if (handoff.blocks[i] == first[j]) {
+				reused++;
+				break;
+			}
+		}
+	}
+	ok(reused > HANDOFF / 2, "Memory freed on another thread is reused while that thread is still running (%d of %d)", reused, HANDOFF);
+
+	aphex_mutex_unlock(handoff.hold);
+	aphex_thread_join(thread);
+	aphex_thread_destroy(thread);
+	aphex_mutex_destroy(handoff.hold);
+	for (i = 0; i < HANDOFF; i++)
+		ffree_ngc(handoff.blocks[i]);
+}
+
+int main(int argc, char *argv[])
+{
+	ferite_init(argc, argv);
+
+	test_parallel_scripts();
+	test_after_threads();
+	test_cross_thread_free();
+
+	ferite_deinit();
+	return done_testing();
+}
@@ -0,0 +1,73 @@
+#include "tap.h"
+#include "ferite.h"
+
+char source[] =
+	"namespace Requests { number served = 0; array seen; }\n"
+	"class Counter { static number count = 100; }\n"
+	"global { number total; string name = \"start\"; }\n"
+	"Requests.served++;\n"
+	"Requests.seen[] = new Counter();\n"
+	"Counter.count += 10;\n"
+	"total += Requests.served;\n"
+	"name = \"changed\";\n"
+	"return Requests.served + Counter.count;\n";
+
+FeriteVariable *find(FeriteScript *script, char *name)
+{
+	return ferite_find_namespace_element_contents(script, script->mainns, name, FENS_VAR);
+}
+
+void test_reset(void)
+{
+	FeriteScript *script = ferite_compile_string(source);
+	FeriteClass *counter;
+	FeriteFormat *format;
+
+	ok(script != NULL && !ferite_has_compile_error(script), "A script with global, namespace and static variables compiles");
+	if (script == NULL || ferite_has_compile_error(script)) {
+		if (script != NULL)
+			diag("%s", ferite_get_error_log(script));
+		return;
+	}
+	counter = ferite_find_namespace_element_contents(script, script->mainns, "Counter", FENS_CLS);
+	ok(!ferite_script_reset(script), "A script cannot be reset without a snapshot");
+	ok(ferite_script_snapshot(script), "A snapshot is taken after compiling");
+
+	ferite_script_execute(script);
+	is(script->return_value, 111, "The first execution sees the initial values");
+	ferite_script_execute(script);
+	is(VAI(find(script, "Requests.served")), 2, "Without a reset the next one sees what it left behind in the namespace");
+	is(VAUA(find(script, "Requests.seen"))->size, 2, "... and in namespace arrays");
+	is(VAI(ferite_class_get_var(script, counter, "count")), 120, "... and in static class variables");
+
+	format = ferite_format_get(script, "%d items\n", 9);
+	ferite_format_release(script, format);
+	is(script->formats->count, 1, "The script has a compiled format in its cache");
+
+	ok(ferite_script_reset(script), "The script is reset");
+	is(VAI(find(script, "Requests.served")), 0, "Namespace variables are back to their snapshot values");
+	is(VAUA(find(script, "Requests.seen"))->size, 0, "... including arrays");
+	is(VAI(ferite_class_get_var(script, counter, "count")), 100, "Static class variables are too");
+	is(VAI(find(script, "total")), 0, "... and globals");
+	is_str(VAS(find(script, "name"))->data, "start", "... including strings");
+	is(script->formats->count, 0, "The format cache is emptied");
+	ok(script->vars->stack_ptr == 0 && script->objects->stack_ptr == 0, "... and so are the spare variables and objects");
+	is(script->return_value, 0, "The return value is cleared");
+
+	ferite_script_execute(script);
+	is(script->return_value, 111, "Executing again starts from the snapshot");
+	ok(ferite_script_reset(script) && find(script, "Requests.served") != NULL, "Resetting twice keeps the variables");
+	ferite_script_execute(script);
+	is(script->return_value, 111, "... and their values");
+	ferite_script_delete(script);
+}
+
+int main(int argc, char *argv[])
+{
+	ferite_init(argc, argv);
+
+	test_reset();
+
+	ferite_deinit();
+	return done_testing();
+}
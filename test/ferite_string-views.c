@@ -0,0 +1,140 @@
+#include "tap.h"
+#include "ferite.h"
+
+void test_view(void)
+{
+	FeriteString *str = ferite_str_new(NULL, "alpha,beta,gamma", 0, FE_CHARSET_DEFAULT);
+	FeriteString *view, *copy, *tail;
+
+	view = ferite_str_view(NULL, str, 6, 4);
+	ok(view->data == str->data + 6, "A view points into the original data");
+	is(view->length, 4, "... and has the length asked for");
+	ok(str->storage != NULL && str->storage == view->storage, "The original and the view share storage");
+	is(str->storage->refcount, 2, "... which both hold a reference to");
+
+	copy = ferite_str_dup(NULL, view);
+	ok(copy->data == view->data, "Duplicating a view shares the data too");
+
+	tail = ferite_str_view(NULL, view, 2, 2);
+	ok(tail->data == str->data + 8 && tail->storage == str->storage, "A view of a view shares the first string's storage");
+
+	is_str(ferite_str_cstr(NULL, tail), "ta", "A view is given its own copy when a C string is needed");
+	ok(tail->storage == NULL && tail->data != str->data + 8, "... so it no longer shares");
+	ferite_str_destroy(NULL, tail);
+
+	tail = ferite_str_view(NULL, str, 11, 5);
+	ok(ferite_str_cstr(NULL, tail) == str->data + 11, "A view up to the end of the data already is one");
+	ferite_str_destroy(NULL, tail);
+
+	ferite_str_data_cat(NULL, copy, "!", 1);
+	is_str(copy->data, "beta!", "Changing a view copies it first");
+	ok(copy->storage == NULL, "... after which it owns its data");
+	is_str(str->data, "alpha,beta,gamma", "... and the original is untouched");
+	ferite_str_destroy(NULL, copy);
+
+	ferite_str_destroy(NULL, str);
+	ok(view->data[0] == 'b' && view->storage->refcount == 1, "The data outlives the string it came from");
+	ferite_str_destroy(NULL, view);
+
+	str = ferite_str_new(NULL, "abc", 0, FE_CHARSET_DEFAULT);
+	view = ferite_str_view(NULL, str, 1, 0);
+	ok(view->length == 0 && view->storage == NULL, "An empty view does not hold on to anything");
+	ok(str->storage == NULL, "... nor does it make the original shared");
+	ferite_str_destroy(NULL, view);
+	ferite_str_destroy(NULL, str);
+}
+
+void test_split(void)
+{
+	FeriteString *str = ferite_str_new(NULL, "one, two, , three", 0, FE_CHARSET_DEFAULT);
+	FeriteString *delimiter = ferite_str_new(NULL, ", ", 0, FE_CHARSET_DEFAULT);
+	FeriteUnifiedArray *array = ferite_uarray_create(NULL);
+	FeriteVariable *piece;
+
+	is(ferite_str_split(NULL, array, str, delimiter, 0), 3, "Split counts the times the string was split");
+	is(array->size, 4, "... giving one more piece");
+	piece = array->array[3];
+	ok(VAS(piece)->data == str->data + 12, "The pieces are views of the string");
+	ok(memcmp(VAS(piece)->data, "three", 5) == 0 && VAS(piece)->length == 5, "... with the right contents");
+	is(VAS(array->array[2])->length, 0, "Empty pieces are kept");
+	is(str->storage->refcount, 4, "Each non-empty piece holds a reference");
+	ferite_uarray_destroy(NULL, array);
+	is(str->storage->refcount, 1, "... which is let go with the array");
+
+	array = ferite_uarray_create(NULL);
+	is(ferite_str_split(NULL, array, str, delimiter, 1), 1, "The number of splits can be limited");
+	is_str(ferite_str_cstr(NULL, VAS(array->array[1])), "two, , three", "... leaving the rest in the last piece");
+	ferite_uarray_destroy(NULL, array);
+
+	ferite_str_destroy(NULL, delimiter);
+	ferite_str_destroy(NULL, str);
+}
+
+static int native_saw_view = 0;
+
+FE_NATIVE_FUNCTION( test_native_peek )
+{
+	native_saw_view = (VAS(params[0])->storage != NULL);
+	FE_RETURN_VOID;
+}
+
+void test_native(void)
+{
+	char source[] = "string text = \"alpha,beta\";\n";
+	FeriteScript *script = ferite_compile_string(source);
+	FeriteFunction *function = ferite_register_ns_function(script, script->mainns, ferite_create_external_function(script, "peek", test_native_peek, "s"));
+	FeriteString *str = ferite_str_new(script, "alpha,beta", 0, FE_CHARSET_DEFAULT);
+	FeriteVariable **plist = ferite_create_parameter_list(script, 2);
+
+	plist[0] = ferite_create_string_variable_from_view(script, "view", str, 0, 5, FE_STATIC);
+	MARK_VARIABLE_AS_DISPOSABLE(plist[0]);
+	ferite_variable_destroy(script, ferite_call_function(script, script->mainns, NULL, function, plist));
+	ok(native_saw_view, "A view is passed to native code without being copied");
+	is_str(ferite_str_cstr(script, VAS(plist[0])), "alpha", "... which copies it when it needs a C string");
+	ferite_delete_parameter_list(script, plist);
+	ferite_str_destroy(script, str);
+	ferite_script_delete(script);
+}
+
+void test_script(void)
+{
+	char source[] =
+		"string text = \"\";\n"
+		"array h = [];\n"
+		"number total = 0, start = 0;\n"
+		"string field;\n"
+		"for( number i = 0; i < 1000; i++ )\n"
+		"    text += \"field,value,12\\n\";\n"
+		"for( number i = 0; i < 1000; i++ ) {\n"
+		"    start = i * 15 + 6;\n"
+		"    field = text[start..start + 4];\n"
+		"    h[field] = i;\n"
+		"    total += (field == \"value\" ? 1 : 0);\n"
+		"}\n"
+		"field += \"s\";\n"
+		"text = \"\";\n"
+		"return total + h[\"value\"] + (field == \"values\" ? 1 : 0);\n";
+	FeriteScript *script = ferite_compile_string(source);
+
+	ok(script != NULL && !ferite_has_compile_error(script), "A script slicing text compiles");
+	if (script != NULL && ferite_has_compile_error(script))
+		diag("%s", ferite_get_error_log(script));
+	if (script != NULL) {
+		ok(ferite_script_execute(script), "... and runs");
+		is(script->return_value, 1000 + 999 + 1, "... with the slices behaving as strings");
+		ferite_script_delete(script);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	ferite_init(argc, argv);
+
+	test_view();
+	test_split();
+	test_native();
+	test_script();
+
+	ferite_deinit();
+	return done_testing();
+}
@@ -0,0 +1,92 @@
+#include "tap.h"
+#include "ferite.h"
+#include <unistd.h>
+
+#define REQUESTS 10
+#define WORKERS 2
+#define PER_WORKER 3
+
+struct Served {
+	int pid;
+	int result;
+	int shared;
+};
+
+int jobs[2], results[2];
+FeriteWorkerPool *pool;
+
+/* Each byte in the jobs pipe is a request; once it is empty the workers retire */
+int take_job(FeriteWorkerPool *pool, void *data)
+{
+	char job;
+	return read(jobs[0], &job, 1) == 1;
+}
+
+void served(FeriteWorkerPool *pool, FeriteScript *script, void *data)
+{
+	struct Served s;
+
+	s.pid = getpid();
+	s.result = script->return_value;
+	s.shared = (script == pool->script);
+	write(results[1], &s, sizeof(s));
+}
+
+void test_pool(char *filename)
+{
+	struct Served s[REQUESTS + 1];
+	int count = 0, i, j, pids = 0, same = 0, shared = 0;
+	char job = 'x';
+
+	pool = ferite_worker_pool_create(filename, WORKERS, PER_WORKER);
+	ok(!ferite_has_compile_error(pool->script), "The master compiles the script");
+	pool->accept = take_job;
+	pool->finish = served;
+
+	pipe(jobs);
+	pipe(results);
+	for (i = 0; i < REQUESTS; i++)
+		write(jobs[1], &job, 1);
+	close(jobs[1]);
+
+	ok(ferite_worker_pool_run(pool), "The pool runs until the requests run out");
+	close(results[1]);
+	while (count <= REQUESTS && read(results[0], &s[count], sizeof(s[count])) == sizeof(s[count]))
+		count++;
+	close(results[0]);
+	close(jobs[0]);
+
+	is(count, REQUESTS, "Every request is served");
+	for (i = 0; i < count; i++) {
+		same += (s[i].result == 1);
+		shared += s[i].shared;
+		for (j = 0; j < i && s[j].pid != s[i].pid; j++)
+			;
+		pids += (j == i);
+	}
+	is(shared, REQUESTS, "... by the script the master compiled");
+	is(same, REQUESTS, "... which is reset between requests");
+	ok(pids >= (REQUESTS + PER_WORKER - 1) / PER_WORKER, "Workers are replaced after %d requests (%d used)", PER_WORKER, pids);
+	ferite_worker_pool_destroy(pool);
+}
+
+int main(int argc, char *argv[])
+{
+	char filename[] = "/tmp/ferite-worker-XXXXXX";
+	char source[] =
+		"namespace Requests { number served = 0; }\n"
+		"Requests.served++;\n"
+		"return Requests.served;\n";
+	int fd;
+
+	ferite_init(argc, argv);
+	fd = mkstemp(filename);
+	write(fd, source, strlen(source));
+	close(fd);
+
+	test_pool(filename);
+
+	unlink(filename);
+	ferite_deinit();
+	return done_testing();
+}
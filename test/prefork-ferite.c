@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2000-2004 Chris Ross and various contributors
+ * Copyright (C) 1999-2000 Chris Ross
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * o Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * o Neither the name of the ferite software nor the names of its contributors may
+ *   be used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ferite.h>
+#include "aphex.h"
+
+#ifdef HAVE_CONFIG_HEADER
+# include "config.h"
+#endif
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <signal.h>
+
+#ifndef MAP_ANONYMOUS
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define DRIVER "prefork-" FERITE_NAME
+
+/*
+ * prefork-ferite: compile a script once, fork a pool of workers and have them
+ * run it a number of times between them. It exists to exercise and measure the
+ * worker pool API; a real server would accept() a connection in the accept
+ * callback rather than take a ticket from a shared counter.
+ */
+
+struct
+{
+	char *scriptname;
+	int verbose;
+	int show_warnings;
+	int workers;
+	int max_requests;
+	int total;
+}
+opt;
+
+struct counters /* lives in memory shared with the workers */
+{
+	int tickets;
+	int failed;
+};
+
+FeriteWorkerPool *pool = NULL;
+
+void print_version()
+{
+	printf( "%s %s [built: %s %s] [%s]\n", DRIVER, VERSION, __DATE__, __TIME__, PLATFORM );
+	printf( "  Base Cross Platform Library Path: %s\n", XPLAT_LIBRARY_DIR );
+	printf( "  Base Native Library Path: %s\n", NATIVE_LIBRARY_DIR );
+}
+
+void print_usage()
+{
+	printf( "Usage: %s [options] [script] [-- script arguments]\n", DRIVER );
+}
+
+void show_help()
+{
+	print_version();
+	printf( "\n" );
+	print_usage();
+	printf( "\n" );
+	printf( " Long Version       Short	 Description\n" );
+	printf( "----------------------------------------------------------------\n" );
+	printf( " --help             -h        Show this help screen.\n" );
+	printf( " --verbose          -v        Be verbose when running.\n" );
+	printf( " --include path     -Ipath    Add 'path' to ferite's search path for scripts.\n" );
+	printf( " --native-inc path  -Npath    Add 'path' to ferite's search path for native modules.\n" );
+	printf( " --preload module   -Pmodule  Get ferite to preload 'module' at compile time.\n" );
+	printf( " --hide-warnings    -w        Hide warnings.\n" );
+	printf( " --workers N        -j N      Number of worker processes; default: 4.\n" );
+	printf( " --requests N       -r N      Requests a worker serves before it is replaced; default: 100.\n" );
+	printf( " --total N          -n N      Total number of times to run the script; default: 1000.\n" );
+	printf( " --version                    Print the version.\n" );
+	printf( "\n" );
+}
+
+int parse_args( int argc, char **argv )
+{
+	int i;
+
+	opt.verbose = FE_FALSE;
+	opt.show_warnings = FE_TRUE;
+	opt.scriptname = NULL;
+	opt.workers = 4;
+	opt.max_requests = 100;
+	opt.total = 1000;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(argv[i][0] == '-')
+		{
+			if( (!strcmp( argv[i], "--")) )
+			{
+				argc = i+1;
+				break;
+			}
+			if((!strcmp(argv[i], "--verbose")) || (!strcmp(argv[i], "-v")))
+				opt.verbose = FE_TRUE;
+			if((!strcmp(argv[i], "--help")) || (!strcmp(argv[i], "-h")))
+			{
+				show_help();
+				exit(0);
+			}
+			if( !strcmp(argv[i], "--version") )
+			{
+				print_version();
+				exit(0);
+			}
+			if( !strcmp(argv[i], "--include" ) )
+				ferite_add_library_search_path( argv[++i] );
+			if( !strncmp( argv[i], "-I", 2 ) )
+				ferite_add_library_search_path( argv[i]+2 );
+			if( !strcmp(argv[i], "--native-inc" ) )
+				ferite_set_library_native_path( argv[++i] );
+			if( !strncmp( argv[i], "-N", 2 ) )
+				ferite_set_library_native_path( argv[i]+2 );
+			if( !strcmp(argv[i], "--preload" ) )
+				ferite_module_add_preload( argv[++i] );
+			if( !strncmp( argv[i], "-P", 2 ) )
+				ferite_module_add_preload( argv[i]+2 );
+			if((!strcmp(argv[i], "--hide-warnings")) || (!strcmp(argv[i], "-w")))
+				opt.show_warnings = FE_FALSE;
+			if(((!strcmp(argv[i], "--workers")) || (!strcmp(argv[i], "-j"))) && argv[i + 1])
+				opt.workers = atol(argv[++i]);
+			if(((!strcmp(argv[i], "--requests")) || (!strcmp(argv[i], "-r"))) && argv[i + 1])
+				opt.max_requests = atol(argv[++i]);
+			if(((!strcmp(argv[i], "--total")) || (!strcmp(argv[i], "-n"))) && argv[i + 1])
+				opt.total = atol(argv[++i]);
+		}
+		else if( opt.scriptname == NULL )
+		{
+			opt.scriptname = aphex_relative_to_absolute( argv[i] );
+		}
+	}
+
+	if(!opt.scriptname)
+	{
+		print_version();
+		printf( "\n" );
+		print_usage();
+		printf( "\n\tYou need to supply a file name. For help try %s --help\n\n", DRIVER );
+		exit( -1 );
+	}
+	return argc;
+}
+
+void sig_stop( int sig )
+{
+	if( pool != NULL )
+		ferite_worker_pool_stop( pool );
+}
+
+static double get_time(void)
+{
+	struct timeval timev;
+	gettimeofday(&timev, NULL);
+	return (double) timev.tv_sec + (((double) timev.tv_usec) / 1000000);
+}
+
+/* Each run of the script takes a ticket; once they are gone the workers retire */
+int take_ticket( FeriteWorkerPool *pool, void *data )
+{
+	struct counters *counters = data;
+	return (__sync_fetch_and_add( &counters->tickets, 1 ) < opt.total ? FE_TRUE : FE_FALSE);
+}
+
+void report( FeriteWorkerPool *pool, FeriteScript *script, void *data )
+{
+	struct counters *counters = data;
+	char *errmsg = NULL;
+
+	if( ferite_has_compile_error( script ) || ferite_has_runtime_error( script ) )
+	{
+		__sync_fetch_and_add( &counters->failed, 1 );
+		errmsg = ferite_get_error_log( script );
+		fprintf( stderr, "[%s: %d]\n%s", DRIVER, (int)getpid(), errmsg );
+		ffree( errmsg );
+	}
+	else if( ferite_has_warnings( script ) && opt.show_warnings )
+	{
+		errmsg = ferite_get_warning_string( script );
+		fprintf( stderr, "[%s: %d]\n%s", DRIVER, (int)getpid(), errmsg );
+		ffree( errmsg );
+	}
+}
+
+int main( int argc, char **argv )
+{
+	int i = 0, retval = 0;
+	char *errmsg = NULL, *dir = NULL, *sep = NULL;
+	struct counters *counters = NULL;
+	double start = 0, compiled = 0, end = 0;
+
+	if( !ferite_init( argc, argv ) )
+	{
+		fprintf( stderr, "Unable to initialise the ferite engine!\n" );
+		return 4;
+	}
+
+	i = parse_args( argc, argv );
+	ferite_add_library_search_path( XPLAT_LIBRARY_DIR );
+	ferite_set_library_native_path( NATIVE_LIBRARY_DIR );
+	ferite_set_script_argv( argc - i, argv + i );
+
+	/* Add a library path for the directory the script lives in */
+	dir = strdup( opt.scriptname );
+	if( (sep = strrchr( dir, DIR_DELIM )) != NULL )
+		*sep = '\0';
+	ferite_add_library_search_path( dir );
+
+	counters = mmap( NULL, sizeof(struct counters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	if( counters == MAP_FAILED )
+	{
+		perror( "mmap" );
+		return 4;
+	}
+	counters->tickets = 0;
+	counters->failed = 0;
+
+	start = get_time();
+	pool = ferite_worker_pool_create( opt.scriptname, opt.workers, opt.max_requests );
+	compiled = get_time();
+	if( ferite_has_compile_error( pool->script ) )
+	{
+		errmsg = ferite_get_error_log( pool->script );
+		fprintf( stderr, "[ferite: compile]\n%s", errmsg );
+		ffree_ngc( errmsg );
+		retval = 1;
+	}
+	else
+	{
+		if( opt.verbose )
+			printf( "--> compiled '%s' in %f, starting %d workers\n", opt.scriptname, compiled - start, opt.workers );
+
+		pool->accept = take_ticket;
+		pool->finish = report;
+		pool->data = counters;
+
+		signal( SIGTERM, sig_stop );
+		signal( SIGINT, sig_stop );
+		ferite_worker_pool_run( pool );
+		signal( SIGTERM, SIG_DFL );
+		signal( SIGINT, SIG_DFL );
+
+		end = get_time();
+		i = (counters->tickets < opt.total ? counters->tickets : opt.total);
+		fprintf( stderr, "master compile time: %f\n", compiled - start );
+		fprintf( stderr, "%d runs (%d failed) by %d workers in %f: %f runs/second\n",
+				 i, counters->failed, opt.workers, end - compiled, (end > compiled ? i / (end - compiled) : 0) );
+		retval = (counters->failed ? 2 : 0);
+	}
+
+	ferite_worker_pool_destroy( pool );
+	munmap( (void*)counters, sizeof(struct counters) );
+	free( dir );
+	ferite_deinit();
+	aphex_free( opt.scriptname );
+	return retval;
+}